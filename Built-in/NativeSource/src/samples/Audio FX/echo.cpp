@@ -13,7 +13,7 @@ DSP_EXPORT uint    audioInputsCount=0;
 *   Produces an echo with a feedback loop and adjustable delay inertia.
 */
 
-#include "../library/utils.h"
+#include "../library/Utils.h"
 
 /*  Effect Description
 *
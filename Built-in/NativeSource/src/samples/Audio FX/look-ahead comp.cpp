@@ -0,0 +1,121 @@
+// C++ scripting support-----------------------------
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+DSP_EXPORT double  sampleRate=0;
+DSP_EXPORT uint    audioInputsCount=0;
+
+// extra system headers
+#include <math.h>
+
+/** \file
+*   Look-ahead compressor/limiter.
+*   Multichannel compressor with a soft knee, peak or RMS detection, linked channels and a look-ahead
+*   delay, so that peaks can be caught before they are heard. The maximum ratio is a limiter.
+*/
+
+/* include our dsp classes.
+*
+*/
+#include "../library/Dynamics.h"
+
+DSP_EXPORT string name="Look-Ahead Comp";
+DSP_EXPORT string author="Blue Cat Audio";
+DSP_EXPORT string description="look-ahead compressor/limiter";
+
+/* Define our parameters.
+*/
+DSP_EXPORT array<string> inputParametersNames={"Threshold","Ratio","Knee","Attack","Release","Look-Ahead","Make Up","Detection","Link"};
+DSP_EXPORT array<string> inputParametersUnits={"dB",":1","dB","ms","ms","ms","dB","","%"};
+DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
+DSP_EXPORT array<double> inputParametersMin={-60,1,0,0,10,0,0,0,0};
+DSP_EXPORT array<double> inputParametersMax={0,20,24,100,1000,10,30,1,100};
+DSP_EXPORT array<double> inputParametersDefault={-12,4,6,5,150,2,0,0,100};
+DSP_EXPORT array<int>    inputParametersSteps={-1,-1,-1,-1,-1,-1,-1,2,-1};
+DSP_EXPORT array<string> inputParametersEnums={"","","","","","","","Peak;RMS",""};
+
+DSP_EXPORT array<string> outputParametersNames={"GR"};
+DSP_EXPORT array<string> outputParametersUnits={"dB"};
+DSP_EXPORT array<double> outputParameters(outputParametersNames.length);
+DSP_EXPORT array<double> outputParametersMin={-40};
+DSP_EXPORT array<double> outputParametersMax={0};
+
+enum EParams
+{
+    kThresholdParam=0,
+    kRatioParam,
+    kKneeParam,
+    kAttackParam,
+    kReleaseParam,
+    kLookAheadParam,
+    kMakeUpParam,
+    kDetectionParam,
+    kLinkParam
+};
+
+// constants
+const double kMaxLookAheadMs=10;
+const double kRmsWindowMs=10;
+
+// internal variables
+KittyDSP::Dynamics::Compressor compressor;
+
+/* smoothing coefficient for a time constant in ms (1 for 0: immediate).
+*
+*/
+double getCoefficient(double timeMs)
+{
+    if(timeMs<=0)
+        return 1;
+    return 1-exp(-1000/(timeMs*sampleRate));
+}
+
+DSP_EXPORT bool initialize()
+{
+    compressor.setup(audioInputsCount,uint(ceil(kMaxLookAheadMs*.001*sampleRate)),uint(ceil(kRmsWindowMs*.001*sampleRate)));
+    compressor.setRmsLength(uint(kRmsWindowMs*.001*sampleRate+.5));
+    return true;
+}
+
+DSP_EXPORT void reset()
+{
+    compressor.reset();
+}
+
+/* latency of the look-ahead delay.
+*
+*/
+DSP_EXPORT int getLatency()
+{
+    return compressor.get_latency();
+}
+
+/* per-block processing function: called for every block with updated parameters values.
+*
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    compressor.processBlock(data.samples,data.samplesToProcess);
+}
+
+/* update internal parameters from inputParameters array.
+*   called every buffer before process method
+*/
+DSP_EXPORT void updateInputParameters()
+{
+    // the maximum ratio is a limiter (infinite ratio)
+    double ratio=inputParameters[kRatioParam];
+    if(ratio>=inputParametersMax[kRatioParam])
+        ratio=0;
+    compressor.setCurve(inputParameters[kThresholdParam],ratio,inputParameters[kKneeParam]);
+    compressor.setTimes(getCoefficient(inputParameters[kAttackParam]),getCoefficient(inputParameters[kReleaseParam]));
+    compressor.setMakeUp(inputParameters[kMakeUpParam]);
+    compressor.setDetection(KittyDSP::Dynamics::Detection(int(inputParameters[kDetectionParam]+.5)));
+    compressor.setLink(.01*inputParameters[kLinkParam]);
+    compressor.setLookAhead(uint(inputParameters[kLookAheadParam]*.001*sampleRate+.5));
+}
+
+DSP_EXPORT void computeOutputData()
+{
+    outputParameters[0]=compressor.readGainReduction();
+}
@@ -12,6 +12,9 @@ DSP_EXPORT uint    audioInputsCount=0;
 *   Mini guitar amp simulator with distortion.
 *   Produces hard-clipping (transistor-like) distortion that can be attenuated with
 *   a low pass filter, that simulates the cabinet.
+*   The clipping stage runs at a higher sample rate (oversampling), to reduce aliasing. The
+*   oversampling filters are minimum phase by default (6 samples of latency at 4x): linear phase
+*   filters keep the phase of the signal, at the cost of a longer latency (37 samples at 4x).
 */
 
 /* include our dsp classes.
@@ -19,6 +22,7 @@ DSP_EXPORT uint    audioInputsCount=0;
 */
 #include "../library/BiquadFilter.h"
 #include "../library/Constants.h"
+#include "../library/Oversampler.h"
 
 /* Script metadata.
 */
@@ -28,52 +32,136 @@ DSP_EXPORT string description="mini guitar amp";
 
 /* Define our parameters.
 */
-DSP_EXPORT array<string> inputParametersNames={"Gain","Filter","Post Gain"};
+DSP_EXPORT array<string> inputParametersNames={"Gain","Filter","Post Gain","Oversampling","Filters"};
 DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
-DSP_EXPORT array<double> inputParametersDefault={.4,.2,.5};
+DSP_EXPORT array<double> inputParametersDefault={.4,.2,.5,2,1};
+DSP_EXPORT array<double> inputParametersMin={0,0,0,0,0};
+DSP_EXPORT array<double> inputParametersMax={1,1,1,3,1};
+DSP_EXPORT array<int>    inputParametersSteps={-1,-1,-1,4,2};
+DSP_EXPORT array<string> inputParametersEnums={"","","","1x;2x;4x;8x","Linear Phase;Minimum Phase"};
+
+enum EParams
+{
+    kGainParam=0,
+    kFilterParam,
+    kPostGainParam,
+    kOversamplingParam,
+    kFiltersParam
+};
 
 /* Define our internal variables.
 *
 */
 KittyDSP::Biquad::Filter filter;
+KittyDSP::Oversampling::Oversampler oversampler;
 double freqRange=0;
 double gain=0;
 double postGain=1;
 
+/* clipping kernel, run on oversampled chunks.
+*   The gain moves exponentially from its value at the beginning of the block to its value at the end.
+*/
+struct ClipKernel
+{
+    double  gain=0;
+    double  gainRatio=1; ///< per oversampled sample
+    double  postGain=1;
+
+    void operator()(double* samples,uint count)
+    {
+        for(uint i=0;i<count;i++)
+        {
+            // apply gain
+            double sample=samples[i]*gain;
+            gain*=gainRatio;
+
+            // simple hard clipping
+            if(sample>1)
+                sample=1;
+            else if(sample<-1)
+                sample=-1;
+
+            // reduce gain (post filtering may introduce clipping otherwise)
+            samples[i]=sample*postGain;
+        }
+    }
+};
 
 DSP_EXPORT bool initialize()
 {
     freqRange=2*PI*1000/sampleRate;
     filter.setChannelsCount(audioInputsCount);
+    oversampler.setChannelsCount(audioInputsCount);
     return true;
 }
 
-/* per-sample processing function: called for every sample with updated parameters values.
+DSP_EXPORT void reset()
+{
+    filter.resetState();
+    oversampler.reset();
+}
+
+/* latency of the oversampling filters.
 *
 */
-DSP_EXPORT void processSample(double ioSample[])
-{  
-    for(uint channel=0;channel<audioInputsCount;channel++)
-    {
-        // apply gain 
-        double sample=ioSample[channel];
-        sample*=gain;
+DSP_EXPORT int getLatency()
+{
+    return oversampler.get_latency();
+}
 
-        // simple hard clipping
-        if(sample>1)
-            sample=1;
-        else if(sample<-1)
-            sample=-1;
+/* compute gains and filter coefficients from parameters values.
+*
+*/
+double getGain(const double* values)
+{
+    // input gain (1 to 100)
+    return pow(10,values[kGainParam]*10);
+}
 
-        // reduce gain (post filtering may introduce clipping otherwise)
-        sample*=postGain;
+void setFilter(const double* values)
+{
+    // set lowpass filter frequency
+    double freq=freqRange*pow(10,1.3*(1-values[kFilterParam]));
+    if(freq>1)
+        freq=1;
+    filter.setLowPass(freq);
+}
 
-        // low pass filter
-        filter.processSample(sample,channel);
+/* per-block processing function: called for every block with updated parameters values.
+*   The clipping stage is oversampled, then the (smoothed) low pass filter is applied at the base rate.
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    const uint factor=oversampler.get_factor();
+    const bool ramping=(data.beginParamValues!=null && data.endParamValues!=null);
+    double endGain=gain;
+    if(ramping)
+    {
+        gain=getGain(data.beginParamValues);
+        endGain=getGain(data.endParamValues);
+        if(data.beginParamValues[kFilterParam]!=data.endParamValues[kFilterParam])
+        {
+            setFilter(data.beginParamValues);
+            filter.beginTransition();
+            setFilter(data.endParamValues);
+        }
+    }
+    double gainRatio=1;
+    if(endGain!=gain && data.samplesToProcess>0)
+        gainRatio=pow(endGain/gain,1.0/double(data.samplesToProcess*factor));
 
-        // copy back
-        ioSample[channel]=sample;
+    for(uint channel=0;channel<audioInputsCount;channel++)
+    {
+        ClipKernel kernel;
+        kernel.gain=gain;
+        kernel.gainRatio=gainRatio;
+        kernel.postGain=postGain;
+        oversampler.process(data.samples[channel],data.samplesToProcess,channel,kernel);
     }
+    gain=endGain;
+
+    // low pass filter
+    filter.processBlockSmoothed(data.samples,audioInputsCount,data.samplesToProcess);
 }
 
 /* update internal parameters from inputParameters array.
@@ -81,14 +169,13 @@ DSP_EXPORT void processSample(double ioSample[])
 */
 DSP_EXPORT void updateInputParameters()
 {
-    // input gain (1 to 100)
-    gain=pow(10,inputParameters[0]*10);
+    gain=getGain(inputParameters.ptr);
+    setFilter(inputParameters.ptr);
 
-    // set lowpass filter frequency
-    double freq=freqRange*pow(10,1.3*(1-inputParameters[1]));
-    if(freq>1)
-        freq=1;
-    filter.setLowPass(freq);
     // post gain: from .1 to 1
-    postGain=pow(10,-1+inputParameters[2]);
+    postGain=pow(10,-1+inputParameters[kPostGainParam]);
+
+    // oversampling factor (1x to 8x) and filters
+    oversampler.setFactor(1<<int(inputParameters[kOversamplingParam]+.5));
+    oversampler.setMode(KittyDSP::Oversampling::Mode(int(inputParameters[kFiltersParam]+.5)));
 }
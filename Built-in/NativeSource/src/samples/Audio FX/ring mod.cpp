@@ -14,6 +14,7 @@ DSP_EXPORT uint    audioInputsCount=0;
 */
 
 #include "../library/Constants.h"
+#include "../library/FastMath.h"
 
 DSP_EXPORT string name="Ring Mod";
 DSP_EXPORT string author="Blue Cat Audio";
@@ -41,7 +42,7 @@ DSP_EXPORT void reset()
 DSP_EXPORT void processSample(double ioSample[])
 {
     // compute value once
-    double coeff=sin(omega*index);
+    double coeff=KittyDSP::FastMath::sinApprox<KittyDSP::FastMath::kMediumAccuracy>(omega*index);
     index++;
     index%=period;
     coeff=(1+(coeff-1)*inputParameters[1]); // dry/wet
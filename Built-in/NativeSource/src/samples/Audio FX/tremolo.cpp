@@ -14,6 +14,7 @@ DSP_EXPORT uint    audioInputsCount=0;
 */
 
 #include "../library/Constants.h"
+#include "../library/FastMath.h"
 
 DSP_EXPORT string name="Tremolo";
 DSP_EXPORT string description="tremolo effect";
@@ -50,7 +51,7 @@ DSP_EXPORT bool initialize()
 DSP_EXPORT void processSample(double ioSample[])
 {
     // compute amplitude value once
-    coeff=.5*(1+sin(currentPhase));
+    coeff=.5*(1+KittyDSP::FastMath::sinApprox<KittyDSP::FastMath::kLowAccuracy>(currentPhase));
     coeff=(1+(coeff-1)*mix); // apply dry-wet
 
     // multiply all channels
@@ -0,0 +1,74 @@
+// C++ scripting support-----------------------------
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+DSP_EXPORT double  sampleRate=0;
+DSP_EXPORT uint    audioInputsCount=0;
+
+// extra system headers
+#include <math.h>
+
+/** \file
+*   Higher order low pass or high pass filter (Butterworth, Linkwitz-Riley or Chebyshev).
+*/
+DSP_EXPORT string name="Cascade Filter";
+DSP_EXPORT string author="Blue Cat Audio";
+DSP_EXPORT string description="Low/high pass filter up to 16th order";
+
+/* include your dsp files.
+*
+*/
+#include "../library/FilterCascade.h"
+#include "../library/Constants.h"
+
+/* Define our parameters.
+*   cutoff frequency, filter type, mode and order (2 to 16, by steps of 2)
+*/
+DSP_EXPORT array<string> inputParametersNames={"Frequency","Type","Mode","Order"};
+DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
+DSP_EXPORT array<double> inputParametersDefault={.5,0,0,4};
+DSP_EXPORT array<double> inputParametersMin={0,0,0,2};
+DSP_EXPORT array<double> inputParametersMax={1,2,1,16};
+DSP_EXPORT array<int>    inputParametersSteps={-1,3,2,8};
+DSP_EXPORT array<string> inputParametersEnums={"","Butterworth;Linkwitz-Riley;Chebyshev","Low Pass;High Pass",""};
+DSP_EXPORT array<string> inputParametersFormats={"","","",".0"};
+
+/* Define our internal variables.
+*
+*/
+KittyDSP::Biquad::FilterCascade filter;
+double freqFactor=0;
+
+DSP_EXPORT bool initialize()
+{
+    freqFactor=2*PI*20/sampleRate;
+    filter.setChannelsCount(audioInputsCount);
+    return true;
+}
+
+DSP_EXPORT void reset()
+{
+    filter.resetState();
+}
+
+/* per-block processing function: called for every block with updated parameters values.
+*   All channels go through all the sections at once (see KittyDSP::Biquad::FilterCascade::processBlock).
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    filter.processBlock(data.samples,audioInputsCount,data.samplesToProcess);
+}
+
+/* update internal parameters from inputParameters array.
+*   called every sample before processSample method or every buffer before process method
+*/
+DSP_EXPORT void updateInputParameters()
+{
+    KittyDSP::Biquad::FilterCascadeType type=KittyDSP::Biquad::FilterCascadeType(int(inputParameters[1]+.5));
+    int order=2*int(inputParameters[3]*.5+.5);
+    double theta=freqFactor*pow(1000,inputParameters[0]);
+    if(inputParameters[2]<.5)
+        filter.setLowPass(type,order,theta);
+    else
+        filter.setHighPass(type,order,theta);
+}
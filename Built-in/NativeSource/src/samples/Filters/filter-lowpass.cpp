@@ -41,12 +41,23 @@ DSP_EXPORT bool initialize()
     return true;
 }
 
-/* per-sample processing function: called for every sample with updated parameters values.
+/* compute filter coefficients from parameters values.
 *
 */
-DSP_EXPORT void processSample(double ioSample[])
+void setFilter(KittyDSP::Biquad::Filter& filter,const double* values)
 {
-    filter.processSample(ioSample);
+    // -3dB boost (flat LP) to 20 dB boost 
+    double q=pow(10,(-3+values[1]*23)/20);
+    filter.setResonantLowPass(freqFactor*pow(1000,values[0]),q);
+}
+
+/* per-block processing function: called for every block with updated parameters values.
+*   When parameters are automated, the filter moves smoothly from the values at the beginning
+*   of the block to the values at the end (see KittyDSP::Biquad::Filter::processBlockAutomated).
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    filter.processBlockAutomated(data,audioInputsCount,inputParameters.length,setFilter);
 }
 
 /* update internal parameters from inputParameters array.
@@ -54,7 +65,5 @@ DSP_EXPORT void processSample(double ioSample[])
 */
 DSP_EXPORT void updateInputParameters()
 {
-    // -3dB boost (flat LP) to 20 dB boost 
-    double q=pow(10,(-3+inputParameters[1]*23)/20);
-    filter.setResonantLowPass(freqFactor*pow(1000,inputParameters[0]),q);
+    setFilter(filter,inputParameters.ptr);
 }
@@ -43,12 +43,21 @@ DSP_EXPORT bool initialize()
     return true;
 }
 
-/* per-sample processing function: called for every sample with updated parameters values.
+/* compute filter coefficients from parameters values.
 *
 */
-DSP_EXPORT void processSample(double ioSample[])
+void setFilter(KittyDSP::Biquad::Filter& filter,const double* values)
 {
-    filter.processSample(ioSample);
+    filter.setPeak(freqFactor*pow(1000,values[0]),minBw+values[1]*bwRange,pow(10,-.5+values[2]));
+}
+
+/* per-block processing function: called for every block with updated parameters values.
+*   When parameters are automated, the filter moves smoothly from the values at the beginning
+*   of the block to the values at the end (see KittyDSP::Biquad::Filter::processBlockAutomated).
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    filter.processBlockAutomated(data,audioInputsCount,inputParameters.length,setFilter);
 }
 
 /* update internal parameters from inputParameters array.
@@ -56,5 +65,5 @@ DSP_EXPORT void processSample(double ioSample[])
 */
 DSP_EXPORT void updateInputParameters()
 {
-    filter.setPeak(freqFactor*pow(1000,inputParameters[0]),minBw+inputParameters[1]*bwRange,pow(10,-.5+inputParameters[2]));
+    setFilter(filter,inputParameters.ptr);
 }
@@ -15,6 +15,8 @@ DSP_EXPORT uint    audioOutputsCount=0;
 
 #include "../library/Midi.h"
 #include "../library/Constants.h"
+#include "../library/VoiceEngine.h"
+#include "../library/MidiBlockSplitter.h"
 
 
 // dsp script interface--------------------------
@@ -22,187 +24,50 @@ DSP_EXPORT string name="ADSR Polyphonic Synth";
 DSP_EXPORT string author="Blue Cat Audio";
 DSP_EXPORT string description="Simple sine wave polyphonic synth";
 
-DSP_EXPORT array<string> inputParametersNames={"Attack","Decay","Sustain","Release","Gain"};
+DSP_EXPORT array<string> inputParametersNames={"Attack","Decay","Sustain","Release","Gain","Voice Stealing","Threads"};
 DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
-DSP_EXPORT array<double> inputParametersDefault={0.01,0.5,0.5,.5,.5};
+DSP_EXPORT array<double> inputParametersDefault={0.01,0.5,0.5,.5,.5,1,0};
+DSP_EXPORT array<double> inputParametersMin={0,0,0,0,0,0,0};
+DSP_EXPORT array<double> inputParametersMax={1,1,1,1,1,3,3};
+DSP_EXPORT array<int>    inputParametersSteps={-1,-1,-1,-1,-1,4,4};
+DSP_EXPORT array<string> inputParametersEnums={"","","","","","Off;Oldest;Quietest;Same Note","Off;2;3;4"};
 
 
 // internal processing properties and functions---------------------
-double currentPitchOffset=0;
-const double period=2*PI;
-
-double attackCoeff=0;
-double decayCoeff=0;
-double releaseCoeff=0;
-double sustainValue=0;
 double gain=0;
-bool pedalIsDown=false;
-uint activeVoicesCount=0;
 
-struct SynthVoice;
-array<SynthVoice> voices(24);
+/* the voices (state stored as structure of arrays, rendered by blocks).
+*   Up to 512 voices: enough for long pads with sustain pedal and large layered patches. When all
+*   voices are busy, a voice is stolen according to the "Voice Stealing" parameter.
+*   When the "Threads" parameter is on, groups of voices are rendered in parallel by worker threads when
+*   there are enough voices playing (up to one worker per extra core). Voices are rendered by the audio
+*   thread only by default.
+*/
+KittyDSP::Voices::VoiceEngine voices(512);
+KittyDSP::Threads::WorkerPool workers;
+uint maxWorkers=0;
 
-enum ADSRState
+DSP_EXPORT bool initialize()
 {
-    kAttackPhase,
-    kDecayPhase,
-    kSustainPhase,
-    kReleasePhase
-};
+    voices.setSampleRate(sampleRate);
+    voices.setWorkerPool(&workers);
+    // all the workers are started now (and parked): the "Threads" parameter only chooses how many are used
+    maxWorkers=KittyDSP::Threads::WorkerPool::getDefaultWorkersCount();
+    workers.start(maxWorkers,KittyDSP::Threads::WorkerPool::kRealTimePriority|KittyDSP::Threads::WorkerPool::kPinnedToCores);
+    workers.setActiveWorkersCount(0);
+    return true;
+}
 
-/** Class that manages a single voice for the synth.
- *
- */
-struct SynthVoice
+DSP_EXPORT void shutdown()
 {
-    ADSRState state=kAttackPhase;
-    
-    double amplitude=0;
-    double omega=0;
-    
-    double currentAmplitude=0;
-    double currentPhase=0;
-    
-    int    currentNote=-1;
-    bool   waitingForPedalRelease;
-    
-    // handle note on operation
-    void NoteOn(const MidiEvent& evt)
-    {
-        amplitude=double(MidiEventUtils::getNoteVelocity(evt))/127.0;
-        currentNote=MidiEventUtils::getNote(evt);
-        omega=2*PI*pow(2,((double(currentNote-69.0)+currentPitchOffset)/12.0))*440.0/sampleRate;
-        state=kAttackPhase;
-    }
-    
-    void NoteOff()
-    {
-        if(!pedalIsDown)
-        {
-            // set state to release phase
-            state=kReleasePhase;
-        }
-        else
-        {
-            // remember that note off has been called - will actually release the note later, when the pedal is released
-            waitingForPedalRelease=true;
-        }
-    }
-    
-    void ForcePitch()
-    {
-        omega=2*PI*pow(2,((double(currentNote-69.0)+currentPitchOffset)/12.0))*440.0/sampleRate;
-    }
-    
-    void PedalReleased()
-    {
-        if(waitingForPedalRelease)
-        {
-            NoteOff();
-            waitingForPedalRelease=false;
-        }
-    }
-    
-    // returns true if voice ended
-    double ProcessSample()
-    {
-        double sampleValue=0;
-        
-        // update amplitude base on current ADSR state
-        switch(state)
-        {
-            case kAttackPhase:
-            {
-                currentAmplitude+=attackCoeff*(1.001-currentAmplitude);
-                if(currentAmplitude>=1)
-                {
-                    currentAmplitude=1;
-                    state=kDecayPhase;
-                }
-                break;
-            }
-            case kDecayPhase:
-            {
-                currentAmplitude+=decayCoeff*(sustainValue-currentAmplitude);
-                if(currentAmplitude<(sustainValue+0.0001))
-                {
-                    currentAmplitude=sustainValue;
-                    state=kSustainPhase;
-                }
-                break;
-            }
-            case kReleasePhase:
-            {
-                currentAmplitude+=releaseCoeff*(0-currentAmplitude);
-                if(currentAmplitude<.0001)
-                {
-                    // value below threshold => the voice ended
-                    
-                    // if not the last voice in the list
-                    if(!(*this==voices[activeVoicesCount-1]))
-                    {
-                        // swap with last voice in the list
-                        *this=voices[activeVoicesCount-1];
-                        voices[activeVoicesCount-1].CancelNote();
-                        
-                        // decrease voices count
-                        activeVoicesCount--;
-                        
-                        // process swaped voice instead of this one
-                        return ProcessSample();
-                    }
-                    else
-                    {
-                        // cancel current note
-                        CancelNote();
-                        
-                        // decrease voices count
-                        activeVoicesCount--;
-                        return 0;
-                    }
-                }
-                break;
-            }
-            case kSustainPhase:
-            {
-                // sustain: nothing to do
-                break;
-            }
-        }
-        
-        // compute sample value
-        sampleValue=amplitude*currentAmplitude*sin(currentPhase);
-        
-        // update phase
-        currentPhase+=omega;
-        return sampleValue;
-    }
-    
-    void CancelNote()
-    {
-        currentNote=-1;
-        currentPhase=0;
-        currentAmplitude=0;
-        omega=0;
-        waitingForPedalRelease=false;
-        state=kAttackPhase;
-    }
-    
-    void ReducePhase()
-    {
-        // warning: this can cause an almost infinite loop is currentPhase not properly updated
-        while(currentPhase>period)
-            currentPhase-=period;
-    }
-    
-    // == operator for find operations
-    bool operator==(const SynthVoice& voice)const
-    {
-        return currentNote==voice.currentNote;
-    }
-};
+    voices.setWorkerPool(null);
+    workers.stop();
+}
 
-SynthVoice tempVoice;
+DSP_EXPORT void reset()
+{
+    voices.reset();
+}
 
 void handleMidiEvent(const MidiEvent& evt)
 {
@@ -210,64 +75,26 @@ void handleMidiEvent(const MidiEvent& evt)
     {
         case kMidiNoteOn:
         {
-            // find voice for the note on event (in case it is already here)
-            // or use the first empty slot (note=-1)
-            tempVoice.currentNote=MidiEventUtils::getNote(evt);
-            int index=voices.find(tempVoice);
-            if(index<0)
-            {
-                if(activeVoicesCount<voices.length)
-                {
-                    index=activeVoicesCount;
-                    activeVoicesCount++;
-                }
-            }
-            if(index>=0)
-            {
-                voices[index].NoteOn(evt);
-            }
+            voices.noteOn(MidiEventUtils::getNote(evt),double(MidiEventUtils::getNoteVelocity(evt))/127.0,MidiEventUtils::getChannel(evt)-1);
             break;
         }
         case kMidiNoteOff:
         {
-            // find voice for the note off event
-            tempVoice.currentNote=MidiEventUtils::getNote(evt);
-            int index=voices.find(tempVoice);
-            if(index>=0)
-            {
-                voices[index].NoteOff();
-            }
+            voices.noteOff(MidiEventUtils::getNote(evt),MidiEventUtils::getChannel(evt)-1);
             break;
         }
         case kMidiPitchWheel:
         {
             // update pitch for all voices
-            currentPitchOffset=2*double(MidiEventUtils::getPitchWheelValue(evt))/8192.0;
-            for(uint i=0;i<activeVoicesCount;i++)
-            {
-                voices[i].ForcePitch();
-            }
+            voices.setPitchOffset(2*double(MidiEventUtils::getPitchWheelValue(evt))/8192.0);
             break;
         }
         case kMidiControlChange:
         {
             // sustain pedal changed event
             if(MidiEventUtils::getCCNumber(evt)==64)
-            {
-                // if pedal is down
-                bool down=(MidiEventUtils::getCCValue(evt)>=64);
-                if(down!=pedalIsDown)
-                {
-                    pedalIsDown=down;
-                    if(pedalIsDown==false)
-                    {
-                        for(uint i=0;i<activeVoicesCount;i++)
-                        {
-                            voices[i].PedalReleased();
-                        }
-                    }
-                }
-            }
+                voices.setPedal(MidiEventUtils::getCCValue(evt)>=64);
+            break;
         }
         default:
             break;
@@ -284,48 +111,47 @@ DSP_EXPORT void processBlock(BlockData& data)
     if(gainDiff!=0)
         gainRatio=pow(10,gainDiff/double(data.samplesToProcess)*2);
 
-    uint nextEventIndex=0;
-    for(uint i=0;i<data.samplesToProcess;i++)
+    if(audioOutputsCount==0)
+        return;
+
+    // render all voices (mono mix) to the first channel, between MIDI events
+    double* mix=data.samples[0];
+    KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents,data.samplesToProcess);
+    while(span.next())
     {
         // manage MIDI events
-        while(nextEventIndex!=data.inputMidiEvents.length && data.inputMidiEvents[nextEventIndex].timeStamp<=double(i))
-        {
-            handleMidiEvent(data.inputMidiEvents[nextEventIndex]);
-            nextEventIndex++;
-        }
-
-        // compute sample value
-        double sampleValue=0;
-        for(uint v=0;v<activeVoicesCount;v++)
-        {
-            sampleValue+=voices[v].ProcessSample();
-        }
-        sampleValue*=gain;
-
-        // copy value to all outputs
-        for(uint ch=0;ch<audioOutputsCount;ch++)
-        {
-            data.samples[ch][i]=sampleValue;
-        }
+        for(uint e=0;e<span.get_eventsCount();e++)
+            handleMidiEvent(span.getEvent(e));
+        voices.render(mix+span.get_start(),span.get_length());
+    }
 
-        // update the gain
+    // apply gain and copy value to all outputs
+    for(uint i=0;i<data.samplesToProcess;i++)
+    {
+        mix[i]*=gain;
         gain*=gainRatio;
     }
-
-    // to avoid overflow, reduce phase for all active voices
-    for(uint i=0;i<activeVoicesCount;i++)
+    for(uint ch=1;ch<audioOutputsCount;ch++)
     {
-        voices[i].ReducePhase();
+        double* samples=data.samples[ch];
+        for(uint i=0;i<data.samplesToProcess;i++)
+            samples[i]=mix[i];
     }
 }
 
 DSP_EXPORT void updateInputParametersForBlock()
 {
-    attackCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[0]))-1;
-    decayCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[1]))-1;
-    sustainValue=inputParameters[2];
-    releaseCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[3]))-1;
+    double attackCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[0]))-1;
+    double decayCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[1]))-1;
+    double releaseCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[3]))-1;
+    voices.setEnvelope(attackCoeff,decayCoeff,inputParameters[2],releaseCoeff);
     gain=pow(10,-1+inputParameters[4]*2);
+    voices.setStealingMode(KittyDSP::Voices::StealingMode(int(inputParameters[5]+.5)));
+    // number of workers used (serial rendering when off, no thread started or stopped here)
+    uint workersCount=uint(inputParameters[6]+.5);
+    if(workersCount>maxWorkers)
+        workersCount=maxWorkers;
+    workers.setActiveWorkersCount(workersCount);
 }
 
 DSP_EXPORT int getTailSize()
@@ -0,0 +1,232 @@
+// C++ scripting support-----------------------------
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+DSP_EXPORT double  sampleRate=0;
+DSP_EXPORT uint    audioOutputsCount=0;
+
+// extra system headers
+#include <math.h>
+
+/** \file
+*   Analog style polyphonic synth.
+*   Polyphonic synthesizer with band-limited saw, square, triangle, pulse and hard sync oscillators
+*   and a simple attack/release envelope.
+*/
+
+#include "../library/Midi.h"
+#include "../library/Constants.h"
+#include "../library/VoiceAllocator.h"
+#include "../library/AnalogOscillators.h"
+#include "../library/MidiBlockSplitter.h"
+
+
+// dsp script interface--------------------------
+DSP_EXPORT string name="Analog Polyphonic Synth";
+DSP_EXPORT string author="Blue Cat Audio";
+DSP_EXPORT string description="Band-limited analog waveforms polyphonic synth";
+
+DSP_EXPORT array<string> inputParametersNames={"Shape","Pulse Width","Sync Ratio","Attack","Release","Gain"};
+DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
+DSP_EXPORT array<double> inputParametersDefault={0,.5,2,0.01,.2,.5};
+DSP_EXPORT array<double> inputParametersMin={0,.05,1,0,0,0};
+DSP_EXPORT array<double> inputParametersMax={4,.95,8,1,1,1};
+DSP_EXPORT array<int>    inputParametersSteps={5,-1,-1,-1,-1,-1};
+DSP_EXPORT array<string> inputParametersEnums={"Saw;Square;Triangle;Pulse;Sync","","","","",""};
+
+enum EParams
+{
+    kShapeParam=0,
+    kPulseWidthParam,
+    kSyncRatioParam,
+    kAttackParam,
+    kReleaseParam,
+    kGainParam
+};
+
+// internal processing properties and functions---------------------
+const uint kMaxVoices=64;
+const uint kControlSamples=32; ///< envelopes are computed every kControlSamples samples (oscillator levels are ramped in between)
+
+double gain=0;
+double attackCoeff=0; ///< per sample decay of the distance to the target level
+double releaseCoeff=0;
+double pitchOffset=0;
+
+/* the voices: one oscillator per voice, all rendered together by the oscillator bank
+*   (8 oscillators in parallel). When all voices are busy, the oldest one is stolen.
+*/
+KittyDSP::Oscillators::OscillatorBank oscillators(kMaxVoices);
+KittyDSP::Voices::VoiceAllocator allocator(kMaxVoices);
+int     voiceNotes[kMaxVoices];
+double  voiceVelocities[kMaxVoices];
+double  voiceEnvelopes[kMaxVoices];
+bool    voiceReleased[kMaxVoices];
+
+double getIncrement(int note)
+{
+    return pow(2,((double(note-69.0)+pitchOffset)/12.0))*440.0/sampleRate;
+}
+
+DSP_EXPORT void reset()
+{
+    allocator.reset();
+    oscillators.reset();
+}
+
+void noteOn(int note,double velocity,int channel)
+{
+    bool isNewVoice=false;
+    int v=allocator.allocate(note,channel,isNewVoice);
+    if(v<0)
+        return;
+    if(isNewVoice)
+    {
+        oscillators.start(v,getIncrement(note));
+        voiceEnvelopes[v]=0;
+    }
+    else
+    {
+        // restarted or stolen voice: keeps its phase and level (no discontinuity)
+        oscillators.setIncrement(v,getIncrement(note));
+    }
+    voiceNotes[v]=note;
+    voiceVelocities[v]=velocity;
+    voiceReleased[v]=false;
+}
+
+void noteOff(int note,int channel)
+{
+    int v=allocator.find(note,channel);
+    if(v>=0)
+        voiceReleased[v]=true;
+}
+
+void handleMidiEvent(const MidiEvent& evt)
+{
+    switch(MidiEventUtils::getType(evt))
+    {
+        case kMidiNoteOn:
+        {
+            noteOn(MidiEventUtils::getNote(evt),double(MidiEventUtils::getNoteVelocity(evt))/127.0,MidiEventUtils::getChannel(evt)-1);
+            break;
+        }
+        case kMidiNoteOff:
+        {
+            noteOff(MidiEventUtils::getNote(evt),MidiEventUtils::getChannel(evt)-1);
+            break;
+        }
+        case kMidiPitchWheel:
+        {
+            // update pitch for all voices
+            pitchOffset=2*double(MidiEventUtils::getPitchWheelValue(evt))/8192.0;
+            for(uint i=0;i<allocator.get_activeCount();i++)
+            {
+                int v=allocator.getActiveVoice(i);
+                oscillators.setIncrement(v,getIncrement(voiceNotes[v]));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/// renders all voices (mono mix) to output (samplesCount samples, overwritten)
+void renderVoices(double* output,uint samplesCount)
+{
+    for(uint i=0;i<samplesCount;i++)
+        output[i]=0;
+    for(uint start=0;start<samplesCount;start+=kControlSamples)
+    {
+        uint count=samplesCount-start;
+        if(count>kControlSamples)
+            count=kControlSamples;
+
+        // envelopes at the end of the chunk (exponential segments)
+        const double attack=pow(attackCoeff,double(count));
+        const double release=pow(releaseCoeff,double(count));
+        for(uint i=0;i<allocator.get_activeCount();i++)
+        {
+            int v=allocator.getActiveVoice(i);
+            if(voiceReleased[v])
+            {
+                voiceEnvelopes[v]*=release;
+                // value below threshold => the voice fades out to zero during this chunk
+                if(voiceEnvelopes[v]<.0001)
+                    voiceEnvelopes[v]=0;
+            }
+            else
+                voiceEnvelopes[v]=1+(voiceEnvelopes[v]-1)*attack;
+            oscillators.setLevel(v,voiceVelocities[v]*voiceEnvelopes[v]);
+        }
+        oscillators.render(output+start,count);
+
+        // free the voices that ended
+        for(uint i=0;i<allocator.get_activeCount();)
+        {
+            int v=allocator.getActiveVoice(i);
+            if(voiceReleased[v] && voiceEnvelopes[v]==0)
+            {
+                oscillators.stop(v);
+                allocator.release(v);
+            }
+            else
+                i++;
+        }
+    }
+}
+
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    // smooth gain update: use begin and end values
+    // since the actual gain is exponential, we can use the ratio between begin and end values
+    // as an incremental multiplier for the actual gain
+    double gainDiff=data.endParamValues[kGainParam]-data.beginParamValues[kGainParam];
+    double gainRatio=1;
+    if(gainDiff!=0)
+        gainRatio=pow(10,gainDiff/double(data.samplesToProcess)*2);
+
+    if(audioOutputsCount==0)
+        return;
+
+    // render all voices (mono mix) to the first channel, between MIDI events
+    double* mix=data.samples[0];
+    KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents,data.samplesToProcess);
+    while(span.next())
+    {
+        // manage MIDI events
+        for(uint e=0;e<span.get_eventsCount();e++)
+            handleMidiEvent(span.getEvent(e));
+        renderVoices(mix+span.get_start(),span.get_length());
+    }
+
+    // apply gain and copy value to all outputs
+    for(uint i=0;i<data.samplesToProcess;i++)
+    {
+        mix[i]*=gain;
+        gain*=gainRatio;
+    }
+    for(uint ch=1;ch<audioOutputsCount;ch++)
+    {
+        double* samples=data.samples[ch];
+        for(uint i=0;i<data.samplesToProcess;i++)
+            samples[i]=mix[i];
+    }
+}
+
+DSP_EXPORT void updateInputParametersForBlock()
+{
+    oscillators.setShape(KittyDSP::Oscillators::Shape(int(inputParameters[kShapeParam]+.5)));
+    oscillators.setPulseWidth(inputParameters[kPulseWidthParam]);
+    oscillators.setSyncRatio(inputParameters[kSyncRatioParam]);
+    // time constants from 1 ms to 2 s
+    attackCoeff=exp(-1.0/(sampleRate*(.001+2*inputParameters[kAttackParam]*inputParameters[kAttackParam])));
+    releaseCoeff=exp(-1.0/(sampleRate*(.001+2*inputParameters[kReleaseParam]*inputParameters[kReleaseParam])));
+    gain=pow(10,-1+inputParameters[kGainParam]*2)*.25;
+}
+
+DSP_EXPORT int getTailSize()
+{
+    return -1;
+}
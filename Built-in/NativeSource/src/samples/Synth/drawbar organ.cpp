@@ -15,6 +15,9 @@ DSP_EXPORT uint    audioOutputsCount=0;
 
 #include "../library/Midi.h"
 #include "../library/Constants.h"
+#include "../library/VoiceEngine.h"
+#include "../library/Wavetable.h"
+#include "../library/MidiBlockSplitter.h"
 
 // dsp script interface--------------------------
 
@@ -22,9 +25,13 @@ DSP_EXPORT string name="Mini Drawbar Organ";
 DSP_EXPORT string author="Blue Cat Audio";
 DSP_EXPORT string description="Simple drawbar organ";
 
-DSP_EXPORT array<string> inputParametersNames={"Smooth", "Bar 1", "Bar 2", "Bar 3", "Bar 4" , "Bar 5", "Gain"};
+DSP_EXPORT array<string> inputParametersNames={"Smooth", "Bar 1", "Bar 2", "Bar 3", "Bar 4" , "Bar 5", "Gain", "Threads"};
 DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
-DSP_EXPORT array<double> inputParametersDefault={0.01,0,1,0,0,0,0.5};
+DSP_EXPORT array<double> inputParametersDefault={0.01,0,1,0,0,0,0.5,0};
+DSP_EXPORT array<double> inputParametersMin={0,0,0,0,0,0,0,0};
+DSP_EXPORT array<double> inputParametersMax={1,1,1,1,1,1,1,3};
+DSP_EXPORT array<int>    inputParametersSteps={-1,-1,-1,-1,-1,-1,-1,4};
+DSP_EXPORT array<string> inputParametersEnums={"","","","","","","","Off;2;3;4"};
 
 enum EParams
 {
@@ -34,139 +41,51 @@ enum EParams
     kBar3Param,
     kBar4Param,
     kBar5Param,
-    kGainParam
+    kGainParam,
+    kThreadsParam
 };
 
 // internal processing properties and functions---------------------
-double currentPitchOffset=0;
-const double period=4*PI; //2*2PI because least common denomiator is half frequency (sub octave)
-
-double amplitudeCoeff=0;
 double gain=0;
-double bar1Level=0;
-double bar2Level=0;
-double bar3Level=0;
-double bar4Level=0;
-double bar5Level=0;
-bool pedalIsDown=false;
-uint activeVoicesCount=0;
 
-struct SynthVoice;
-array<SynthVoice> voices(24);
+/* the voices (state stored as structure of arrays, rendered by blocks).
+*   The five drawbars (sub octave, fundamental, fifth, octave and twelfth) are harmonics 1,2,3,4 and 6
+*   of the sub octave: they are mixed in a band-limited wavetable, played by each voice at half the
+*   note frequency (a single table read per sample instead of five sine waves).
+*   When all voices are busy, the oldest one is stolen. When the "Threads" parameter is on, groups of
+*   voices are rendered in parallel by worker threads when there are enough voices playing (up to one
+*   worker per extra core). Voices are rendered by the audio thread only by default.
+*/
+KittyDSP::Voices::VoiceEngine voices(128);
+KittyDSP::Threads::WorkerPool workers;
+KittyDSP::Wavetables::WavetableBank organWave;
+const uint barHarmonics[]={1,2,3,4,6};
+double barLevels[]={-1,-1,-1,-1,-1};
+uint maxWorkers=0;
+
+DSP_EXPORT bool initialize()
+{
+    voices.setSampleRate(sampleRate);
+    voices.setPartial(0,.5,1);
+    voices.setWavetable(&organWave);
+    voices.setWorkerPool(&workers);
+    // all the workers are started now (and parked): the "Threads" parameter only chooses how many are used
+    maxWorkers=KittyDSP::Threads::WorkerPool::getDefaultWorkersCount();
+    workers.start(maxWorkers,KittyDSP::Threads::WorkerPool::kRealTimePriority|KittyDSP::Threads::WorkerPool::kPinnedToCores);
+    workers.setActiveWorkersCount(0);
+    return true;
+}
 
-/** Class that manages a single voice for the synth.
- *
- */
-struct SynthVoice
+DSP_EXPORT void shutdown()
 {
-    double amplitude=0;
-    double omega=0;
-    
-    double currentAmplitude=0;
-    double currentPhase=0;
-    
-    int    currentNote=-1;
-    bool   waitingForPedalRelease;
-    
-    // handle note on operation
-    void NoteOn(const MidiEvent& evt)
-    {
-        amplitude=double(MidiEventUtils::getNoteVelocity(evt))/127.0;
-        currentNote=MidiEventUtils::getNote(evt);
-        omega=2*PI*pow(2,((double(currentNote-69.0)+currentPitchOffset)/12.0))*440.0/sampleRate;
-    }
-    
-    void NoteOff()
-    {
-        if(!pedalIsDown)
-            // set amplitude to zero. Voice will be freed only when amplitude gets close to zero
-            amplitude=0;
-        else
-            // remember that note off has been called - will actually release the note later, when the pedal is released
-            waitingForPedalRelease=true;
-    }
-    
-    void ForcePitch()
-    {
-        omega=2*PI*pow(2,((double(currentNote-69.0)+currentPitchOffset)/12.0))*440.0/sampleRate;
-    }
-    
-    void PedalReleased()
-    {
-        if(waitingForPedalRelease)
-        {
-            NoteOff();
-            waitingForPedalRelease=false;
-        }
-    }
-    
-    // returns true if voice ended
-    double ProcessSample()
-    {
-        double sampleValue=0;
-        
-        // update amplitude
-        currentAmplitude+=amplitudeCoeff*(amplitude-currentAmplitude);
-        if(amplitude==0 && currentAmplitude<.0001)
-        {
-            // value below threshold => the voice ended
-            
-            // if not the last voice in the list
-            if(!(voices[activeVoicesCount-1]==*this))
-            {
-                // swap with last voice in the list
-                *this=voices[activeVoicesCount-1];
-                voices[activeVoicesCount-1].CancelNote();
-                
-                // decrease voices count
-                activeVoicesCount--;
-                
-                // process swaped voice instead of this one
-                return ProcessSample();
-            }
-            else
-            {
-                // cancel current note
-                CancelNote();
-                
-                // decrease voices count
-                activeVoicesCount--;
-                return 0;
-            }
-        }
-        
-        // compute sample value
-        sampleValue=currentAmplitude*(bar1Level*sin(currentPhase*.5)+bar2Level*sin(currentPhase)+bar3Level*sin(currentPhase*1.5)+bar4Level*sin(currentPhase*2)+bar5Level*sin(currentPhase*3));
-        
-        // update phase
-        currentPhase+=omega;
-        return sampleValue;
-    }
-    
-    void CancelNote()
-    {
-        currentNote=-1;
-        currentPhase=0;
-        currentAmplitude=0;
-        omega=0;
-        waitingForPedalRelease=false;
-    }
-    
-    void ReducePhase()
-    {
-        // warning: this can cause an almost infinite loop is currentPhase not properly updated
-        while(currentPhase>period)
-            currentPhase-=period;
-    }
-    
-    // == operator for find operations
-    bool operator ==(const SynthVoice& voice)const
-    {
-        return currentNote==voice.currentNote;
-    }
-};
+    voices.setWorkerPool(null);
+    workers.stop();
+}
 
-SynthVoice tempVoice;
+DSP_EXPORT void reset()
+{
+    voices.reset();
+}
 
 void handleMidiEvent(const MidiEvent& evt)
 {
@@ -174,67 +93,26 @@ void handleMidiEvent(const MidiEvent& evt)
     {
         case kMidiNoteOn:
         {
-            // find voice for the note on event (in case it is already here)
-            // or use the first empty slot (note=-1)
-            tempVoice.currentNote=MidiEventUtils::getNote(evt);
-            int index=voices.find(tempVoice);
-            if(index<0)
-            {
-                if(activeVoicesCount<voices.length)
-                {
-                    index=activeVoicesCount;
-                    activeVoicesCount++;
-                }
-            }
-            if(index>=0)
-            {
-                voices[index].NoteOn(evt);
-            }
+            voices.noteOn(MidiEventUtils::getNote(evt),double(MidiEventUtils::getNoteVelocity(evt))/127.0,MidiEventUtils::getChannel(evt)-1);
             break;
         }
         case kMidiNoteOff:
         {
-            // find voice for the note off event
-            tempVoice.currentNote=MidiEventUtils::getNote(evt);
-            int index=voices.find(tempVoice);
-            if(index>=0)
-            {
-                voices[index].NoteOff();
-            }
+            voices.noteOff(MidiEventUtils::getNote(evt),MidiEventUtils::getChannel(evt)-1);
             break;
         }
         case kMidiPitchWheel:
         {
             // update pitch for all voices
-            currentPitchOffset=2*double(MidiEventUtils::getPitchWheelValue(evt))/8192.0;
-            for(uint i=0;i<activeVoicesCount;i++)
-            {
-                if(voices[i].omega>0)
-                {
-                    voices[i].ForcePitch();
-                }
-            }
+            voices.setPitchOffset(2*double(MidiEventUtils::getPitchWheelValue(evt))/8192.0);
             break;
         }
         case kMidiControlChange:
         {
             // sustain pedal changed event
             if(MidiEventUtils::getCCNumber(evt)==64)
-            {
-                // if pedal is down
-                bool down=(MidiEventUtils::getCCValue(evt)>=64);
-                if(down!=pedalIsDown)
-                {
-                    pedalIsDown=down;
-                    if(pedalIsDown==false)
-                    {
-                        for(uint i=0;i<activeVoicesCount;i++)
-                        {
-                            voices[i].PedalReleased();
-                        }
-                    }
-                }
-            }
+                voices.setPedal(MidiEventUtils::getCCValue(evt)>=64);
+            break;
         }
         default:
             break;
@@ -251,50 +129,62 @@ DSP_EXPORT void processBlock(BlockData& data)
     if(gainDiff!=0)
         gainRatio=pow(10,gainDiff/double(data.samplesToProcess)*2);
 
-    uint nextEventIndex=0;
-    for(uint i=0;i<data.samplesToProcess;i++)
+    if(audioOutputsCount==0)
+        return;
+
+    // render all voices (mono mix) to the first channel, between MIDI events
+    double* mix=data.samples[0];
+    KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents,data.samplesToProcess);
+    while(span.next())
     {
         // manage MIDI events
-        while(nextEventIndex!=data.inputMidiEvents.length && data.inputMidiEvents[nextEventIndex].timeStamp<=double(i))
-        {
-            handleMidiEvent(data.inputMidiEvents[nextEventIndex]);
-            nextEventIndex++;
-        }
-
-        // compute sample value
-        double sampleValue=0;
-        for(uint v=0;v<activeVoicesCount;v++)
-        {
-            sampleValue+=voices[v].ProcessSample();
-        }
-        sampleValue*=gain;
-
-        // copy value to all outputs
-        for(uint ch=0;ch<audioOutputsCount;ch++)
-        {
-            data.samples[ch][i]=sampleValue;
-        }
+        for(uint e=0;e<span.get_eventsCount();e++)
+            handleMidiEvent(span.getEvent(e));
+        voices.render(mix+span.get_start(),span.get_length());
+    }
 
-        // update the gain
+    // apply gain and copy value to all outputs
+    for(uint i=0;i<data.samplesToProcess;i++)
+    {
+        mix[i]*=gain;
         gain*=gainRatio;
     }
-
-    // to avoid overflow, reduce phase for all active voices
-    for(uint i=0;i<activeVoicesCount;i++)
+    for(uint ch=1;ch<audioOutputsCount;ch++)
     {
-        voices[i].ReducePhase();
+        double* samples=data.samples[ch];
+        for(uint i=0;i<data.samplesToProcess;i++)
+            samples[i]=mix[i];
     }
 }
 
 DSP_EXPORT void updateInputParametersForBlock()
 {
-    amplitudeCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[0]))-1;
-    bar1Level=inputParameters[kBar1Param];
-    bar2Level=inputParameters[kBar2Param];
-    bar3Level=inputParameters[kBar3Param];
-    bar4Level=inputParameters[kBar4Param];
-    bar5Level=inputParameters[kBar5Param];
+    // the same smoothing coefficient is used for attack and release (no decay: full level sustain)
+    double amplitudeCoeff=pow(10,1.0/(50+.5*sampleRate*inputParameters[kSmoothParam]))-1;
+    voices.setEnvelope(amplitudeCoeff,1,1,amplitudeCoeff);
+    // rebuild the wavetable when a drawbar is moved
+    bool barsChanged=false;
+    for(uint bar=0;bar<5;bar++)
+    {
+        if(barLevels[bar]!=inputParameters[kBar1Param+bar])
+        {
+            barLevels[bar]=inputParameters[kBar1Param+bar];
+            barsChanged=true;
+        }
+    }
+    if(barsChanged)
+    {
+        double harmonics[6]={0,0,0,0,0,0};
+        for(uint bar=0;bar<5;bar++)
+            harmonics[barHarmonics[bar]-1]=barLevels[bar];
+        organWave.build(harmonics,6);
+    }
     gain=pow(10,-1+inputParameters[kGainParam]*2);
+    // number of workers used (serial rendering when off, no thread started or stopped here)
+    uint workersCount=uint(inputParameters[kThreadsParam]+.5);
+    if(workersCount>maxWorkers)
+        workersCount=maxWorkers;
+    workers.setActiveWorkersCount(workersCount);
 }
 
 DSP_EXPORT int getTailSize()
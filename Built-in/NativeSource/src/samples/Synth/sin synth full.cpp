@@ -14,6 +14,7 @@ DSP_EXPORT uint    audioOutputsCount=0;
 
 #include "../library/Midi.h"
 #include "../library/Constants.h"
+#include "../library/Wavetable.h"
 
 // dsp script interface--------------------------
 
@@ -37,6 +38,7 @@ enum SynthParams
 // internal processing properties and functions---------------------
 double currentPitchOffset=0;
 const double period=2*PI;
+const double* sineTable=null; // shared sine wavetable (phase in cycles)
 
 double amplitudeAttackCoeff=0;
 double amplitudeReleaseCoeff=0;
@@ -150,7 +152,7 @@ struct SynthVoice
             currentOmega+=omegaReleaseCoeff*(omega-currentOmega);
         
         // compute sample value
-        sampleValue=currentAmplitude*sin(currentPhase);
+        sampleValue=currentAmplitude*KittyDSP::Wavetables::interpolate(sineTable,currentPhase*(1.0/period));
         
         // update phase
         currentPhase+=currentOmega;
@@ -181,6 +183,12 @@ struct SynthVoice
 };
 SynthVoice tempVoice;
 
+DSP_EXPORT bool initialize()
+{
+    sineTable=KittyDSP::Wavetables::getSineTable();
+    return true;
+}
+
 void handleMidiEvent(const MidiEvent& evt)
 {
     switch(MidiEventUtils::getType(evt))
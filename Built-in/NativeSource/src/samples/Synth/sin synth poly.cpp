@@ -14,6 +14,7 @@ DSP_EXPORT uint    audioOutputsCount=0;
 
 #include "../library/Midi.h"
 #include "../library/Constants.h"
+#include "../library/MidiBlockSplitter.h"
 
 // dsp script interface--------------------------
 
@@ -82,47 +83,33 @@ struct SynthVoice
         }
     }
     
-    // returns true if voice ended
-    double ProcessSample()
+    /** Adds count samples of the voice to output.
+    *   Returns the number of samples rendered before the end of the voice (count if still playing).
+    */
+    uint Render(double* output,uint count)
     {
-        double sampleValue=0;
-        
-        // update amplitude
-        currentAmplitude+=amplitudeCoeff*(amplitude-currentAmplitude);
-        if(amplitude==0 && currentAmplitude<.0001)
+        double phase=currentPhase;
+        double level=currentAmplitude;
+        uint i=0;
+        for(;i<count;i++)
         {
-            // value below threshold => the voice ended
-            
-            // if not the last voice in the list
-            if(!(voices[activeVoicesCount-1]==*this))
+            // update amplitude
+            level+=amplitudeCoeff*(amplitude-level);
+            if(amplitude==0 && level<.0001)
             {
-                // swap with last voice in the list
-                *this=voices[activeVoicesCount-1];
-                voices[activeVoicesCount-1].CancelNote();
-                
-                // decrease voices count
-                activeVoicesCount--;
-                
-                // process swaped voice instead of this one
-                return ProcessSample();
-            }
-            else
-            {
-                // cancel current note
-                CancelNote();
-                
-                // decrease voices count
-                activeVoicesCount--;
-                return 0;
+                // value below threshold => the voice ended
+                break;
             }
+
+            // compute sample value
+            output[i]+=level*sin(phase);
+
+            // update phase
+            phase+=omega;
         }
-        
-        // compute sample value
-        sampleValue=currentAmplitude*sin(currentPhase);
-        
-        // update phase
-        currentPhase+=omega;
-        return sampleValue;
+        currentPhase=phase;
+        currentAmplitude=level;
+        return i;
     }
     
     void CancelNote()
@@ -233,33 +220,48 @@ DSP_EXPORT void processBlock(BlockData& data)
     if(gainDiff!=0)
         gainRatio=pow(10,gainDiff/double(data.samplesToProcess)*2);
 
-    uint nextEventIndex=0;
+    if(audioOutputsCount==0)
+        return;
+
+    // render all voices (mono mix) to the first channel, between MIDI events
+    double* mix=data.samples[0];
     for(uint i=0;i<data.samplesToProcess;i++)
+        mix[i]=0;
+    KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents,data.samplesToProcess);
+    while(span.next())
     {
         // manage MIDI events
-        while(nextEventIndex!=data.inputMidiEvents.length && data.inputMidiEvents[nextEventIndex].timeStamp<=double(i))
-        {
-            handleMidiEvent(data.inputMidiEvents[nextEventIndex]);
-            nextEventIndex++;
-        }
-
-        // compute sample value
-        double sampleValue=0;
-        for(uint v=0;v<activeVoicesCount;v++)
-        {
-            sampleValue+=voices[v].ProcessSample();
-        }
-        sampleValue*=gain;
+        for(uint e=0;e<span.get_eventsCount();e++)
+            handleMidiEvent(span.getEvent(e));
 
-        // copy value to all outputs
-        for(uint ch=0;ch<audioOutputsCount;ch++)
+        // render the voices one after the other
+        for(uint v=0;v<activeVoicesCount;)
         {
-            data.samples[ch][i]=sampleValue;
+            if(voices[v].Render(mix+span.get_start(),span.get_length())<span.get_length())
+            {
+                // voice ended: swap with last voice in the list (rendered instead of this one)
+                activeVoicesCount--;
+                if(v!=activeVoicesCount)
+                    voices[v]=voices[activeVoicesCount];
+                voices[activeVoicesCount].CancelNote();
+            }
+            else
+                v++;
         }
+    }
 
-        // update the gain
+    // apply gain and copy value to all outputs
+    for(uint i=0;i<data.samplesToProcess;i++)
+    {
+        mix[i]*=gain;
         gain*=gainRatio;
     }
+    for(uint ch=1;ch<audioOutputsCount;ch++)
+    {
+        double* samples=data.samples[ch];
+        for(uint i=0;i<data.samplesToProcess;i++)
+            samples[i]=mix[i];
+    }
 
     // to avoid overflow, reduce phase for all active voices
     for(uint i=0;i<activeVoicesCount;i++)
@@ -11,6 +11,11 @@ DSP_EXPORT uint    audioInputsCount=0;
 *   Simple 0dB clipping statistics display.
 */
 
+/* include our dsp classes.
+*
+*/
+#include "../library/Metering.h"
+
 
 DSP_EXPORT string name="Clipping Stats";
 DSP_EXPORT string author="Blue Cat Audio";
@@ -73,19 +78,26 @@ DSP_EXPORT bool initialize()
     return true;
 }
 
-DSP_EXPORT void processSample(double ioSample[])
+/* per-block processing: samples are only checked one by one in blocks that clip.
+*
+*/
+DSP_EXPORT void processBlock(BlockData& data)
 {
     // for each channel
     for(uint channel=0;channel<audioInputsCount;channel++)
     {
-        // check if channel is "clipping"
-        double value=fabs(ioSample[channel]);
-        if(value>=1)
+        const double* samples=data.samples[channel];
+        if(KittyDSP::Metering::maxAbs(samples,data.samplesToProcess)<1)
+            continue;
+
+        // check which samples are "clipping"
+        for(uint i=0;i<data.samplesToProcess;i++)
         {
-            channelData[channel].AddClippingValueForSample(currentSample);
+            if(fabs(samples[i])>=1)
+                channelData[channel].AddClippingValueForSample(currentSample+i);
         }
     }
-    currentSample++;
+    currentSample+=data.samplesToProcess;
 }
 
 DSP_EXPORT void reset()
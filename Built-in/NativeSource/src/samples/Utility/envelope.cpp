@@ -3,6 +3,11 @@
 #include "cpphelpers.h"
 #include <math.h>
 
+/* include our dsp classes.
+*
+*/
+#include "../library/Metering.h"
+
 // variables filled by host
 DSP_EXPORT uint    audioInputsCount = 0;
 DSP_EXPORT double  sampleRate = 0;
@@ -25,28 +30,15 @@ DSP_EXPORT array<double> outputParameters(outputParametersNames.length);
 DSP_EXPORT array<double> outputParametersMin={0};
 DSP_EXPORT array<double> outputParametersMax={1};
 
-// meter decay
-double decay=0;
-
-// the measured level
-double level=0;
+// the measured level (highest channel)
+KittyDSP::Metering::PeakBallistics level;
 
-/* per-sample processing.
+/* per-block processing: the level is only read once per block.
  *
  */
-DSP_EXPORT void processSample(double ioSample[])
+DSP_EXPORT void processBlock(BlockData& data)
 {
-    double maxValue=0;
-    for(uint channel=0;channel<audioInputsCount;channel++)
-    {
-        double value=fabs(ioSample[channel]);
-        if(value>maxValue)
-            maxValue=value;
-    }
-    if(maxValue>level)
-        level=maxValue;
-    else
-        level+=decay*(maxValue-level);
+    level.processBlock(data.samples,audioInputsCount,data.samplesToProcess);
 }
 
 DSP_EXPORT int getTailSize()
@@ -58,24 +50,25 @@ DSP_EXPORT int getTailSize()
 DSP_EXPORT void reset()
 {
     // reset level to 0
-    level=0;
+    level.reset();
 }
 
 DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* info)
 {
-    decay=(1-exp(-log(10.0)/(sampleRate*.1*(.01+5*inputParameters[1]))));
+    level.setRelease(1-exp(-log(10.0)/(sampleRate*.1*(.01+5*inputParameters[1]))));
 }
 
 DSP_EXPORT void computeOutputData()
 {
+    const double value=level.get_level();
     // linear mode
     if(inputParameters[0]<.5)
-        outputParameters[0]=level;
+        outputParameters[0]=value;
     else
     {
         // Log scale (dB)
-        if(level>pow(10.0,-3)) // -60 dB limit
-            outputParameters[0]=(20.0*log10(level)+60.0)/60.0;
+        if(value>pow(10.0,-3)) // -60 dB limit
+            outputParameters[0]=(20.0*log10(value)+60.0)/60.0;
         else
             outputParameters[0]=0;
     }
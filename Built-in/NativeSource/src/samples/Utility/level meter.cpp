@@ -11,6 +11,11 @@ DSP_EXPORT double  sampleRate=0;
 /** \file
 *   Multichannel peak levels meter.
 */
+
+/* include our dsp classes.
+*
+*/
+#include "../library/Metering.h"
 DSP_EXPORT string name="Level Meter";
 DSP_EXPORT string author="Blue Cat Audio";
 DSP_EXPORT string description="Multichannel peak levels meter";
@@ -25,11 +30,8 @@ DSP_EXPORT array<double> outputParametersMax={};
 // arrays that actually contain the strings
 array<std::string> stdOutputParametersNames;
 
-// meter decay
-double decay=0;
-
-// levels array
-array<double>   levels={};
+// levels (one peak meter per channel)
+array<KittyDSP::Metering::PeakBallistics>   levels={};
 
 DSP_EXPORT bool initialize()
 {
@@ -42,8 +44,10 @@ DSP_EXPORT bool initialize()
     stdOutputParametersNames.resize(audioInputsCount);
     levels.resize(audioInputsCount);
     
-    // initialize decay variable
-    decay=1-exp(-log(10)/(sampleRate*.3));
+    // initialize meters decay
+    const double decay=1-exp(-log(10)/(sampleRate*.3));
+    for(uint i=0;i<levels.length;i++)
+        levels[i].setRelease(decay);
     
     // initialize output parameters properties
     if(audioInputsCount==1)
@@ -71,21 +75,13 @@ DSP_EXPORT bool initialize()
     return true;
 }
 
-/* per-sample processing.
+/* per-block processing: meters are only read once per block.
 *
 */
-DSP_EXPORT void processSample(double ioSample[])
+DSP_EXPORT void processBlock(BlockData& data)
 {
     for(uint channel=0;channel<audioInputsCount;channel++)
-    {
-        double value=fabs(ioSample[channel]);
-        double level=levels[channel];
-        if(value>level)
-            level=value;
-        else
-            level+=decay*(value-level);
-        levels[channel]=level;
-    }
+        levels[channel].processBlock(data.samples+channel,1,data.samplesToProcess);
 }
 
 DSP_EXPORT int getTailSize()
@@ -99,7 +95,7 @@ DSP_EXPORT void reset()
     // reset levels to 0
     for(uint i=0;i<levels.length;i++)
     {
-        levels[i]=0;
+        levels[i].reset();
     }
 }
 
@@ -107,8 +103,9 @@ DSP_EXPORT void computeOutputData()
 {
     for(uint i=0;i<audioInputsCount;i++)
     {
-        if(levels[i]>pow(10,-3)) // -60 dB limit
-            outputParameters[i]=20*log10(levels[i]);
+        const double level=levels[i].get_level();
+        if(level>pow(10,-3)) // -60 dB limit
+            outputParameters[i]=20*log10(level);
         else
             outputParameters[i]=-60;
     }
@@ -0,0 +1,72 @@
+// C++ scripting support-----------------------------
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+DSP_EXPORT uint    audioInputsCount=0;
+DSP_EXPORT double  sampleRate=0;
+
+#include <math.h>
+
+/** \file
+*   Loudness and true peak meter (ITU-R BS.1770-4, EBU R128).
+*   Momentary, short-term and integrated loudness, loudness range and true peak of all channels.
+*   Integrated values are measured since the last reset (playback start).
+*/
+#include "../library/Loudness.h"
+
+DSP_EXPORT string name="Loudness Meter";
+DSP_EXPORT string author="Blue Cat Audio";
+DSP_EXPORT string description="EBU R128 loudness and true peak meter";
+
+// Output parameters definition
+DSP_EXPORT array<string> outputParametersNames={"Momentary","Short-Term","Integrated","Range","True Peak"};
+DSP_EXPORT array<string> outputParametersUnits={"LUFS","LUFS","LUFS","LU","dBTP"};
+DSP_EXPORT array<double> outputParameters(outputParametersNames.length);
+DSP_EXPORT array<double> outputParametersMin={-60,-60,-60,0,-60};
+DSP_EXPORT array<double> outputParametersMax={0,0,0,30,3};
+
+enum EOutputParams
+{
+    kMomentaryParam=0,
+    kShortTermParam,
+    kIntegratedParam,
+    kRangeParam,
+    kTruePeakParam
+};
+
+KittyDSP::Loudness::LoudnessMeter meter;
+
+DSP_EXPORT bool initialize()
+{
+    meter.setup(audioInputsCount,sampleRate);
+    return true;
+}
+
+DSP_EXPORT void reset()
+{
+    meter.reset();
+}
+
+/* per-block processing: the audio is only measured.
+*
+*/
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    meter.processBlock(data.samples,data.samplesToProcess);
+}
+
+DSP_EXPORT void computeOutputData()
+{
+    outputParameters[kMomentaryParam]=meter.get_momentary();
+    outputParameters[kShortTermParam]=meter.get_shortTerm();
+    outputParameters[kIntegratedParam]=meter.get_integrated();
+    outputParameters[kRangeParam]=meter.get_range();
+    outputParameters[kTruePeakParam]=meter.get_truePeak();
+
+    // values below the meters range
+    for(uint i=0;i<outputParameters.length;i++)
+    {
+        if(outputParameters[i]<outputParametersMin[i])
+            outputParameters[i]=outputParametersMin[i];
+    }
+}
@@ -1,78 +1,112 @@
 /** \file
-*   Simple oscilloscope display using output strings.
+*   Simple oscilloscope display using an output buffer.
+*   The last 1024 samples are decimated to the width of the display (minimum and maximum
+*   of each column) and sent as binary values after every block. The raw samples are also
+*   available as a string (newest first) for user interfaces that only read output strings,
+*   refreshed at the rate of the display only (formatting is much more expensive than the rest).
 */
 
 // C++ scripting support-----------------------------
 #include "dspapi.h"
 #include "cpphelpers.h"
-#include <string>
+
+// include our dsp classes
+#include "../library/Metering.h"
+
 DSP_EXPORT uint    audioInputsCount = 0;
+DSP_EXPORT double  sampleRate = 0;
 
+// display constants
+const uint kSamplesCount = 1024;
+const uint kColumnsCount = 512; ///< width of the display, in pixels
+const uint kValuesCount = 2 * kColumnsCount; ///< minimum and maximum for each column
+const double kStringRefreshRate = 30; ///< string updates per second
 
 DSP_EXPORT string name = "Micr'Oscillo";
 DSP_EXPORT string description = "Simple Oscilloscope that displays the last 1024 audio samples (mono)";
 DSP_EXPORT array<string> outputStringsNames = { "Audio Data" };
-DSP_EXPORT array<int> outputStringsMaxLengths = { 1024 * (24 + 1) }; ///<24 characters required to store doubles as strings
+DSP_EXPORT array<int> outputStringsMaxLengths = { int(kSamplesCount * KittyDSP::Metering::kMaxValueLength) };
 DSP_EXPORT array<string>  outputStrings(outputStringsNames.length, NULL);
-
-// pre-allocated temporary string
-std::string tempString;
-std::string outputString;
+DSP_EXPORT array<string> outputBuffersNames = { "Audio Data" };
+DSP_EXPORT array<OutputBuffer> outputBuffers(outputBuffersNames.length);
 
 // audio data circular buffer
-array<double> buffer(1024);
-int mask = 1023;
+array<double> buffer(kSamplesCount);
+int mask = kSamplesCount - 1;
 int currentIndex = 0;
-double averageRatio = 1.0;
+
+// pre-allocated display data (no allocation in computeOutputData)
+array<double> orderedSamples(kSamplesCount);
+array<float> displayValues(kValuesCount);
+array<char> outputString(kSamplesCount * KittyDSP::Metering::kMaxValueLength + 1);
+uint stringRefreshPeriod = 0; ///< in samples
+uint samplesSinceStringRefresh = 0;
 
 DSP_EXPORT bool initialize()
 {
-    tempString.resize(1024);
-    outputString.resize(1024 * (24 + 1));
-    outputString="";
-    if (audioInputsCount != 0)
-        averageRatio = 1.0 / double(audioInputsCount);
+    // the display values are sent as 32-bit floats
+    OutputBuffer& output = outputBuffers[0];
+    output.data = &displayValues[0];
+    output.capacity = displayValues.length;
+    output.length = 0;
+    output.format = kOutputBufferFloat32;
+    outputString[0] = 0;
+    stringRefreshPeriod = uint(sampleRate / kStringRefreshRate);
     return true;
 }
 
 DSP_EXPORT void reset()
 {
     currentIndex = 0;
-    for (uint i = 0; i < 1024; i++)
+    for (uint i = 0; i < kSamplesCount; i++)
         buffer[i] = 0;
+    samplesSinceStringRefresh = stringRefreshPeriod;
 }
 
-DSP_EXPORT void processSample(double ioSample[])
+DSP_EXPORT void processBlock(BlockData& data)
 {
-    double value = 0;
-    // compute channels average value
-    for (uint channel = 0; channel < audioInputsCount; channel++)
+    // store the channels average value, split where the buffer wraps around
+    uint start = 0;
+    while (start < data.samplesToProcess)
     {
-        // check if channel is "clipping"
-        value += ioSample[channel];
+        uint count = data.samplesToProcess - start;
+        if (count > buffer.length - currentIndex)
+            count = buffer.length - currentIndex;
+        KittyDSP::Metering::mixDown(data.samples, audioInputsCount, start, count, &buffer[currentIndex]);
+        start += count;
+        currentIndex += count;
+        currentIndex &= mask;
     }
-    buffer[currentIndex] = value*averageRatio;
-    currentIndex++;
-    currentIndex &= mask;
+    samplesSinceStringRefresh += data.samplesToProcess;
 }
 
 DSP_EXPORT void computeOutputData()
 {
-    // convert raw audio data to csv values (using ';' as separator)
-    outputString = "";
-    for (int i = 0; i < 1024; i++)
-    {
-        // convert value to string into our pre-allocated temp string, with re-allocating the string
-        double value = buffer[(currentIndex - 1 - i)&mask];
-        tempString.resize(1024);
-        sprintf(&tempString[0],"%0.6f", value);
-        tempString.resize(strlen(&tempString[0]));
+    // samples from oldest to newest
+    const uint oldestCount = kSamplesCount - currentIndex;
+    for (uint i = 0; i < oldestCount; i++)
+        orderedSamples[i] = buffer[currentIndex + i];
+    for (uint i = 0; i < uint(currentIndex); i++)
+        orderedSamples[oldestCount + i] = buffer[i];
+
+    // binary output: minimum and maximum of each column, oldest first
+    OutputBuffer& output = outputBuffers[0];
+    output.beginUpdate();
+    KittyDSP::Metering::decimateMinMax(&orderedSamples[0], kSamplesCount, kColumnsCount, &displayValues[0]);
+    output.length = kValuesCount;
+    output.endUpdate();
 
-        // adding it to the output string
-        outputString += tempString;
-        if (i != 1023)
-            outputString += ";";
+    // string output: raw samples as csv (using ';' as separator), newest first
+    if (samplesSinceStringRefresh < stringRefreshPeriod)
+        return;
+    samplesSinceStringRefresh = 0;
+    char* position = &outputString[0];
+    for (uint i = 0; i < kSamplesCount; i++)
+    {
+        if (i != 0)
+            *position++ = ';';
+        position += KittyDSP::Metering::writeValue(position, orderedSamples[kSamplesCount - 1 - i]);
     }
-    // copy pointer to output
-    outputStrings[0] = outputString.c_str();
-}
\ No newline at end of file
+    *position = 0;
+    outputStrings[0] = &outputString[0];
+}
@@ -0,0 +1,162 @@
+/** \file
+*   Spectrum analyzer display using output buffers.
+*   The audio thread only copies the samples (mono) for a background thread that computes
+*   windowed and overlapping FFTs and groups the bins into log-frequency bands. The levels
+*   of the bands (dB) are sent to the user interface as binary values when a new analysis
+*   is available, with the center frequencies of the bands in a second buffer. The levels are
+*   also available as a string for user interfaces that only read output strings, refreshed at
+*   the rate of the display only.
+*/
+
+// C++ scripting support-----------------------------
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+// include our dsp classes
+#include "../library/Metering.h"
+#include "../library/SpectrumAnalyzer.h"
+
+DSP_EXPORT uint    audioInputsCount = 0;
+DSP_EXPORT double  sampleRate = 0;
+DSP_EXPORT void*   host = null;
+DSP_EXPORT HostPrintFunc* hostPrint = null;
+
+// display constants
+const uint kBandsCount = 256; ///< width of the display, in bands
+const double kMinFrequency = 20;
+const uint kChunkSize = 1024; ///< samples mixed down at once
+const double kStringRefreshRate = 30; ///< string updates per second
+
+DSP_EXPORT string name = "Spectrum Analyzer";
+DSP_EXPORT string description = "FFT spectrum analyzer with log-frequency bands (mono)";
+
+// Input parameters definition
+DSP_EXPORT array<string> inputParametersNames = { "FFT Size", "Overlap", "Averaging" };
+DSP_EXPORT array<string> inputParametersUnits = { "", "", "ms" };
+DSP_EXPORT array<string> inputParametersEnums = { "256;512;1024;2048;4096;8192;16384;32768;65536", "50%;75%;87.5%", "" };
+DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
+DSP_EXPORT array<double> inputParametersMin = { 0, 0, 0 };
+DSP_EXPORT array<double> inputParametersMax = { KittyDSP::Spectrum::kSizesCount - 1, 2, 2000 };
+DSP_EXPORT array<double> inputParametersDefault = { 4, 1, 200 };
+DSP_EXPORT array<int>    inputParametersSteps = { KittyDSP::Spectrum::kSizesCount, 3, -1 };
+DSP_EXPORT array<string> inputParametersFormats = { "", "", ".0" };
+
+enum EInputParams
+{
+    kFftSizeParam = 0,
+    kOverlapParam,
+    kAveragingParam
+};
+
+// Output strings and buffers definition
+DSP_EXPORT array<string> outputStringsNames = { "Spectrum" };
+DSP_EXPORT array<int> outputStringsMaxLengths = { int(kBandsCount * KittyDSP::Metering::kMaxValueLength) };
+DSP_EXPORT array<string> outputStrings(outputStringsNames.length, NULL);
+DSP_EXPORT array<string> outputBuffersNames = { "Spectrum", "Frequencies" };
+DSP_EXPORT array<OutputBuffer> outputBuffers(outputBuffersNames.length);
+
+enum EOutputBuffers
+{
+    kSpectrumBuffer = 0,
+    kFrequenciesBuffer
+};
+
+KittyDSP::Spectrum::SpectrumAnalyzer analyzer;
+
+// pre-allocated data (no allocation in the audio thread)
+array<double> monoSamples(kChunkSize);
+array<float> levels(kBandsCount);
+array<float> frequencies(kBandsCount);
+array<char> spectrumString(kBandsCount * KittyDSP::Metering::kMaxValueLength + 1);
+uint stringRefreshPeriod = 0; ///< in samples
+uint samplesSinceStringRefresh = 0;
+
+DSP_EXPORT bool initialize()
+{
+    if (!analyzer.start(sampleRate, kBandsCount, kMinFrequency))
+    {
+        print("Error: cannot start the spectrum analyzer");
+        return false;
+    }
+
+    // the levels (dB) and the frequencies of the bands (Hz) are sent as 32-bit floats
+    for (uint b = 0; b < kBandsCount; b++)
+    {
+        levels[b] = float(KittyDSP::Spectrum::kMinDb);
+        frequencies[b] = float(analyzer.get_frequency(b));
+    }
+    OutputBuffer& spectrum = outputBuffers[kSpectrumBuffer];
+    spectrum.data = &levels[0];
+    spectrum.capacity = kBandsCount;
+    spectrum.length = kBandsCount;
+    spectrum.format = kOutputBufferFloat32;
+    OutputBuffer& bands = outputBuffers[kFrequenciesBuffer];
+    bands.data = &frequencies[0];
+    bands.capacity = kBandsCount;
+    bands.length = kBandsCount;
+    bands.format = kOutputBufferFloat32;
+    spectrumString[0] = 0;
+    stringRefreshPeriod = uint(sampleRate / kStringRefreshRate);
+    return true;
+}
+
+DSP_EXPORT void shutdown()
+{
+    analyzer.stop();
+}
+
+DSP_EXPORT void reset()
+{
+    analyzer.reset();
+    samplesSinceStringRefresh = stringRefreshPeriod;
+}
+
+DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* info)
+{
+    analyzer.setSize(uint(inputParameters[kFftSizeParam] + .5));
+    analyzer.setOverlap(2u << uint(inputParameters[kOverlapParam] + .5));
+    analyzer.setAveraging(inputParameters[kAveragingParam] / 1000);
+}
+
+DSP_EXPORT void processBlock(BlockData& data)
+{
+    // channels average, by chunks
+    uint start = 0;
+    while (start < data.samplesToProcess)
+    {
+        uint count = data.samplesToProcess - start;
+        if (count > kChunkSize)
+            count = kChunkSize;
+        KittyDSP::Metering::mixDown(data.samples, audioInputsCount, start, count, &monoSamples[0]);
+        analyzer.push(&monoSamples[0], count);
+        start += count;
+    }
+    samplesSinceStringRefresh += data.samplesToProcess;
+}
+
+DSP_EXPORT void computeOutputData()
+{
+    // copy the latest analysis, if any
+    const float* latest = analyzer.receive();
+    if (latest == null)
+        return;
+    OutputBuffer& spectrum = outputBuffers[kSpectrumBuffer];
+    spectrum.beginUpdate();
+    for (uint b = 0; b < kBandsCount; b++)
+        levels[b] = latest[b];
+    spectrum.endUpdate();
+
+    // string output: same levels as csv (using ';' as separator), lowest band first
+    if (samplesSinceStringRefresh < stringRefreshPeriod)
+        return;
+    samplesSinceStringRefresh = 0;
+    char* position = &spectrumString[0];
+    for (uint b = 0; b < kBandsCount; b++)
+    {
+        if (b != 0)
+            *position++ = ';';
+        position += KittyDSP::Metering::writeValue(position, levels[b]);
+    }
+    *position = 0;
+    outputStrings[0] = &spectrumString[0];
+}
@@ -3,15 +3,17 @@
 #include "cpphelpers.h"
 
 DSP_EXPORT uint    audioOutputsCount=0;
+DSP_EXPORT double  sampleRate=0;
 DSP_EXPORT string  userDocumentsPath=null;
 
 /** \file
 *   Simple wave file player.
-*   This simple player reads the file directly in the audio thread, and may be sensitive to
-*   system load. It may produce drop outs if used with small buffer sizes.
+*   The file is read and decoded by a background thread into a 2 seconds buffer, so that
+*   the audio thread never accesses the disk. Drop outs (if the disk or network cannot keep up)
+*   are reported by the "Underruns" output parameter.
 */
 
-#include "../library/WaveFile.h"
+#include "../library/BufferedWaveFile.h"
 
 DSP_EXPORT string name="Wave File Player";
 DSP_EXPORT string author="Blue Cat Audio";
@@ -29,14 +31,15 @@ DSP_EXPORT array<double> inputParametersMax={3};
 DSP_EXPORT array<int>    inputParametersSteps={4};
 DSP_EXPORT array<string>  inputParametersEnums={"Auto;Stop;Pause;Resume"};
 
-DSP_EXPORT array<string> outputParametersNames={"Status"};
+DSP_EXPORT array<string> outputParametersNames={"Status","Buffer","Underruns"};
+DSP_EXPORT array<string> outputParametersUnits={"","%",""};
 DSP_EXPORT array<double> outputParameters(outputParametersNames.length);
-DSP_EXPORT array<double> outputParametersMin={0};
-DSP_EXPORT array<double> outputParametersMax={2};
-DSP_EXPORT array<string>  outputParametersEnums={"Stopped;Paused;Playing"};
+DSP_EXPORT array<double> outputParametersMin={0,0,0};
+DSP_EXPORT array<double> outputParametersMax={2,100,1000};
+DSP_EXPORT array<string>  outputParametersEnums={"Stopped;Paused;Playing","",""};
+DSP_EXPORT array<string>  outputParametersFormats={"",".0",".0"};
 
-WaveFileReader  wavReader;
-uint            channelsToPlay=0;
+BufferedWaveFileReader  wavReader;
 bool            playing=false;
 bool            paused=false;
 double          amplitude=0;
@@ -64,10 +67,17 @@ DSP_EXPORT bool initialize()
     // reserve space for file name string (avoids memory allocation)
     fileName.resize(1024);
     filePath.resize(1024);
-    return true;
+
+    // start streaming thread (2 seconds buffer)
+    return wavReader.start(audioOutputsCount,uint(2*sampleRate));
+}
+
+DSP_EXPORT void shutdown()
+{
+    wavReader.stop();
 }
 
-DSP_EXPORT void processSample(double ioSample[])
+DSP_EXPORT void processBlock(BlockData& data)
 {
     if(playing)
     {
@@ -76,36 +86,37 @@ DSP_EXPORT void processSample(double ioSample[])
             // silence all channels
             for(uint ch=0;ch<audioOutputsCount;ch++)
             {
-                ioSample[ch]=0;;
-            }   
+                for(uint i=0;i<data.samplesToProcess;i++)
+                    data.samples[ch][i]=0;
+            }
         }
         else
         {
-            // read samples
-            wavReader.readSample(ioSample);
-
-            // apply gain
-            for(uint ch=0;ch<channelsToPlay;ch++)
+            // copy samples prefetched by the streaming thread (unused channels are silent).
+            // When rendering offline, wait for the streaming thread rather than dropping out.
+            wavReader.read(data.samples,audioOutputsCount,data.samplesToProcess,data.offlineRenderingMode);
+
+            // apply gain, ramping from the value at the beginning of the block to avoid steps
+            double gain=amplitude;
+            double gainStep=0;
+            if(data.beginParamValues!=null && data.endParamValues!=null && data.samplesToProcess>0)
             {
-                ioSample[ch]*=amplitude;
+                gain=data.beginParamValues[1];
+                gainStep=(data.endParamValues[1]-gain)/data.samplesToProcess;
             }
-            // silence unused channels
-            for(uint ch=channelsToPlay;ch<audioOutputsCount;ch++)
+            for(uint ch=0;ch<audioOutputsCount;ch++)
             {
-                ioSample[ch]=0;;
-            }   
+                double* samples=data.samples[ch];
+                for(uint i=0;i<data.samplesToProcess;i++)
+                    samples[i]*=gain+(i+1)*gainStep;
+            }
         }
     }
-
-    // loop back to beginning if end of file was reached
-    if(wavReader.isEndOfFile())
-        wavReader.setPos(0);
 }
 
 DSP_EXPORT void updateInputParameters()
 {
-    // amplitude is updated for each sample, to avoid steps
-   amplitude=inputParameters[1];
+    amplitude=inputParameters[1];
 }
 
 DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* transportInfo)
@@ -129,7 +140,7 @@ DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* transportInfo
     // if playing stopped -> close file
     if(wasPlaying && !playing)
     {
-        wavReader.close();
+        wavReader.closeFile();
     }
 
     // store file name if different
@@ -148,15 +159,8 @@ DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* transportInfo
         if((filePath.find("/")!=0) && (filePath.find(":")==std::string::npos) && converted) // check if relative path
             filePath=userDocumentsPath+filePath;
         
-        // open file and store the number of channels to play
-        channelsToPlay=0;
-        bool ok=wavReader.openFile(filePath,audioOutputsCount);
-        if(ok)
-        {
-            channelsToPlay=wavReader.get_channelsCount();
-            if(channelsToPlay>audioOutputsCount)
-                channelsToPlay=audioOutputsCount;
-        }
+        // open file (asynchronous) and play it in a loop
+        wavReader.openFile(filePath,true);
     }
 }
 
@@ -164,10 +168,12 @@ DSP_EXPORT void computeOutputData()
 {
     if(paused)
         outputParameters[0]=1;
-    else if(playing && channelsToPlay!=0)
+    else if(playing && wavReader.get_fileChannelsCount()!=0)
         outputParameters[0]=2;
     else
         outputParameters[0]=0;
+    outputParameters[1]=100*wavReader.get_fillRatio();
+    outputParameters[2]=wavReader.get_underrunsCount();
 }
 
 DSP_EXPORT int getTailSize()
@@ -8,11 +8,12 @@ DSP_EXPORT double  sampleRate=0;
 
 /** \file
 *   Simple wave file recorder.
-*   This simple recorder writes the file directly in the audio thread, and may be sensitive to
-*   system load. It may produce drop outs if used with small buffer sizes.
+*   Audio data is copied to a 4 seconds buffer, and written to disk by a background thread, so that
+*   the audio thread never accesses the disk. Blocks lost because the disk cannot keep up are recorded as
+*   silence, so that the file stays aligned with the session, and reported by the "Dropped" output parameter. The file header is updated every second while recording.
 */
 
-#include "../library/WaveFile.h"
+#include "../library/BufferedWaveFile.h"
 
 DSP_EXPORT string name="Wave file recorder";
 DSP_EXPORT string author="Blue Cat Audio";
@@ -30,13 +31,16 @@ DSP_EXPORT array<double> inputParametersMax={3,20,5};
 DSP_EXPORT array<int>    inputParametersSteps={4,20,5};
 DSP_EXPORT array<string>  inputParametersEnums={"Auto;Stop;Pause;Resume","","8;16;24;32;64"};
 
-DSP_EXPORT array<string> outputParametersNames={"Status"};
+DSP_EXPORT array<string> outputParametersNames={"Status","Buffer","Dropped"};
+DSP_EXPORT array<string> outputParametersUnits={"","%","Blocks"};
 DSP_EXPORT array<double> outputParameters(outputParametersNames.length);
-DSP_EXPORT array<double> outputParametersMin={0};
-DSP_EXPORT array<double> outputParametersMax={2};
-DSP_EXPORT array<string>  outputParametersEnums={"Stopped;Paused;Recording"};
+DSP_EXPORT array<double> outputParametersMin={0,0,0};
+DSP_EXPORT array<double> outputParametersMax={2,100,1000};
+DSP_EXPORT array<string>  outputParametersEnums={"Stopped;Paused;Recording","",""};
+DSP_EXPORT array<string>  outputParametersFormats={"",".0",".0"};
 
-WaveFileWriter  wavWriter;
+BufferedWaveFileWriter  wavWriter;
+uint            bytesPerSample=2;
 bool            recording=false;
 bool            paused=false;
 int             fileIndex=0;
@@ -61,24 +65,40 @@ bool convertToUnix(std::string& path)
 
 DSP_EXPORT bool initialize()
 {
-    // store file header data
-    wavWriter.header.sampleRate=uint64(sampleRate);
-    wavWriter.header.channelsCount=audioInputsCount;
     // reserve space for file name string (avoids memory allocation)
     fileName.resize(1024);
-    return true;
+
+    // start writing thread (4 seconds buffer)
+    return wavWriter.start(audioInputsCount,uint(4*sampleRate));
+}
+
+DSP_EXPORT void shutdown()
+{
+    // writes pending audio data and closes the file
+    wavWriter.stop();
 }
 
-DSP_EXPORT void processSample(double ioSample[])
+DSP_EXPORT void processBlock(BlockData& data)
 {
-    // apply gain
-    for(uint i=0;i<audioInputsCount;i++)
+    // apply gain, ramping from the value at the beginning of the block to avoid steps
+    double gain=amplitude;
+    double gainStep=0;
+    if(data.beginParamValues!=null && data.endParamValues!=null && data.samplesToProcess>0)
     {
-        ioSample[i]*=amplitude;
+        gain=data.beginParamValues[3];
+        gainStep=(data.endParamValues[3]-gain)/data.samplesToProcess;
     }
-    // record to file
+    for(uint ch=0;ch<audioInputsCount;ch++)
+    {
+        double* samples=data.samples[ch];
+        for(uint i=0;i<data.samplesToProcess;i++)
+            samples[i]*=gain+(i+1)*gainStep;
+    }
+
+    // record to file (copied to the buffer, written by the background thread).
+    // When rendering offline, wait for the writing thread rather than dropping blocks.
     if(recording && !paused)
-        wavWriter.writeSample(ioSample);
+        wavWriter.write(data.samples,audioInputsCount,data.samplesToProcess,data.offlineRenderingMode);
 }
 
 DSP_EXPORT void updateInputParameters()
@@ -108,15 +128,15 @@ DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* transportInfo
 	// if recording stopped -> close file
 	if (wasRecording && !recording)
 	{
-		wavWriter.close();
+		wavWriter.closeFile();
 	}
 
 	// if recording started -> open new file with appropriate bit depth and name
     if (!wasRecording && recording)
     {
-        wavWriter.header.bytesPerSample = int(inputParameters[2] + .5);
-        if (wavWriter.header.bytesPerSample == 5)
-            wavWriter.header.bytesPerSample = 8;
+        bytesPerSample = int(inputParameters[2] + .5);
+        if (bytesPerSample == 5)
+            bytesPerSample = 8;
         // generate file name    
         if (inputStrings[0] != null && strlen(inputStrings[0]) != 0)
         {
@@ -140,8 +160,8 @@ DSP_EXPORT void updateInputParametersForBlock(const TransportInfo* transportInfo
             fileName += std::to_string(fileIndex + 1);
         fileName += ".wav";
 
-        // open file
-        wavWriter.openFile(fileName);
+        // open file (asynchronous)
+        wavWriter.openFile(fileName,uint64(sampleRate),bytesPerSample);
 
         // update current file index       
         fileIndex++;
@@ -157,6 +177,8 @@ DSP_EXPORT void computeOutputData()
         outputParameters[0]=2;
     else
         outputParameters[0]=0;
+    outputParameters[1]=100*wavWriter.get_fillRatio();
+    outputParameters[2]=wavWriter.get_droppedBlocksCount();
 }
 
 DSP_EXPORT int getTailSize()
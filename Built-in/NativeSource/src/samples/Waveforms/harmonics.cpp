@@ -8,9 +8,13 @@ DSP_EXPORT uint    audioOutputsCount=0;
 /** \file
 *   Additive synthesis waveform generator.
 *   Generates an audio waveform using additive synthesis with multiple
-*   sine waves.
+*   sine waves. The harmonics are mixed in a wavetable when they change, so that a single
+*   table read is required per sample. The generator is monophonic: the table only contains
+*   the harmonics below the Nyquist frequency for the current frequency, and is rebuilt when
+*   this number of harmonics changes.
 */
 #include "../library/Constants.h"
+#include "../library/Wavetable.h"
 
 DSP_EXPORT string name="Harmonics";
 DSP_EXPORT string author="Blue Cat Audio";
@@ -24,45 +28,28 @@ DSP_EXPORT array<double> inputParametersDefault={50,200,1};
 DSP_EXPORT array<double> inputParametersMax={100,5000};
 
 double amplitude=0;
-double omega=0;
-double currentPhase=0;
-double h0=0;
-double h1=0;
-double h2=0;
-double h3=0;
-double h4=0;
-double h5=0;
-double h6=0;
-double ph0=0;
-double ph1=0;
-double ph2=0;
-double ph3=0;
-double ph4=0;
-double ph5=0;
-double ph6=0;
+double increment=0; // in cycles per sample
+double currentPhase=0; // in cycles
 
-const double period=2*PI;
-double omegaFactor=0;// to be initialized with sampleRate
+// harmonics levels and phases (in cycles)
+const uint harmonicsCount=7;
+double harmonicsLevels[harmonicsCount]={0};
+double harmonicsPhases[harmonicsCount]={0};
+uint audibleHarmonicsCount=0; // harmonics below the Nyquist frequency
+KittyDSP::Wavetables::WavetableBank wavetable;
 
 DSP_EXPORT bool initialize()
 {
-    omegaFactor=period/sampleRate;
     return true;
 }
 
 DSP_EXPORT void processSample(double ioSample[])
 {
     // compute sample value
-    double sampleValue=amplitude*(h0*sin(currentPhase+ph0)
-                                  +h1*sin(2*currentPhase+ph1)
-                                  +h2*sin(3*currentPhase+ph2)
-                                  +h3*sin(4*currentPhase+ph3)
-                                  +h4*sin(5*currentPhase+ph4)
-                                  +h5*sin(6*currentPhase+ph5)
-                                  +h6*sin(7*currentPhase+ph6));
+    double sampleValue=amplitude*wavetable.read(currentPhase);
         
     // update phase
-    currentPhase+=omega;
+    currentPhase+=increment;
         
     // copy to all audio outputs
     for(uint channel=0;channel<audioOutputsCount;channel++)
@@ -71,28 +58,32 @@ DSP_EXPORT void processSample(double ioSample[])
     }
     
     // to avoid overflow, reduce phase
-    while(currentPhase>period)
-        currentPhase-=period;
+    if(currentPhase>=1)
+        currentPhase-=floor(currentPhase);
 }
 
 DSP_EXPORT void updateInputParameters()
 {
-   amplitude=inputParameters[0]*.01;
-   omega=omegaFactor*inputParameters[1];
-   h0=inputParameters[2];
-   h1=inputParameters[3];
-   h2=inputParameters[4];
-   h3=inputParameters[5];
-   h4=inputParameters[6];
-   h5=inputParameters[7];
-   h6=inputParameters[8];
-   ph0=inputParameters[9]*period;
-   ph1=inputParameters[10]*period;
-   ph2=inputParameters[11]*period;
-   ph3=inputParameters[12]*period;
-   ph4=inputParameters[13]*period;
-   ph5=inputParameters[14]*period;
-   ph6=inputParameters[15]*period;
+    amplitude=inputParameters[0]*.01;
+    increment=inputParameters[1]/sampleRate;
+
+    // rebuild the wavetable only if the harmonics or the number of harmonics below Nyquist have changed
+    uint audibleCount=0;
+    while(audibleCount<harmonicsCount && double(audibleCount+1)*increment<.5)
+        audibleCount++;
+    bool changed=(audibleCount!=audibleHarmonicsCount);
+    audibleHarmonicsCount=audibleCount;
+    for(uint h=0;h<harmonicsCount;h++)
+    {
+        if(harmonicsLevels[h]!=inputParameters[2+h] || harmonicsPhases[h]!=inputParameters[9+h])
+        {
+            harmonicsLevels[h]=inputParameters[2+h];
+            harmonicsPhases[h]=inputParameters[9+h];
+            changed=true;
+        }
+    }
+    if(changed)
+        wavetable.build(harmonicsLevels,audibleHarmonicsCount,harmonicsPhases);
 }
 
 DSP_EXPORT int getTailSize()
@@ -0,0 +1,524 @@
+#ifndef _AnalogOscillators_h_
+#define _AnalogOscillators_h_
+
+#include <math.h>
+#include <string.h>
+/** \file AnalogOscillators.h
+*   Band-limited "analog" oscillators (saw, square, triangle, pulse and hard sync) for c/c++ dsp scripting.
+*
+*   The naive waveforms are computed from the phase, and their discontinuities are corrected:
+*   - saw, square and pulse: PolyBLEP (polynomial band-limited step, on the sample before and after each jump).
+*   - triangle: PolyBLAMP (integrated PolyBLEP, for the changes of slope).
+*   - hard sync: the slave saw is reset at arbitrary positions by the master oscillator. Steps are corrected
+*     with a precomputed MinBLEP table (minimum phase band-limited step): the correction starts at the
+*     discontinuity, so that it does not have to be known one sample in advance.
+*
+*   An OscillatorBank renders a whole block for up to maxCount oscillators of the same shape. Oscillators
+*   are processed by groups of 8 (one lane per oscillator) with branchless computations, so that the
+*   compiler can vectorize them. Unlike BLIT, the cost does not depend on the number of harmonics and there
+*   is no division or table read per sample (except for hard sync steps).
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Oscillators
+    {
+        /** Oscillator shapes.
+        *
+        */
+        enum Shape
+        {
+            kSaw,
+            kSquare,
+            kTriangle,
+            kPulse, ///< variable pulse width (see OscillatorBank::setPulseWidth)
+            kSyncSaw ///< saw (slave) reset by a master oscillator at the note frequency (see OscillatorBank::setSyncRatio)
+        };
+
+        /** PolyBLEP residual of a unit upward step at phase 0 (band-limited step minus naive step), for a phase t
+        *   in [0;1[ and a phase increment dt (up to .5). invDt is 1/dt. Not null for the samples just before and
+        *   after the step only. Without branches, so that lanes can be computed in parallel.
+        */
+        inline double polyBlep(double t,double dt,double invDt)
+        {
+            const double after=(t<dt)?1.0:0.0;
+            const double before=(t>1.0-dt)?1.0:0.0;
+            const double xa=1.0-t*invDt; // 1 at the step, 0 one sample after
+            const double xb=1.0+(t-1.0)*invDt; // 0 one sample before the step, 1 at the step
+            return .5*(before*xb*xb-after*xa*xa);
+        }
+
+        /** PolyBLAMP residual of a unit change of slope (per sample) at phase 0 (integral of the PolyBLEP residual).
+        *   Same parameters as polyBlep.
+        */
+        inline double polyBlamp(double t,double dt,double invDt)
+        {
+            const double after=(t<dt)?1.0:0.0;
+            const double before=(t>1.0-dt)?1.0:0.0;
+            const double xa=1.0-t*invDt;
+            const double xb=1.0+(t-1.0)*invDt;
+            return (1.0/6.0)*(before*xb*xb*xb+after*xa*xa*xa);
+        }
+
+        /** Minimum phase band-limited step (MinBLEP), stored as the residual to add to a naive unit step:
+        *   the correction starts at the step and lasts kLength samples.
+        *   Computed once from a windowed sinc (minimum phase version obtained with the real cepstrum).
+        */
+        struct MinBlepTable
+        {
+            static const uint kZeroCrossings=8;
+            static const uint kOversampling=64; ///< table points per sample
+            static const uint kLength=2*kZeroCrossings; ///< samples affected by a step (power of two)
+
+            /// computes the table. Not for the audio thread (see getMinBlepTable).
+            MinBlepTable()
+            {
+                const uint pointsCount=kLength*kOversampling;
+                const uint fftSize=4*pointsCount;
+                array<double> re(fftSize);
+                array<double> im(fftSize);
+                const double pi=3.141592653589793238462;
+
+                // band-limited impulse: windowed sinc (Blackman window), centered
+                for(uint i=0;i<fftSize;i++)
+                {
+                    re[i]=0;
+                    im[i]=0;
+                }
+                for(uint i=0;i<pointsCount;i++)
+                {
+                    const double x=(double(i)-double(pointsCount/2))/double(kOversampling);
+                    const double sinc=(x==0)?1:sin(pi*x)/(pi*x);
+                    const double w=double(i)/double(pointsCount-1);
+                    re[i]=sinc*(.42-.5*cos(2*pi*w)+.08*cos(4*pi*w));
+                }
+
+                // real cepstrum: inverse transform of the log of the magnitude
+                fft(re.ptr,im.ptr,fftSize,false);
+                for(uint i=0;i<fftSize;i++)
+                {
+                    double magnitude=sqrt(re[i]*re[i]+im[i]*im[i]);
+                    if(magnitude<1e-50)
+                        magnitude=1e-50;
+                    re[i]=log(magnitude);
+                    im[i]=0;
+                }
+                fft(re.ptr,im.ptr,fftSize,true);
+
+                // minimum phase: fold the cepstrum (causal part only), then back to the time domain
+                for(uint i=1;i<fftSize/2;i++)
+                    re[i]*=2;
+                for(uint i=fftSize/2+1;i<fftSize;i++)
+                    re[i]=0;
+                for(uint i=0;i<fftSize;i++)
+                    im[i]=0;
+                fft(re.ptr,im.ptr,fftSize,false);
+                for(uint i=0;i<fftSize;i++)
+                {
+                    const double magnitude=exp(re[i]);
+                    const double phase=im[i];
+                    re[i]=magnitude*cos(phase);
+                    im[i]=magnitude*sin(phase);
+                }
+                fft(re.ptr,im.ptr,fftSize,true);
+
+                // step: integral of the impulse, normalized to 1, minus the naive step
+                double sum=0;
+                for(uint i=0;i<pointsCount;i++)
+                    sum+=re[i];
+                double step=0;
+                for(uint i=0;i<pointsCount;i++)
+                {
+                    step+=re[i];
+                    residuals[i]=step/sum-1;
+                }
+                // settled at the end (and guard point for interpolation)
+                residuals[pointsCount]=0;
+                residuals[pointsCount+1]=0;
+            }
+
+            /** Residual at x samples after the step (0 to kLength), linear interpolation.
+            *
+            */
+            double getResidual(double x)const
+            {
+                const double position=x*double(kOversampling);
+                const int index=int(position);
+                const double fraction=position-double(index);
+                return residuals[index]+fraction*(residuals[index+1]-residuals[index]);
+            }
+
+            /** Adds a step of the given height that occurred delay samples before the current sample (0 to 1) to a
+            *   ring buffer of kLength samples, starting at position (current sample). stride is the distance between
+            *   two samples in the buffer (buffers of several oscillators can be interleaved).
+            */
+            void addStep(double* ringBuffer,uint position,uint stride,double delay,double height)const
+            {
+                if(delay<0)
+                    delay=0;
+                if(delay>1)
+                    delay=1;
+                for(uint i=0;i<kLength;i++)
+                    ringBuffer[((position+i)&(kLength-1))*stride]+=height*getResidual(delay+double(i));
+            }
+
+            // private data
+        private:
+            double  residuals[kLength*kOversampling+2];
+
+            /// in place complex FFT (size is a power of two). The inverse transform is scaled by 1/size.
+            static void fft(double* re,double* im,uint size,bool inverse)
+            {
+                // bit reversal permutation
+                for(uint i=1,j=0;i<size;i++)
+                {
+                    uint bit=size>>1;
+                    for(;j&bit;bit>>=1)
+                        j^=bit;
+                    j^=bit;
+                    if(i<j)
+                    {
+                        double tmp=re[i];re[i]=re[j];re[j]=tmp;
+                        tmp=im[i];im[i]=im[j];im[j]=tmp;
+                    }
+                }
+                // butterflies
+                const double pi=3.141592653589793238462;
+                for(uint length=2;length<=size;length<<=1)
+                {
+                    const double angle=(inverse?2:-2)*pi/double(length);
+                    for(uint i=0;i<size;i+=length)
+                    {
+                        for(uint k=0;k<length/2;k++)
+                        {
+                            const double wr=cos(angle*double(k));
+                            const double wi=sin(angle*double(k));
+                            const uint a=i+k;
+                            const uint b=a+length/2;
+                            const double xr=re[b]*wr-im[b]*wi;
+                            const double xi=re[b]*wi+im[b]*wr;
+                            re[b]=re[a]-xr;
+                            im[b]=im[a]-xi;
+                            re[a]+=xr;
+                            im[a]+=xi;
+                        }
+                    }
+                }
+                if(inverse)
+                {
+                    const double scale=1.0/double(size);
+                    for(uint i=0;i<size;i++)
+                    {
+                        re[i]*=scale;
+                        im[i]*=scale;
+                    }
+                }
+            }
+        };
+
+        /// the MinBLEP table, computed on first use and shared by all the instances of the script.
+        inline const MinBlepTable& getMinBlepTable()
+        {
+            static const MinBlepTable table;
+            return table;
+        }
+
+        /** A set of oscillators of the same shape, rendered together (mono mix).
+        *   Oscillators are slots (0 to maxCount-1), typically indexed by voice. Their level is
+        *   ramped linearly during each render call, so that envelopes can be applied at control rate.
+        */
+        struct OscillatorBank
+        {
+            static const uint kLanes=8; ///< oscillators processed in parallel
+            static const uint kStepLength=MinBlepTable::kLength;
+
+            OscillatorBank(uint maxCount=0)
+            {
+                // MinBLEP table ready before the audio thread uses it
+                minBlep=&getMinBlepTable();
+                setMaxCount(maxCount);
+            }
+
+            /// allocates the oscillators (rounded up to a multiple of kLanes) and stops them. Not for the audio thread.
+            void setMaxCount(uint count)
+            {
+                count=(count+kLanes-1)/kLanes*kLanes;
+                phases.resize(count);
+                increments.resize(count);
+                inverseIncrements.resize(count);
+                levels.resize(count);
+                targetLevels.resize(count);
+                steps.resize(count*kStepLength);
+                reset();
+            }
+
+            uint get_maxCount()const
+            {
+                return phases.length;
+            }
+
+            /// stops all oscillators.
+            void reset()
+            {
+                for(uint i=0;i<phases.length;i++)
+                    stop(i);
+                stepsPosition=0;
+            }
+
+            void setShape(Shape iShape)
+            {
+                shape=iShape;
+            }
+
+            Shape get_shape()const
+            {
+                return shape;
+            }
+
+            /// pulse width of the kPulse shape (duty cycle, .01 to .99).
+            void setPulseWidth(double width)
+            {
+                if(width<.01)
+                    width=.01;
+                if(width>.99)
+                    width=.99;
+                pulseWidth=width;
+            }
+
+            /// frequency of the slave oscillator for the kSyncSaw shape, relative to the note (1 to 16).
+            void setSyncRatio(double ratio)
+            {
+                if(ratio<1)
+                    ratio=1;
+                if(ratio>16)
+                    ratio=16;
+                syncRatio=ratio;
+            }
+
+            /** Starts an oscillator at phase 0, silent: use setLevel to make it audible.
+            *   increment is the phase increment per sample (frequency/sampleRate).
+            */
+            void start(uint i,double increment)
+            {
+                phases[i]=0;
+                levels[i]=0;
+                targetLevels[i]=0;
+                setIncrement(i,increment);
+                const uint lane=i%kLanes;
+                double* ringBuffer=steps.ptr+(i-lane)*kStepLength+lane;
+                for(uint s=0;s<kStepLength;s++)
+                    ringBuffer[s*kLanes]=0;
+            }
+
+            /// changes the frequency of an oscillator (phase increment per sample, up to .5), keeping its phase.
+            void setIncrement(uint i,double increment)
+            {
+                if(increment<1e-6)
+                    increment=1e-6;
+                if(increment>.5)
+                    increment=.5;
+                increments[i]=increment;
+                inverseIncrements[i]=1.0/increment;
+            }
+
+            /// sets the level of an oscillator, reached at the end of the next render call (linear ramp).
+            void setLevel(uint i,double level)
+            {
+                targetLevels[i]=level;
+            }
+
+            /// stops an oscillator immediately.
+            void stop(uint i)
+            {
+                start(i,.01);
+            }
+
+            /** Adds samplesCount samples of all the oscillators to output.
+            *   Groups of kLanes oscillators that are all silent are skipped.
+            */
+            void render(double* output,uint samplesCount)
+            {
+                if(samplesCount==0)
+                    return;
+                for(uint first=0;first<phases.length;first+=kLanes)
+                {
+                    bool silent=true;
+                    for(uint l=0;l<kLanes && silent;l++)
+                        silent=(levels[first+l]==0 && targetLevels[first+l]==0);
+                    if(silent)
+                        continue;
+                    switch(shape)
+                    {
+                    case kSaw:
+                        renderGroup<kSaw>(first,output,samplesCount);
+                        break;
+                    case kSquare:
+                        renderGroup<kSquare>(first,output,samplesCount);
+                        break;
+                    case kTriangle:
+                        renderGroup<kTriangle>(first,output,samplesCount);
+                        break;
+                    case kPulse:
+                        renderGroup<kPulse>(first,output,samplesCount);
+                        break;
+                    case kSyncSaw:
+                        renderSyncGroup(first,output,samplesCount);
+                        break;
+                    }
+                }
+                stepsPosition=(stepsPosition+samplesCount)&(kStepLength-1);
+            }
+
+            // private data
+        private:
+            Shape   shape=kSaw;
+            double  pulseWidth=.5;
+            double  syncRatio=2;
+            const MinBlepTable* minBlep=null;
+
+            /// oscillators state (structure of arrays)
+            array<double>   phases; ///< in cycles, [0;1[
+            array<double>   increments;
+            array<double>   inverseIncrements;
+            array<double>   levels;
+            array<double>   targetLevels;
+            array<double>   steps; ///< MinBLEP ring buffers (hard sync), interleaved by group: [group][sample][lane]
+            uint            stepsPosition=0; ///< position of the current sample in the ring buffers
+
+            /// value of a PolyBLEP shape at phase t
+            template<Shape kShape>
+            static double getValue(double t,double dt,double invDt,double width)
+            {
+                if(kShape==kSaw)
+                    return 2*t-1-2*polyBlep(t,dt,invDt);
+                // second edge (falling step or top of the triangle)
+                double t2=t+1.0-width;
+                t2-=double(int(t2));
+                if(kShape==kTriangle)
+                {
+                    const double naive=1-4*fabs(t-.5);
+                    return naive+8*dt*(polyBlamp(t,dt,invDt)-polyBlamp(t2,dt,invDt));
+                }
+                // pulse, centered (no DC offset)
+                const double naive=((t<width)?1.0:-1.0)-(2*width-1);
+                return naive+2*(polyBlep(t,dt,invDt)-polyBlep(t2,dt,invDt));
+            }
+
+            /// adds samplesCount samples of oscillators [first;first+kLanes[ to output (PolyBLEP shapes)
+            template<Shape kShape>
+            void renderGroup(uint first,double* output,uint samplesCount)
+            {
+                const double width=(kShape==kPulse)?pulseWidth:.5;
+                // local copy of the state (kept in registers)
+                double t[kLanes],dt[kLanes],invDt[kLanes],level[kLanes],levelStep[kLanes];
+                for(uint l=0;l<kLanes;l++)
+                {
+                    t[l]=phases[first+l];
+                    dt[l]=increments[first+l];
+                    invDt[l]=inverseIncrements[first+l];
+                    level[l]=levels[first+l];
+                    levelStep[l]=(targetLevels[first+l]-level[l])/double(samplesCount);
+                }
+                for(uint i=0;i<samplesCount;i++)
+                {
+                    // independent lanes (computed in parallel), then mixed
+                    double y[kLanes];
+                    for(uint l=0;l<kLanes;l++)
+                    {
+                        level[l]+=levelStep[l];
+                        y[l]=level[l]*getValue<kShape>(t[l],dt[l],invDt[l],width);
+                        double tl=t[l]+dt[l];
+                        tl-=double(int(tl));
+                        t[l]=tl;
+                    }
+                    double sum=0;
+                    for(uint l=0;l<kLanes;l++)
+                        sum+=y[l];
+                    output[i]+=sum;
+                }
+                for(uint l=0;l<kLanes;l++)
+                {
+                    phases[first+l]=t[l];
+                    levels[first+l]=targetLevels[first+l];
+                }
+            }
+
+            /** adds samplesCount samples of oscillators [first;first+kLanes[ to output (hard sync).
+            *   The phase is the phase of the master oscillator: the slave saw is 2*frac(ratio*phase)-1.
+            */
+            void renderSyncGroup(uint first,double* output,uint samplesCount)
+            {
+                const double ratio=syncRatio;
+                // step when the master resets the slave (-2 if the slave also ends its cycle)
+                const double resetHeight=-2*(ratio-ceil(ratio)+1);
+                double* ringBuffer=steps.ptr+first*kStepLength;
+                double t[kLanes],dt[kLanes],level[kLanes],levelStep[kLanes];
+                for(uint l=0;l<kLanes;l++)
+                {
+                    t[l]=phases[first+l];
+                    dt[l]=increments[first+l];
+                    level[l]=levels[first+l];
+                    levelStep[l]=(targetLevels[first+l]-level[l])/double(samplesCount);
+                }
+                uint position=stepsPosition;
+                for(uint i=0;i<samplesCount;i++)
+                {
+                    double* corrections=ringBuffer+position*kLanes;
+                    double next[kLanes],y[kLanes];
+                    for(uint l=0;l<kLanes;l++)
+                    {
+                        level[l]+=levelStep[l];
+                        double slave=ratio*t[l];
+                        slave-=double(int(slave));
+                        y[l]=level[l]*(2*slave-1+corrections[l]);
+                        corrections[l]=0;
+                        next[l]=t[l]+dt[l];
+                    }
+                    double sum=0;
+                    for(uint l=0;l<kLanes;l++)
+                        sum+=y[l];
+                    output[i]+=sum;
+                    position=(position+1)&(kStepLength-1);
+
+                    // steps before the next sample (rare: not vectorized)
+                    for(uint l=0;l<kLanes;l++)
+                    {
+                        if(next[l]>=1 || int(ratio*next[l])!=int(ratio*t[l]))
+                            addSyncSteps(ringBuffer+l,position,t[l],dt[l],inverseIncrements[first+l],ratio,resetHeight);
+                    }
+                    for(uint l=0;l<kLanes;l++)
+                        t[l]=next[l]-double(int(next[l]));
+                }
+                for(uint l=0;l<kLanes;l++)
+                {
+                    phases[first+l]=t[l];
+                    levels[first+l]=targetLevels[first+l];
+                }
+            }
+
+            /** adds the steps of the slave saw between master phases t0 and t0+dt (unwrapped, the next sample) to a
+            *   ring buffer, starting at the next sample: ends of the slave cycles and reset by the master.
+            */
+            void addSyncSteps(double* ringBuffer,uint position,double t0,double dt,double invDt,double ratio,double resetHeight)const
+            {
+                const double end=t0+dt;
+                // end of the slave cycles in the current master cycle
+                const double cycleEnd=(end<1)?end:1;
+                for(double k=floor(ratio*t0)+1;k<ratio && k<=ratio*cycleEnd;k++)
+                    minBlep->addStep(ringBuffer,position,kLanes,(end-k/ratio)*invDt,-2);
+                if(end>=1)
+                {
+                    // reset by the master, then slave cycles in the new master cycle
+                    minBlep->addStep(ringBuffer,position,kLanes,(end-1)*invDt,resetHeight);
+                    for(double k=1;k<ratio && k<=ratio*(end-1);k++)
+                        minBlep->addStep(ringBuffer,position,kLanes,(end-1-k/ratio)*invDt,-2);
+                }
+            }
+        };
+    }
+}
+#endif
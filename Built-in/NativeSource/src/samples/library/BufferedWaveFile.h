@@ -0,0 +1,750 @@
+#ifndef _BufferedWaveFile_h_
+#define _BufferedWaveFile_h_
+
+#include "WaveFile.h"
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+/**
+ *  \file BufferedWaveFile.h
+ *  Wave file streaming from a background thread, for c++ scripting.
+ *
+ *  Created by Blue Cat Audio <services@bluecataudio.com>
+ *  \copyright 2014 Blue Cat Audio. All rights reserved.
+ *
+ *  Unlike the simple classes of WaveFile.h, file access never happens in the audio thread:
+ *  a worker thread reads or writes the file by large chunks, and exchanges audio data with the
+ *  audio thread through a lock-free ring buffer (single producer, single consumer).
+ *
+ *  - BufferedWaveFileReader: stream a wave file from disk, with prefetching.
+ *  - BufferedWaveFileWriter: record a wave file to disk, writing from a background thread.
+ */
+
+/** Wave file reader with a background prefetch thread.
+ *   Call start() from initialize() and stop() from shutdown(). Then openFile(), closeFile()
+ *   and read() can be called from the audio thread: they never wait for the worker thread,
+ *   allocate memory or access the file. If the worker thread cannot keep up, read() returns
+ *   silence for the missing samples and increments the underruns count.
+ *   Note: does not handle resampling.
+ */
+struct BufferedWaveFileReader
+{
+    static const uint kMaxPathLength=2048;
+    static const uint kMaxReadAttempts=16; ///< consistent reads of the file positions before giving up for this block
+
+    /** Allocates the ring buffer and starts the worker thread.
+     *   channelsCount is the number of channels delivered by read() (extra file channels are ignored,
+     *   missing channels are silent). bufferSize is the size of the ring buffer in samples (rounded up to
+     *   a power of two): the longest stall of the file system that can be absorbed. chunkSize is the number
+     *   of samples read from the file at once.
+     */
+    bool start(uint iChannelsCount,uint bufferSize,uint iChunkSize=4096)
+    {
+        stop();
+        channelsCount=iChannelsCount;
+        chunkSize=iChunkSize;
+        capacity=1;
+        while(capacity<bufferSize || capacity<2*chunkSize)
+            capacity*=2;
+        ring.assign(size_t(capacity)*channelsCount,0);
+        writePos.store(0);
+        readPos.store(0);
+        generation.store(0);
+        generationStart.store(0);
+        generationEnd.store(0);
+        fileChannelsCount.store(0);
+        underrunsCount.store(0);
+        requestState.store(kIdle);
+        hasNextRequest=false;
+        readGeneration=0;
+        receivedData=false;
+        running.store(true);
+        worker=std::thread(&BufferedWaveFileReader::run,this);
+        return true;
+    }
+
+    /** Stops the worker thread and closes the file.
+     *
+     */
+    void stop()
+    {
+        if(worker.joinable())
+        {
+            running.store(false);
+            worker.join();
+        }
+        f.close();
+    }
+
+    ~BufferedWaveFileReader()
+    {
+        stop();
+    }
+
+    /** Requests the worker thread to open a file and start streaming it (from the beginning).
+     *   Audio data is available after the worker has opened the file and decoded the first chunk.
+     *   Safe to call from the audio thread (the path is copied to a preallocated buffer).
+     */
+    void openFile(const std::string& filePath,bool iLoop=true)
+    {
+        nextRequest.type=kOpen;
+        nextRequest.loop=iLoop;
+        size_t length=filePath.length();
+        if(length>=kMaxPathLength)
+            length=kMaxPathLength-1;
+        memcpy(nextRequest.path,filePath.c_str(),length);
+        nextRequest.path[length]=0;
+        hasNextRequest=true;
+        postRequest();
+    }
+
+    /** Requests the worker thread to close the file. read() returns silence from now on.
+     *   Safe to call from the audio thread.
+     */
+    void closeFile()
+    {
+        nextRequest.type=kClose;
+        hasNextRequest=true;
+        postRequest();
+    }
+
+    /** Copies the next samplesCount samples of the file to samples[ch][i], for iChannelsCount channels.
+     *   Returns the number of samples read from the file. The remaining samples are set to zero
+     *   (end of file, file not opened yet, or underrun if the worker thread could not keep up).
+     *   Wait-free: call it from the audio thread. For offline rendering only (see BlockData::offlineRenderingMode),
+     *   waitForData makes it wait for the worker thread instead of returning silence.
+     */
+    uint read(double** samples,uint iChannelsCount,uint samplesCount,bool waitForData=false)
+    {
+        postRequest();
+        uint64 available=0;
+        uint64 position=readPos.load(std::memory_order_relaxed);
+        bool ended=getAvailable(samplesCount,position,available);
+        if(waitForData)
+        {
+            // wait for pending requests and data (with a timeout, in case the file system hangs)
+            for(int i=0;i<10000 && (hasNextRequest || requestState.load(std::memory_order_acquire)!=kIdle || (available<samplesCount && !ended));i++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                postRequest();
+                ended=getAvailable(samplesCount,position,available);
+            }
+        }
+
+        uint toCopy=(available<samplesCount)?uint(available):samplesCount;
+        uint channels=(iChannelsCount<channelsCount)?iChannelsCount:channelsCount;
+        const uint64 mask=capacity-1;
+        for(uint i=0;i<toCopy;i++)
+        {
+            const double* frame=&ring[size_t((position+i)&mask)*channelsCount];
+            for(uint ch=0;ch<channels;ch++)
+                samples[ch][i]=frame[ch];
+        }
+        for(uint ch=0;ch<iChannelsCount;ch++)
+        {
+            uint i=(ch<channels)?toCopy:0;
+            for(;i<samplesCount;i++)
+                samples[ch][i]=0;
+        }
+        if(toCopy!=0)
+            receivedData=true;
+        else if(samplesCount!=0 && !receivedData)
+            ended=true; // still opening: not an underrun
+        if(toCopy<samplesCount && !ended)
+            underrunsCount.fetch_add(1,std::memory_order_relaxed);
+
+        readPos.store(position+toCopy,std::memory_order_release);
+        return toCopy;
+    }
+
+    /** Number of channels of the current file (0 if no file or failed to open).
+     *
+     */
+    uint get_fileChannelsCount()const
+    {
+        return fileChannelsCount.load(std::memory_order_relaxed);
+    }
+
+    /** Number of times read() could not deliver all samples because the worker thread was late.
+     *
+     */
+    uint get_underrunsCount()const
+    {
+        return underrunsCount.load(std::memory_order_relaxed);
+    }
+
+    /** Ratio of the ring buffer filled with audio data waiting to be read (0 to 1).
+     *
+     */
+    double get_fillRatio()const
+    {
+        uint64 written=writePos.load(std::memory_order_relaxed);
+        uint64 position=readPos.load(std::memory_order_relaxed);
+        return (written>position)?double(written-position)/double(capacity):0;
+    }
+
+    // private data
+private:
+    enum RequestType
+    {
+        kOpen,
+        kClose
+    };
+    enum RequestState
+    {
+        kIdle, // the worker is ready for a new request
+        kWriting, // the audio thread is filling the request
+        kPending // request ready for the worker
+    };
+    struct Request
+    {
+        RequestType type=kClose;
+        bool        loop=true;
+        char        path[kMaxPathLength];
+    };
+
+    /* audio thread: updates the read position and number of samples available for the current file.
+     *  Returns true if the end of the file (or no file) will be reached within samplesCount samples.
+     */
+    bool getAvailable(uint samplesCount,uint64& position,uint64& available)
+    {
+        // which file does the ring contain? generation is a seqlock (odd while the worker changes the file):
+        // retry if it was odd or changed while reading, so that start and end always belong to the same file
+        available=0;
+        uint gen=0;
+        uint64 start=0;
+        uint64 written=0;
+        uint64 end=0;
+        for(uint attempt=0;;attempt++)
+        {
+            if(attempt==kMaxReadAttempts)
+                return true; // the worker is changing the file: no data for now
+            gen=generation.load(std::memory_order_acquire);
+            if(gen&1)
+                continue;
+            start=generationStart.load(std::memory_order_relaxed);
+            written=writePos.load(std::memory_order_acquire);
+            end=generationEnd.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(gen==generation.load(std::memory_order_relaxed))
+                break;
+        }
+        if(gen!=readGeneration)
+        {
+            // new file: skip the end of the previous one
+            readGeneration=gen;
+            receivedData=false;
+            position=start;
+            readPos.store(position,std::memory_order_release);
+        }
+        if(end<written)
+            written=end;
+        if(written>position)
+            available=written-position;
+        return end<=position+samplesCount;
+    }
+
+    // audio thread: hands the next request over to the worker if it is ready to accept it
+    void postRequest()
+    {
+        if(hasNextRequest)
+        {
+            int expected=kIdle;
+            if(requestState.compare_exchange_strong(expected,kWriting,std::memory_order_acquire))
+            {
+                request=nextRequest;
+                requestState.store(kPending,std::memory_order_release);
+                hasNextRequest=false;
+            }
+        }
+    }
+
+    // worker thread: starts a new generation of audio data in the ring
+    void beginGeneration(uint channels,bool ended)
+    {
+        uint64 position=writePos.load(std::memory_order_relaxed);
+        generation.fetch_add(1,std::memory_order_relaxed); // odd: being changed
+        std::atomic_thread_fence(std::memory_order_release);
+        fileChannelsCount.store(channels,std::memory_order_relaxed);
+        generationStart.store(position,std::memory_order_relaxed);
+        generationEnd.store(ended?position:~uint64(0),std::memory_order_relaxed);
+        generation.fetch_add(1,std::memory_order_release); // even: consistent
+    }
+
+    // worker thread: opens the requested file
+    void openRequestedFile(const Request& r)
+    {
+        f.close();
+        loop=r.loop;
+        filePos=0;
+        bool ok=false;
+        header=WaveFileHeader();
+        if(f.open(r.path,"r")>=0 && header.read(f) && header.channelsCount>0 && header.bytesPerSample>0)
+        {
+            bytesPerFrame=header.channelsCount*header.bytesPerSample;
+            format=KittyDSP::Pcm::getSampleFormat(header.bytesPerSample,header.get_isFloat());
+            // not in the audio thread: allocation is fine
+            chunk.resize(size_t(bytesPerFrame)*chunkSize);
+            decodedChunk.resize(size_t(header.channelsCount)*chunkSize);
+            ok=(format!=KittyDSP::Pcm::kUnsupportedFormat && f.setPos(header.headerSize)>=0);
+        }
+        if(!ok)
+            f.close();
+        beginGeneration(ok?header.channelsCount:0,!ok);
+    }
+
+    // worker thread: reads and decodes one chunk into the ring, if there is room. Returns false if nothing was done.
+    bool fillChunk()
+    {
+        if(f.f==null)
+            return false;
+        uint64 position=writePos.load(std::memory_order_relaxed);
+        uint64 freeFrames=capacity-(position-readPos.load(std::memory_order_acquire));
+        if(freeFrames<chunkSize)
+            return false;
+        if(filePos>=header.samplesCount)
+        {
+            if(loop && header.samplesCount>0 && f.setPos(header.headerSize)>=0)
+                filePos=0;
+            else
+            {
+                // end of file
+                f.close();
+                generationEnd.store(position,std::memory_order_relaxed);
+                writePos.store(position,std::memory_order_release);
+                return false;
+            }
+        }
+        uint64 frames=header.samplesCount-filePos;
+        if(frames>chunkSize)
+            frames=chunkSize;
+        frames=fread(&chunk[0],bytesPerFrame,size_t(frames),f.f);
+        if(frames==0)
+        {
+            // truncated file
+            filePos=header.samplesCount;
+            return true;
+        }
+        filePos+=frames;
+        if(filePos>=header.samplesCount && !loop)
+            generationEnd.store(position+frames,std::memory_order_relaxed); // published with writePos below
+
+        // decode the entire chunk at once, then copy to the ring
+        KittyDSP::Pcm::toDouble(format,&chunk[0],&decodedChunk[0],size_t(frames*header.channelsCount));
+        const uint channels=(header.channelsCount<channelsCount)?header.channelsCount:channelsCount;
+        const uint64 mask=capacity-1;
+        for(uint64 i=0;i<frames;i++)
+        {
+            const double* src=&decodedChunk[size_t(i*header.channelsCount)];
+            double* frame=&ring[size_t((position+i)&mask)*channelsCount];
+            for(uint ch=0;ch<channels;ch++)
+                frame[ch]=src[ch];
+            for(uint ch=channels;ch<channelsCount;ch++)
+                frame[ch]=0;
+        }
+        writePos.store(position+frames,std::memory_order_release);
+        return true;
+    }
+
+    // worker thread main loop
+    void run()
+    {
+        while(running.load(std::memory_order_relaxed))
+        {
+            if(requestState.load(std::memory_order_acquire)==kPending)
+            {
+                // the request stays pending until the new generation is published, so that
+                // read(waitForData) never sees the end of the previous file as the end of this one
+                if(request.type==kOpen)
+                    openRequestedFile(request);
+                else
+                {
+                    f.close();
+                    beginGeneration(0,true);
+                }
+                requestState.store(kIdle,std::memory_order_release);
+            }
+            if(!fillChunk())
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    // configuration (set by start)
+    uint                channelsCount=0;
+    uint                chunkSize=0;
+    uint64              capacity=1;
+
+    // ring buffer (interleaved samples), written by the worker, read by the audio thread
+    std::vector<double> ring;
+    std::atomic<uint64> writePos{0};
+    std::atomic<uint64> readPos{0};
+    std::atomic<uint>   generation{0}; // seqlock: incremented before and after a file is opened or closed
+    std::atomic<uint64> generationStart{0}; // position of the first sample of the current file in the ring
+    std::atomic<uint64> generationEnd{0}; // position after the last sample of the current file (when known)
+    std::atomic<uint>   fileChannelsCount{0};
+    std::atomic<uint>   underrunsCount{0};
+
+    // requests from the audio thread
+    std::atomic<int>    requestState{kIdle};
+    Request             request;
+    Request             nextRequest; // not posted yet (worker busy)
+    bool                hasNextRequest=false;
+
+    // audio thread state
+    uint                readGeneration=0;
+    bool                receivedData=false;
+
+    // worker thread state
+    std::thread         worker;
+    std::atomic<bool>   running{false};
+    file                f;
+    WaveFileHeader      header;
+    std::vector<uint8>  chunk;
+    std::vector<double> decodedChunk;
+    KittyDSP::Pcm::SampleFormat format=KittyDSP::Pcm::kUnsupportedFormat;
+    uint                bytesPerFrame=0;
+    uint64              filePos=0;
+    bool                loop=true;
+};
+
+/** Wave file writer with a background writing thread.
+ *   Call start() from initialize() and stop() from shutdown(). Then openFile(), closeFile() and write()
+ *   can be called from the audio thread: they only copy data to preallocated buffers, and the worker
+ *   thread encodes the audio data and writes it to disk. If the worker thread cannot keep up, write()
+ *   drops the entire block and increments the dropped blocks count: the dropped blocks are recorded as
+ *   silence once there is room again, so that the file stays aligned with the session. The header of the file is
+ *   updated periodically, so that the recording can be recovered if the application crashes.
+ *   Note: does not handle resampling.
+ */
+struct BufferedWaveFileWriter
+{
+    static const uint kMaxPathLength=2048;
+    static const uint kMaxRequests=4;
+
+    /** Allocates the ring buffer and starts the worker thread.
+     *   channelsCount is the number of channels of the recorded files. bufferSize is the size of the
+     *   ring buffer in samples (rounded up to a power of two): the longest stall of the file system that
+     *   can be absorbed. chunkSize is the number of samples written to the file at once, and
+     *   headerUpdatePeriod the time between two updates of the header, in milliseconds.
+     */
+    bool start(uint iChannelsCount,uint bufferSize,uint iChunkSize=4096,uint iHeaderUpdatePeriod=1000)
+    {
+        stop();
+        channelsCount=iChannelsCount;
+        chunkSize=iChunkSize;
+        headerUpdatePeriod=iHeaderUpdatePeriod;
+        capacity=1;
+        while(capacity<bufferSize || capacity<2*chunkSize)
+            capacity*=2;
+        ring.assign(size_t(capacity)*channelsCount,0);
+        encodedChunk.resize(size_t(chunkSize)*channelsCount*sizeof(double));
+        silence.assign(size_t(chunkSize)*channelsCount,0);
+        writePos.store(0);
+        readPos.store(0);
+        requestsWritten.store(0);
+        requestsRead.store(0);
+        droppedBlocksCount.store(0);
+        fileOpened=false;
+        droppedFrames=0;
+        running.store(true);
+        worker=std::thread(&BufferedWaveFileWriter::run,this);
+        return true;
+    }
+
+    /** Stops the worker thread, after it has written all pending audio data and closed the file.
+     *
+     */
+    void stop()
+    {
+        if(worker.joinable())
+        {
+            running.store(false);
+            worker.join();
+        }
+        fileOpened=false;
+    }
+
+    ~BufferedWaveFileWriter()
+    {
+        stop();
+    }
+
+    /** Requests the worker thread to create a new file (closing the current one), that will contain
+     *   the audio data passed to write() from now on. bytesPerSample is 1, 2 or 3 for integer files,
+     *   4 or 8 for floating point files.
+     *   Safe to call from the audio thread (the path is copied to a preallocated buffer).
+     *   Returns false if too many requests are pending.
+     */
+    bool openFile(const std::string& filePath,uint64 sampleRate,uint bytesPerSample)
+    {
+        postDroppedFrames();
+        Request* r=beginRequest();
+        if(r==null)
+            return false;
+        r->type=kOpen;
+        r->sampleRate=sampleRate;
+        r->bytesPerSample=bytesPerSample;
+        size_t length=filePath.length();
+        if(length>=kMaxPathLength)
+            length=kMaxPathLength-1;
+        memcpy(r->path,filePath.c_str(),length);
+        r->path[length]=0;
+        endRequest();
+        fileOpened=true;
+        return true;
+    }
+
+    /** Requests the worker thread to close the file, once all the audio data written before
+     *   has been written to disk. Safe to call from the audio thread.
+     */
+    bool closeFile()
+    {
+        postDroppedFrames();
+        Request* r=beginRequest();
+        if(r==null)
+            return false;
+        r->type=kClose;
+        endRequest();
+        fileOpened=false;
+        return true;
+    }
+
+    /** Appends samplesCount samples (samples[ch][i], for iChannelsCount channels) to the current file.
+     *   Missing channels are recorded as silence. Returns false if no file is opened or if the block was
+     *   dropped because the buffer is full (it is then recorded as silence, before the next block written).
+     *   Wait-free: call it from the audio thread. For offline rendering only (see BlockData::offlineRenderingMode),
+     *   waitForSpace makes it wait for the worker thread instead of dropping the block.
+     */
+    bool write(double** samples,uint iChannelsCount,uint samplesCount,bool waitForSpace=false)
+    {
+        if(!fileOpened)
+            return false;
+        uint64 position=writePos.load(std::memory_order_relaxed);
+        uint64 freeFrames=capacity-(position-readPos.load(std::memory_order_acquire));
+        if(waitForSpace && samplesCount<=capacity)
+        {
+            // (with a timeout, in case the file system hangs)
+            for(int i=0;i<10000 && freeFrames<samplesCount;i++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                freeFrames=capacity-(position-readPos.load(std::memory_order_acquire));
+            }
+        }
+        if(freeFrames<samplesCount || !postDroppedFrames())
+        {
+            droppedFrames+=samplesCount;
+            droppedBlocksCount.fetch_add(1,std::memory_order_relaxed);
+            return false;
+        }
+
+        uint channels=(iChannelsCount<channelsCount)?iChannelsCount:channelsCount;
+        const uint64 mask=capacity-1;
+        for(uint i=0;i<samplesCount;i++)
+        {
+            double* frame=&ring[size_t((position+i)&mask)*channelsCount];
+            for(uint ch=0;ch<channels;ch++)
+                frame[ch]=samples[ch][i];
+            for(uint ch=channels;ch<channelsCount;ch++)
+                frame[ch]=0;
+        }
+        writePos.store(position+samplesCount,std::memory_order_release);
+        return true;
+    }
+
+    /** Number of blocks that could not be recorded because the worker thread was late.
+     *
+     */
+    uint get_droppedBlocksCount()const
+    {
+        return droppedBlocksCount.load(std::memory_order_relaxed);
+    }
+
+    /** Ratio of the ring buffer filled with audio data waiting to be written (0 to 1).
+     *
+     */
+    double get_fillRatio()const
+    {
+        uint64 written=writePos.load(std::memory_order_relaxed);
+        uint64 position=readPos.load(std::memory_order_relaxed);
+        return (written>position)?double(written-position)/double(capacity):0;
+    }
+
+    // private data
+private:
+    enum RequestType
+    {
+        kOpen,
+        kClose,
+        kSilence
+    };
+    struct Request
+    {
+        RequestType type=kClose;
+        uint64      position=0; // position in the ring when the request was made
+        uint64      silenceFrames=0; // frames of silence to write (dropped blocks)
+        uint64      sampleRate=0;
+        uint        bytesPerSample=0;
+        char        path[kMaxPathLength];
+    };
+
+    // audio thread: returns the next free request slot (or null if the queue is full)
+    Request* beginRequest()
+    {
+        uint index=requestsWritten.load(std::memory_order_relaxed);
+        if(index-requestsRead.load(std::memory_order_acquire)>=kMaxRequests)
+            return null;
+        Request* r=&requests[index%kMaxRequests];
+        r->position=writePos.load(std::memory_order_relaxed);
+        return r;
+    }
+
+    // audio thread: hands the request over to the worker
+    void endRequest()
+    {
+        requestsWritten.fetch_add(1,std::memory_order_release);
+    }
+
+    /* audio thread: requests the worker to write the frames dropped since the last block written, as silence
+     *  at the current position. Returns false if the queue is full (the frames remain pending).
+     */
+    bool postDroppedFrames()
+    {
+        if(droppedFrames==0)
+            return true;
+        Request* r=beginRequest();
+        if(r==null)
+            return false;
+        r->type=kSilence;
+        r->silenceFrames=droppedFrames;
+        endRequest();
+        droppedFrames=0;
+        return true;
+    }
+
+    // worker thread: executes a request
+    void execute(const Request& r)
+    {
+        if(r.type==kSilence)
+        {
+            if(writer.f.f==null)
+                return;
+            KittyDSP::Pcm::fromDouble(format,&silence[0],&encodedChunk[0],silence.size());
+            const size_t bytesPerFrame=size_t(writer.header.bytesPerSample)*channelsCount;
+            for(uint64 written=0;written<r.silenceFrames;written+=chunkSize)
+            {
+                uint64 frames=r.silenceFrames-written;
+                if(frames>chunkSize)
+                    frames=chunkSize;
+                writer.header.samplesCount+=fwrite(&encodedChunk[0],bytesPerFrame,size_t(frames),writer.f.f);
+            }
+            return;
+        }
+        writer.close();
+        if(r.type==kOpen)
+        {
+            writer.header.channelsCount=channelsCount;
+            writer.header.sampleRate=r.sampleRate;
+            writer.header.bytesPerSample=r.bytesPerSample;
+            format=KittyDSP::Pcm::getSampleFormat(r.bytesPerSample,r.bytesPerSample>=4);
+            if(format==KittyDSP::Pcm::kUnsupportedFormat || !writer.openFile(r.path))
+                writer.close();
+            lastHeaderUpdate=std::chrono::steady_clock::now();
+        }
+    }
+
+    // worker thread: executes the next request or writes one chunk to the file. Returns false if nothing was done.
+    bool writeChunk()
+    {
+        uint64 position=readPos.load(std::memory_order_relaxed);
+        uint64 end=writePos.load(std::memory_order_acquire);
+
+        // requests are executed once the audio data that preceded them has been written
+        uint index=requestsRead.load(std::memory_order_relaxed);
+        if(index!=requestsWritten.load(std::memory_order_acquire))
+        {
+            const Request& r=requests[index%kMaxRequests];
+            if(r.position<=position)
+            {
+                execute(r);
+                requestsRead.store(index+1,std::memory_order_release);
+                return true;
+            }
+            if(end>r.position)
+                end=r.position;
+        }
+        if(end<=position)
+            return false;
+
+        uint64 frames=end-position;
+        if(frames>chunkSize)
+            frames=chunkSize;
+        if(writer.f.f!=null)
+        {
+            // encode the chunk (in two parts if it wraps around the end of the ring)
+            const uint64 mask=capacity-1;
+            const size_t bytesPerFrame=size_t(writer.header.bytesPerSample)*channelsCount;
+            uint64 start=position&mask;
+            uint64 firstPart=capacity-start;
+            if(firstPart>frames)
+                firstPart=frames;
+            KittyDSP::Pcm::fromDouble(format,&ring[size_t(start)*channelsCount],&encodedChunk[0],size_t(firstPart*channelsCount));
+            if(frames>firstPart)
+                KittyDSP::Pcm::fromDouble(format,&ring[0],&encodedChunk[size_t(firstPart)*bytesPerFrame],size_t((frames-firstPart)*channelsCount));
+            writer.header.samplesCount+=fwrite(&encodedChunk[0],bytesPerFrame,size_t(frames),writer.f.f);
+        }
+        readPos.store(position+frames,std::memory_order_release);
+        return true;
+    }
+
+    // worker thread main loop
+    void run()
+    {
+        while(running.load(std::memory_order_relaxed))
+        {
+            if(!writeChunk())
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            if(writer.f.f!=null && std::chrono::steady_clock::now()-lastHeaderUpdate>=std::chrono::milliseconds(headerUpdatePeriod))
+            {
+                writer.flushHeader();
+                lastHeaderUpdate=std::chrono::steady_clock::now();
+            }
+        }
+        // write pending data and execute pending requests before exiting
+        while(writeChunk())
+        {}
+        writer.close();
+    }
+
+    // configuration (set by start)
+    uint                channelsCount=0;
+    uint                chunkSize=0;
+    uint                headerUpdatePeriod=1000;
+    uint64              capacity=1;
+
+    // ring buffer (interleaved samples), written by the audio thread, read by the worker
+    std::vector<double> ring;
+    std::atomic<uint64> writePos{0};
+    std::atomic<uint64> readPos{0};
+    std::atomic<uint>   droppedBlocksCount{0};
+
+    // requests queue (single producer, single consumer)
+    Request             requests[kMaxRequests];
+    std::atomic<uint>   requestsWritten{0};
+    std::atomic<uint>   requestsRead{0};
+
+    // audio thread state
+    bool                fileOpened=false;
+    uint64              droppedFrames=0; // dropped since the last block written, not requested as silence yet
+
+    // worker thread state
+    std::thread         worker;
+    std::atomic<bool>   running{false};
+    WaveFileWriter      writer;
+    std::vector<uint8>  encodedChunk;
+    std::vector<double> silence; // one chunk of silence, encoded when dropped blocks are written
+    KittyDSP::Pcm::SampleFormat format=KittyDSP::Pcm::kUnsupportedFormat;
+    std::chrono::steady_clock::time_point lastHeaderUpdate;
+};
+#endif
@@ -0,0 +1,559 @@
+#ifndef _Dynamics_h_
+#define _Dynamics_h_
+
+#include <math.h>
+#include "FastMath.h"
+/** \file Dynamics.h
+*   Multichannel look-ahead compressor/limiter engine (c/c++ dsp scripting).
+*
+*   Blocks are processed by chunks of samples, in stages that each run over a whole chunk:
+*   - detection: absolute values (peak) or squares (RMS) of each channel, then the maximum over a
+*     sliding window as long as the look-ahead (monotonic deque, O(1) per sample), or the mean over
+*     the RMS window (running sum).
+*   - linking: the level of each channel moves towards the highest level of all channels. Fully
+*     linked channels share a single gain computer.
+*   - gain computer: levels are converted to dB, and the gain reduction of the soft knee curve is
+*     computed without branches, so that the compiler can vectorize these loops (see FastMath.h).
+*   - smoothing: attack and release in the dB domain (the only loop that depends on the previous
+*     sample), then a moving average as long as the look-ahead. Together with the sliding maximum,
+*     the average reaches the gain reduction of a peak when the peak leaves the delay line: peaks
+*     are caught even with an immediate attack.
+*   - the gains (reduction and make up) are applied to the delayed audio.
+*
+*   The latency is the look-ahead, in samples. Memories are allocated by setup() for the longest
+*   look-ahead and RMS window: changing them later does not allocate memory. The delay line and the
+*   moving average always keep the history of the longest look-ahead, so that the look-ahead can be
+*   changed (automated) without clearing them.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Dynamics
+    {
+        /** Level detection modes.
+        *
+        */
+        enum Detection
+        {
+            kPeakDetection,
+            kRmsDetection
+        };
+
+        static const uint kChunkSize=64; ///< samples processed by each stage at once
+        static const uint kGroupSize=8; ///< samples computed in parallel by the vectorized stages
+        static const double kMinKnee=.01; ///< narrowest knee (dB): avoids dividing by zero
+
+        /** Look-ahead compressor for several channels.
+        *
+        */
+        struct Compressor
+        {
+            /** Allocates the memories (not for the audio thread): maximum look-ahead and RMS window lengths in
+            *   samples.
+            */
+            void setup(uint iChannelsCount,uint iMaxLookAhead,uint iMaxRmsLength)
+            {
+                channelsCount=iChannelsCount;
+                windowStride=iMaxLookAhead+1;
+                rmsStride=(iMaxRmsLength>0)?iMaxRmsLength:1;
+                delayLines.resize(channelsCount*windowStride);
+                dequeValues.resize(channelsCount*windowStride);
+                dequePositions.resize(channelsCount*windowStride);
+                averageLines.resize(channelsCount*windowStride);
+                rmsLines.resize(channelsCount*rmsStride);
+                levels.resize(channelsCount*kChunkSize);
+                gains.resize(channelsCount*kChunkSize);
+                states.resize(channelsCount);
+                if(lookAhead>iMaxLookAhead)
+                    lookAhead=iMaxLookAhead;
+                if(rmsLength>rmsStride)
+                    rmsLength=rmsStride;
+                reset();
+            }
+
+            uint get_channelsCount()const
+            {
+                return channelsCount;
+            }
+
+            /** Sets the curve of the gain computer: threshold (dB), ratio (1 or more, 0 for infinity: limiter)
+            *   and width of the soft knee (dB, 0 for a hard knee).
+            */
+            void setCurve(double thresholdDb,double ratio,double kneeDb)
+            {
+                threshold=thresholdDb;
+                slope=(ratio>=1)?(1/ratio-1):-1;
+                knee=(kneeDb>kMinKnee)?kneeDb:kMinKnee;
+            }
+
+            /// attack and release coefficients (0 to 1, 1 being immediate) of the gain reduction smoothing.
+            void setTimes(double iAttackCoeff,double iReleaseCoeff)
+            {
+                attackCoeff=iAttackCoeff;
+                releaseCoeff=iReleaseCoeff;
+            }
+
+            /// make up gain (dB), applied after the gain reduction.
+            void setMakeUp(double makeUpDb)
+            {
+                makeUp=makeUpDb;
+            }
+
+            /// link between channels: 0 (independent channels) to 1 (same gain for all channels).
+            void setLink(double iLink)
+            {
+                link=(iLink<0)?0:((iLink>1)?1:iLink);
+            }
+
+            /// sets the detection mode. Resets the memories if changed.
+            void setDetection(Detection iDetection)
+            {
+                if(iDetection!=detection)
+                {
+                    detection=iDetection;
+                    reset();
+                }
+            }
+
+            Detection get_detection()const
+            {
+                return detection;
+            }
+
+            /** Sets the look-ahead in samples (up to the maximum set by setup()). The buffered audio is kept:
+            *   only the delay changes, and the sliding maximum and moving average are computed again over the
+            *   history that is in the new window.
+            */
+            void setLookAhead(uint iLookAhead)
+            {
+                if(iLookAhead>windowStride-1)
+                    iLookAhead=windowStride-1;
+                if(iLookAhead!=lookAhead)
+                {
+                    lookAhead=iLookAhead;
+                    for(uint c=0;c<channelsCount;c++)
+                        resizeWindow(c);
+                }
+            }
+
+            /// latency in samples, to be reported by getLatency().
+            int get_latency()const
+            {
+                return int(lookAhead);
+            }
+
+            /// sets the length of the RMS window in samples (up to the maximum set by setup()). Resets the memories if changed.
+            void setRmsLength(uint iRmsLength)
+            {
+                if(iRmsLength<1)
+                    iRmsLength=1;
+                if(iRmsLength>rmsStride)
+                    iRmsLength=rmsStride;
+                if(iRmsLength!=rmsLength)
+                {
+                    rmsLength=iRmsLength;
+                    reset();
+                }
+            }
+
+            /// highest gain reduction (dB, negative) since the last call (for metering).
+            double readGainReduction()
+            {
+                double value=maxReduction;
+                maxReduction=0;
+                return value;
+            }
+
+            void reset()
+            {
+                clear(delayLines);
+                clear(dequeValues);
+                clear(averageLines);
+                clear(rmsLines);
+                clear(levels);
+                clear(gains);
+                for(uint c=0;c<dequePositions.length;c++)
+                    dequePositions[c]=0;
+                for(uint c=0;c<states.length;c++)
+                    states[c]=ChannelState();
+                maxReduction=0;
+            }
+
+            /// processes count samples of each channel in place.
+            void processBlock(double** samples,uint count)
+            {
+                for(uint start=0;start<count;start+=kChunkSize)
+                {
+                    uint n=count-start;
+                    if(n>kChunkSize)
+                        n=kChunkSize;
+                    processChunk(samples,start,n);
+                }
+            }
+
+            // private data
+        private:
+            /// memories of a channel, besides the lines
+            struct ChannelState
+            {
+                uint    position=0; ///< samples processed (for the positions of the deque)
+                uint    delayIndex=0; ///< next write index of the delay line
+                uint    dequeHead=0;
+                uint    dequeCount=0;
+                uint    rmsIndex=0;
+                double  rmsSum=0;
+                uint    averageIndex=0;
+                double  averageSum=0;
+                double  reduction=0; ///< smoothed gain reduction (dB)
+            };
+
+            // lines: one block of stride values per channel
+            array<double>       delayLines; ///< delayed audio (history of the longest look-ahead)
+            array<double>       dequeValues; ///< candidates for the maximum, decreasing from the head
+            array<uint>         dequePositions;
+            array<double>       averageLines; ///< gain reductions in the moving average (history of the longest look-ahead)
+            array<double>       rmsLines; ///< squares in the RMS window
+            array<double>       levels; ///< levels, then gain reductions of the current chunk
+            array<double>       gains; ///< gains of the current chunk
+            array<ChannelState> states;
+            double              linked[kChunkSize]; ///< highest level of all channels
+
+            uint                channelsCount=0;
+            uint                windowStride=1;
+            uint                rmsStride=1;
+            uint                lookAhead=0;
+            uint                rmsLength=1;
+            Detection           detection=kPeakDetection;
+            double              threshold=0;
+            double              slope=0;
+            double              knee=kMinKnee;
+            double              attackCoeff=1;
+            double              releaseCoeff=1;
+            double              makeUp=0;
+            double              link=1;
+            double              maxReduction=0;
+
+            void processChunk(double** samples,uint start,uint n)
+            {
+                // detection
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    const double* input=samples[c]+start;
+                    double* level=levels.ptr+c*kChunkSize;
+                    if(detection==kPeakDetection)
+                    {
+                        for(uint g=0;g<n/kGroupSize;g++)
+                        {
+                            double x[kGroupSize];
+                            loadGroup(input+g*kGroupSize,x);
+                            double* group=level+g*kGroupSize;
+                            for(uint l=0;l<kGroupSize;l++)
+                                group[l]=fabs(x[l]);
+                        }
+                        for(uint i=n-n%kGroupSize;i<n;i++)
+                            level[i]=fabs(input[i]);
+                        slideMax(c,level,n);
+                    }
+                    else
+                    {
+                        for(uint g=0;g<n/kGroupSize;g++)
+                        {
+                            double x[kGroupSize];
+                            loadGroup(input+g*kGroupSize,x);
+                            double* group=level+g*kGroupSize;
+                            for(uint l=0;l<kGroupSize;l++)
+                                group[l]=x[l]*x[l];
+                        }
+                        for(uint i=n-n%kGroupSize;i<n;i++)
+                            level[i]=input[i]*input[i];
+                        slideMean(c,level,n);
+                    }
+                }
+
+                // the next stages work on whole groups: the chunk buffers are padded
+                const uint groupsCount=(n+kGroupSize-1)/kGroupSize;
+
+                // linking: fully linked channels use the gain computer of the first channel
+                uint detectorsCount=channelsCount;
+                if(channelsCount>1 && link>0)
+                {
+                    for(uint i=0;i<groupsCount*kGroupSize;i++)
+                        linked[i]=levels[i];
+                    for(uint g=0;g<groupsCount;g++)
+                    {
+                        // maximum with absolute values (vectorized)
+                        double highest[kGroupSize];
+                        loadGroup(levels.ptr+g*kGroupSize,highest);
+                        for(uint c=1;c<channelsCount;c++)
+                        {
+                            double x[kGroupSize];
+                            loadGroup(levels.ptr+c*kChunkSize+g*kGroupSize,x);
+                            for(uint l=0;l<kGroupSize;l++)
+                                highest[l]=.5*(highest[l]+x[l]+fabs(highest[l]-x[l]));
+                        }
+                        double* group=linked+g*kGroupSize;
+                        for(uint l=0;l<kGroupSize;l++)
+                            group[l]=highest[l];
+                    }
+                    if(link>=1)
+                        detectorsCount=1;
+                    const double amount=link;
+                    for(uint c=0;c<detectorsCount;c++)
+                    {
+                        double* level=levels.ptr+c*kChunkSize;
+                        for(uint g=0;g<groupsCount;g++)
+                        {
+                            double x[kGroupSize];
+                            double target[kGroupSize];
+                            loadGroup(level+g*kGroupSize,x);
+                            loadGroup(linked+g*kGroupSize,target);
+                            double* group=level+g*kGroupSize;
+                            for(uint l=0;l<kGroupSize;l++)
+                                group[l]=x[l]+amount*(target[l]-x[l]);
+                        }
+                    }
+                }
+
+                // gain computer and smoothing
+                for(uint c=0;c<detectorsCount;c++)
+                {
+                    double* level=levels.ptr+c*kChunkSize;
+                    double* gain=gains.ptr+c*kChunkSize;
+                    computeReduction(level,groupsCount);
+                    smooth(c,level,gain,n);
+                    computeGains(gain,groupsCount);
+                }
+
+                // gains applied to the delayed audio
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    const double* gain=gains.ptr+((c<detectorsCount)?c:0)*kChunkSize;
+                    delay(c,samples[c]+start,gain,n);
+                }
+            }
+
+            /// replaces the levels by their maximum over the last lookAhead+1 samples.
+            void slideMax(uint c,double* level,uint n)
+            {
+                ChannelState& state=states[c];
+                const uint window=lookAhead+1;
+                for(uint i=0;i<n;i++)
+                {
+                    // drop the candidate that left the window
+                    if(state.dequeCount>0 && state.position-dequePositions[c*windowStride+state.dequeHead]>=window)
+                    {
+                        state.dequeHead++;
+                        if(state.dequeHead==windowStride)
+                            state.dequeHead=0;
+                        state.dequeCount--;
+                    }
+                    pushCandidate(c,level[i]);
+                    level[i]=dequeValues[c*windowStride+state.dequeHead];
+                }
+            }
+
+            /// adds the level of the next sample to the deque of a channel, after the candidates that it hides.
+            void pushCandidate(uint c,double value)
+            {
+                ChannelState& state=states[c];
+                double* values=dequeValues.ptr+c*windowStride;
+                uint* positions=dequePositions.ptr+c*windowStride;
+                while(state.dequeCount>0)
+                {
+                    uint back=state.dequeHead+state.dequeCount-1;
+                    if(back>=windowStride)
+                        back-=windowStride;
+                    if(values[back]>value)
+                        break;
+                    state.dequeCount--;
+                }
+                uint tail=state.dequeHead+state.dequeCount;
+                if(tail>=windowStride)
+                    tail-=windowStride;
+                values[tail]=value;
+                positions[tail]=state.position;
+                state.dequeCount++;
+                state.position++;
+            }
+
+            /** Adapts the memories of a channel to a new look-ahead: the deque is built again from the levels of
+            *   the samples in the new window (still in the delay line), and the moving average is summed again.
+            */
+            void resizeWindow(uint c)
+            {
+                ChannelState& state=states[c];
+                const uint window=lookAhead+1;
+                if(detection==kPeakDetection)
+                {
+                    const double* line=delayLines.ptr+c*windowStride;
+                    const uint end=state.position;
+                    state.dequeHead=0;
+                    state.dequeCount=0;
+                    state.position=end-window;
+                    uint index=state.delayIndex+windowStride-window; // oldest sample in the window
+                    for(uint i=0;i<window;i++)
+                    {
+                        if(index>=windowStride)
+                            index-=windowStride;
+                        pushCandidate(c,fabs(line[index]));
+                        index++;
+                    }
+                }
+                state.averageSum=sumWindow(averageLines.ptr+c*windowStride,state.averageIndex,window);
+            }
+
+            /// replaces the squares by their mean over the RMS window.
+            void slideMean(uint c,double* level,uint n)
+            {
+                ChannelState& state=states[c];
+                double* line=rmsLines.ptr+c*rmsStride;
+                const double scale=1/double(rmsLength);
+                for(uint i=0;i<n;i++)
+                {
+                    state.rmsSum+=level[i]-line[state.rmsIndex];
+                    line[state.rmsIndex]=level[i];
+                    state.rmsIndex++;
+                    if(state.rmsIndex==rmsLength)
+                    {
+                        // sum again once per window, so that rounding errors do not accumulate
+                        state.rmsIndex=0;
+                        state.rmsSum=sum(line,rmsLength);
+                    }
+                    level[i]=state.rmsSum*scale;
+                }
+            }
+
+            /// replaces groups of levels by the gain reductions (dB) of the soft knee curve (no branches: vectorized).
+            void computeReduction(double* level,uint groupsCount)
+            {
+                // RMS levels are mean squares: half of their dB value
+                const double dbScale=(detection==kPeakDetection)?(20/FastMath::kLn10):(10/FastMath::kLn10);
+                // local copies (not aliased by the levels: kept in registers)
+                const double t=threshold;
+                const double k=knee;
+                const double halfKnee=.5*k;
+                const double s=slope;
+                const double kneeScale=s/(2*k);
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    double x[kGroupSize];
+                    loadGroup(level+g*kGroupSize,x);
+                    double* group=level+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                    {
+                        // over the knee: slope*excess; within the knee: quadratic curve
+                        const double excess=FastMath::logApprox<FastMath::kMediumAccuracy>(x[l])*dbScale-t;
+                        const double inKnee=FastMath::clamp(excess+halfKnee,0,k);
+                        const double above=excess-halfKnee;
+                        group[l]=kneeScale*inKnee*inKnee+s*.5*(above+fabs(above));
+                    }
+                }
+            }
+
+            /// replaces groups of gain reductions by gains, with the make up gain (vectorized).
+            void computeGains(double* gain,uint groupsCount)
+            {
+                const double scale=FastMath::kLn10/20;
+                const double offset=makeUp*scale;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    double x[kGroupSize];
+                    loadGroup(gain+g*kGroupSize,x);
+                    double* group=gain+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        group[l]=FastMath::expApprox<FastMath::kMediumAccuracy>(x[l]*scale+offset);
+                }
+            }
+
+            /// smooths the gain reductions (attack and release, then moving average).
+            void smooth(uint c,const double* reduction,double* gain,uint n)
+            {
+                ChannelState& state=states[c];
+                double* line=averageLines.ptr+c*windowStride;
+                const uint window=lookAhead+1;
+                const double scale=1/double(window);
+                double value=state.reduction;
+                double peak=maxReduction;
+                for(uint i=0;i<n;i++)
+                {
+                    const double target=reduction[i];
+                    value+=((target<value)?attackCoeff:releaseCoeff)*(target-value);
+                    // the value that leaves the window is lookAhead+1 values back in the line
+                    uint oldest=state.averageIndex+windowStride-window;
+                    if(oldest>=windowStride)
+                        oldest-=windowStride;
+                    state.averageSum+=value-line[oldest];
+                    line[state.averageIndex]=value;
+                    state.averageIndex++;
+                    if(state.averageIndex==windowStride)
+                        state.averageIndex=0;
+                    if(state.averageIndex==0)
+                    {
+                        // sum again once per line, so that rounding errors do not accumulate
+                        state.averageSum=sumWindow(line,0,window);
+                    }
+                    gain[i]=state.averageSum*scale;
+                    if(gain[i]<peak)
+                        peak=gain[i];
+                }
+                state.reduction=value;
+                maxReduction=peak;
+            }
+
+            /// delays the samples of a channel by the look-ahead, and applies the gains.
+            void delay(uint c,double* samples,const double* gain,uint n)
+            {
+                ChannelState& state=states[c];
+                double* line=delayLines.ptr+c*windowStride;
+                uint read=state.delayIndex+windowStride-lookAhead;
+                if(read>=windowStride)
+                    read-=windowStride;
+                for(uint i=0;i<n;i++)
+                {
+                    line[state.delayIndex]=samples[i];
+                    samples[i]=line[read]*gain[i];
+                    state.delayIndex++;
+                    if(state.delayIndex==windowStride)
+                        state.delayIndex=0;
+                    read++;
+                    if(read==windowStride)
+                        read=0;
+                }
+            }
+
+            /// local copy of a group of values, so that the group can be written without aliasing them.
+            static void loadGroup(const double* values,double* group)
+            {
+                for(uint l=0;l<kGroupSize;l++)
+                    group[l]=values[l];
+            }
+
+            static double sum(const double* values,uint count)
+            {
+                double total=0;
+                for(uint i=0;i<count;i++)
+                    total+=values[i];
+                return total;
+            }
+
+            /// sum of the count values before index in a line of windowStride values (circular).
+            double sumWindow(const double* line,uint index,uint count)const
+            {
+                if(count<=index)
+                    return sum(line+index-count,count);
+                return sum(line,index)+sum(line+windowStride-(count-index),count-index);
+            }
+
+            static void clear(array<double>& values)
+            {
+                for(uint i=0;i<values.length;i++)
+                    values[i]=0;
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,215 @@
+#ifndef _Envelope_h_
+#define _Envelope_h_
+
+#include <math.h>
+/** \file Envelope.h
+*   Exponential ADSR envelope rendered by segments (c/c++ dsp scripting).
+*
+*   Each segment of the envelope is an exponential curve level(n)=target+(start-target)*factor^n, with
+*   factor=1-coefficient (same as updating level+=coefficient*(target-level) for every sample). Instead
+*   of updating and testing the level for every sample, the position where a segment ends is computed
+*   once (logarithm of the remaining distance), and the samples of the segment are computed in closed
+*   form, by groups of 8 independent samples (precomputed powers of the factor) that the compiler can
+*   vectorize.
+*
+*   The state of an envelope is its level and stage only, so that it can be stored per voice (structure
+*   of arrays) and retriggered at any sample: a new attack starts from the current level. The sustain
+*   level can change at any time: the decay and sustain stages glide to it at the decay rate.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Envelopes
+    {
+        /** Envelope stages.
+        *
+        */
+        enum Stage
+        {
+            kAttackStage,
+            kDecayStage,
+            kSustainStage,
+            kReleaseStage
+        };
+
+        static const double kAttackTarget=1.001; ///< the attack aims slightly above 1, so that it ends in a finite time
+        static const double kDecayThreshold=.0001; ///< distance to the sustain level that ends the decay
+        static const double kEndThreshold=.0001; ///< level that ends the release
+
+        /** Exponential segment: distance(n)=distance(0)*factor^n from the target level.
+        *
+        */
+        struct ExponentialSegment
+        {
+            static const uint kGroupSize=8; ///< samples computed in parallel
+
+            /// sets the coefficient (0 to 1, 1 being immediate): part of the distance to the target covered per sample.
+            void setCoefficient(double coefficient)
+            {
+                factor=1-coefficient;
+                if(factor<0)
+                    factor=0;
+                if(factor>1)
+                    factor=1;
+                powers[0]=factor;
+                for(uint l=1;l<kGroupSize;l++)
+                    powers[l]=powers[l-1]*factor;
+                logFactor=(factor>0 && factor<1)?log(factor):0;
+            }
+
+            /** Number of samples until the distance to the target falls below threshold (the first sample n>=1
+            *   such as distance(0)*factor^n<threshold), for a distance magnitude (positive). Returns a value
+            *   above maxLength if the segment does not end within maxLength samples.
+            */
+            uint getLength(double magnitude,double threshold,uint maxLength)const
+            {
+                if(magnitude<threshold || factor==0)
+                    return 1;
+                if(factor==1)
+                    return maxLength+1;
+                const double length=floor(log(threshold/magnitude)/logFactor)+1;
+                if(length>double(maxLength))
+                    return maxLength+1;
+                return uint(length);
+            }
+
+            /** Writes count samples of the segment to output (the samples after the current one), and
+            *   updates the distance to the target (level-target).
+            */
+            void render(double* output,uint count,double target,double& distance)const
+            {
+                // local copies (not aliased by output: kept in registers)
+                double d=distance;
+                double p[kGroupSize];
+                for(uint l=0;l<kGroupSize;l++)
+                    p[l]=powers[l];
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    double* group=output+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        group[l]=target+d*p[l];
+                    d*=p[kGroupSize-1];
+                }
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                {
+                    d*=factor;
+                    output[i]=target+d;
+                }
+                distance=d;
+            }
+
+            // private data
+        private:
+            double  factor=0;
+            double  logFactor=0;
+            double  powers[kGroupSize]={0}; ///< factor^1 to factor^kGroupSize
+        };
+
+        /** ADSR envelope with exponential segments, shared by several voices (each voice stores its own
+        *   level and stage).
+        */
+        struct ADSREnvelope
+        {
+            ADSREnvelope()
+            {
+                set(1,1,1,1);
+            }
+
+            /** Sets the coefficients of the exponential segments (0 to 1, 1 being immediate) and the sustain
+            *   level (0 to 1). Cheap: can be called for every block.
+            */
+            void set(double attackCoeff,double decayCoeff,double sustain,double releaseCoeff)
+            {
+                attack.setCoefficient(attackCoeff);
+                decay.setCoefficient(decayCoeff);
+                release.setCoefficient(releaseCoeff);
+                sustainLevel=sustain;
+            }
+
+            /** Renders samplesCount samples of an envelope (level and stage are updated).
+            *   Returns the number of samples before the end of the release (samplesCount if still playing):
+            *   the level is then set to zero.
+            */
+            uint render(double& level,int& stage,double* envelope,uint samplesCount)const
+            {
+                uint i=0;
+                while(i<samplesCount)
+                {
+                    const uint remaining=samplesCount-i;
+                    double distance=0;
+                    switch(stage)
+                    {
+                    case kAttackStage:
+                        {
+                            distance=level-kAttackTarget;
+                            uint length=attack.getLength(-distance,kAttackTarget-1,remaining);
+                            if(length>remaining)
+                            {
+                                attack.render(envelope+i,remaining,kAttackTarget,distance);
+                                level=kAttackTarget+distance;
+                                return samplesCount;
+                            }
+                            attack.render(envelope+i,length-1,kAttackTarget,distance);
+                            i+=length;
+                            level=1;
+                            envelope[i-1]=level;
+                            stage=kDecayStage;
+                            break;
+                        }
+                    case kDecayStage:
+                    case kSustainStage:
+                        {
+                            // glide to the sustain level, from above or below: the sustain stage follows
+                            // the changes of the sustain level at the decay rate
+                            distance=level-sustainLevel;
+                            uint length=decay.getLength(fabs(distance),kDecayThreshold,remaining);
+                            if(length>remaining)
+                            {
+                                decay.render(envelope+i,remaining,sustainLevel,distance);
+                                level=sustainLevel+distance;
+                                return samplesCount;
+                            }
+                            decay.render(envelope+i,length-1,sustainLevel,distance);
+                            i+=length;
+                            level=sustainLevel;
+                            envelope[i-1]=level;
+                            stage=kSustainStage;
+                            for(;i<samplesCount;i++)
+                                envelope[i]=level;
+                            break;
+                        }
+                    case kReleaseStage:
+                        {
+                            distance=level;
+                            uint length=release.getLength(distance,kEndThreshold,remaining);
+                            if(length>remaining)
+                            {
+                                release.render(envelope+i,remaining,0,distance);
+                                level=distance;
+                                return samplesCount;
+                            }
+                            // value below threshold => the envelope ended
+                            release.render(envelope+i,length-1,0,distance);
+                            level=0;
+                            return i+length-1;
+                        }
+                    }
+                }
+                return samplesCount;
+            }
+
+            // private data
+        private:
+            ExponentialSegment  attack;
+            ExponentialSegment  decay;
+            ExponentialSegment  release;
+            double              sustainLevel=1;
+        };
+    }
+}
+#endif
@@ -0,0 +1,292 @@
+#ifndef _FFT_h_
+#define _FFT_h_
+
+#include <math.h>
+/** \file FFT.h
+*   Fast Fourier transform of real signals (c/c++ dsp scripting).
+*
+*   A real signal of N samples is transformed with a complex FFT of N/2 points (even samples as the
+*   real parts, odd samples as the imaginary parts), then the N/2+1 bins of the real spectrum are
+*   separated from the complex result. The complex FFT is computed in place (decimation in time):
+*   - the input is permuted in bit-reversed order (precomputed table).
+*   - one radix-2 stage if log2(N/2) is odd, then radix-4 stages (two radix-2 stages at once, with
+*     three complex multiplications per butterfly and half as many passes over the data).
+*   - real and imaginary parts are stored in separate arrays, and the butterflies of a stage are
+*     computed by groups of 4 consecutive ones, so that the compiler can vectorize them.
+*
+*   All twiddle factors, the permutation table and the work memories are computed by setup() (the
+*   "plan"): call it from initialize(). forward() does not allocate memory and can be used in the
+*   audio thread.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace FFT
+    {
+        static const uint kMinSize=256; ///< smallest supported transform size
+        static const uint kMaxSize=65536; ///< largest supported transform size
+        static const uint kGroupSize=4; ///< butterflies computed in parallel
+
+        /** FFT of real signals, for a fixed power of two size (plan).
+        *
+        */
+        struct RealFFT
+        {
+            /** Computes the plan for size real samples (not for the audio thread). Returns false if size is not a
+            *   power of two between kMinSize and kMaxSize.
+            */
+            bool setup(uint iSize)
+            {
+                size=0;
+                if(iSize<kMinSize || iSize>kMaxSize || (iSize&(iSize-1))!=0)
+                    return false;
+                size=iSize;
+                const uint half=size/2;
+                uint bits=0;
+                while((1u<<bits)<half)
+                    bits++;
+                const double pi=3.141592653589793238462;
+
+                // bit reversal permutation of the complex points
+                reversed.resize(half);
+                for(uint i=0;i<half;i++)
+                {
+                    uint r=0;
+                    for(uint b=0;b<bits;b++)
+                        r|=((i>>b)&1)<<(bits-1-b);
+                    reversed[i]=r;
+                }
+
+                // radix-4 stages (sub-transforms of length L combined into 4L): w^k, w^2k and w^3k for k<L,
+                // with w=exp(-2*pi*i/(4L))
+                firstLength=(bits&1)?2:1;
+                uint twiddlesCount=0;
+                for(uint length=firstLength;length<half;length*=4)
+                    twiddlesCount+=3*length;
+                twiddlesRe.resize(twiddlesCount);
+                twiddlesIm.resize(twiddlesCount);
+                uint offset=0;
+                for(uint length=firstLength;length<half;length*=4)
+                {
+                    for(uint t=1;t<=3;t++)
+                    {
+                        for(uint k=0;k<length;k++)
+                        {
+                            const double angle=-2*pi*double(t*k)/double(4*length);
+                            twiddlesRe[offset+k]=cos(angle);
+                            twiddlesIm[offset+k]=sin(angle);
+                        }
+                        offset+=length;
+                    }
+                }
+
+                // separation of the real spectrum: exp(-2*pi*i*k/size) for k<=size/4
+                splitRe.resize(half/2+1);
+                splitIm.resize(half/2+1);
+                for(uint k=0;k<=half/2;k++)
+                {
+                    const double angle=-2*pi*double(k)/double(size);
+                    splitRe[k]=cos(angle);
+                    splitIm[k]=sin(angle);
+                }
+                workRe.resize(half);
+                workIm.resize(half);
+                return true;
+            }
+
+            /// size of the transform (real samples), 0 if not set up.
+            uint get_size()const
+            {
+                return size;
+            }
+
+            /** Spectrum of size real samples: size/2+1 bins (from 0 to the Nyquist frequency) stored in re and im.
+            *   Not normalized: a full scale sine of an integer number of periods gives a bin of magnitude size/2.
+            */
+            void forward(const double* input,double* re,double* im)
+            {
+                const uint half=size/2;
+                double* zr=&workRe[0];
+                double* zi=&workIm[0];
+                for(uint i=0;i<half;i++)
+                {
+                    const uint j=reversed[i];
+                    zr[i]=input[2*j];
+                    zi[i]=input[2*j+1];
+                }
+                transform(zr,zi);
+
+                // X(k)=(Z(k)+conj(Z(N/2-k)))/2 + exp(-2*pi*i*k/N)*(Z(k)-conj(Z(N/2-k)))/2i, computed for k and
+                // N/2-k together (the twiddle of N/2-k is the opposite conjugate)
+                re[0]=zr[0]+zi[0];
+                im[0]=0;
+                re[half]=zr[0]-zi[0];
+                im[half]=0;
+                for(uint k=1;k<=half/2;k++)
+                {
+                    const uint c=half-k;
+                    // even and odd parts
+                    const double er=.5*(zr[k]+zr[c]);
+                    const double ei=.5*(zi[k]-zi[c]);
+                    const double or_=.5*(zi[k]+zi[c]);
+                    const double oi=-.5*(zr[k]-zr[c]);
+                    const double wr=splitRe[k];
+                    const double wi=splitIm[k];
+                    const double tr=wr*or_-wi*oi;
+                    const double ti=wr*oi+wi*or_;
+                    re[k]=er+tr;
+                    im[k]=ei+ti;
+                    re[c]=er-tr;
+                    im[c]=ti-ei;
+                }
+            }
+
+            // private data
+        private:
+            uint            size=0;
+            uint            firstLength=1; ///< length of the sub-transforms combined by the first radix-4 stage
+            array<uint>     reversed;
+            array<double>   twiddlesRe;
+            array<double>   twiddlesIm;
+            array<double>   splitRe;
+            array<double>   splitIm;
+            array<double>   workRe;
+            array<double>   workIm;
+
+            /// in place complex FFT of size/2 points, already in bit-reversed order.
+            void transform(double* zr,double* zi)const
+            {
+                const uint half=size/2;
+                if(firstLength==2)
+                {
+                    // radix-2 stage
+                    for(uint i=0;i<half;i+=2)
+                    {
+                        const double ar=zr[i];
+                        const double ai=zi[i];
+                        zr[i]=ar+zr[i+1];
+                        zi[i]=ai+zi[i+1];
+                        zr[i+1]=ar-zr[i+1];
+                        zi[i+1]=ai-zi[i+1];
+                    }
+                }
+                uint offset=0;
+                for(uint length=firstLength;length<half;length*=4)
+                {
+                    const double* w1r=&twiddlesRe[offset];
+                    const double* w1i=&twiddlesIm[offset];
+                    const double* w2r=w1r+length;
+                    const double* w2i=w1i+length;
+                    const double* w3r=w2r+length;
+                    const double* w3i=w2i+length;
+                    offset+=3*length;
+                    for(uint block=0;block<half;block+=4*length)
+                    {
+                        double* r=zr+block;
+                        double* i=zi+block;
+                        if(length<kGroupSize)
+                        {
+                            for(uint k=0;k<length;k++)
+                                butterfly(r+k,i+k,length,w1r[k],w1i[k],w2r[k],w2i[k],w3r[k],w3i[k]);
+                        }
+                        else
+                        {
+                            for(uint k=0;k<length;k+=kGroupSize)
+                                butterflies(r+k,i+k,length,w1r+k,w1i+k,w2r+k,w2i+k,w3r+k,w3i+k);
+                        }
+                    }
+                }
+            }
+
+            /** radix-4 butterfly: combines the points at 0, L, 2L and 3L of four sub-transforms (twiddles w^k,
+            *   w^2k and w^3k).
+            */
+            static void butterfly(double* r,double* i,uint length,double w1r,double w1i,double w2r,double w2i,
+                double w3r,double w3i)
+            {
+                const double x0r=r[0];
+                const double x0i=i[0];
+                const double ar=w2r*r[length]-w2i*i[length];
+                const double ai=w2r*i[length]+w2i*r[length];
+                const double cr=w1r*r[2*length]-w1i*i[2*length];
+                const double ci=w1r*i[2*length]+w1i*r[2*length];
+                const double dr=w3r*r[3*length]-w3i*i[3*length];
+                const double di=w3r*i[3*length]+w3i*r[3*length];
+                const double y0r=x0r+ar;
+                const double y0i=x0i+ai;
+                const double y1r=x0r-ar;
+                const double y1i=x0i-ai;
+                const double pr=cr+dr;
+                const double pi=ci+di;
+                const double qr=cr-dr;
+                const double qi=ci-di;
+                r[0]=y0r+pr;
+                i[0]=y0i+pi;
+                r[2*length]=y0r-pr;
+                i[2*length]=y0i-pi;
+                r[length]=y1r+qi;
+                i[length]=y1i-qr;
+                r[3*length]=y1r-qi;
+                i[3*length]=y1i+qr;
+            }
+
+            /// kGroupSize consecutive radix-4 butterflies (local copies, so that the lanes are vectorized).
+            static void butterflies(double* r,double* i,uint length,const double* w1r,const double* w1i,
+                const double* w2r,const double* w2i,const double* w3r,const double* w3i)
+            {
+                double x0r[kGroupSize],x0i[kGroupSize],x1r[kGroupSize],x1i[kGroupSize];
+                double x2r[kGroupSize],x2i[kGroupSize],x3r[kGroupSize],x3i[kGroupSize];
+                for(uint l=0;l<kGroupSize;l++)
+                {
+                    x0r[l]=r[l];
+                    x0i[l]=i[l];
+                    x1r[l]=r[length+l];
+                    x1i[l]=i[length+l];
+                    x2r[l]=r[2*length+l];
+                    x2i[l]=i[2*length+l];
+                    x3r[l]=r[3*length+l];
+                    x3i[l]=i[3*length+l];
+                }
+                double z0r[kGroupSize],z0i[kGroupSize],z1r[kGroupSize],z1i[kGroupSize];
+                double z2r[kGroupSize],z2i[kGroupSize],z3r[kGroupSize],z3i[kGroupSize];
+                for(uint l=0;l<kGroupSize;l++)
+                {
+                    const double ar=w2r[l]*x1r[l]-w2i[l]*x1i[l];
+                    const double ai=w2r[l]*x1i[l]+w2i[l]*x1r[l];
+                    const double cr=w1r[l]*x2r[l]-w1i[l]*x2i[l];
+                    const double ci=w1r[l]*x2i[l]+w1i[l]*x2r[l];
+                    const double dr=w3r[l]*x3r[l]-w3i[l]*x3i[l];
+                    const double di=w3r[l]*x3i[l]+w3i[l]*x3r[l];
+                    const double pr=cr+dr;
+                    const double pi=ci+di;
+                    const double qr=cr-dr;
+                    const double qi=ci-di;
+                    z0r[l]=x0r[l]+ar+pr;
+                    z0i[l]=x0i[l]+ai+pi;
+                    z2r[l]=x0r[l]+ar-pr;
+                    z2i[l]=x0i[l]+ai-pi;
+                    z1r[l]=x0r[l]-ar+qi;
+                    z1i[l]=x0i[l]-ai-qr;
+                    z3r[l]=x0r[l]-ar-qi;
+                    z3i[l]=x0i[l]-ai+qr;
+                }
+                for(uint l=0;l<kGroupSize;l++)
+                {
+                    r[l]=z0r[l];
+                    i[l]=z0i[l];
+                    r[length+l]=z1r[l];
+                    i[length+l]=z1i[l];
+                    r[2*length+l]=z2r[l];
+                    i[2*length+l]=z2i[l];
+                    r[3*length+l]=z3r[l];
+                    i[3*length+l]=z3i[l];
+                }
+            }
+        };
+    }
+}
+#endif
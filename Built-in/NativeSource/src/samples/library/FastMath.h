@@ -0,0 +1,308 @@
+#ifndef _FastMath_h_
+#define _FastMath_h_
+
+#include <math.h>
+/** \file FastMath.h
+*   Fast approximations of transcendental functions (c/c++ dsp scripting).
+*
+*   exp, expm1, log, pow, sin, cos and tanh, with three accuracy levels selected at compile time for
+*   each call site (template parameter), so that a sample can use the cheapest approximation that is
+*   good enough where it calls them, and keep the standard library elsewhere:
+*   - kLowAccuracy: error below 1e-3 (LFOs, envelopes, gain smoothing)
+*   - kMediumAccuracy: error below 1e-5 (audio rate oscillators and waveshapers)
+*   - kHighAccuracy: error below 1e-7 (where errors accumulate, pitch computations)
+*   Errors are relative, except for log and sin (absolute error: they have zeros). The mathbench tool
+*   (tools/benchmark) measures the actual errors and speed against the standard library.
+*
+*   Functions have no branches: the argument is reduced with integer operations on the bits of
+*   doubles, then the function is computed with a minimax polynomial on the reduced range. The
+*   block versions process groups of 8 values, that the compiler can vectorize. Arguments out of
+*   range are clamped instead of returning infinities or NaNs: see each function.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace FastMath
+    {
+        /** Accuracy of the approximations.
+        *
+        */
+        enum Accuracy
+        {
+            kLowAccuracy,
+            kMediumAccuracy,
+            kHighAccuracy
+        };
+
+        static const uint kGroupSize=8; ///< values computed in parallel by block functions
+
+        static const double kLn2=0.693147180559945309417;
+        static const double kLog2e=1.44269504088896340736;
+        static const double kLn10=2.30258509299404568402;
+        static const double kInvPi=0.318309886183790671538;
+        static const double kPiHigh=3.14159265358979311600; ///< pi rounded to a double
+        static const double kPiLow=1.22464679914735317723e-16; ///< pi-kPiHigh
+        static const double kRoundingMagic=6755399441055744.0; ///< 2^52+2^51: x+magic rounds x to an integer in the low bits
+
+        /// bits of a double (through a union rather than memcpy: string.h would declare index() for the scripts).
+        union DoubleBits
+        {
+            double  value;
+            uint64  bits;
+        };
+
+        inline uint64 toBits(double x)
+        {
+            DoubleBits u;
+            u.value=x;
+            return u.bits;
+        }
+
+        inline double fromBits(uint64 bits)
+        {
+            DoubleBits u;
+            u.bits=bits;
+            return u.value;
+        }
+
+        /** x clamped to [low,high] (|x|<1e15), computed with absolute values: comparisons would let the
+        *   compiler specialize the code that follows for the clamped values, and it would not vectorize it.
+        *   The result has an absolute error of about one ulp of low and high.
+        */
+        inline double clamp(double x,double low,double high)
+        {
+            x=.5*(x+low+fabs(x-low));
+            return .5*(x+high-fabs(x-high));
+        }
+
+        /// y with the sign of x (y must be positive).
+        inline double withSignOf(double x,double y)
+        {
+            return fromBits(toBits(y)|(toBits(x)&0x8000000000000000ULL));
+        }
+
+        /** Reduces x (|x|<1e15) to x=n*ln2+y, with n integer and |y|<=ln2/2, and computes e^y-1 (relative
+        *   accuracy) and 2^n. x is clamped to [-708,709].
+        */
+        template <Accuracy accuracy>
+        inline void reduceExp(double x,double& expm1Y,double& scale)
+        {
+            x=clamp(x,-708,709);
+            const double t=x*kLog2e+kRoundingMagic;
+            const double n=t-kRoundingMagic;
+            const double y=x-n*kLn2;
+
+            // 2^n, built from the exponent bits (n is in the low bits of t)
+            scale=fromBits((toBits(t)-toBits(kRoundingMagic)+1023)<<52);
+
+            // e^y-1=y*q(y): minimax polynomial for the relative error
+            double q=0;
+            if(accuracy==kLowAccuracy)
+                q=1.0000449061289682+y*(0.503751086455813+y*0.16666585701373124);
+            else if(accuracy==kMediumAccuracy)
+                q=0.99999994653284+y*(0.4999937687201798+y*(0.16666934999501432+y*(0.04187512222900089
+                    +y*0.008333319617979654)));
+            else
+                q=1.00000001062961+y*(0.49999998124531764+y*(0.16666506202567952+y*(0.04166713624287314
+                    +y*(0.008369070480154226+y*0.0013888874205369478))));
+            expm1Y=y*q;
+        }
+
+        /** Exponential, for |x|<1e15. Arguments below -708 return 0, arguments above 709 are clamped.
+        *
+        */
+        template <Accuracy accuracy>
+        inline double expApprox(double x)
+        {
+            const double underflow=double(x>=-708);
+            double expm1Y=0;
+            double scale=0;
+            reduceExp<accuracy>(x,expm1Y,scale);
+            return (scale+scale*expm1Y)*underflow;
+        }
+
+        /** e^x-1, with a relative accuracy for small arguments (see expApprox).
+        *
+        */
+        template <Accuracy accuracy>
+        inline double expm1Approx(double x)
+        {
+            double expm1Y=0;
+            double scale=0;
+            reduceExp<accuracy>(x,expm1Y,scale);
+            return scale*expm1Y+(scale-1);
+        }
+
+        /** Natural logarithm, for positive arguments. 0 and denormal numbers return about -709 (logarithm of the
+        *   smallest normal number), infinity about 710.
+        */
+        template <Accuracy accuracy>
+        inline double logApprox(double x)
+        {
+            // x=2^e*m, with m in [sqrt(2)/2,sqrt(2)[: offsetting the bits by those of sqrt(2)/2 moves the
+            // mantissas above sqrt(2) to the next exponent (integer operations only)
+            const uint64 bits=toBits(x)&0x7fffffffffffffffULL;
+            const uint64 offset=bits-0x3fe6a09e667f3bcdULL+0x4000000000000000ULL;
+            const double e=fromBits(0x4330000000000000ULL|(offset>>52))-4503599627370496.0-1024;
+            const double m=fromBits(bits-((offset&0xfff0000000000000ULL)-0x4000000000000000ULL));
+
+            // log(m)=2*atanh(s) with s=(m-1)/(m+1): minimax polynomial in s^2
+            const double s=(m-1)/(m+1);
+            const double z=s*s;
+            double p=0;
+            if(accuracy==kLowAccuracy)
+                p=1.9999554910576356+z*0.6786797077618845;
+            else if(accuracy==kMediumAccuracy)
+                p=2.0000002374077837+z*(0.6665222219667973+z*0.4129644302655423);
+            else
+                p=1.999999998621111+z*(0.6666681597054127+z*(0.3997479263921667+z*0.29925713718230873));
+            return e*kLn2+s*p;
+        }
+
+        /// base 10 logarithm (see logApprox).
+        template <Accuracy accuracy>
+        inline double log10Approx(double x)
+        {
+            return logApprox<accuracy>(x)*(1/kLn10);
+        }
+
+        /** x^y for positive x (see logApprox and expApprox). The relative error is the error of the exponential,
+        *   plus the error of the logarithm multiplied by y.
+        */
+        template <Accuracy accuracy>
+        inline double powApprox(double x,double y)
+        {
+            return expApprox<accuracy>(y*logApprox<accuracy>(x));
+        }
+
+        /// converts decibels to a gain factor: 10^(dB/20).
+        template <Accuracy accuracy>
+        inline double dbToGain(double dB)
+        {
+            return expApprox<accuracy>(dB*(kLn10/20));
+        }
+
+        /// converts a gain factor to decibels: 20*log10(gain) (about -6160 dB for 0).
+        template <Accuracy accuracy>
+        inline double gainToDb(double gain)
+        {
+            return logApprox<accuracy>(gain)*(20/kLn10);
+        }
+
+        /** Sine. The reduction of the argument is accurate for |x|<1e6 or so (the absolute error grows with
+        *   |x| like the rounding error of x).
+        */
+        template <Accuracy accuracy>
+        inline double sinApprox(double x)
+        {
+            // x=q*pi+r, with q integer and |r|<=pi/2: sin(x)=(-1)^q*sin(r)
+            const double t=x*kInvPi+kRoundingMagic;
+            const double q=t-kRoundingMagic;
+            const double r=(x-q*kPiHigh)-q*kPiLow;
+            const uint64 sign=(toBits(t)&1)<<63;
+
+            // sin(r): minimax polynomial in r^2, times r
+            const double z=r*r;
+            double p=0;
+            if(accuracy==kLowAccuracy)
+                p=0.9998918047826366+z*(-0.16596004139557008+z*0.007602864482751218);
+            else if(accuracy==kMediumAccuracy)
+                p=0.999999060756069+z*(-0.16665553955819545+z*(0.008311898021652714+z*-0.0001848808421231165));
+            else
+                p=0.999999994685373+z*(-0.16666656682922118+z*(0.008333025113224288+z*(-0.0001980741682562121
+                    +z*2.6018987482215945e-06)));
+            return fromBits(toBits(r*p)^sign);
+        }
+
+        /// cosine (see sinApprox).
+        template <Accuracy accuracy>
+        inline double cosApprox(double x)
+        {
+            return sinApprox<accuracy>(x+.5*kPiHigh);
+        }
+
+        /// hyperbolic tangent, for |x|<1e15.
+        template <Accuracy accuracy>
+        inline double tanhApprox(double x)
+        {
+            // tanh(|x|)=-e/(2+e) with e=expm1(-2|x|) (relative accuracy near 0)
+            const double e=expm1Approx<accuracy>(-2*fabs(x));
+            return withSignOf(x,fabs(e)/(2+e));
+        }
+
+        /** Applies function to count values of input (output may be the same buffer as input).
+        *
+        */
+        template <double (*function)(double)>
+        inline void applyBlock(const double* input,double* output,uint count)
+        {
+            const uint groupsCount=count/kGroupSize;
+            for(uint g=0;g<groupsCount;g++)
+            {
+                // local copies, so that output can alias input
+                double x[kGroupSize];
+                const double* in=input+g*kGroupSize;
+                for(uint l=0;l<kGroupSize;l++)
+                    x[l]=in[l];
+                double* out=output+g*kGroupSize;
+                for(uint l=0;l<kGroupSize;l++)
+                    out[l]=function(x[l]);
+            }
+            for(uint i=groupsCount*kGroupSize;i<count;i++)
+                output[i]=function(input[i]);
+        }
+
+        template <Accuracy accuracy>
+        inline void expBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<expApprox<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void expm1Block(const double* input,double* output,uint count)
+        {
+            applyBlock<expm1Approx<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void logBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<logApprox<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void sinBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<sinApprox<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void cosBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<cosApprox<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void tanhBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<tanhApprox<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void dbToGainBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<dbToGain<accuracy> >(input,output,count);
+        }
+
+        template <Accuracy accuracy>
+        inline void gainToDbBlock(const double* input,double* output,uint count)
+        {
+            applyBlock<gainToDb<accuracy> >(input,output,count);
+        }
+    }
+}
+#endif
@@ -0,0 +1,304 @@
+#ifndef _FilterCascade_h_
+#define _FilterCascade_h_
+/** \file FilterCascade.h
+*   Higher order filters (Butterworth, Linkwitz-Riley, Chebyshev) for c/c++ dsp scripting.
+*
+*   The filters are designed as a chain of second order sections (biquads), that are stored
+*   and processed together: the coefficients of all sections are in a single fixed size table,
+*   and the memories of all sections of a channel are contiguous, so that a sample goes through
+*   the whole chain without leaving the cache, for several channels in parallel.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Biquad
+    {
+        /** Filter families supported by FilterCascade.
+        *
+        */
+        enum FilterCascadeType
+        {
+            kButterworth, ///< maximally flat pass band (-3 dB at cutoff)
+            kLinkwitzRiley, ///< two cascaded Butterworth filters (-6 dB at cutoff, low and high pass sum flat: the high pass is inverted when order/2 is odd). Even orders only.
+            kChebyshev ///< type I: steeper slope, with ripple in the pass band (0 dB peaks, -ripple dB at cutoff)
+        };
+
+        struct FilterCascade
+        {
+            static const int kMaxOrder=16;
+            static const int kMaxSections=kMaxOrder/2;
+
+            /// coefficients of each section: b0, b1, b2, a1, a2 (denominator is 1+a1*z^-1+a2*z^-2)
+            double  coefficients[kMaxSections][5];
+            uint    sectionsCount=0;
+
+            /// memories (transposed direct form II), two for each section: memories[(channel*kMaxSections+section)*2+i]
+            array<double>   memories;
+            uint            channelsCount=0;
+
+            FilterCascade(int iChannelsCount=0)
+            {
+                setChannelsCount(iChannelsCount);
+                setPassThrough();
+            }
+
+            void setChannelsCount(uint iChannelsCount)
+            {
+                channelsCount=iChannelsCount;
+                memories.resize(channelsCount*kMaxSections*2);
+                resetState();
+            }
+
+            uint get_sectionsCount()const
+            {
+                return sectionsCount;
+            }
+
+            void resetState()
+            {
+                for(uint i=0;i<memories.length;i++)
+                    memories[i]=0;
+            }
+
+            /// no filtering (zero sections).
+            void setPassThrough()
+            {
+                sectionsCount=0;
+            }
+
+            /** Low pass filter of the given order (1 to 16).
+            *   theta is the normalized cutoff (2*PI*frequency/sampleRate), ripple (in dB) is used by Chebyshev filters only.
+            */
+            void setLowPass(FilterCascadeType type,int order,double theta,double rippleDb=1)
+            {
+                design(type,order,theta,rippleDb,false);
+            }
+
+            /** High pass filter of the given order (1 to 16).
+            *   theta is the normalized cutoff (2*PI*frequency/sampleRate), ripple (in dB) is used by Chebyshev filters only.
+            */
+            void setHighPass(FilterCascadeType type,int order,double theta,double rippleDb=1)
+            {
+                design(type,order,theta,rippleDb,true);
+            }
+
+            /** Filters one sample of each channel.
+            *
+            */
+            void processSample(double ioSample[])
+            {
+                for(uint ch=0;ch<channelsCount;ch++)
+                {
+                    double* mem=&memories[ch*kMaxSections*2];
+                    double x=ioSample[ch];
+                    for(uint s=0;s<sectionsCount;s++)
+                    {
+                        const double* c=coefficients[s];
+                        const double y=c[0]*x+mem[2*s];
+                        mem[2*s]=c[1]*x-c[3]*y+mem[2*s+1];
+                        mem[2*s+1]=c[2]*x-c[4]*y;
+                        x=y;
+                    }
+                    ioSample[ch]=x;
+                }
+            }
+
+            /** Processes samplesCount samples of the first channelsCount channels (samples[ch][i]).
+            *   Channels are processed in groups of 4 through all the sections, so that the compiler
+            *   can run them in parallel in vector registers. Denormals are flushed once per block.
+            */
+            void processBlock(double** samples,uint iChannelsCount,uint samplesCount)
+            {
+                if(iChannelsCount>channelsCount)
+                    iChannelsCount=channelsCount;
+                if(sectionsCount==0)
+                    return;
+                uint ch=0;
+                for(;ch+4<=iChannelsCount;ch+=4)
+                    processChannels<4>(samples+ch,ch,samplesCount);
+                for(;ch+2<=iChannelsCount;ch+=2)
+                    processChannels<2>(samples+ch,ch,samplesCount);
+                for(;ch<iChannelsCount;ch++)
+                    processChannels<1>(samples+ch,ch,samplesCount);
+                flushDenormals();
+            }
+
+            /// processes "lanes" channels in parallel, starting at firstChannel.
+            template<int lanes>
+            void processChannels(double** samples,uint firstChannel,uint samplesCount)
+            {
+                // local copies of the coefficients and memories for the entire block
+                double c[kMaxSections][5];
+                double z1[kMaxSections][lanes];
+                double z2[kMaxSections][lanes];
+                double* io[lanes];
+                const uint count=sectionsCount;
+                for(uint s=0;s<count;s++)
+                {
+                    for(int i=0;i<5;i++)
+                        c[s][i]=coefficients[s][i];
+                    for(int l=0;l<lanes;l++)
+                    {
+                        const double* mem=&memories[((firstChannel+l)*kMaxSections+s)*2];
+                        z1[s][l]=mem[0];
+                        z2[s][l]=mem[1];
+                    }
+                }
+                for(int l=0;l<lanes;l++)
+                    io[l]=samples[l];
+
+                for(uint i=0;i<samplesCount;i++)
+                {
+                    double x[lanes];
+                    for(int l=0;l<lanes;l++)
+                        x[l]=io[l][i];
+                    for(uint s=0;s<count;s++)
+                    {
+                        const double b0=c[s][0],b1=c[s][1],b2=c[s][2],a1=c[s][3],a2=c[s][4];
+                        for(int l=0;l<lanes;l++)
+                        {
+                            const double y=b0*x[l]+z1[s][l];
+                            z1[s][l]=b1*x[l]-a1*y+z2[s][l];
+                            z2[s][l]=b2*x[l]-a2*y;
+                            x[l]=y;
+                        }
+                    }
+                    for(int l=0;l<lanes;l++)
+                        io[l][i]=x[l];
+                }
+
+                for(uint s=0;s<count;s++)
+                {
+                    for(int l=0;l<lanes;l++)
+                    {
+                        double* mem=&memories[((firstChannel+l)*kMaxSections+s)*2];
+                        mem[0]=z1[s][l];
+                        mem[1]=z2[s][l];
+                    }
+                }
+            }
+
+            /// sets memories that have decayed below the threshold to zero, before they become denormal numbers.
+            void flushDenormals()
+            {
+                const double threshold=1e-20;
+                for(uint i=0;i<memories.length;i++)
+                {
+                    if(fabs(memories[i])<threshold)
+                        memories[i]=0;
+                }
+            }
+
+            // Design-----------------------------------------------------------------
+            /** Computes the sections for the analog prototype poles of the filter (cutoff at 1 rad/s),
+            *   transformed to high pass if required, then to digital with the bilinear transform.
+            */
+            void design(FilterCascadeType type,int order,double theta,double rippleDb,bool highPass)
+            {
+                const double pi=3.141592653589793238462;
+                if(order<1)
+                    order=1;
+                if(order>kMaxOrder)
+                    order=kMaxOrder;
+
+                // Linkwitz-Riley: Butterworth of half the order, applied twice
+                int prototypeOrder=order;
+                int repeat=1;
+                if(type==kLinkwitzRiley)
+                {
+                    prototypeOrder=(order+1)/2;
+                    repeat=2;
+                }
+
+                // pole radius factors (1 for Butterworth)
+                double sinhMu=1;
+                double coshMu=1;
+                double gain=1;
+                if(type==kChebyshev)
+                {
+                    if(rippleDb<=0)
+                        rippleDb=1e-6;
+                    const double epsilon=sqrt(pow(10,rippleDb/10)-1);
+                    const double mu=asinh(1/epsilon)/prototypeOrder;
+                    sinhMu=sinh(mu);
+                    coshMu=cosh(mu);
+                    // even orders start at -ripple dB at DC: peaks at 0 dB
+                    if((prototypeOrder&1)==0)
+                        gain=1/sqrt(1+epsilon*epsilon);
+                }
+
+                // prewarping (cutoff exactly at theta)
+                if(theta>pi*.999)
+                    theta=pi*.999;
+                const double K=tan(.5*theta);
+
+                sectionsCount=0;
+                for(int r=0;r<repeat;r++)
+                {
+                    for(int k=0;k<prototypeOrder/2;k++)
+                    {
+                        // conjugate poles -sigma+/-j*omega => s^2+2*sigma*s+(sigma^2+omega^2)
+                        const double angle=pi*(2*k+1)/(2*prototypeOrder);
+                        const double sigma=sinhMu*sin(angle);
+                        const double omega=coshMu*cos(angle);
+                        const double d0=sigma*sigma+omega*omega;
+                        const double d1=2*sigma;
+                        if(highPass)
+                            addSection(1,0,0,d1/d0,1/d0,K); // s^2/(s^2+d1/d0*s+1/d0)
+                        else
+                            addSection(0,0,d0,d1,d0,K);
+                    }
+                    if(prototypeOrder&1)
+                    {
+                        // real pole -sigma => first order section
+                        const double sigma=sinhMu;
+                        if(highPass)
+                            addFirstOrderSection(1,0,1/sigma,K); // s/(s+1/sigma)
+                        else
+                            addFirstOrderSection(0,sigma,sigma,K);
+                    }
+                }
+
+                // Linkwitz-Riley high pass of order 2, 6, 10...: inverted, so that the low and high pass are
+                // in phase and sum flat (they would cancel at the cutoff)
+                if(type==kLinkwitzRiley && highPass && (prototypeOrder&1))
+                    gain=-1;
+
+                // pass band gain on the first section (Chebyshev, inverted Linkwitz-Riley)
+                for(int i=0;i<3;i++)
+                    coefficients[0][i]*=gain;
+            }
+
+            /// adds the digital equivalent of (n2*s^2+n1*s+n0)/(s^2+d1*s+d0), with s=(1/K)*(1-z^-1)/(1+z^-1).
+            void addSection(double n2,double n1,double n0,double d1,double d0,double K)
+            {
+                const double K2=K*K;
+                const double a0=1+d1*K+d0*K2;
+                const double _a0=1/a0;
+                double* c=coefficients[sectionsCount++];
+                c[0]=(n2+n1*K+n0*K2)*_a0;
+                c[1]=2*(n0*K2-n2)*_a0;
+                c[2]=(n2-n1*K+n0*K2)*_a0;
+                c[3]=2*(d0*K2-1)*_a0;
+                c[4]=(1-d1*K+d0*K2)*_a0;
+            }
+
+            /// adds the digital equivalent of (n1*s+n0)/(s+d0), with s=(1/K)*(1-z^-1)/(1+z^-1).
+            void addFirstOrderSection(double n1,double n0,double d0,double K)
+            {
+                const double _a0=1/(1+d0*K);
+                double* c=coefficients[sectionsCount++];
+                c[0]=(n1+n0*K)*_a0;
+                c[1]=(n0*K-n1)*_a0;
+                c[2]=0;
+                c[3]=(d0*K-1)*_a0;
+                c[4]=0;
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,583 @@
+#ifndef _Loudness_h_
+#define _Loudness_h_
+
+#include <math.h>
+/** \file Loudness.h
+*   Loudness and true peak metering, as specified by ITU-R BS.1770-4 and EBU R128 (c/c++ dsp scripting).
+*
+*   - K-weighting: pre-filter (high shelf) and RLB high-pass filter, on a copy of the audio processed
+*     by chunks.
+*   - loudness: the weighted mean squares of the channels are accumulated over 100 ms blocks. The
+*     momentary (400 ms) and short-term (3 s) loudness are the means of the last 4 and 30 blocks.
+*   - integrated loudness and loudness range (EBU Tech 3342): the momentary and short-term values
+*     are added every 100 ms to gating histograms (0.1 LU bins, count and energy per bin), in O(1).
+*     The gates and percentiles are computed from the histograms when the values are read.
+*   - true peak: 4x oversampling with a polyphase interpolator (4 phases of 12 taps, the first one
+*     being the samples themselves), computed by groups of samples that the compiler can vectorize.
+*
+*   Memories are allocated by setup(): processing does not allocate memory.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Loudness
+    {
+        static const double kPi=3.141592653589793238462;
+        static const uint kChunkSize=64; ///< samples processed at once
+        static const uint kGroupSize=8; ///< samples computed in parallel by the vectorized loops
+        static const uint kMomentaryBlocks=4; ///< 100 ms blocks in the momentary window (400 ms)
+        static const uint kShortTermBlocks=30; ///< 100 ms blocks in the short-term window (3 s)
+        static const double kAbsoluteGate=-70; ///< LUFS
+        static const double kIntegratedGate=-10; ///< relative gate of the integrated loudness (LU)
+        static const double kRangeGate=-20; ///< relative gate of the loudness range (LU)
+        static const double kSilence=-200; ///< loudness (LUFS) or level (dB) reported for silence
+        static const double kBinWidth=.1; ///< LU per bin of the gating histograms
+        static const uint kBinsCount=800; ///< bins from the absolute gate (-70 LUFS) to +10 LUFS
+
+        /// loudness (LUFS) of a weighted mean square.
+        inline double energyToLoudness(double energy)
+        {
+            if(energy<=0)
+                return kSilence;
+            return -.691+10*log10(energy);
+        }
+
+        /** K-weighting filters for several channels: two biquad sections (direct form I), run one after the
+        *   other for each sample so that the memories of a channel stay in registers.
+        */
+        struct KWeighting
+        {
+            static const uint kSectionsCount=2;
+            static const uint kMemoriesCount=3*kSectionsCount; ///< input of the first section, output of each section
+
+            /// allocates the memories and computes the coefficients for the sample rate (not for the audio thread).
+            void setup(uint channelsCount,double sampleRate)
+            {
+                // pre-filter: high shelf (+4 dB above 1.7 kHz)
+                double f0=1681.974450955533;
+                double q=0.7071752369554196;
+                double k=tan(kPi*f0/sampleRate);
+                const double vh=pow(10,3.999843853973347/20);
+                const double vb=pow(vh,0.4996667741545416);
+                double a0=1+k/q+k*k;
+                b[0][0]=(vh+vb*k/q+k*k)/a0;
+                b[0][1]=2*(k*k-vh)/a0;
+                b[0][2]=(vh-vb*k/q+k*k)/a0;
+                a[0][0]=2*(k*k-1)/a0;
+                a[0][1]=(1-k/q+k*k)/a0;
+
+                // RLB weighting: high pass at 38 Hz
+                f0=38.13547087602444;
+                q=0.5003270373238773;
+                k=tan(kPi*f0/sampleRate);
+                a0=1+k/q+k*k;
+                b[1][0]=1;
+                b[1][1]=-2;
+                b[1][2]=1;
+                a[1][0]=2*(k*k-1)/a0;
+                a[1][1]=(1-k/q+k*k)/a0;
+
+                memories.resize(channelsCount*kMemoriesCount);
+                reset();
+            }
+
+            void reset()
+            {
+                for(uint i=0;i<memories.length;i++)
+                    memories[i]=0;
+            }
+
+            /// filters count samples of a channel in place.
+            void process(double* samples,uint channel,uint count)
+            {
+                // local copies (kept in registers)
+                double* m=memories.ptr+channel*kMemoriesCount;
+                double x1=m[0],x2=m[1],y1=m[2],y2=m[3],z1=m[4],z2=m[5];
+                const double b00=b[0][0],b01=b[0][1],b02=b[0][2],a00=a[0][0],a01=a[0][1];
+                const double b10=b[1][0],b11=b[1][1],b12=b[1][2],a10=a[1][0],a11=a[1][1];
+                for(uint i=0;i<count;i++)
+                {
+                    const double x=samples[i];
+                    const double y=b00*x+b01*x1+b02*x2-a00*y1-a01*y2;
+                    const double z=b10*y+b11*y1+b12*y2-a10*z1-a11*z2;
+                    x2=x1;
+                    x1=x;
+                    y2=y1;
+                    y1=y;
+                    z2=z1;
+                    z1=z;
+                    samples[i]=z;
+                }
+
+                // getting rid of denormal numbers
+                const double threshold=1e-20;
+                m[0]=x1;
+                m[1]=x2;
+                m[2]=(fabs(y1)<threshold)?0:y1;
+                m[3]=(fabs(y2)<threshold)?0:y2;
+                m[4]=(fabs(z1)<threshold)?0:z1;
+                m[5]=(fabs(z2)<threshold)?0:z2;
+            }
+
+            // private data
+        private:
+            double          b[kSectionsCount][3]; ///< numerators
+            double          a[kSectionsCount][2]; ///< denominators (a0=1)
+            array<double>   memories;
+        };
+
+        /** Gating histogram of loudness values (momentary or short-term), from the absolute gate: number of
+        *   values and sum of their energies for each bin.
+        */
+        struct GatingHistogram
+        {
+            GatingHistogram()
+            {
+                reset();
+            }
+
+            void reset()
+            {
+                for(uint b=0;b<kBinsCount;b++)
+                {
+                    counts[b]=0;
+                    energies[b]=0;
+                }
+                totalCount=0;
+                totalEnergy=0;
+            }
+
+            /// adds a value (weighted mean square): ignored below the absolute gate.
+            void add(double energy)
+            {
+                const double loudness=energyToLoudness(energy);
+                if(loudness<kAbsoluteGate)
+                    return;
+                const uint bin=getBin(loudness);
+                counts[bin]++;
+                energies[bin]+=energy;
+                totalCount++;
+                totalEnergy+=energy;
+            }
+
+            /// loudness (LUFS) of the values above the relative gate (LU, below the loudness of all values).
+            double getGatedLoudness(double relativeGate)const
+            {
+                const uint first=getFirstBin(relativeGate);
+                uint count=0;
+                double energy=0;
+                for(uint b=first;b<kBinsCount;b++)
+                {
+                    count+=counts[b];
+                    energy+=energies[b];
+                }
+                if(count==0)
+                    return kSilence;
+                return energyToLoudness(energy/double(count));
+            }
+
+            /// difference (LU) between the 95th and 10th percentiles of the values above the relative gate.
+            double getRange(double relativeGate)const
+            {
+                const uint first=getFirstBin(relativeGate);
+                uint count=0;
+                for(uint b=first;b<kBinsCount;b++)
+                    count+=counts[b];
+                if(count==0)
+                    return 0;
+                const double low=getPercentile(first,.1*double(count));
+                const double high=getPercentile(first,.95*double(count));
+                return high-low;
+            }
+
+            // private data
+        private:
+            uint    counts[kBinsCount];
+            double  energies[kBinsCount];
+            uint    totalCount;
+            double  totalEnergy;
+
+            static uint getBin(double loudness)
+            {
+                const double position=(loudness-kAbsoluteGate)/kBinWidth;
+                if(position<=0)
+                    return 0;
+                if(position>=double(kBinsCount-1))
+                    return kBinsCount-1;
+                return uint(position);
+            }
+
+            /// first bin above the relative gate.
+            uint getFirstBin(double relativeGate)const
+            {
+                if(totalCount==0)
+                    return kBinsCount;
+                return getBin(energyToLoudness(totalEnergy/double(totalCount))+relativeGate);
+            }
+
+            /// loudness (center of the bin) of the value at the rank, counting from the first bin.
+            double getPercentile(uint first,double rank)const
+            {
+                double count=0;
+                uint b=first;
+                for(;b<kBinsCount-1;b++)
+                {
+                    count+=double(counts[b]);
+                    if(count>rank)
+                        break;
+                }
+                return kAbsoluteGate+(double(b)+.5)*kBinWidth;
+            }
+        };
+
+        /** True peak detector for several channels: 4x oversampling with a polyphase interpolator. The
+        *   interpolator is a Kaiser windowed sinc: within .003 dB for sine waves up to 20 kHz at 48 kHz.
+        */
+        struct TruePeakDetector
+        {
+            static const uint kPhasesCount=4;
+            static const uint kPhaseLength=12; ///< taps per phase
+            static const uint kGroupSize=4; ///< outputs computed in parallel (more would not fit in registers)
+            static const uint kStride=kPhaseLength-1+kChunkSize; ///< history and chunk of a channel
+
+            TruePeakDetector()
+            {
+                // windowed sinc, centered on a tap of the first phase (which is then the identity)
+                const uint length=kPhasesCount*kPhaseLength;
+                const double center=.5*double(length);
+                const double beta=8;
+                for(uint p=1;p<kPhasesCount;p++)
+                {
+                    double sum=0;
+                    for(uint k=0;k<kPhaseLength;k++)
+                    {
+                        const double t=double(k*kPhasesCount+p)-center;
+                        const double x=kPi*t/double(kPhasesCount);
+                        const double r=t/center;
+                        const double window=besselI0(beta*sqrt(1-r*r))/besselI0(beta);
+                        taps[p-1][kPhaseLength-1-k]=window*sin(x)/x;
+                        sum+=taps[p-1][kPhaseLength-1-k];
+                    }
+                    // unity gain for each phase
+                    for(uint k=0;k<kPhaseLength;k++)
+                        taps[p-1][k]/=sum;
+                }
+            }
+
+            /// allocates the memories (not for the audio thread).
+            void setChannelsCount(uint iChannelsCount)
+            {
+                channelsCount=iChannelsCount;
+                lines.resize(channelsCount*kStride);
+                peaks.resize(channelsCount);
+                reset();
+            }
+
+            void reset()
+            {
+                for(uint i=0;i<lines.length;i++)
+                    lines[i]=0;
+                for(uint c=0;c<peaks.length;c++)
+                    peaks[c]=0;
+            }
+
+            /// highest true peak (linear) of a channel since the last reset.
+            double get_peak(uint channel)const
+            {
+                return peaks[channel];
+            }
+
+            /// updates the peaks with count samples (kChunkSize at most) of each channel.
+            void processChunk(double** samples,uint start,uint count)
+            {
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    double* line=lines.ptr+c*kStride;
+                    const double* input=samples[c]+start;
+                    for(uint i=0;i<count;i++)
+                        line[kPhaseLength-1+i]=input[i];
+                    peaks[c]=processLine(line,count,peaks[c]);
+
+                    // keep the history for the next chunk
+                    for(uint i=0;i<kPhaseLength-1;i++)
+                        line[i]=line[count+i];
+                }
+            }
+
+            // private data
+        private:
+            double          taps[kPhasesCount-1][kPhaseLength]; ///< phases 1 to 3 (phase 0 is the identity), oldest sample first
+            array<double>   lines;
+            array<double>   peaks;
+            uint            channelsCount=0;
+
+            /// maximum of the absolute values of the interpolated samples of a line (history and count samples).
+            double processLine(const double* line,uint count,double peak)const
+            {
+                double highest[kGroupSize];
+                for(uint l=0;l<kGroupSize;l++)
+                    highest[l]=peak;
+
+                // output i of the phases is between samples i+kPhaseLength/2-1 and i+kPhaseLength/2 of the line
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    const double* x=line+g*kGroupSize;
+                    for(uint p=0;p<kPhasesCount;p++)
+                    {
+                        double y[kGroupSize];
+                        if(p==0)
+                        {
+                            for(uint l=0;l<kGroupSize;l++)
+                                y[l]=x[l+kPhaseLength/2-1];
+                        }
+                        else
+                            filterGroup(x,taps[p-1],y);
+
+                        // maximum with absolute values (vectorized)
+                        for(uint l=0;l<kGroupSize;l++)
+                        {
+                            const double value=fabs(y[l]);
+                            highest[l]=.5*(highest[l]+value+fabs(highest[l]-value));
+                        }
+                    }
+                }
+                for(uint l=0;l<kGroupSize;l++)
+                {
+                    if(highest[l]>peak)
+                        peak=highest[l];
+                }
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                {
+                    const double* x=line+i;
+                    double value=fabs(x[kPhaseLength/2-1]);
+                    if(value>peak)
+                        peak=value;
+                    for(uint p=1;p<kPhasesCount;p++)
+                    {
+                        double y=0;
+                        for(uint k=0;k<kPhaseLength;k++)
+                            y+=taps[p-1][k]*x[k];
+                        value=fabs(y);
+                        if(value>peak)
+                            peak=value;
+                    }
+                }
+                return peak;
+            }
+
+            /// phase for kGroupSize consecutive outputs (input[l] to input[l+kPhaseLength-1]).
+            static void filterGroup(const double* input,const double* phaseTaps,double* y)
+            {
+                for(uint l=0;l<kGroupSize;l++)
+                    y[l]=0;
+                for(uint k=0;k<kPhaseLength;k++)
+                {
+                    const double tap=phaseTaps[k];
+                    const double* x=input+k;
+                    for(uint l=0;l<kGroupSize;l++)
+                        y[l]+=tap*x[l];
+                }
+            }
+
+            static double besselI0(double x)
+            {
+                double sum=1;
+                double term=1;
+                for(uint k=1;k<50;k++)
+                {
+                    const double f=x/(2*double(k));
+                    term*=f*f;
+                    sum+=term;
+                    if(term<1e-12*sum)
+                        break;
+                }
+                return sum;
+            }
+        };
+
+        /** Loudness meter for several channels (BS.1770-4 and EBU R128): momentary, short-term and integrated
+        *   loudness, loudness range and true peak.
+        */
+        struct LoudnessMeter
+        {
+            /** Allocates the memories (not for the audio thread). Channels are weighted as specified for up to 5.1
+            *   channels (L, R, C, LFE, Ls, Rs: the LFE channel is ignored and surround channels weighted by 1.41).
+            */
+            void setup(uint iChannelsCount,double sampleRate)
+            {
+                channelsCount=iChannelsCount;
+                kWeighting.setup(channelsCount,sampleRate);
+                truePeak.setChannelsCount(channelsCount);
+                chunk.resize(channelsCount*kChunkSize);
+                weights.resize(channelsCount);
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    weights[c]=1;
+                    if(channelsCount==6 && c==3)
+                        weights[c]=0;
+                    else if(channelsCount==6 && c>3)
+                        weights[c]=1.41;
+                }
+                blockLength=uint(sampleRate*.1+.5);
+                if(blockLength<1)
+                    blockLength=1;
+                reset();
+            }
+
+            void reset()
+            {
+                kWeighting.reset();
+                truePeak.reset();
+                momentaryHistogram.reset();
+                shortTermHistogram.reset();
+                for(uint b=0;b<kShortTermBlocks;b++)
+                    blockEnergies[b]=0;
+                blockIndex=0;
+                blocksCount=0;
+                blockPosition=0;
+                blockSum=0;
+                momentaryEnergy=0;
+                shortTermEnergy=0;
+            }
+
+            /// measures count samples of each channel (not modified).
+            void processBlock(double** samples,uint count)
+            {
+                uint start=0;
+                while(start<count)
+                {
+                    // chunks end at the end of the 100 ms blocks
+                    uint n=count-start;
+                    if(n>kChunkSize)
+                        n=kChunkSize;
+                    if(n>blockLength-blockPosition)
+                        n=blockLength-blockPosition;
+                    truePeak.processChunk(samples,start,n);
+                    for(uint c=0;c<channelsCount;c++)
+                    {
+                        const double* input=samples[c]+start;
+                        double* filtered=chunk.ptr+c*kChunkSize;
+                        for(uint i=0;i<n;i++)
+                            filtered[i]=input[i];
+                        kWeighting.process(filtered,c,n);
+                        blockSum+=weights[c]*sumOfSquares(filtered,n);
+                    }
+                    blockPosition+=n;
+                    if(blockPosition==blockLength)
+                        endBlock();
+                    start+=n;
+                }
+            }
+
+            /// loudness of the last 400 ms (LUFS).
+            double get_momentary()const
+            {
+                return energyToLoudness(momentaryEnergy);
+            }
+
+            /// loudness of the last 3 seconds (LUFS).
+            double get_shortTerm()const
+            {
+                return energyToLoudness(shortTermEnergy);
+            }
+
+            /// integrated loudness since the last reset (LUFS).
+            double get_integrated()const
+            {
+                return momentaryHistogram.getGatedLoudness(kIntegratedGate);
+            }
+
+            /// loudness range since the last reset (LU).
+            double get_range()const
+            {
+                return shortTermHistogram.getRange(kRangeGate);
+            }
+
+            /// highest true peak of all channels since the last reset (dBTP).
+            double get_truePeak()const
+            {
+                double peak=0;
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    if(truePeak.get_peak(c)>peak)
+                        peak=truePeak.get_peak(c);
+                }
+                if(peak<=0)
+                    return kSilence;
+                return 20*log10(peak);
+            }
+
+            // private data
+        private:
+            KWeighting          kWeighting;
+            TruePeakDetector    truePeak;
+            GatingHistogram     momentaryHistogram;
+            GatingHistogram     shortTermHistogram;
+            array<double>       chunk; ///< K-weighted chunk of each channel
+            array<double>       weights;
+            uint                channelsCount=0;
+            uint                blockLength=1; ///< samples per 100 ms block
+            uint                blockPosition=0;
+            double              blockSum=0; ///< weighted sum of squares of the current block
+            double              blockEnergies[kShortTermBlocks]; ///< weighted mean squares of the last blocks
+            uint                blockIndex=0;
+            uint                blocksCount=0; ///< complete blocks since reset (up to kShortTermBlocks)
+            double              momentaryEnergy=0;
+            double              shortTermEnergy=0;
+
+            /// updates the windows and histograms at the end of a 100 ms block.
+            void endBlock()
+            {
+                blockEnergies[blockIndex]=blockSum/double(blockLength);
+                blockIndex++;
+                if(blockIndex==kShortTermBlocks)
+                    blockIndex=0;
+                if(blocksCount<kShortTermBlocks)
+                    blocksCount++;
+                blockPosition=0;
+                blockSum=0;
+
+                // windows: the last blocks (missing blocks are silent)
+                double sum=0;
+                for(uint b=1;b<=kShortTermBlocks;b++)
+                {
+                    sum+=blockEnergies[(blockIndex+kShortTermBlocks-b)%kShortTermBlocks];
+                    if(b==kMomentaryBlocks)
+                        momentaryEnergy=sum/double(kMomentaryBlocks);
+                }
+                shortTermEnergy=sum/double(kShortTermBlocks);
+
+                // gating blocks overlap by 75% (momentary) and short-term values are taken every 100 ms
+                if(blocksCount>=kMomentaryBlocks)
+                    momentaryHistogram.add(momentaryEnergy);
+                if(blocksCount>=kShortTermBlocks)
+                    shortTermHistogram.add(shortTermEnergy);
+            }
+
+            /// sum of squares of count values, in parallel lanes (vectorized).
+            static double sumOfSquares(const double* values,uint count)
+            {
+                double lanes[kGroupSize]={0};
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    const double* group=values+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        lanes[l]+=group[l]*group[l];
+                }
+                double sum=0;
+                for(uint l=0;l<kGroupSize;l++)
+                    sum+=lanes[l];
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                    sum+=values[i]*values[i];
+                return sum;
+            }
+        };
+    }
+}
+#endif
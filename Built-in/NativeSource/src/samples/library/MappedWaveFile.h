@@ -0,0 +1,272 @@
+#ifndef _MappedWaveFile_h_
+#define _MappedWaveFile_h_
+
+#include "PcmDecode.h"
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ *  \file MappedWaveFile.h
+ *  Memory mapped (zero copy) access to wave files for c++ scripting.
+ *
+ *  Created by Blue Cat Audio <services@bluecataudio.com>
+ *  \copyright 2014 Blue Cat Audio. All rights reserved.
+ *
+ *  The file is mapped in memory by the operating system, which loads it on demand: there is no
+ *  read call or intermediate copy, and the data chunk can be accessed directly or decoded by blocks
+ *  (see PcmDecode.h). Supports 8/16/24/32-bit integer and 32/64-bit float PCM files (including the
+ *  WAVE_FORMAT_EXTENSIBLE variant), and RF64/BW64 files larger than 4 GB on 64-bit systems.
+ *
+ *  Opening and mapping a file should not be done from the real time audio thread, and the first
+ *  access to a region of the file may read it from disk.
+ */
+
+struct MappedWaveFile
+{
+    /** Maps the file in memory and parses the wave file header.
+     *   Returns false if the file cannot be opened or is not a supported wave file.
+     */
+    bool open(const std::string& filePath)
+    {
+        close();
+        if(!map(filePath))
+            return false;
+        if(!parseHeader())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /** Unmaps the file.
+     *
+     */
+    void close()
+    {
+        unmap();
+        data=null;
+        dataSize=0;
+        channelsCount=0;
+        samplesCount=0;
+        sampleRate=0;
+        bytesPerSample=0;
+        format=KittyDSP::Pcm::kUnsupportedFormat;
+    }
+
+    ~MappedWaveFile()
+    {
+        close();
+    }
+
+    /** Decodes samplesCount samples starting at "position" to deinterleaved buffers (samples[ch][i]),
+     *   for iChannelsCount channels (missing channels are set to zero).
+     *   Returns the number of samples decoded (less than samplesCount if the end of the file is reached).
+     */
+    uint decode(uint64 position,double** samples,uint iChannelsCount,uint iSamplesCount)const
+    {
+        uint count=0;
+        if(position<samplesCount)
+        {
+            uint64 available=samplesCount-position;
+            count=(available<iSamplesCount)?uint(available):iSamplesCount;
+            KittyDSP::Pcm::decodeDeinterleaved(format,data+position*get_bytesPerFrame(),channelsCount,samples,iChannelsCount,0,count);
+        }
+        return count;
+    }
+
+    /** Decodes samplesCount samples starting at "position" to interleaved samples (all channels of the file).
+     *   Returns the number of samples decoded (less than samplesCount if the end of the file is reached).
+     */
+    uint64 decodeInterleaved(uint64 position,double* interleavedSamples,uint64 iSamplesCount)const
+    {
+        uint64 count=0;
+        if(position<samplesCount)
+        {
+            uint64 available=samplesCount-position;
+            count=(available<iSamplesCount)?available:iSamplesCount;
+            KittyDSP::Pcm::toDouble(format,data+position*get_bytesPerFrame(),interleavedSamples,size_t(count*channelsCount));
+        }
+        return count;
+    }
+
+    /// data chunk: raw interleaved samples (little endian), or null if not opened.
+    const uint8* get_data()const{return data;}
+    /// size of the data chunk in bytes.
+    uint64 get_dataSize()const{return dataSize;}
+    /// number of audio channels.
+    uint get_channelsCount()const{return channelsCount;}
+    /// number of audio samples (per channel).
+    uint64 get_samplesCount()const{return samplesCount;}
+    /// the sample rate of the audio data.
+    double get_sampleRate()const{return sampleRate;}
+    /// the number of bytes per individual channel sample.
+    uint get_bytesPerSample()const{return bytesPerSample;}
+    /// the number of bytes per sample frame (all channels).
+    uint get_bytesPerFrame()const{return bytesPerSample*channelsCount;}
+    /// the format of the samples.
+    KittyDSP::Pcm::SampleFormat get_format()const{return format;}
+
+    // private data
+private:
+    static uint32_t readUInt32(const uint8* p)
+    {
+        return uint32_t(p[0])|(uint32_t(p[1])<<8)|(uint32_t(p[2])<<16)|(uint32_t(p[3])<<24);
+    }
+
+    static uint16_t readUInt16(const uint8* p)
+    {
+        return uint16_t(p[0]|(p[1]<<8));
+    }
+
+    bool parseHeader()
+    {
+        if(fileSize<12 || memcmp(fileData+8,"WAVE",4)!=0)
+            return false;
+        if(memcmp(fileData,"RIFF",4)!=0 && memcmp(fileData,"RF64",4)!=0 && memcmp(fileData,"BW64",4)!=0)
+            return false;
+
+        bool hasFormat=false;
+        bool isFloat=false;
+        uint64 ds64DataSize=0;
+        uint64 offset=12;
+        while(offset+8<=fileSize)
+        {
+            const uint8* chunk=fileData+offset;
+            uint64 chunkSize=readUInt32(chunk+4);
+            uint64 chunkDataOffset=offset+8;
+            if(memcmp(chunk,"ds64",4)==0 && chunkSize>=24 && chunkDataOffset+24<=fileSize)
+            {
+                // RF64: 64-bit sizes (riff, data, samples count)
+                ds64DataSize=uint64(readUInt32(chunk+16))|(uint64(readUInt32(chunk+20))<<32);
+            }
+            else if(memcmp(chunk,"fmt ",4)==0 && chunkSize>=16 && chunkDataOffset+16<=fileSize)
+            {
+                const uint8* fmt=fileData+chunkDataOffset;
+                uint formatTag=readUInt16(fmt);
+                channelsCount=readUInt16(fmt+2);
+                sampleRate=readUInt32(fmt+4);
+                bytesPerSample=readUInt16(fmt+14)/8;
+                if(formatTag==0xFFFE && chunkSize>=26 && chunkDataOffset+26<=fileSize)
+                    formatTag=readUInt16(fmt+24); // WAVE_FORMAT_EXTENSIBLE: sub format
+                if(formatTag!=1 && formatTag!=3)
+                    return false;
+                isFloat=(formatTag==3);
+                hasFormat=true;
+            }
+            else if(memcmp(chunk,"data",4)==0)
+            {
+                if(!hasFormat)
+                    return false;
+                format=KittyDSP::Pcm::getSampleFormat(bytesPerSample,isFloat);
+                if(format==KittyDSP::Pcm::kUnsupportedFormat || channelsCount==0)
+                    return false;
+                if(chunkSize==0xFFFFFFFF && ds64DataSize!=0)
+                    chunkSize=ds64DataSize;
+                // truncated files: use the data actually available
+                if(chunkDataOffset+chunkSize>fileSize)
+                    chunkSize=fileSize-chunkDataOffset;
+                data=fileData+chunkDataOffset;
+                samplesCount=chunkSize/get_bytesPerFrame();
+                dataSize=samplesCount*get_bytesPerFrame();
+                return true;
+            }
+            // next chunk (chunks are word aligned)
+            offset=chunkDataOffset+chunkSize+(chunkSize&1);
+        }
+        return false;
+    }
+
+#ifdef _WIN32
+    bool map(const std::string& filePath)
+    {
+        fileHandle=CreateFileA(filePath.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+        if(fileHandle==INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if(GetFileSizeEx(fileHandle,&size) && size.QuadPart>0)
+        {
+            mappingHandle=CreateFileMappingA(fileHandle,NULL,PAGE_READONLY,0,0,NULL);
+            if(mappingHandle!=NULL)
+            {
+                fileData=(const uint8*)MapViewOfFile(mappingHandle,FILE_MAP_READ,0,0,0);
+                fileSize=uint64(size.QuadPart);
+            }
+        }
+        if(fileData==null)
+        {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void unmap()
+    {
+        if(fileData!=null)
+            UnmapViewOfFile(fileData);
+        if(mappingHandle!=NULL)
+            CloseHandle(mappingHandle);
+        if(fileHandle!=INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        fileData=null;
+        fileSize=0;
+        mappingHandle=NULL;
+        fileHandle=INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE          fileHandle=INVALID_HANDLE_VALUE;
+    HANDLE          mappingHandle=NULL;
+#else
+    bool map(const std::string& filePath)
+    {
+        int fd=::open(filePath.c_str(),O_RDONLY);
+        if(fd<0)
+            return false;
+        struct stat status;
+        if(fstat(fd,&status)==0 && status.st_size>0)
+        {
+            void* address=mmap(null,size_t(status.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+            if(address!=MAP_FAILED)
+            {
+                fileData=(const uint8*)address;
+                fileSize=uint64(status.st_size);
+                // the file is usually read from the beginning to the end: let the system read ahead
+                madvise(address,size_t(fileSize),MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd); // the mapping remains valid
+        return fileData!=null;
+    }
+
+    void unmap()
+    {
+        if(fileData!=null)
+            munmap((void*)fileData,size_t(fileSize));
+        fileData=null;
+        fileSize=0;
+    }
+#endif
+
+    const uint8*    fileData=null; // the entire file
+    uint64          fileSize=0;
+    const uint8*    data=null; // the data chunk
+    uint64          dataSize=0;
+    uint            channelsCount=0;
+    uint64          samplesCount=0;
+    double          sampleRate=0;
+    uint            bytesPerSample=0;
+    KittyDSP::Pcm::SampleFormat format=KittyDSP::Pcm::kUnsupportedFormat;
+};
+#endif
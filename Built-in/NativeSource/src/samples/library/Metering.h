@@ -0,0 +1,294 @@
+#ifndef _Metering_h_
+#define _Metering_h_
+
+#include <math.h>
+/** \file Metering.h
+*   Block processing for meters (c/c++ dsp scripting).
+*
+*   Meters only need their values once per block (computeOutputData), so they can process whole
+*   blocks (processBlock) instead of being called for every sample:
+*   - reductions (maximum of absolute values, sums) computed in parallel lanes of 16 samples that
+*     the compiler can vectorize, then combined.
+*   - peak ballistics (instant attack, exponential release) in closed form: the level after a group
+*     of samples is a weighted maximum of the samples and of the previous level, so that meters do
+*     not have to run a recurrence for every sample.
+*   - decimation of waveforms to the display width (minimum and maximum of each column), so that
+*     displays receive two values per column instead of every sample.
+*   - formatting of display values without sprintf, for user interfaces that only read output strings.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Metering
+    {
+        static const uint kGroupSize=16; ///< samples processed in parallel
+
+        /// highest of two values, computed with absolute values (vectorized, unlike comparisons).
+        inline double maxOf(double a,double b)
+        {
+            return .5*(a+b+fabs(a-b));
+        }
+
+        /// maximum of the absolute values of count samples (0 if count is 0).
+        inline double maxAbs(const double* samples,uint count)
+        {
+            double lanes[kGroupSize]={0};
+            const uint groupsCount=count/kGroupSize;
+            for(uint g=0;g<groupsCount;g++)
+            {
+                const double* group=samples+g*kGroupSize;
+                for(uint l=0;l<kGroupSize;l++)
+                    lanes[l]=maxOf(lanes[l],fabs(group[l]));
+            }
+            double result=0;
+            for(uint l=0;l<kGroupSize;l++)
+                result=maxOf(result,lanes[l]);
+            for(uint i=groupsCount*kGroupSize;i<count;i++)
+                result=maxOf(result,fabs(samples[i]));
+            return result;
+        }
+
+        /// sum of the squares of count samples.
+        inline double sumOfSquares(const double* samples,uint count)
+        {
+            double lanes[kGroupSize]={0};
+            const uint groupsCount=count/kGroupSize;
+            for(uint g=0;g<groupsCount;g++)
+            {
+                const double* group=samples+g*kGroupSize;
+                for(uint l=0;l<kGroupSize;l++)
+                    lanes[l]+=group[l]*group[l];
+            }
+            double result=0;
+            for(uint l=0;l<kGroupSize;l++)
+                result+=lanes[l];
+            for(uint i=groupsCount*kGroupSize;i<count;i++)
+                result+=samples[i]*samples[i];
+            return result;
+        }
+
+        /** Mean of several channels, for count samples starting at index start of each channel.
+        *   The output may be one of the channels.
+        */
+        inline void mixDown(double** samples,uint channelsCount,uint start,uint count,double* output)
+        {
+            if(channelsCount==0)
+            {
+                for(uint i=0;i<count;i++)
+                    output[i]=0;
+                return;
+            }
+            const double scale=1/double(channelsCount);
+            const uint groupsCount=count/kGroupSize;
+            for(uint g=0;g<groupsCount;g++)
+            {
+                // local sums, so that output can alias the channels
+                double sum[kGroupSize]={0};
+                for(uint c=0;c<channelsCount;c++)
+                {
+                    const double* group=samples[c]+start+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        sum[l]+=group[l];
+                }
+                double* out=output+g*kGroupSize;
+                for(uint l=0;l<kGroupSize;l++)
+                    out[l]=sum[l]*scale;
+            }
+            for(uint i=groupsCount*kGroupSize;i<count;i++)
+            {
+                double sum=0;
+                for(uint c=0;c<channelsCount;c++)
+                    sum+=samples[c][start+i];
+                output[i]=sum*scale;
+            }
+        }
+
+        /** Minimum and maximum values of count samples for each of columnsCount columns (display width), stored as
+        *   (min,max) pairs in output (2*columnsCount values). Samples are spread evenly over the columns.
+        */
+        inline void decimateMinMax(const double* samples,uint count,uint columnsCount,float* output)
+        {
+            for(uint c=0;c<columnsCount;c++)
+            {
+                uint start=uint(uint64(c)*count/columnsCount);
+                uint end=uint(uint64(c+1)*count/columnsCount);
+                double low=0;
+                double high=0;
+                if(start<count)
+                {
+                    if(end==start)
+                        end=start+1;
+                    low=samples[start];
+                    high=samples[start];
+                    for(uint i=start+1;i<end;i++)
+                    {
+                        const double value=samples[i];
+                        if(value<low)
+                            low=value;
+                        if(value>high)
+                            high=value;
+                    }
+                }
+                output[2*c]=float(low);
+                output[2*c+1]=float(high);
+            }
+        }
+
+        static const uint kMaxValueLength=12; ///< characters written by writeValue, with a separator: "-9999.9999;"
+
+        /** Writes value with 4 decimals at position (without using sprintf, no terminating zero), and returns the
+        *   number of characters (kMaxValueLength-1 at most: values are clipped to +/-9999.9999).
+        */
+        inline uint writeValue(char* position,double value)
+        {
+            char* current=position;
+            if(value<0)
+            {
+                *current++='-';
+                value=-value;
+            }
+            if(!(value<9999.9999)) // also catches NaN
+                value=9999.9999;
+            uint fixedPoint=uint(value*10000+.5);
+            uint integerPart=fixedPoint/10000;
+            uint decimals=fixedPoint%10000;
+
+            // integer part (at most 4 digits)
+            char digits[4];
+            uint digitsCount=0;
+            do
+            {
+                digits[digitsCount++]=char('0'+integerPart%10);
+                integerPart/=10;
+            } while(integerPart!=0);
+            while(digitsCount>0)
+                *current++=digits[--digitsCount];
+
+            // decimals
+            *current++='.';
+            for(uint divider=1000;divider!=0;divider/=10)
+            {
+                *current++=char('0'+decimals/divider);
+                decimals%=divider;
+            }
+            return uint(current-position);
+        }
+
+        /** Peak level with an instant attack and an exponential release toward the current value (the classic
+        *   meter ballistics): for every sample, level=|x| if above the level, level+=d*(|x|-level) otherwise.
+        *   That is level=max(v,r*level+d*v) with v=|x| and r=1-d, which is still of the form max(a,r*level+b)
+        *   after several samples: for a group of n samples, the level is the highest of the start level decayed
+        *   (r^n*level+d*sum(v(j)*r^(n-1-j))) and of each sample decayed after it was measured
+        *   (v(i)*r^(n-1-i)+d*sum for j>i of v(j)*r^(n-1-j)). Several channels are measured together (maximum of
+        *   the channels for every sample).
+        */
+        struct PeakBallistics
+        {
+            PeakBallistics()
+            {
+                setRelease(0);
+            }
+
+            /// release coefficient d (0 to 1): part of the distance to the current value lost per sample.
+            void setRelease(double coefficient)
+            {
+                if(coefficient<0)
+                    coefficient=0;
+                if(coefficient>1)
+                    coefficient=1;
+                const double r=1-coefficient;
+                // weights of the samples of a group at its end, and decay over a whole group
+                double power=1;
+                for(uint l=kGroupSize;l>0;l--)
+                {
+                    weights[l-1]=power;
+                    power*=r;
+                }
+                groupDecay=power;
+                decay=r;
+                release=coefficient;
+            }
+
+            double get_level()const
+            {
+                return level;
+            }
+
+            void reset()
+            {
+                level=0;
+            }
+
+            /// updates the level with count samples of channelsCount channels.
+            void processBlock(double** samples,uint channelsCount,uint count)
+            {
+                if(channelsCount==0)
+                    return;
+                // local copies (kept in registers)
+                double w[kGroupSize];
+                for(uint l=0;l<kGroupSize;l++)
+                    w[l]=weights[l];
+                const double r=decay;
+                const double d=release;
+                const double rGroup=groupDecay;
+                double value=level;
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    // highest channel, weighted by the decay until the end of the group
+                    double weighted[kGroupSize];
+                    const double* first=samples[0]+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        weighted[l]=fabs(first[l]);
+                    for(uint c=1;c<channelsCount;c++)
+                    {
+                        const double* group=samples[c]+g*kGroupSize;
+                        for(uint l=0;l<kGroupSize;l++)
+                            weighted[l]=maxOf(weighted[l],fabs(group[l]));
+                    }
+                    for(uint l=0;l<kGroupSize;l++)
+                        weighted[l]*=w[l];
+
+                    // running sums: the part of the release sum that comes from samples up to l
+                    double sums[kGroupSize];
+                    double sum=0;
+                    for(uint l=0;l<kGroupSize;l++)
+                    {
+                        sum+=weighted[l];
+                        sums[l]=sum;
+                    }
+                    // the common release part d*sum is added once (scalar maximum: not vectorized anyway)
+                    double highest=value*rGroup;
+                    for(uint l=0;l<kGroupSize;l++)
+                    {
+                        const double candidate=weighted[l]-d*sums[l];
+                        if(candidate>highest)
+                            highest=candidate;
+                    }
+                    value=highest+d*sum;
+                }
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                {
+                    double v=fabs(samples[0][i]);
+                    for(uint c=1;c<channelsCount;c++)
+                        v=maxOf(v,fabs(samples[c][i]));
+                    value=maxOf(v,value*r+d*v);
+                }
+                level=value;
+            }
+
+            // private data
+        private:
+            double  weights[kGroupSize]; ///< r^(kGroupSize-1-l)
+            double  groupDecay=1; ///< r^kGroupSize
+            double  decay=1; ///< r
+            double  release=0; ///< d
+            double  level=0;
+        };
+    }
+}
+#endif
@@ -0,0 +1,87 @@
+#ifndef _MidiBlockSplitter_h_
+#define _MidiBlockSplitter_h_
+
+#include <math.h>
+/** \file MidiBlockSplitter.h
+*   Splits an audio block into spans without MIDI events, for c/c++ dsp scripting.
+*
+*   Instead of checking the MIDI events queue for every sample, instruments can render contiguous
+*   spans of samples between events with a tight loop (that the compiler can vectorize), and apply
+*   the events at the beginning of each span. Events remain sample accurate: an event with time stamp t
+*   is applied before the first sample i such as t<=i (same as in the per sample loops of the samples).
+*
+*   Usage:
+*   \code
+*   KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents,data.samplesToProcess);
+*   while(span.next())
+*   {
+*       for(uint e=0;e<span.get_eventsCount();e++)
+*           handleMidiEvent(span.getEvent(e));
+*       render(output+span.get_start(),span.get_length());
+*   }
+*   \endcode
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Midi
+    {
+        /** Walks the MIDI events queue once (events are sorted by time stamp) and returns
+        *   the spans of the block, with the events to apply before each of them.
+        */
+        struct BlockSplitter
+        {
+            BlockSplitter(const MidiQueue& iEvents,uint iSamplesCount):
+                events(iEvents),
+                samplesCount(iSamplesCount)
+            {}
+
+            /** Moves to the next span. Returns false when the end of the block has been reached.
+            *   Events with a time stamp after the end of the block are ignored.
+            */
+            bool next()
+            {
+                if(end>=samplesCount)
+                    return false;
+                start=end;
+                firstEvent=nextEvent;
+                while(nextEvent!=events.length && events[nextEvent].timeStamp<=double(start))
+                    nextEvent++;
+                end=samplesCount;
+                if(nextEvent!=events.length)
+                {
+                    // first sample that comes after the next event
+                    double eventPosition=ceil(events[nextEvent].timeStamp);
+                    if(eventPosition<double(end))
+                        end=uint(eventPosition);
+                }
+                return true;
+            }
+
+            /// position of the first sample of the span in the block.
+            uint get_start()const{return start;}
+            /// number of samples in the span (at least one).
+            uint get_length()const{return end-start;}
+            /// position of the sample after the span in the block.
+            uint get_end()const{return end;}
+            /// number of events to apply before rendering the span.
+            uint get_eventsCount()const{return nextEvent-firstEvent;}
+            /// event i (0 to eventsCount-1) to apply before rendering the span, in time order.
+            const MidiEvent& getEvent(uint i)const{return events[firstEvent+i];}
+
+            // private data
+        private:
+            const MidiQueue&    events;
+            uint                samplesCount;
+            uint                start=0;
+            uint                end=0;
+            uint                firstEvent=0;
+            uint                nextEvent=0;
+        };
+    }
+}
+#endif
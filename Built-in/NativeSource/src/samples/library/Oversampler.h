@@ -0,0 +1,609 @@
+#ifndef _Oversampler_h_
+#define _Oversampler_h_
+
+#include <math.h>
+/** \file Oversampler.h
+*   Oversampling (2x, 4x or 8x) of a nonlinear processing kernel (c/c++ dsp scripting).
+*
+*   The signal is upsampled, processed by the kernel at the higher rate, and downsampled. Each 2x
+*   step is a half-band lowpass filter, cascaded for higher factors (the first step, closest to the
+*   audio band, uses the longest filter). Two modes are available:
+*   - linear phase: polyphase half-band FIR filters (Kaiser windowed sinc). Half of the taps of a
+*     half-band filter are zero: each branch of the polyphase filter is either a pure delay or a
+*     symmetric FIR, computed for groups of 8 output samples (independent sums that the compiler
+*     can vectorize). The latency is padded to a whole number of samples at the base rate, so that
+*     the reported latency is exact.
+*   - minimum phase: polyphase IIR half-band filters (two chains of first order allpass sections,
+*     elliptic response). Very short delay (a few samples), but the phase is not linear: the
+*     reported latency is the position of the peak of the impulse response (measured when the
+*     factor changes), which comes about one sample after the group delay at low frequencies.
+*
+*   Filter coefficients and channel memories are allocated by setChannelsCount() for the highest
+*   factor, so that the factor and mode can be changed in the audio thread.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Oversampling
+    {
+        /** Oversampling filters mode.
+        *
+        */
+        enum Mode
+        {
+            kLinearPhase,
+            kMinimumPhase
+        };
+
+        static const uint kMaxStages=3; ///< 2^kMaxStages is the highest oversampling factor
+        static const uint kMaxFactor=1<<kMaxStages;
+        static const uint kChunkSize=64; ///< samples (base rate) processed at once
+        static const uint kGroupSize=8; ///< FIR output samples computed in parallel
+
+        /// modified Bessel function of the first kind, order 0 (for Kaiser windows).
+        inline double besselI0(double x)
+        {
+            double sum=1;
+            double term=1;
+            for(uint k=1;k<64 && term>sum*1e-17;k++)
+            {
+                const double t=x/(2*k);
+                term*=t*t;
+                sum+=term;
+            }
+            return sum;
+        }
+
+        /** Linear phase half-band FIR filter, for one 2x step (up and down).
+        *   The filter has 4*halfLength-1 taps: the center tap (.5), zeros, and 2*halfLength non zero taps,
+        *   which form the FIR branch of the polyphase filter (the other branch is a delay of halfLength
+        *   samples at the lower rate).
+        */
+        struct HalfBandFir
+        {
+            /// designs the filter (Kaiser window): longer filters have a sharper transition.
+            void design(uint iHalfLength,double beta)
+            {
+                halfLength=iHalfLength;
+                const uint count=2*halfLength;
+                taps.resize(count);
+                const double center=double(2*halfLength-1);
+                const double i0Beta=besselI0(beta);
+                for(uint i=0;i<count;i++)
+                {
+                    // tap i of the branch is the tap 2*i of the full filter
+                    const double n=double(2*i)-center;
+                    const double r=n/(center+1);
+                    const double window=besselI0(beta*sqrt(1-r*r))/i0Beta;
+                    taps[i]=sin(PI*n*.5)/(PI*n)*window;
+                }
+                // normalize: unity gain at DC (the taps of the branch sum to .5)
+                double sum=0;
+                for(uint i=0;i<count;i++)
+                    sum+=taps[i];
+                for(uint i=0;i<count;i++)
+                    taps[i]*=.5/sum;
+            }
+
+            uint get_halfLength()const
+            {
+                return halfLength;
+            }
+
+            /// samples of history before the input of the FIR branch.
+            uint get_historyLength()const
+            {
+                return 2*halfLength-1;
+            }
+
+            /// delay of the up and down filters together, at the higher rate, in samples.
+            uint get_delay()const
+            {
+                return 2*(2*halfLength-1);
+            }
+
+            /** Upsamples count samples: line contains get_historyLength() samples of history followed by the
+            *   input samples. Writes 2*count samples to output and updates the history.
+            */
+            void upsample(double* line,uint count,double* output)const
+            {
+                const uint history=get_historyLength();
+                const double* delayed=line+halfLength;
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    double y[kGroupSize];
+                    filterGroup(line+g*kGroupSize,y);
+                    double* group=output+2*g*kGroupSize;
+                    const double* d=delayed+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                    {
+                        group[2*l]=2*y[l];
+                        group[2*l+1]=d[l];
+                    }
+                }
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                {
+                    output[2*i]=2*filterSample(line+i);
+                    output[2*i+1]=delayed[i];
+                }
+                for(uint i=0;i<history;i++)
+                    line[i]=line[count+i];
+            }
+
+            /** Downsamples 2*count samples (input) to count samples (output). evenLine and oddLine hold the history
+            *   of the even and odd samples (get_historyLength() and get_halfLength() samples), followed by room for
+            *   count samples.
+            */
+            void downsample(const double* input,uint count,double* evenLine,double* oddLine,double* output)const
+            {
+                const uint history=get_historyLength();
+                double* even=evenLine+history;
+                double* odd=oddLine+halfLength;
+                for(uint i=0;i<count;i++)
+                {
+                    even[i]=input[2*i];
+                    odd[i]=input[2*i+1];
+                }
+                const uint groupsCount=count/kGroupSize;
+                for(uint g=0;g<groupsCount;g++)
+                {
+                    double y[kGroupSize];
+                    filterGroup(evenLine+g*kGroupSize,y);
+                    double* group=output+g*kGroupSize;
+                    const double* d=oddLine+g*kGroupSize;
+                    for(uint l=0;l<kGroupSize;l++)
+                        group[l]=y[l]+.5*d[l];
+                }
+                for(uint i=groupsCount*kGroupSize;i<count;i++)
+                    output[i]=filterSample(evenLine+i)+.5*oddLine[i];
+                for(uint i=0;i<history;i++)
+                    evenLine[i]=evenLine[count+i];
+                for(uint i=0;i<halfLength;i++)
+                    oddLine[i]=oddLine[count+i];
+            }
+
+            // private data
+        private:
+            array<double>   taps;
+            uint            halfLength=0;
+
+            /// FIR branch for kGroupSize consecutive outputs (input[l] to input[l+taps count-1]).
+            void filterGroup(const double* input,double* y)const
+            {
+                for(uint l=0;l<kGroupSize;l++)
+                    y[l]=0;
+                const double* t=taps.ptr;
+                for(uint i=0,count=taps.length;i<count;i++)
+                {
+                    const double tap=t[i];
+                    const double* x=input+i;
+                    for(uint l=0;l<kGroupSize;l++)
+                        y[l]+=tap*x[l];
+                }
+            }
+
+            double filterSample(const double* input)const
+            {
+                double y=0;
+                for(uint i=0;i<taps.length;i++)
+                    y+=taps[i]*input[i];
+                return y;
+            }
+        };
+
+        /** Minimum phase half-band IIR filter, for one 2x step (up and down): two chains of first order
+        *   allpass sections (a+z^-1)/(1+a*z^-1) at the lower rate, with alternate coefficients.
+        */
+        struct HalfBandIir
+        {
+            static const uint kMaxCoefficients=12;
+
+            /** Designs the filter for a number of coefficients (memory: 2 values per coefficient) and a
+            *   transition bandwidth (relative to the higher sampling rate, 0 to .5).
+            */
+            void design(uint count,double transition)
+            {
+                if(count>kMaxCoefficients)
+                    count=kMaxCoefficients;
+                coefficientsCount=count;
+
+                // elliptic filter parameters
+                double k=tan((1-transition*2)*PI/4);
+                k*=k;
+                const double kk=pow(1-k*k,.25);
+                const double e=.5*(1-kk)/(1+kk);
+                const double e4=e*e*e*e;
+                const double q=e*(1+e4*(2+e4*(15+150*e4)));
+                const double order=double(2*count+1);
+                for(uint c=0;c<count;c++)
+                {
+                    double num=0;
+                    double term=0;
+                    int sign=1;
+                    for(uint i=0;i==0 || fabs(term)>1e-100;i++,sign=-sign)
+                    {
+                        term=pow(q,double(i*(i+1)))*sin(double(2*i+1)*double(c+1)*PI/order)*sign;
+                        num+=term;
+                    }
+                    double den=.5;
+                    sign=-1;
+                    for(uint i=1;i==1 || fabs(term)>1e-100;i++,sign=-sign)
+                    {
+                        term=pow(q,double(i*i))*cos(double(2*i)*double(c+1)*PI/order)*sign;
+                        den+=term;
+                    }
+                    const double w=num*pow(q,.25)/den;
+                    const double w2=w*w;
+                    const double x=sqrt((1-w2*k)*(1-w2/k))/(1+w2);
+                    coefficients[c]=(1-x)/(1+x);
+                }
+            }
+
+            uint get_coefficientsCount()const
+            {
+                return coefficientsCount;
+            }
+
+            /// group delay at low frequencies of the up and down filters together, at the higher rate, in samples.
+            double get_delay()const
+            {
+                // sum of the allpass delays of both chains (each delay doubled at the higher rate). The delay
+                // between the chains (one sample) is compensated by the downsampler, which ends on the odd sample
+                double delay=0;
+                for(uint c=0;c<coefficientsCount;c++)
+                    delay+=(1-coefficients[c])/(1+coefficients[c]);
+                return 2*delay;
+            }
+
+            /** Upsamples count samples (input) to 2*count samples (output). memory holds 2*get_coefficientsCount()
+            *   values.
+            */
+            void upsample(const double* input,uint count,double* memory,double* output)const
+            {
+                for(uint i=0;i<count;i++)
+                {
+                    double even=input[i];
+                    double odd=even;
+                    processPair(even,odd,memory);
+                    output[2*i]=even;
+                    output[2*i+1]=odd;
+                }
+            }
+
+            /** Downsamples 2*count samples (input) to count samples (output). memory holds 2*get_coefficientsCount()
+            *   values.
+            */
+            void downsample(const double* input,uint count,double* memory,double* output)const
+            {
+                for(uint i=0;i<count;i++)
+                {
+                    double even=input[2*i+1];
+                    double odd=input[2*i];
+                    processPair(even,odd,memory);
+                    output[i]=.5*(even+odd);
+                }
+            }
+
+            // private data
+        private:
+            double  coefficients[kMaxCoefficients]={0};
+            uint    coefficientsCount=0;
+
+            /// processes one sample of both chains (even coefficients for the first one, odd for the second one).
+            void processPair(double& even,double& odd,double* memory)const
+            {
+                for(uint c=0;c+1<coefficientsCount;c+=2)
+                {
+                    even=allpass(even,coefficients[c],memory[2*c],memory[2*c+1]);
+                    odd=allpass(odd,coefficients[c+1],memory[2*c+2],memory[2*c+3]);
+                }
+                if(coefficientsCount&1)
+                {
+                    const uint c=coefficientsCount-1;
+                    even=allpass(even,coefficients[c],memory[2*c],memory[2*c+1]);
+                }
+            }
+
+            static double allpass(double input,double a,double& inputMem,double& outputMem)
+            {
+                double output=(input-outputMem)*a+inputMem;
+                // getting rid of denormal numbers
+                const double antiDenormal=1e-30;
+                output+=antiDenormal;
+                output-=antiDenormal;
+                inputMem=input;
+                outputMem=output;
+                return output;
+            }
+        };
+
+        /** Oversampler for several channels: upsample() a chunk of a channel, process the returned samples with
+        *   the kernel, then downsample() them. process() does it for a whole block.
+        */
+        struct Oversampler
+        {
+            Oversampler(uint iChannelsCount=0)
+            {
+                // the first step needs a sharp transition (top of the audio band), the others only need to
+                // reject the images above the audio band
+                fir[0].design(16,8);
+                iir[0].design(10,.04);
+                for(uint s=1;s<kMaxStages;s++)
+                {
+                    fir[s].design(6,8);
+                    iir[s].design(4,.15);
+                }
+                for(uint s=0;s<kMaxStages;s++)
+                {
+                    upStride[s]=fir[s].get_historyLength()+(kChunkSize<<s);
+                    oddStride[s]=fir[s].get_halfLength()+(kChunkSize<<s);
+                    iirStride[s]=2*iir[s].get_coefficientsCount();
+                }
+                setChannelsCount(iChannelsCount);
+                setFactor(2);
+            }
+
+            /// allocates the memories of the channels (not for the audio thread).
+            void setChannelsCount(uint iChannelsCount)
+            {
+                channelsCount=iChannelsCount;
+                for(uint s=0;s<kMaxStages;s++)
+                {
+                    upLines[s].resize(channelsCount*upStride[s]);
+                    evenLines[s].resize(channelsCount*upStride[s]);
+                    oddLines[s].resize(channelsCount*oddStride[s]);
+                    iirUpMemory[s].resize(channelsCount*iirStride[s]);
+                    iirDownMemory[s].resize(channelsCount*iirStride[s]);
+                }
+                delayLines.resize(channelsCount*kDelayLength);
+                reset();
+            }
+
+            uint get_channelsCount()const
+            {
+                return channelsCount;
+            }
+
+            /// sets the oversampling factor (1, 2, 4 or 8: rounded down to a power of 2). Resets the memories if changed.
+            void setFactor(uint iFactor)
+            {
+                uint count=0;
+                while(count<kMaxStages && (2u<<count)<=iFactor)
+                    count++;
+                if(count!=stagesCount)
+                {
+                    stagesCount=count;
+                    updateLatency();
+                    reset();
+                }
+            }
+
+            uint get_factor()const
+            {
+                return 1<<stagesCount;
+            }
+
+            /// sets the filters mode. Resets the memories if changed.
+            void setMode(Mode iMode)
+            {
+                if(iMode!=mode)
+                {
+                    mode=iMode;
+                    updateLatency();
+                    reset();
+                }
+            }
+
+            Mode get_mode()const
+            {
+                return mode;
+            }
+
+            /// latency in samples (base rate), to be reported by getLatency().
+            int get_latency()const
+            {
+                return latency;
+            }
+
+            void reset()
+            {
+                for(uint s=0;s<kMaxStages;s++)
+                {
+                    clear(upLines[s]);
+                    clear(evenLines[s]);
+                    clear(oddLines[s]);
+                    clear(iirUpMemory[s]);
+                    clear(iirDownMemory[s]);
+                }
+                clear(delayLines);
+            }
+
+            /** Upsamples count samples (up to kChunkSize) of a channel. Returns count*get_factor() samples, that
+            *   can be processed in place before calling downsample() for the same channel.
+            */
+            double* upsample(const double* input,uint count,uint channel)
+            {
+                if(stagesCount==0)
+                {
+                    double* output=delayLines.ptr+channel*kDelayLength;
+                    for(uint i=0;i<count;i++)
+                        output[i]=input[i];
+                    return output;
+                }
+                if(mode==kMinimumPhase)
+                {
+                    // cascade of IIR steps (stage output in the line of the next stage: used as plain buffers)
+                    const double* in=input;
+                    for(uint s=0;s<stagesCount;s++)
+                    {
+                        double* out=(s+1<stagesCount)?upLines[s+1].ptr+channel*upStride[s+1]:delayLines.ptr+channel*kDelayLength;
+                        iir[s].upsample(in,count<<s,iirUpMemory[s].ptr+channel*iirStride[s],out);
+                        in=out;
+                    }
+                    return delayLines.ptr+channel*kDelayLength;
+                }
+
+                // FIR steps: each stage writes to the input of the next stage line (after its history)
+                double* line=upLines[0].ptr+channel*upStride[0];
+                double* lineInput=line+fir[0].get_historyLength();
+                for(uint i=0;i<count;i++)
+                    lineInput[i]=input[i];
+                for(uint s=0;s<stagesCount;s++)
+                {
+                    double* output=null;
+                    if(s+1<stagesCount)
+                        output=upLines[s+1].ptr+channel*upStride[s+1]+fir[s+1].get_historyLength();
+                    else
+                        output=delayLines.ptr+channel*kDelayLength+padding;
+                    fir[s].upsample(upLines[s].ptr+channel*upStride[s],count<<s,output);
+                }
+                // delay padding (whole latency at the base rate): processed samples start before the new samples
+                return delayLines.ptr+channel*kDelayLength;
+            }
+
+            /** Downsamples count*get_factor() samples returned by upsample() (and processed) to count samples of
+            *   the channel (output).
+            */
+            void downsample(double* output,uint count,uint channel)
+            {
+                double* samples=delayLines.ptr+channel*kDelayLength;
+                if(stagesCount==0)
+                {
+                    for(uint i=0;i<count;i++)
+                        output[i]=samples[i];
+                    return;
+                }
+                const double* in=samples;
+                for(uint s=stagesCount;s-->0;)
+                {
+                    // intermediate results in the scratch buffers (the last step writes to the output)
+                    double* out=(s==0)?output:scratch[s&1];
+                    const uint n=count<<s;
+                    if(mode==kMinimumPhase)
+                        iir[s].downsample(in,n,iirDownMemory[s].ptr+channel*iirStride[s],out);
+                    else
+                        fir[s].downsample(in,n,evenLines[s].ptr+channel*upStride[s],oddLines[s].ptr+channel*oddStride[s],out);
+                    in=out;
+                }
+                if(mode==kLinearPhase)
+                {
+                    // keep the samples that have not been processed yet (delay padding)
+                    const uint total=count<<stagesCount;
+                    for(uint i=0;i<padding;i++)
+                        samples[i]=samples[total+i];
+                }
+            }
+
+            /** Processes count samples of a channel in place: kernel(samples,count) is called for chunks of
+            *   oversampled samples.
+            */
+            template <class Kernel>
+            void process(double* samples,uint count,uint channel,Kernel& kernel)
+            {
+                for(uint start=0;start<count;start+=kChunkSize)
+                {
+                    uint n=count-start;
+                    if(n>kChunkSize)
+                        n=kChunkSize;
+                    double* oversampled=upsample(samples+start,n,channel);
+                    kernel(oversampled,n<<stagesCount);
+                    downsample(samples+start,n,channel);
+                }
+            }
+
+            // private data
+        private:
+            static const uint kDelayLength=kMaxFactor+kChunkSize*kMaxFactor;
+
+            HalfBandFir     fir[kMaxStages];
+            HalfBandIir     iir[kMaxStages];
+            uint            upStride[kMaxStages];
+            uint            oddStride[kMaxStages];
+            uint            iirStride[kMaxStages];
+
+            // channel memories (one block of stride values per channel)
+            array<double>   upLines[kMaxStages];
+            array<double>   evenLines[kMaxStages];
+            array<double>   oddLines[kMaxStages];
+            array<double>   iirUpMemory[kMaxStages];
+            array<double>   iirDownMemory[kMaxStages];
+            array<double>   delayLines; ///< oversampled samples, after padding delay
+
+            double          scratch[2][kChunkSize*kMaxFactor/2];
+            uint            channelsCount=0;
+            uint            stagesCount=0;
+            Mode            mode=kLinearPhase;
+            uint            padding=0; ///< delay at the highest rate, for a whole latency at the base rate
+            int             latency=0;
+
+            void updateLatency()
+            {
+                padding=0;
+                if(mode==kMinimumPhase)
+                {
+                    latency=getImpulsePeak();
+                    return;
+                }
+                // delay at the highest rate: the delay of a stage pair is doubled by each following stage
+                uint delay=0;
+                for(uint s=0;s<stagesCount;s++)
+                    delay+=fir[s].get_delay()<<(stagesCount-1-s);
+                const uint factor=1<<stagesCount;
+                padding=(factor-delay%factor)%factor;
+                latency=int((delay+padding)/factor);
+            }
+
+            /** position (base rate) of the peak of the impulse response of the minimum phase filters, measured
+            *   with temporary memories (no allocation).
+            */
+            int getImpulsePeak()const
+            {
+                static const uint kLength=32; ///< base rate samples (the response peaks within a few samples)
+                double buffers[2][kLength*kMaxFactor];
+                double memory[2*HalfBandIir::kMaxCoefficients];
+                for(uint i=0;i<kLength;i++)
+                    buffers[0][i]=0;
+                buffers[0][0]=1;
+                double* in=buffers[0];
+                double* out=buffers[1];
+                for(uint s=0;s<stagesCount;s++)
+                {
+                    for(uint i=0;i<2*HalfBandIir::kMaxCoefficients;i++)
+                        memory[i]=0;
+                    iir[s].upsample(in,kLength<<s,memory,out);
+                    double* temp=in;
+                    in=out;
+                    out=temp;
+                }
+                for(uint s=stagesCount;s-->0;)
+                {
+                    for(uint i=0;i<2*HalfBandIir::kMaxCoefficients;i++)
+                        memory[i]=0;
+                    iir[s].downsample(in,kLength<<s,memory,out);
+                    double* temp=in;
+                    in=out;
+                    out=temp;
+                }
+                uint peak=0;
+                for(uint i=1;i<kLength;i++)
+                {
+                    if(fabs(in[i])>fabs(in[peak]))
+                        peak=i;
+                }
+                return int(peak);
+            }
+
+            static void clear(array<double>& values)
+            {
+                for(uint i=0;i<values.length;i++)
+                    values[i]=0;
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,326 @@
+#ifndef _PcmDecode_h_
+#define _PcmDecode_h_
+
+#include <string.h>
+#include <stdint.h>
+
+/** \file PcmDecode.h
+*   Block conversion of PCM audio data (as stored in wave files) to double precision samples
+*   and back, for c/c++ dsp scripting.
+*
+*   The conversion kernels are simple loops over contiguous data, so that the compiler can vectorize
+*   them for the target processor (SSE2/AVX2 on x86, NEON on ARM). Data is little endian, like wave files
+*   and all the platforms supported by the plug-in. Integer formats use the same scaling as WaveFile.h.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2014 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Pcm
+    {
+        /** Supported sample formats.
+        *
+        */
+        enum SampleFormat
+        {
+            kUnsupportedFormat,
+            kUInt8, ///< 8-bit unsigned integer (128 is zero)
+            kInt16, ///< 16-bit signed integer
+            kInt24, ///< 24-bit signed integer (packed, 3 bytes)
+            kInt32, ///< 32-bit signed integer
+            kFloat32, ///< single precision floating point
+            kFloat64 ///< double precision floating point
+        };
+
+        /** Returns the format for the given sample size and type.
+        *
+        */
+        inline SampleFormat getSampleFormat(uint bytesPerSample,bool isFloat)
+        {
+            switch(bytesPerSample)
+            {
+            case 1:
+                return kUInt8;
+            case 2:
+                return kInt16;
+            case 3:
+                return kInt24;
+            case 4:
+                return isFloat?kFloat32:kInt32;
+            case 8:
+                return isFloat?kFloat64:kUnsupportedFormat;
+            }
+            return kUnsupportedFormat;
+        }
+
+        /** Returns the size in bytes of a single sample in the given format.
+        *
+        */
+        inline uint getBytesPerSample(SampleFormat format)
+        {
+            switch(format)
+            {
+            case kUInt8:
+                return 1;
+            case kInt16:
+                return 2;
+            case kInt24:
+                return 3;
+            case kInt32:
+            case kFloat32:
+                return 4;
+            case kFloat64:
+                return 8;
+            default:
+                return 0;
+            }
+        }
+
+        // Conversion kernels (count samples, interleaved or not)---------------
+        inline void uint8ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+                dest[i]=(double(src[i])-128.0)*(1.0/128.0);
+        }
+
+        inline void int16ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            const double factor=1.0/32767.0;
+            for(size_t i=0;i<count;i++)
+            {
+                int16_t value;
+                memcpy(&value,src+2*i,2);
+                dest[i]=double(value)*factor;
+            }
+        }
+
+        inline void int24ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            const double factor=1.0/8388607.0;
+            for(size_t i=0;i<count;i++)
+            {
+                const uint8* s=src+3*i;
+                // sign extension: value in the upper 24 bits, then arithmetic shift
+                int32_t value=int32_t((uint32_t(s[0])<<8)|(uint32_t(s[1])<<16)|(uint32_t(s[2])<<24))>>8;
+                dest[i]=double(value)*factor;
+            }
+        }
+
+        inline void int32ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            const double factor=1.0/2147483647.0;
+            for(size_t i=0;i<count;i++)
+            {
+                int32_t value;
+                memcpy(&value,src+4*i,4);
+                dest[i]=double(value)*factor;
+            }
+        }
+
+        inline void float32ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                float value;
+                memcpy(&value,src+4*i,4);
+                dest[i]=value;
+            }
+        }
+
+        inline void float64ToDouble(const uint8* src,double* dest,size_t count)
+        {
+            memcpy(dest,src,count*sizeof(double));
+        }
+
+        /** Converts count samples (any channel layout) to double.
+        *
+        */
+        inline void toDouble(SampleFormat format,const uint8* src,double* dest,size_t count)
+        {
+            switch(format)
+            {
+            case kUInt8:
+                uint8ToDouble(src,dest,count);
+                break;
+            case kInt16:
+                int16ToDouble(src,dest,count);
+                break;
+            case kInt24:
+                int24ToDouble(src,dest,count);
+                break;
+            case kInt32:
+                int32ToDouble(src,dest,count);
+                break;
+            case kFloat32:
+                float32ToDouble(src,dest,count);
+                break;
+            case kFloat64:
+                float64ToDouble(src,dest,count);
+                break;
+            default:
+                for(size_t i=0;i<count;i++)
+                    dest[i]=0;
+                break;
+            }
+        }
+
+        // Encoding kernels (double to PCM, clipped to the range of integer formats)---------------
+        inline double clip(double value)
+        {
+            return (value>1.0)?1.0:((value<-1.0)?-1.0:value);
+        }
+
+        inline void doubleToUInt8(const double* src,uint8* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                double value=src[i]*128.0+128.0;
+                dest[i]=uint8((value>255.0)?255.0:((value<0.0)?0.0:value));
+            }
+        }
+
+        inline void doubleToInt16(const double* src,uint8* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                int16_t value=int16_t(clip(src[i])*32767.0);
+                memcpy(dest+2*i,&value,2);
+            }
+        }
+
+        inline void doubleToInt24(const double* src,uint8* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                int32_t value=int32_t(clip(src[i])*8388607.0);
+                uint8* d=dest+3*i;
+                d[0]=uint8(value);
+                d[1]=uint8(value>>8);
+                d[2]=uint8(value>>16);
+            }
+        }
+
+        inline void doubleToInt32(const double* src,uint8* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                int32_t value=int32_t(clip(src[i])*2147483647.0);
+                memcpy(dest+4*i,&value,4);
+            }
+        }
+
+        inline void doubleToFloat32(const double* src,uint8* dest,size_t count)
+        {
+            for(size_t i=0;i<count;i++)
+            {
+                float value=float(src[i]);
+                memcpy(dest+4*i,&value,4);
+            }
+        }
+
+        inline void doubleToFloat64(const double* src,uint8* dest,size_t count)
+        {
+            memcpy(dest,src,count*sizeof(double));
+        }
+
+        /** Converts count samples (any channel layout) from double to the given format.
+        *
+        */
+        inline void fromDouble(SampleFormat format,const double* src,uint8* dest,size_t count)
+        {
+            switch(format)
+            {
+            case kUInt8:
+                doubleToUInt8(src,dest,count);
+                break;
+            case kInt16:
+                doubleToInt16(src,dest,count);
+                break;
+            case kInt24:
+                doubleToInt24(src,dest,count);
+                break;
+            case kInt32:
+                doubleToInt32(src,dest,count);
+                break;
+            case kFloat32:
+                doubleToFloat32(src,dest,count);
+                break;
+            case kFloat64:
+                doubleToFloat64(src,dest,count);
+                break;
+            default:
+                break;
+            }
+        }
+
+        /** Decodes framesCount frames of interleaved samples (srcChannelsCount per frame) into
+        *   deinterleaved channel buffers: dest[ch][destOffset+i], for destChannelsCount channels.
+        *   Extra source channels are ignored, and extra destination channels are set to zero.
+        *   Works by tiles: conversion of a tile of contiguous samples, then deinterleaving from the cache.
+        */
+        inline void decodeDeinterleaved(SampleFormat format,const uint8* src,uint srcChannelsCount,
+            double** dest,uint destChannelsCount,size_t destOffset,size_t framesCount)
+        {
+            const uint kTileSize=2048;
+            double tile[kTileSize];
+            const uint bytesPerFrame=getBytesPerSample(format)*srcChannelsCount;
+            const uint channels=(srcChannelsCount<destChannelsCount)?srcChannelsCount:destChannelsCount;
+            if(srcChannelsCount>0 && srcChannelsCount<=kTileSize && bytesPerFrame>0)
+            {
+                const size_t tileFrames=kTileSize/srcChannelsCount;
+                for(size_t start=0;start<framesCount;start+=tileFrames)
+                {
+                    size_t frames=framesCount-start;
+                    if(frames>tileFrames)
+                        frames=tileFrames;
+                    toDouble(format,src+start*bytesPerFrame,tile,frames*srcChannelsCount);
+                    if(srcChannelsCount==1)
+                    {
+                        if(channels==1)
+                            memcpy(dest[0]+destOffset+start,tile,frames*sizeof(double));
+                    }
+                    else if(srcChannelsCount==2 && channels==2)
+                    {
+                        double* left=dest[0]+destOffset+start;
+                        double* right=dest[1]+destOffset+start;
+                        for(size_t i=0;i<frames;i++)
+                        {
+                            left[i]=tile[2*i];
+                            right[i]=tile[2*i+1];
+                        }
+                    }
+                    else
+                    {
+                        for(uint ch=0;ch<channels;ch++)
+                        {
+                            double* channel=dest[ch]+destOffset+start;
+                            const double* s=tile+ch;
+                            for(size_t i=0;i<frames;i++)
+                                channel[i]=s[i*srcChannelsCount];
+                        }
+                    }
+                }
+            }
+            else if(bytesPerFrame>0)
+            {
+                // (very) large number of channels: sample by sample
+                const uint bytesPerSample=getBytesPerSample(format);
+                for(uint ch=0;ch<channels;ch++)
+                {
+                    for(size_t i=0;i<framesCount;i++)
+                        toDouble(format,src+i*bytesPerFrame+ch*bytesPerSample,dest[ch]+destOffset+i,1);
+                }
+            }
+            for(uint ch=channels;ch<destChannelsCount;ch++)
+            {
+                double* channel=dest[ch]+destOffset;
+                for(size_t i=0;i<framesCount;i++)
+                    channel[i]=0;
+            }
+        }
+    }
+}
+#endif
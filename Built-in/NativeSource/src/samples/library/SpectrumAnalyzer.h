@@ -0,0 +1,409 @@
+#ifndef _SpectrumAnalyzer_h_
+#define _SpectrumAnalyzer_h_
+
+#include "FFT.h"
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+#endif
+
+/** \file SpectrumAnalyzer.h
+*   Spectrum analysis on a background thread (c++ scripting).
+*
+*   The audio thread only copies its samples to a lock-free ring buffer (single producer, single
+*   consumer): it never waits for the analysis, which runs on a low priority worker thread:
+*   - overlapping frames (50% to 87.5%) are taken from the ring buffer when enough samples have been
+*     received. If the worker is late, it skips to the most recent frame instead of catching up.
+*   - Hann window, real FFT and power spectrum, normalized so that a full scale sine reads 0 dB.
+*   - log-frequency bands: the highest bin of each band, or the spectrum interpolated at the center
+*     of the band when it is narrower than the bins (low frequencies, small transforms).
+*   - optional exponential averaging of the bands power.
+*   Results are exchanged through a triple buffer: the audio thread gets the latest complete result
+*   without waiting, and the worker never overwrites the values being read.
+*
+*   The FFT plans of all sizes and all the buffers are allocated by start(): call it from initialize(),
+*   and stop() from shutdown().
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Spectrum
+    {
+        static const uint kSizesCount=9; ///< FFT sizes from FFT::kMinSize (256) to FFT::kMaxSize (65536)
+        static const uint kRingSize=4*FFT::kMaxSize; ///< audio history (samples, power of two)
+        static const uint kMaxPushSize=4096; ///< samples written by push() before the position is published
+        static const double kMinDb=-200; ///< lowest level returned (silence)
+
+        /// FFT size for a size index (0 to kSizesCount-1).
+        inline uint fftSizeFor(uint sizeIndex)
+        {
+            return FFT::kMinSize<<sizeIndex;
+        }
+
+        struct SpectrumAnalyzer
+        {
+            SpectrumAnalyzer(){}
+
+            ~SpectrumAnalyzer()
+            {
+                stop();
+            }
+
+            /** Computes the FFT plans and the bands, allocates the buffers and starts the worker thread. Not for the
+            *   audio thread. bandsCount log-frequency bands between minFrequency and the Nyquist frequency.
+            */
+            bool start(double iSampleRate,uint iBandsCount,double minFrequency=20)
+            {
+                stop();
+                if(iSampleRate<=0 || iBandsCount==0)
+                    return false;
+                sampleRate=iSampleRate;
+                bandsCount=iBandsCount;
+                for(uint s=0;s<kSizesCount;s++)
+                {
+                    if(!plans[s].setup(fftSizeFor(s)))
+                        return false;
+                }
+                ring.resize(kRingSize);
+                for(uint i=0;i<kRingSize;i++)
+                    ring[i]=0;
+                frame.resize(FFT::kMaxSize);
+                window.resize(FFT::kMaxSize);
+                spectrumRe.resize(FFT::kMaxSize/2+1);
+                spectrumIm.resize(FFT::kMaxSize/2+1);
+                power.resize(FFT::kMaxSize/2+1);
+
+                // band edges (log scale), centers and bins (depend on the FFT size: computed by the worker)
+                const double maxFrequency=.5*sampleRate;
+                if(minFrequency<=0 || minFrequency>=maxFrequency)
+                    minFrequency=maxFrequency/1000;
+                edges.resize(bandsCount+1);
+                frequencies.resize(bandsCount);
+                for(uint b=0;b<=bandsCount;b++)
+                    edges[b]=minFrequency*pow(maxFrequency/minFrequency,double(b)/double(bandsCount));
+                for(uint b=0;b<bandsCount;b++)
+                    frequencies[b]=sqrt(edges[b]*edges[b+1]);
+                firstBins.resize(bandsCount);
+                binsCounts.resize(bandsCount);
+                centerBins.resize(bandsCount);
+                averages.resize(bandsCount);
+                for(uint b=0;b<bandsCount;b++)
+                    averages[b]=0;
+                for(uint r=0;r<3;r++)
+                {
+                    results[r].resize(bandsCount);
+                    for(uint b=0;b<bandsCount;b++)
+                        results[r][b]=float(kMinDb);
+                }
+                front=0;
+                exchange.store(1);
+                back=2;
+                writePos.store(0);
+                resetRequested.store(true);
+                running.store(true);
+                worker=std::thread(&SpectrumAnalyzer::run,this);
+                return true;
+            }
+
+            /// stops the worker thread.
+            void stop()
+            {
+                running.store(false);
+                if(worker.joinable())
+                    worker.join();
+            }
+
+            /// selects the FFT size (0 for 256 to kSizesCount-1 for 65536). Can be called from the audio thread.
+            void setSize(uint sizeIndex)
+            {
+                if(sizeIndex>=kSizesCount)
+                    sizeIndex=kSizesCount-1;
+                requestedSize.store(sizeIndex,std::memory_order_relaxed);
+            }
+
+            /// overlap of consecutive frames: 1-1/overlapFactor (2, 4 or 8). Can be called from the audio thread.
+            void setOverlap(uint overlapFactor)
+            {
+                if(overlapFactor<1)
+                    overlapFactor=1;
+                requestedOverlap.store(overlapFactor,std::memory_order_relaxed);
+            }
+
+            /// time constant of the averaging, in seconds (0 for none). Can be called from the audio thread.
+            void setAveraging(double seconds)
+            {
+                averaging.store(seconds,std::memory_order_relaxed);
+            }
+
+            /// clears the averages (the analysis restarts). Can be called from the audio thread.
+            void reset()
+            {
+                resetRequested.store(true,std::memory_order_relaxed);
+            }
+
+            /** appends count samples to the analyzed signal. Wait-free: call it from the audio thread.
+            *   The position is published after every kMaxPushSize samples at most, so that the worker knows how
+            *   far ahead of the published position samples may be overwritten.
+            */
+            void push(const double* samples,uint count)
+            {
+                uint64 position=writePos.load(std::memory_order_relaxed);
+                while(count>0)
+                {
+                    const uint index=uint(position)&(kRingSize-1);
+                    uint n=kRingSize-index;
+                    if(n>count)
+                        n=count;
+                    if(n>kMaxPushSize)
+                        n=kMaxPushSize;
+                    double* destination=&ring[index];
+                    for(uint i=0;i<n;i++)
+                        destination[i]=samples[i];
+                    samples+=n;
+                    count-=n;
+                    position+=n;
+                    writePos.store(position,std::memory_order_release);
+                }
+            }
+
+            /** Returns the latest bands levels (dB, get_bandsCount() values) if a new analysis has been completed
+            *   since the last call, null otherwise. Wait-free: call it from the audio thread. The values remain
+            *   valid until the next call.
+            */
+            const float* receive()
+            {
+                if((exchange.load(std::memory_order_relaxed)&kFresh)==0)
+                    return null;
+                front=exchange.exchange(front,std::memory_order_acq_rel)&kIndexMask;
+                return &results[front][0];
+            }
+
+            uint get_bandsCount()const
+            {
+                return bandsCount;
+            }
+
+            /// center frequency of band b (Hz).
+            double get_frequency(uint b)const
+            {
+                return frequencies[b];
+            }
+
+            // private data
+        private:
+            static const uint kFresh=4; ///< set in exchange when it holds a result that has not been received
+            static const uint kIndexMask=3;
+
+            double              sampleRate=0;
+            uint                bandsCount=0;
+            FFT::RealFFT        plans[kSizesCount];
+
+            // audio history, written by the audio thread
+            array<double>       ring;
+            std::atomic<uint64> writePos{0};
+
+            // parameters, written by the audio thread
+            std::atomic<uint>   requestedSize{4};
+            std::atomic<uint>   requestedOverlap{4};
+            std::atomic<double> averaging{0};
+            std::atomic<bool>   resetRequested{false};
+
+            // results (triple buffer): front is used by the reader, back by the worker, exchange holds the
+            // third index and the fresh flag
+            array<float>        results[3];
+            uint                front=0;
+            std::atomic<uint>   exchange{1};
+            uint                back=2;
+
+            // worker thread state
+            std::thread         worker;
+            std::atomic<bool>   running{false};
+            array<double>       frame;
+            array<double>       window;
+            array<double>       spectrumRe;
+            array<double>       spectrumIm;
+            array<double>       power;
+            array<double>       edges;
+            array<double>       frequencies;
+            array<uint>         firstBins; ///< first bin of each band
+            array<uint>         binsCounts; ///< bins of each band (0: interpolated at the center)
+            array<double>       centerBins; ///< center of each band, in bins
+            array<double>       averages; ///< power of the bands
+            double              powerScale=0; ///< power normalization (window and FFT gains)
+
+            /// window and bands for an FFT size.
+            void prepare(uint size)
+            {
+                const double pi=3.141592653589793238462;
+                double sum=0;
+                for(uint i=0;i<size;i++)
+                {
+                    window[i]=.5-.5*cos(2*pi*double(i)/double(size));
+                    sum+=window[i];
+                }
+                // a sine of amplitude A gives a bin of magnitude A*sum/2
+                powerScale=4/(sum*sum);
+
+                const double binWidth=sampleRate/double(size);
+                const uint binsCount=size/2+1;
+                for(uint b=0;b<bandsCount;b++)
+                {
+                    // bins in [low edge,high edge[
+                    uint first=uint(ceil(edges[b]/binWidth));
+                    uint end=uint(ceil(edges[b+1]/binWidth));
+                    if(b==bandsCount-1)
+                        end=binsCount;
+                    if(end>binsCount)
+                        end=binsCount;
+                    if(first>end)
+                        first=end;
+                    firstBins[b]=first;
+                    binsCounts[b]=end-first;
+                    centerBins[b]=frequencies[b]/binWidth;
+                }
+            }
+
+            /** analyzes the samples ending at position end, with the FFT size of sizeIndex. Returns false if the
+            *   samples have been overwritten by the audio thread (or may be: the audio thread writes up to
+            *   kMaxPushSize samples beyond the published position).
+            */
+            bool analyze(uint sizeIndex,uint64 end,double averagingFactor)
+            {
+                const uint size=fftSizeFor(sizeIndex);
+                // copy the samples, then make sure that they have not been overwritten in the meantime
+                const uint start=uint(end-size)&(kRingSize-1);
+                const uint first=kRingSize-start<size?kRingSize-start:size;
+                for(uint i=0;i<first;i++)
+                    frame[i]=ring[start+i]*window[i];
+                for(uint i=first;i<size;i++)
+                    frame[i]=ring[i-first]*window[i];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(writePos.load(std::memory_order_relaxed)-(end-size)>kRingSize-kMaxPushSize)
+                    return false;
+
+                plans[sizeIndex].forward(&frame[0],&spectrumRe[0],&spectrumIm[0]);
+                const uint binsCount=size/2+1;
+                for(uint k=0;k<binsCount;k++)
+                    power[k]=powerScale*(spectrumRe[k]*spectrumRe[k]+spectrumIm[k]*spectrumIm[k]);
+
+                float* levels=&results[back][0];
+                for(uint b=0;b<bandsCount;b++)
+                {
+                    double value=0;
+                    const uint count=binsCounts[b];
+                    if(count>0)
+                    {
+                        const double* bins=&power[firstBins[b]];
+                        for(uint k=0;k<count;k++)
+                        {
+                            if(bins[k]>value)
+                                value=bins[k];
+                        }
+                    }
+                    else
+                    {
+                        // linear interpolation of the power between the two closest bins
+                        const double position=centerBins[b];
+                        uint k=uint(position);
+                        if(k>=binsCount-1)
+                            k=binsCount-2;
+                        const double fraction=position-double(k);
+                        value=power[k]+fraction*(power[k+1]-power[k]);
+                    }
+                    averages[b]=value+averagingFactor*(averages[b]-value);
+                    const double level=averages[b]>0?10*log10(averages[b]):kMinDb;
+                    levels[b]=float(level>kMinDb?level:kMinDb);
+                }
+
+                // publish the result and reuse the previous exchange buffer
+                back=exchange.exchange(back|kFresh,std::memory_order_acq_rel)&kIndexMask;
+                return true;
+            }
+
+            // worker thread main loop
+            void run()
+            {
+                setLowPriority();
+                uint sizeIndex=0;
+                uint size=0;
+                uint hop=0;
+                uint64 nextEnd=0;
+                uint64 lastEnd=0;
+                bool averaged=false; ///< the averages hold a previous analysis
+                while(running.load(std::memory_order_relaxed))
+                {
+                    // parameters changes
+                    const uint newSizeIndex=requestedSize.load(std::memory_order_relaxed);
+                    const uint newSize=fftSizeFor(newSizeIndex);
+                    uint newHop=newSize/requestedOverlap.load(std::memory_order_relaxed);
+                    if(newHop==0)
+                        newHop=1;
+                    const bool clear=resetRequested.exchange(false,std::memory_order_relaxed);
+                    if(newSize!=size || newHop!=hop || clear)
+                    {
+                        if(newSize!=size)
+                            prepare(newSize);
+                        sizeIndex=newSizeIndex;
+                        size=newSize;
+                        hop=newHop;
+                        averaged=false;
+                        nextEnd=writePos.load(std::memory_order_acquire)+hop;
+                    }
+
+                    const uint64 position=writePos.load(std::memory_order_acquire);
+                    if(position<nextEnd || position<size)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                        continue;
+                    }
+                    // most recent frame (frames are skipped if the worker is late)
+                    const uint64 end=nextEnd+(position-nextEnd)/hop*hop;
+                    // the averaging depends on the time elapsed since the previous analysis
+                    const double seconds=averaging.load(std::memory_order_relaxed);
+                    double averagingFactor=0;
+                    if(averaged && seconds>0)
+                        averagingFactor=exp(-double(end-lastEnd)/(seconds*sampleRate));
+                    if(analyze(sizeIndex,end,averagingFactor))
+                    {
+                        lastEnd=end;
+                        averaged=true;
+                    }
+                    nextEnd=end+hop;
+                }
+            }
+
+            /// the analysis must not delay the audio thread or the user interface.
+            static void setLowPriority()
+            {
+#ifdef _WIN32
+                SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+                // nice value of the calling thread only on Linux
+                setpriority(PRIO_PROCESS,0,10);
+#else
+                sched_param param;
+                param.sched_priority=sched_get_priority_min(SCHED_OTHER);
+                pthread_setschedparam(pthread_self(),SCHED_OTHER,&param);
+#endif
+            }
+        };
+    }
+}
+#endif
@@ -0,0 +1,236 @@
+#ifndef _VoiceAllocator_h_
+#define _VoiceAllocator_h_
+/** \file VoiceAllocator.h
+*   Constant time voice allocation for polyphonic instruments (c/c++ dsp scripting).
+*
+*   Voices are fixed slots (0 to voicesCount-1) that keep their index while playing. The allocator
+*   maintains a note/channel to voice index, a list of free voices, a dense list of active voices
+*   (for rendering) and the age order of active voices (for stealing), so that note on, note off
+*   and voice release never scan the voices.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Voices
+    {
+        /** What to do when a note starts while all voices are busy.
+        *
+        */
+        enum StealingMode
+        {
+            kNoStealing, ///< the new note is ignored
+            kStealOldest, ///< the voice that started first is reused
+            kStealQuietest, ///< the voice with the lowest level is reused (requires voice levels)
+            kStealSameNote ///< a voice playing the same note (on another channel) is reused, or else the oldest one
+        };
+
+        struct VoiceAllocator
+        {
+            static const uint kNotesCount=128;
+            static const uint kChannelsCount=16;
+
+            StealingMode stealingMode=kStealOldest;
+
+            VoiceAllocator(uint voicesCount=0)
+            {
+                setVoicesCount(voicesCount);
+            }
+
+            /// allocates the voices and frees them all. Not for the audio thread.
+            void setVoicesCount(uint count)
+            {
+                voiceKeys.resize(count);
+                activePositions.resize(count);
+                activeVoices.resize(count);
+                freeVoices.resize(count);
+                olderVoices.resize(count);
+                newerVoices.resize(count);
+                keyToVoice.resize(kNotesCount*kChannelsCount);
+                reset();
+            }
+
+            uint get_voicesCount()const
+            {
+                return activeVoices.length;
+            }
+
+            /// frees all voices.
+            void reset()
+            {
+                for(uint i=0;i<keyToVoice.length;i++)
+                    keyToVoice[i]=-1;
+                activeCount=0;
+                freeCount=activeVoices.length;
+                for(uint v=0;v<freeCount;v++)
+                {
+                    // first voices are allocated first
+                    freeVoices[v]=int(freeCount-1-v);
+                    voiceKeys[v]=-1;
+                }
+                oldestVoice=-1;
+                newestVoice=-1;
+            }
+
+            /// number of active voices.
+            uint get_activeCount()const
+            {
+                return activeCount;
+            }
+
+            /// index of the active voice at position i (0 to activeCount-1). Order changes when voices are released.
+            int getActiveVoice(uint i)const
+            {
+                return activeVoices[i];
+            }
+
+            /// the voice playing the note on this channel (-1 if none).
+            int find(int note,int channel=0)const
+            {
+                int key=getKey(note,channel);
+                return (key>=0)?keyToVoice[key]:-1;
+            }
+
+            /** Returns the voice for a new note: the voice already playing this note on this channel,
+            *   a free voice, or a stolen voice (see stealingMode). Returns -1 if no voice is available.
+            *   levels (indexed by voice) is required for kStealQuietest only.
+            *   isNewVoice is set to true if the voice was not playing before (and should be initialized).
+            */
+            int allocate(int note,int channel,bool& isNewVoice,const double* levels=null)
+            {
+                isNewVoice=false;
+                int key=getKey(note,channel);
+                if(key<0)
+                    return -1;
+                int v=keyToVoice[key];
+                if(v>=0)
+                {
+                    // restarted note: it becomes the newest one
+                    unlinkAge(v);
+                    linkNewest(v);
+                    return v;
+                }
+                if(freeCount>0)
+                {
+                    v=freeVoices[--freeCount];
+                    activePositions[v]=activeCount;
+                    activeVoices[activeCount++]=v;
+                    isNewVoice=true;
+                }
+                else
+                {
+                    v=findVoiceToSteal(note,levels);
+                    if(v<0)
+                        return -1;
+                    keyToVoice[voiceKeys[v]]=-1;
+                    unlinkAge(v);
+                }
+                voiceKeys[v]=key;
+                keyToVoice[key]=v;
+                linkNewest(v);
+                return v;
+            }
+
+            /// frees a voice (end of release).
+            void release(int v)
+            {
+                if(voiceKeys[v]<0)
+                    return;
+                keyToVoice[voiceKeys[v]]=-1;
+                voiceKeys[v]=-1;
+                unlinkAge(v);
+                // the last active voice takes its place in the dense list
+                uint position=activePositions[v];
+                int last=activeVoices[--activeCount];
+                activeVoices[position]=last;
+                activePositions[last]=position;
+                freeVoices[freeCount++]=v;
+            }
+
+            // private data
+        private:
+            array<int>  voiceKeys; ///< note/channel key of each voice (-1 if free)
+            array<uint> activePositions; ///< position of each active voice in activeVoices
+            array<int>  activeVoices;
+            uint        activeCount=0;
+            array<int>  freeVoices; ///< stack of free voices
+            uint        freeCount=0;
+            array<int>  olderVoices; ///< age list (doubly linked): previous voice
+            array<int>  newerVoices; ///< age list (doubly linked): next voice
+            int         oldestVoice=-1;
+            int         newestVoice=-1;
+            array<int>  keyToVoice; ///< voice for each note/channel (-1 if none)
+
+            static int getKey(int note,int channel)
+            {
+                if(note<0 || note>=int(kNotesCount) || channel<0 || channel>=int(kChannelsCount))
+                    return -1;
+                return channel*kNotesCount+note;
+            }
+
+            void linkNewest(int v)
+            {
+                olderVoices[v]=newestVoice;
+                newerVoices[v]=-1;
+                if(newestVoice>=0)
+                    newerVoices[newestVoice]=v;
+                else
+                    oldestVoice=v;
+                newestVoice=v;
+            }
+
+            void unlinkAge(int v)
+            {
+                int older=olderVoices[v];
+                int newer=newerVoices[v];
+                if(older>=0)
+                    newerVoices[older]=newer;
+                else
+                    oldestVoice=newer;
+                if(newer>=0)
+                    olderVoices[newer]=older;
+                else
+                    newestVoice=older;
+            }
+
+            int findVoiceToSteal(int note,const double* levels)const
+            {
+                switch(stealingMode)
+                {
+                case kStealSameNote:
+                    {
+                        for(uint ch=0;ch<kChannelsCount;ch++)
+                        {
+                            int v=keyToVoice[ch*kNotesCount+note];
+                            if(v>=0)
+                                return v;
+                        }
+                        return oldestVoice;
+                    }
+                case kStealQuietest:
+                    {
+                        // only case that scans the voices (when all of them are busy)
+                        if(levels==null)
+                            return oldestVoice;
+                        int quietest=oldestVoice;
+                        for(uint i=0;i<activeCount;i++)
+                        {
+                            int v=activeVoices[i];
+                            if(levels[v]<levels[quietest])
+                                quietest=v;
+                        }
+                        return quietest;
+                    }
+                case kStealOldest:
+                    return oldestVoice;
+                default:
+                    return -1;
+                }
+            }
+        };
+    }
+}
+#endif
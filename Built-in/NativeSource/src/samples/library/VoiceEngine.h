@@ -0,0 +1,470 @@
+#ifndef _VoiceEngine_h_
+#define _VoiceEngine_h_
+
+#include "VoiceAllocator.h"
+#include "Wavetable.h"
+#include "WorkerPool.h"
+#include "Envelope.h"
+/** \file VoiceEngine.h
+*   Polyphonic voice engine (additive sine oscillators with ADSR envelope) for c/c++ dsp scripting.
+*
+*   The state of the voices is stored as a structure of arrays (one array per property), and voices
+*   are rendered one after the other for a whole block: the oscillator of a voice has no dependency
+*   from one sample to the next (the phase is computed from the position in the block), so that the
+*   compiler can vectorize it, and the sine function is a polynomial instead of a call to sin().
+*   Voices are allocated in constant time by a VoiceAllocator (see VoiceAllocator.h).
+*   The partials can also play a band-limited wavetable instead of a sine wave (see Wavetable.h).
+*   With a worker pool (see WorkerPool.h), groups of voices are rendered in parallel, each group in its
+*   own buffer. The buffers are mixed in group order, so that the result does not depend on the thread
+*   that rendered each group.
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Voices
+    {
+        /** Polynomial approximation of sin(2*PI*cycles), for positive values of cycles (max error 2e-11).
+        *   The phase is reduced to [0;.25] using the symmetries of the sine function, without branches.
+        */
+        inline double sin2Pi(double cycles)
+        {
+            const double x=cycles-double(int(cycles+.5)); // [-.5;.5]
+            const double r=.25-fabs(.25-fabs(x)); // [0;.25]
+            const double r2=r*r;
+            const double y=r*(6.2831853064875069+r2*(-41.341701929773087+r2*(81.605209431120102+r2*(-76.703667829377565+
+                r2*(41.999989858233405+r2*-14.337024888102638)))));
+            return copysign(y,x);
+        }
+
+        /** Polyphonic sine synthesizer voices.
+        *   Each voice plays a sum of partials (harmonics shared by all voices, with a frequency ratio
+        *   and a level), shaped by a simple ADSR envelope (exponential segments, see Envelope.h).
+        */
+        struct VoiceEngine
+        {
+            static const uint kMaxPartials=8;
+            static const uint kChunkSize=128; // envelope buffer size (on the stack)
+            static const uint kVoicesPerTask=8; ///< voices rendered by each task on the worker pool
+            static const uint kTaskBlockSize=512; ///< samples rendered by each dispatch on the worker pool
+            static const uint kMinParallelSamples=32; ///< shorter spans are rendered by the calling thread
+            static const uint kMinParallelVoices=2*kVoicesPerTask; ///< fewer voices are rendered by the calling thread
+
+            /// voice allocation (active voices list, notes index and stealing)
+            VoiceAllocator  allocator;
+
+            /// voices state (structure of arrays, indexed by voice)
+            array<int>      notes;
+            array<double>   phases; ///< oscillator phase, in cycles of the fundamental
+            array<double>   increments; ///< phase increment per sample
+            array<double>   velocities;
+            array<double>   levels; ///< envelope level
+            array<int>      stages; ///< envelope stage (Envelopes::Stage)
+            array<bool>     waitingForPedalRelease;
+            array<bool>     ended; ///< voice ended while rendered by a task (released after the tasks)
+
+            VoiceEngine(uint maxVoicesCount=0)
+            {
+                setMaxVoicesCount(maxVoicesCount);
+                setPartialsCount(1);
+            }
+
+            /// allocates the voices. Not for the audio thread.
+            void setMaxVoicesCount(uint count)
+            {
+                notes.resize(count);
+                phases.resize(count);
+                increments.resize(count);
+                velocities.resize(count);
+                levels.resize(count);
+                stages.resize(count);
+                waitingForPedalRelease.resize(count);
+                ended.resize(count);
+                for(uint v=0;v<count;v++)
+                    ended[v]=false;
+                taskBuffers.resize(((count+kVoicesPerTask-1)/kVoicesPerTask)*kTaskBlockSize);
+                allocator.setVoicesCount(count);
+                reset();
+            }
+
+            uint get_maxVoicesCount()const
+            {
+                return notes.length;
+            }
+
+            uint get_activeVoicesCount()const
+            {
+                return allocator.get_activeCount();
+            }
+
+            /// what to do when a note starts while all voices are busy.
+            void setStealingMode(StealingMode mode)
+            {
+                allocator.stealingMode=mode;
+            }
+
+            void setSampleRate(double rate)
+            {
+                sampleRate=rate;
+                updatePitch();
+            }
+
+            /// stops all voices immediately.
+            void reset()
+            {
+                allocator.reset();
+                pedalIsDown=false;
+            }
+
+            /** Sets the envelope parameters: the coefficients of the exponential segments (0 to 1, 1 being immediate)
+            *   and the sustain level (0 to 1).
+            */
+            void setEnvelope(double attack,double decay,double sustain,double release)
+            {
+                envelopeShape.set(attack,decay,sustain,release);
+            }
+
+            /// sets the number of partials played by each voice (1 to kMaxPartials).
+            void setPartialsCount(uint count)
+            {
+                if(count<1)
+                    count=1;
+                if(count>kMaxPartials)
+                    count=kMaxPartials;
+                for(uint p=partialsCount;p<count;p++)
+                {
+                    // default: harmonic series, with only the fundamental audible
+                    partialRatios[p]=p+1;
+                    partialLevels[p]=(p==0)?1:0;
+                }
+                partialsCount=count;
+                updatePhasePeriod();
+            }
+
+            /** Sets the waveform played by all partials: a wavetable bank (not owned, must remain valid while
+            *   in use), or null for a sine wave (default). With a wavetable, a single partial can play a whole timbre.
+            */
+            void setWavetable(const Wavetables::WavetableBank* bank)
+            {
+                wavetable=bank;
+            }
+
+            /** Renders groups of voices in parallel on a worker pool (not owned, must remain valid while in use),
+            *   or on the calling thread only if null (default). Short spans and small numbers of voices are
+            *   always rendered by the calling thread (the dispatch would cost more than it saves).
+            */
+            void setWorkerPool(Threads::WorkerPool* iPool)
+            {
+                pool=iPool;
+            }
+
+            /// sets the frequency ratio (relative to the note frequency) and level of a partial.
+            void setPartial(uint index,double ratio,double level)
+            {
+                if(index<partialsCount)
+                {
+                    bool ratioChanged=(partialRatios[index]!=ratio);
+                    partialRatios[index]=ratio;
+                    partialLevels[index]=level;
+                    if(ratioChanged)
+                        updatePhasePeriod();
+                }
+            }
+
+            /** Starts a note (velocity 0 to 1) on a MIDI channel (0 to 15). If the note is already playing,
+            *   its voice is restarted. If all voices are busy, a voice is stolen (see setStealingMode): it
+            *   keeps its phase and level and starts its attack from there, so that there is no discontinuity.
+            */
+            void noteOn(int note,double velocity,int channel=0)
+            {
+                bool isNewVoice=false;
+                int v=allocator.allocate(note,channel,isNewVoice,levels.ptr);
+                if(v<0)
+                    return;
+                if(isNewVoice)
+                {
+                    phases[v]=0;
+                    levels[v]=0;
+                }
+                notes[v]=note;
+                velocities[v]=velocity;
+                increments[v]=getIncrement(note);
+                stages[v]=Envelopes::kAttackStage;
+                waitingForPedalRelease[v]=false;
+            }
+
+            /// releases a note (or waits for the sustain pedal to be released).
+            void noteOff(int note,int channel=0)
+            {
+                int v=allocator.find(note,channel);
+                if(v>=0)
+                {
+                    if(pedalIsDown)
+                        waitingForPedalRelease[v]=true;
+                    else
+                        stages[v]=Envelopes::kReleaseStage;
+                }
+            }
+
+            /// sustain pedal: notes released while the pedal is down are held until the pedal is released.
+            void setPedal(bool down)
+            {
+                if(down!=pedalIsDown)
+                {
+                    pedalIsDown=down;
+                    if(!pedalIsDown)
+                    {
+                        for(uint i=0;i<allocator.get_activeCount();i++)
+                        {
+                            int v=allocator.getActiveVoice(i);
+                            if(waitingForPedalRelease[v])
+                            {
+                                stages[v]=Envelopes::kReleaseStage;
+                                waitingForPedalRelease[v]=false;
+                            }
+                        }
+                    }
+                }
+            }
+
+            /// pitch offset (in semitones) applied to all voices.
+            void setPitchOffset(double semitones)
+            {
+                pitchOffset=semitones;
+                updatePitch();
+            }
+
+            /** Renders all active voices (mono mix) to output (samplesCount samples, overwritten).
+            *   Voices that reach the end of their release are freed.
+            */
+            void render(double* output,uint samplesCount)
+            {
+                if(pool!=null && pool->get_activeWorkersCount()>0)
+                {
+                    for(uint start=0;start<samplesCount;start+=kTaskBlockSize)
+                    {
+                        uint count=samplesCount-start;
+                        if(count>kTaskBlockSize)
+                            count=kTaskBlockSize;
+                        if(count>=kMinParallelSamples && allocator.get_activeCount()>=kMinParallelVoices)
+                            renderParallel(output+start,count);
+                        else
+                            renderSerial(output+start,count);
+                    }
+                }
+                else
+                    renderSerial(output,samplesCount);
+            }
+
+            // private data
+        private:
+            double  sampleRate=44100;
+            double  pitchOffset=0;
+            bool    pedalIsDown=false;
+
+            Envelopes::ADSREnvelope envelopeShape;
+
+            double  partialRatios[kMaxPartials];
+            double  partialLevels[kMaxPartials];
+            uint    partialsCount=0;
+            double  phasePeriod=1; ///< phases are reduced modulo this period, so that all partials remain continuous
+            const Wavetables::WavetableBank* wavetable=null;
+
+            Threads::WorkerPool*    pool=null;
+            array<double>           taskBuffers; ///< one buffer of kTaskBlockSize samples per task
+            uint                    taskSamplesCount=0; ///< samples to render by the tasks of the current dispatch
+
+            /// renders all active voices in the calling thread, one after the other.
+            void renderSerial(double* output,uint samplesCount)
+            {
+                for(uint i=0;i<samplesCount;i++)
+                    output[i]=0;
+                double envelope[kChunkSize];
+                for(uint start=0;start<samplesCount;start+=kChunkSize)
+                {
+                    uint count=samplesCount-start;
+                    if(count>kChunkSize)
+                        count=kChunkSize;
+                    for(uint i=0;i<allocator.get_activeCount();)
+                    {
+                        int v=allocator.getActiveVoice(i);
+                        uint playing=renderEnvelope(v,envelope,count);
+                        renderOscillator(v,envelope,output+start,playing);
+                        if(playing<count)
+                        {
+                            // voice ended: the last active voice (not rendered yet for this chunk) takes its place
+                            allocator.release(v);
+                        }
+                        else
+                            i++;
+                    }
+                }
+            }
+
+            /** renders groups of kVoicesPerTask active voices on the worker pool (samplesCount up to kTaskBlockSize),
+            *   then mixes the buffers of the groups in order and releases the voices that ended.
+            */
+            void renderParallel(double* output,uint samplesCount)
+            {
+                const uint tasksCount=(allocator.get_activeCount()+kVoicesPerTask-1)/kVoicesPerTask;
+                taskSamplesCount=samplesCount;
+                pool->run(&renderTask,this,tasksCount);
+                for(uint i=0;i<samplesCount;i++)
+                    output[i]=0;
+                for(uint t=0;t<tasksCount;t++)
+                {
+                    const double* buffer=taskBuffers.ptr+t*kTaskBlockSize;
+                    for(uint i=0;i<samplesCount;i++)
+                        output[i]+=buffer[i];
+                }
+                for(uint i=0;i<allocator.get_activeCount();)
+                {
+                    int v=allocator.getActiveVoice(i);
+                    if(ended[v])
+                    {
+                        // the last active voice takes its place (checked next)
+                        ended[v]=false;
+                        allocator.release(v);
+                    }
+                    else
+                        i++;
+                }
+            }
+
+            /** renders the voices of a task (positions task*kVoicesPerTask to task*kVoicesPerTask+kVoicesPerTask-1
+            *   in the active voices list) to the buffer of the task. Called by the worker pool, from any thread:
+            *   only writes the state of these voices and the buffer of the task.
+            */
+            static void renderTask(void* context,uint task)
+            {
+                VoiceEngine& engine=*static_cast<VoiceEngine*>(context);
+                const uint samplesCount=engine.taskSamplesCount;
+                double* buffer=engine.taskBuffers.ptr+task*kTaskBlockSize;
+                for(uint i=0;i<samplesCount;i++)
+                    buffer[i]=0;
+                uint last=(task+1)*kVoicesPerTask;
+                if(last>engine.allocator.get_activeCount())
+                    last=engine.allocator.get_activeCount();
+                double envelope[kChunkSize];
+                for(uint i=task*kVoicesPerTask;i<last;i++)
+                {
+                    int v=engine.allocator.getActiveVoice(i);
+                    for(uint start=0;start<samplesCount;start+=kChunkSize)
+                    {
+                        uint count=samplesCount-start;
+                        if(count>kChunkSize)
+                            count=kChunkSize;
+                        uint playing=engine.renderEnvelope(v,envelope,count);
+                        engine.renderOscillator(v,envelope,buffer+start,playing);
+                        if(playing<count)
+                        {
+                            engine.ended[v]=true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            double getIncrement(int note)const
+            {
+                return pow(2,((double(note-69.0)+pitchOffset)/12.0))*440.0/sampleRate;
+            }
+
+            void updatePitch()
+            {
+                for(uint i=0;i<allocator.get_activeCount();i++)
+                {
+                    int v=allocator.getActiveVoice(i);
+                    increments[v]=getIncrement(notes[v]);
+                }
+            }
+
+            // smallest number of cycles after which all partials are back to phase zero
+            void updatePhasePeriod()
+            {
+                phasePeriod=65536;
+                for(int period=1;period<=64;period++)
+                {
+                    bool integer=true;
+                    for(uint p=0;p<partialsCount && integer;p++)
+                    {
+                        double cycles=partialRatios[p]*period;
+                        integer=(fabs(cycles-floor(cycles+.5))<1e-9);
+                    }
+                    if(integer)
+                    {
+                        phasePeriod=period;
+                        break;
+                    }
+                }
+            }
+
+            /** Computes the envelope of voice v for samplesCount samples (whole segments at once).
+            *   Returns the number of samples before the end of the voice (samplesCount if still playing).
+            */
+            uint renderEnvelope(uint v,double* envelope,uint samplesCount)
+            {
+                return envelopeShape.render(levels[v],stages[v],envelope,samplesCount);
+            }
+
+            /// adds samplesCount samples of voice v to output, and updates its phase.
+            void renderOscillator(uint v,const double* envelope,double* output,uint samplesCount)
+            {
+                const double phase=phases[v];
+                const double increment=increments[v];
+                const double velocity=velocities[v];
+                for(uint p=0;p<partialsCount;p++)
+                {
+                    const double level=velocity*partialLevels[p];
+                    if(level==0)
+                        continue;
+                    const double partialPhase=phase*partialRatios[p];
+                    const double partialIncrement=increment*partialRatios[p];
+                    if(wavetable!=null)
+                    {
+                        renderWavetable(wavetable->getTable(wavetable->getLevel(partialIncrement)),envelope,output,samplesCount,
+                            partialPhase,partialIncrement,level);
+                        continue;
+                    }
+                    // groups of 8 samples (independent from each other: computed in parallel in vector registers)
+                    uint i=0;
+                    for(;i+8<=samplesCount;i+=8)
+                    {
+                        double y[8];
+                        for(int l=0;l<8;l++)
+                            y[l]=sin2Pi(partialPhase+double(i+l)*partialIncrement);
+                        for(int l=0;l<8;l++)
+                            output[i+l]+=level*envelope[i+l]*y[l];
+                    }
+                    for(;i<samplesCount;i++)
+                        output[i]+=level*envelope[i]*sin2Pi(partialPhase+double(i)*partialIncrement);
+                }
+                double newPhase=phase+double(samplesCount)*increment;
+                if(newPhase>=phasePeriod)
+                    newPhase-=phasePeriod*floor(newPhase/phasePeriod);
+                phases[v]=newPhase;
+            }
+
+            /// adds a partial read from a wavetable to output (same as the sine partials in renderOscillator).
+            static void renderWavetable(const double* table,const double* envelope,double* output,uint samplesCount,
+                double phase,double increment,double level)
+            {
+                uint i=0;
+                for(;i+8<=samplesCount;i+=8)
+                {
+                    double y[8];
+                    for(int l=0;l<8;l++)
+                        y[l]=Wavetables::interpolate(table,phase+double(i+l)*increment);
+                    for(int l=0;l<8;l++)
+                        output[i+l]+=level*envelope[i+l]*y[l];
+                }
+                for(;i<samplesCount;i++)
+                    output[i]+=level*envelope[i]*Wavetables::interpolate(table,phase+double(i)*increment);
+            }
+        };
+    }
+}
+#endif
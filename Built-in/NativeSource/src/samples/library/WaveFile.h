@@ -2,6 +2,7 @@
 #define _WaveFile_h_
 
 #include "file.h"
+#include "MappedWaveFile.h"
 
 /**
  *  \file WaveFile.hxx
@@ -26,6 +27,9 @@
 /** Utility class to handle Wave file header data.
  *   Used by the classes above.
  *   Ignores LIST and INFO chunks.
+ *   Files larger than 4 GB are supported with the RF64/BW64 format (64-bit sizes in a "ds64" chunk):
+ *   written files start with a "JUNK" chunk, which is replaced by the "ds64" chunk if the data
+ *   grows over the 32-bit limit, so that the header size never changes.
  */
 struct WaveFileHeader
 {
@@ -33,61 +37,87 @@ struct WaveFileHeader
     uint64  samplesCount=0;         // number of audio samples
     uint64  sampleRate=0;           // the sample rate of the audio data
     uint    bytesPerSample=0;       // the number of bytes per individual channel sample
+    uint    formatTag=0;            // the format of the samples: 1 for integer PCM, 3 for IEEE float
     uint    headerSize=0;           // the size of the header (offset to audio data)
     
+    /// size of the audio data in bytes.
+    uint64 get_dataSize()const
+    {
+        return uint64(bytesPerSample)*samplesCount*channelsCount;
+    }
+
+    /// true if the samples are floating point numbers (false for integers).
+    bool get_isFloat()const
+    {
+        return formatTag==3;
+    }
+    
     /** Read header data from file.
      *   Assumes that the file is at position 0.
      */
     bool read(file& f)
     {
-        bool ok=false;
         std::string tempString;
         f.readString(4,tempString);
-        if(tempString=="RIFF")
+        if(tempString!="RIFF" && tempString!="RF64" && tempString!="BW64")
+            return false;
+        f.readUInt(4); // riff size (not used, may be truncated)
+        f.readString(4,tempString);
+        if(tempString!="WAVE")
+            return false;
+        
+        // parse chunks until data chunk is found
+        bool hasFormat=false;
+        uint64 blockSize=0;
+        uint64 ds64DataSize=0;
+        while(f.readString(4,tempString)==4)
         {
-            int64 size=f.readUInt(4);
-            f.readString(4,tempString);
-            if(tempString=="WAVE")
+            uint64 chunkSize=f.readUInt(4);
+            int64 chunkEnd=f.getPos()+int64(chunkSize+(chunkSize&1)); // chunks are word aligned
+            if(tempString=="ds64" && chunkSize>=24)
+            {
+                f.readUInt(8); // riff size
+                ds64DataSize=f.readUInt(8);
+            }
+            else if(tempString=="fmt " && chunkSize>=16) // PCM format size is 16, 18 or 40
             {
-                f.readString(4,tempString);
-                if(tempString=="fmt ")
+                uint64 format=f.readUInt(2);
+                channelsCount=(uint)f.readUInt(2);
+                sampleRate=f.readUInt(4);
+                f.readUInt(4); // byte rate
+                blockSize=f.readUInt(2);
+                bytesPerSample = (uint)f.readUInt(2)/8;
+                if(format==0xFFFE && chunkSize>=26)
                 {
-                    uint64 fmtSize = f.readUInt(4);
-                    if(fmtSize>=16) // PCM format size is 16 or 18
-                    {
-                        int64 dataOffset=int64(fmtSize)-16;
-                        uint64 format=f.readInt(2);
-                        if(format==1 || format==3) //uncompressed PCM format or float are supported
-                        {
-                            channelsCount=(uint)f.readUInt(2);
-                            sampleRate=f.readUInt(4);
-                            uint64 byteRate=f.readUInt(4);
-                            uint64 blockSize=f.readUInt(2);
-                            bytesPerSample = (uint)f.readUInt(2)/8;
-                            // end of subchunk
-                            f.movePos((int)dataOffset);
-                            
-                            // looking for data subchunk => skipping all others
-                            f.readString(4,tempString); // data id
-                            while(tempString!="data" && !f.isEndOfFile())
-                            {
-                                uint64 dataSize = f.readUInt(4);
-                                f.movePos((int)dataSize);        // skip junk data
-                                f.readString(4,tempString); // read next chunk id
-                            }
-                            if(tempString=="data")
-                            {
-                                uint64 dataSize = f.readUInt(4);
-                                samplesCount=dataSize/blockSize;
-                            }
-                            headerSize=f.getPos();
-                            ok=true;
-                        }
-                    }
+                    // WAVE_FORMAT_EXTENSIBLE: format in the first bytes of the sub format
+                    f.movePos(8);
+                    format=f.readUInt(2);
                 }
+                //uncompressed PCM format or float are supported
+                if(format!=1 && format!=3)
+                    return false;
+                formatTag=uint(format);
+                hasFormat=(blockSize!=0);
+            }
+            else if(tempString=="data")
+            {
+                if(!hasFormat)
+                    return false;
+                uint64 dataSize=chunkSize;
+                if(chunkSize==0xFFFFFFFF && ds64DataSize!=0)
+                    dataSize=ds64DataSize;
+                headerSize=uint(f.getPos());
+                // truncated files (interrupted recording): use the data actually available
+                int64 fileSize=f.getSize();
+                if(fileSize>=int64(headerSize) && dataSize>uint64(fileSize-headerSize))
+                    dataSize=uint64(fileSize-headerSize);
+                samplesCount=dataSize/blockSize;
+                return true;
             }
+            if(f.setPos(chunkEnd)<0)
+                break;
         }
-        return ok;
+        return false;
     }
     
     /** Write header data to file.
@@ -95,17 +125,27 @@ struct WaveFileHeader
      */
     bool write(file& f)
     {
-        f.writeString("RIFF");
-        int64 dataSize=(bytesPerSample)*samplesCount*channelsCount;
-        f.writeUInt(36+dataSize,4);
+        uint64 dataSize=get_dataSize();
+        uint64 riffSize=4+(8+28)+(8+16)+(8+dataSize);
+        // the 32-bit sizes are set to 0xFFFFFFFF for RF64 files
+        bool rf64=(riffSize>=0xFFFFFFFF);
+        f.writeString(rf64?"RF64":"RIFF");
+        f.writeUInt(rf64?0xFFFFFFFF:riffSize,4);
         f.writeString("WAVE");
+        
+        // 64-bit sizes (or place holder)
+        f.writeString(rf64?"ds64":"JUNK");
+        f.writeUInt(28,4);
+        f.writeUInt(rf64?riffSize:0,8);
+        f.writeUInt(rf64?dataSize:0,8);
+        f.writeUInt(rf64?samplesCount:0,8);
+        f.writeUInt(0,4); // table length
+        
         f.writeString("fmt ");
         f.writeUInt(16,4);
         //uncompressed PCM format or float
-        if(bytesPerSample>=4)
-            f.writeInt(3,2);
-        else
-            f.writeInt(1,2);
+        formatTag=(bytesPerSample>=4)?3:1;
+        f.writeInt(formatTag,2);
         f.writeUInt(channelsCount,2);
         f.writeUInt(sampleRate,4);
         f.writeUInt(sampleRate*channelsCount * bytesPerSample,4); // byte rate
@@ -114,7 +154,8 @@ struct WaveFileHeader
         
         // data subchunk
         f.writeString("data"); // data id
-        f.writeUInt(dataSize,4);
+        f.writeUInt(rf64?0xFFFFFFFF:dataSize,4);
+        headerSize=uint(f.getPos());
         return true;
     }
 };
@@ -140,80 +181,21 @@ struct WaveFileData
     /** load entire audio file from disk into the interleavedSamples array.
      *   This method allocates memory and may take a while,
      *   so this should not be called from the real time audio thread.
+     *   The file is memory mapped and converted by large blocks (see MappedWaveFile).
      */
     bool loadFile(string filePath)
     {
         bool ok=false;
-        // open the file
-        file f;
-        if(f.open(filePath,"r")>=0)
+        MappedWaveFile mappedFile;
+        if(mappedFile.open(filePath))
         {
-            // read the header
-            WaveFileHeader header;
-            if(header.read(f))
-            {
-                ok=true;
-                // store file data
-                channelsCount=header.channelsCount;
-                sampleRate=double(header.sampleRate);
-                interleavedSamples.length=uint(header.samplesCount*channelsCount);
-                
-                switch(header.bytesPerSample)
-                {
-                        // 8-bit wav files use only positive values (0 to 255)
-                    case 1:
-                    {
-                        for (uint i = 0; i < header.samplesCount; i++)
-                        {
-                            for(uint ch=0;ch<channelsCount;ch++)
-                            {
-                                interleavedSamples[i+ch]=(double(f.readUInt(header.bytesPerSample))-128.0)/128.0;
-                            }
-                        }
-                        break;
-                    }
-                        // single precision floating point wav file
-                    case 4:
-                    {
-                        for (uint i = 0; i < header.samplesCount; i++)
-                        {
-                            for(uint ch=0;ch<channelsCount;ch++)
-                            {
-                                interleavedSamples[i+ch]=f.readFloat();
-                            }
-                        }
-                        break;
-                    }
-                    case 8:
-                        // double precision floating point wav file
-                    {
-                        for (uint i = 0; i < header.samplesCount; i++)
-                        {
-                            for(uint ch=0;ch<channelsCount;ch++)
-                            {
-                                interleavedSamples[i+ch]=f.readDouble();
-                            }
-                        }
-                        break;
-                    }
-                        // 16 or 24-bit integer files
-                    default:
-                    {
-                        uint64 maxValue=(1<<(header.bytesPerSample*8-1))-1;
-                        double factor=1.0/double(maxValue);
-                        for (uint i = 0; i < header.samplesCount; i++)
-                        {
-                            for(uint ch=0;ch<channelsCount;ch++)
-                            {
-                                int64 value=f.readInt(header.bytesPerSample);
-                                interleavedSamples[i+ch]=double(value)*factor;
-                            }
-                        }
-                        break;
-                    }
-                }
-            }
-            f.close();
+            ok=true;
+            // store file data
+            channelsCount=mappedFile.get_channelsCount();
+            sampleRate=mappedFile.get_sampleRate();
+            interleavedSamples.resize(uint(mappedFile.get_samplesCount()*channelsCount));
+            if(interleavedSamples.length!=0)
+                mappedFile.decodeInterleaved(0,interleavedSamples.ptr,mappedFile.get_samplesCount());
         }
         return ok;
     }
@@ -243,11 +225,11 @@ struct WaveFileData
                 case 1:
                 {
                     // 8-bit wav files use only positive values (0 to 255)
-                    for (uint i = 0; i < header.samplesCount; i++)
+                    for (uint64 i = 0; i < header.samplesCount; i++)
                     {
                         for(uint ch=0;ch<header.channelsCount;ch++)
                         {
-                            f.writeUInt(uint64(interleavedSamples[i+ch]*128.0+128.0),1);
+                            f.writeUInt(uint64(interleavedSamples[uint(i*header.channelsCount+ch)]*128.0+128.0),1);
                         }
                     }
                     break;
@@ -255,11 +237,11 @@ struct WaveFileData
                     // single precision floating point wav file
                 case 4:
                 {
-                    for (uint i = 0; i < header.samplesCount; i++)
+                    for (uint64 i = 0; i < header.samplesCount; i++)
                     {
                         for(uint ch=0;ch<header.channelsCount;ch++)
                         {
-                            f.writeFloat((float)interleavedSamples[i+ch]);
+                            f.writeFloat((float)interleavedSamples[uint(i*header.channelsCount+ch)]);
                         }
                     }
                     break;
@@ -267,11 +249,11 @@ struct WaveFileData
                 case 8:
                     // double precision floating point wav file
                 {
-                    for (uint i = 0; i < header.samplesCount; i++)
+                    for (uint64 i = 0; i < header.samplesCount; i++)
                     {
                         for(uint ch=0;ch<header.channelsCount;ch++)
                         {
-                            f.writeDouble(interleavedSamples[i+ch]);
+                            f.writeDouble(interleavedSamples[uint(i*header.channelsCount+ch)]);
                         }
                     }
                     break;
@@ -280,17 +262,20 @@ struct WaveFileData
                 {
                     double maxValue=(1<<(header.bytesPerSample*8-1))-1;
                     double factor=double(maxValue);
-                    for (uint i = 0; i < header.samplesCount; i++)
+                    for (uint64 i = 0; i < header.samplesCount; i++)
                     {
                         for(uint ch=0;ch<header.channelsCount;ch++)
                         {
-                            int64 value=int64(interleavedSamples[i+ch]*maxValue);
+                            int64 value=int64(interleavedSamples[uint(i*header.channelsCount+ch)]*maxValue);
                             f.writeInt(value,header.bytesPerSample);
                         }
                     }
                     break;
                 }
             }
+            // chunks are word aligned
+            if(header.get_dataSize()&1)
+                f.writeUInt(0,1);
             ok=true;
             f.close();
         }
@@ -316,9 +301,9 @@ struct WaveFileReader
             {
                 ok=true;
                 blockSize=header.channelsCount*header.bytesPerSample;
-                if(header.bytesPerSample>1 && header.bytesPerSample<4)
+                if(header.bytesPerSample>1 && !header.get_isFloat())
                 {
-                    uint64 maxValue=(1<<(header.bytesPerSample*8-1))-1;
+                    uint64 maxValue=(uint64(1)<<(header.bytesPerSample*8-1))-1;
                     gainFactor=1.0/double(maxValue);
                 }
                 if(maxChannelsCount>0 && uint(maxChannelsCount)<header.channelsCount)
@@ -359,19 +344,6 @@ struct WaveFileReader
                 
                 break;
             }
-                // single precision floating point wav file
-            case 4:
-            {
-                for(uint ch=0;ch<channelsToRead;ch++)
-                {
-                    oSample[ch]=f.readFloat();
-                }
-                for(uint ch=0;ch<channelsToSkip;ch++)
-                {
-                    f.readFloat();
-                }
-                break;
-            }
             case 8:
                 // double precision floating point wav file
             {
@@ -385,7 +357,24 @@ struct WaveFileReader
                 }
                 break;
             }
-                // 16 or 24-bit integer wav file
+                // single precision floating point wav file
+            case 4:
+            {
+                if(header.get_isFloat())
+                {
+                    for(uint ch=0;ch<channelsToRead;ch++)
+                    {
+                        oSample[ch]=f.readFloat();
+                    }
+                    for(uint ch=0;ch<channelsToSkip;ch++)
+                    {
+                        f.readFloat();
+                    }
+                    break;
+                }
+                // 32-bit integer wav file: fall through
+            }
+                // 16, 24 or 32-bit integer wav file
             default:
             {
                 for(uint ch=0;ch<channelsToRead;ch++)
@@ -403,20 +392,20 @@ struct WaveFileReader
     /** Move file cursor to sample number "samplePosition".
      *   Warning: does not check if end of data chunk is reached.
      */
-    bool setPos(uint samplePosition)
+    bool setPos(uint64 samplePosition)
     {
-        return f.setPos(header.headerSize+samplePosition*blockSize)>=0;
+        return f.setPos(int64(header.headerSize)+int64(samplePosition*blockSize))>=0;
     }
     
     /** Move file cursor by "sampleOffset" samples.
      *   returns false if failed.
      *   Warning: does not check if end of data chunk is reached.
      */
-    bool movePos(int sampleOffset)
+    bool movePos(int64 sampleOffset)
     {
-        int newPos=f.getPos()+sampleOffset*blockSize;
-        if(newPos>=int(header.headerSize))
-            return f.setPos(sampleOffset*blockSize)>=0;
+        int64 newPos=f.getPos()+sampleOffset*int64(blockSize);
+        if(newPos>=int64(header.headerSize))
+            return f.setPos(newPos)>=0;
         else
             return false;
     }
@@ -444,7 +433,23 @@ struct WaveFileReader
     {
         return int(header.channelsCount);
     }
-    
+
+    /** samplesCount property (read only): the number of samples in the file.
+     *
+     */
+    uint64 get_samplesCount()const
+    {
+        return header.samplesCount;
+    }
+
+    /** sampleRate property (read only).
+     *
+     */
+    double get_sampleRate()const
+    {
+        return double(header.sampleRate);
+    }
+
     // private data
 private:
     file    f; // the file
@@ -539,8 +544,29 @@ struct WaveFileWriter
         }
     }
     
+    /** Updates the header with the current size of the data, so that the file can be read
+     *   up to this point even if it is never closed (crash). The file position is preserved.
+     */
+    bool flushHeader()
+    {
+        if(f.f==NULL)
+            return false;
+        int64 position=f.getPos();
+        f.setPos(0);
+        header.write(f);
+        f.setPos(position);
+        return fflush(f.f)==0;
+    }
+    
     bool close()
     {
+        if(f.f==NULL)
+            return false;
+        
+        // chunks are word aligned
+        if(header.get_dataSize()&1)
+            f.writeUInt(0,1);
+        
         // flush header to update file size
         f.setPos(0);
         header.write(f);
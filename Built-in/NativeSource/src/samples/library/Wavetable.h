@@ -0,0 +1,267 @@
+#ifndef _Wavetable_h_
+#define _Wavetable_h_
+
+#include <math.h>
+#include <string.h>
+/** \file Wavetable.h
+*   Band-limited wavetable oscillators with mip-mapped tables (c/c++ dsp scripting).
+*
+*   A wavetable bank stores one period of a waveform at several levels (mip maps), one per octave:
+*   level l contains the harmonics up to kMaxHarmonics/2^l only, so that a voice can read the level that
+*   does not alias at its frequency. The tables only depend on the harmonics of the waveform (not on the
+*   sample rate): they are built once, from harmonic amplitudes, and can then be read by any number of voices.
+*   Banks for standard waveforms are built on first use and shared by all the instances of the script
+*   (see getSharedBank).
+*
+*   Reading a table is a linear interpolation between two points instead of a call to sin() per
+*   harmonic. Blocks are rendered by groups of 8 samples with independent phases, so that the index and
+*   interpolation computations can be vectorized by the compiler (table reads are gathers).
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Wavetables
+    {
+        static const double kPi=3.141592653589793238462;
+        static const uint kTableSize=2048; ///< samples per period (power of two)
+        static const uint kMaxHarmonics=kTableSize/2; ///< harmonics of the first level
+        static const uint kLevelsCount=11; ///< number of levels (the last one contains the fundamental only)
+
+        /** Standard waveforms (see getSharedBank).
+        *
+        */
+        enum Waveform
+        {
+            kSine,
+            kTriangle,
+            kSaw,
+            kSquare
+        };
+
+        /** Reads a table (kTableSize+1 points, the last one being a copy of the first one) with linear interpolation.
+        *   cycles is the position in the waveform (positive, periods are wrapped).
+        */
+        inline double interpolate(const double* table,double cycles)
+        {
+            const double position=cycles*double(kTableSize);
+            const int index=int(position);
+            const double fraction=position-double(index);
+            const int i=index&int(kTableSize-1);
+            return table[i]+fraction*(table[i+1]-table[i]);
+        }
+
+        /// one period of a sine wave (kTableSize+1 points), computed on first use.
+        inline const double* getSineTable()
+        {
+            struct SineTable
+            {
+                double values[kTableSize+1];
+                SineTable()
+                {
+                    for(uint i=0;i<=kTableSize;i++)
+                        values[i]=sin(2*kPi*double(i)/double(kTableSize));
+                    values[kTableSize]=values[0];
+                }
+            };
+            static const SineTable table;
+            return table.values;
+        }
+
+        /** Mip-mapped wavetables for a single waveform.
+        *
+        */
+        struct WavetableBank
+        {
+            /// allocates the tables (silence). Not for the audio thread.
+            WavetableBank()
+            {
+                tables.resize(kLevelsCount*(kTableSize+1));
+                for(uint i=0;i<tables.length;i++)
+                    tables[i]=0;
+                // sine table ready before the audio thread builds the tables
+                getSineTable();
+            }
+
+            /// allocates and builds the tables of a standard waveform. Not for the audio thread.
+            WavetableBank(Waveform waveform):WavetableBank()
+            {
+                array<double> amplitudes(kMaxHarmonics);
+                for(uint h=1;h<=kMaxHarmonics;h++)
+                {
+                    double amplitude=0;
+                    bool odd=((h&1)==1);
+                    switch(waveform)
+                    {
+                    case kSine:
+                        amplitude=(h==1)?1:0;
+                        break;
+                    case kTriangle:
+                        if(odd)
+                            amplitude=((h&3)==1?1:-1)*8/(kPi*kPi*double(h*h));
+                        break;
+                    case kSaw:
+                        amplitude=(odd?2:-2)/(kPi*double(h));
+                        break;
+                    case kSquare:
+                        if(odd)
+                            amplitude=4/(kPi*double(h));
+                        break;
+                    }
+                    amplitudes[h-1]=amplitude;
+                }
+                build(amplitudes.ptr,amplitudes.length);
+            }
+
+            /** Builds the tables from the amplitudes of the harmonics (amplitudes[h] for harmonic h+1) and their
+            *   phases (in cycles, optional). Harmonics above kMaxHarmonics are ignored.
+            *   Does not allocate memory: can be called from the audio thread when the spectrum changes
+            *   (cost proportional to kTableSize*(harmonicsCount+kLevelsCount)).
+            */
+            void build(const double* amplitudes,uint harmonicsCount,const double* phases=null)
+            {
+                if(harmonicsCount>kMaxHarmonics)
+                    harmonicsCount=kMaxHarmonics;
+                const double* sine=getSineTable();
+                const uint mask=kTableSize-1;
+                const uint quarter=kTableSize/4;
+
+                // from the last level (fewest harmonics) to the first one: add the missing harmonics to
+                // the previous level, so that each harmonic is computed once
+                double* previous=null;
+                uint h=1;
+                for(int level=kLevelsCount-1;level>=0;level--)
+                {
+                    double* table=getWritableTable(level);
+                    if(previous!=null)
+                        memcpy(table,previous,(kTableSize+1)*sizeof(double));
+                    else
+                    {
+                        for(uint i=0;i<=kTableSize;i++)
+                            table[i]=0;
+                    }
+                    const uint maxHarmonic=getMaxHarmonic(level);
+                    for(;h<=maxHarmonic && h<=harmonicsCount;h++)
+                    {
+                        const double amplitude=amplitudes[h-1];
+                        if(amplitude==0)
+                            continue;
+                        // a*sin(x+p)=a*cos(p)*sin(x)+a*sin(p)*cos(x), read from the sine table
+                        double sinCoeff=amplitude;
+                        double cosCoeff=0;
+                        if(phases!=null && phases[h-1]!=0)
+                        {
+                            sinCoeff=amplitude*cos(2*kPi*phases[h-1]);
+                            cosCoeff=amplitude*sin(2*kPi*phases[h-1]);
+                        }
+                        for(uint i=0;i<kTableSize;i++)
+                        {
+                            const uint index=h*i;
+                            table[i]+=sinCoeff*sine[index&mask]+cosCoeff*sine[(index+quarter)&mask];
+                        }
+                    }
+                    table[kTableSize]=table[0];
+                    previous=table;
+                }
+            }
+
+            /// the highest harmonic contained in a level.
+            static uint getMaxHarmonic(uint level)
+            {
+                return kMaxHarmonics>>level;
+            }
+
+            /** Returns the level to use for a given phase increment (cycles of the fundamental per sample):
+            *   the first level without harmonics above the Nyquist frequency. Levels are one octave apart, so the
+            *   harmonics above half the Nyquist frequency may be missing: a monophonic generator can rather
+            *   build level 0 with the harmonics below the Nyquist frequency only, and read it.
+            */
+            static uint getLevel(double increment)
+            {
+                const double maxHarmonic=.5/increment;
+                uint level=0;
+                while(level<kLevelsCount-1 && double(getMaxHarmonic(level))>maxHarmonic)
+                    level++;
+                return level;
+            }
+
+            /// the table of a level (kTableSize+1 points), to be read with interpolate().
+            const double* getTable(uint level)const
+            {
+                return tables.ptr+level*(kTableSize+1);
+            }
+
+            /// reads the waveform at the given position (in cycles, positive).
+            double read(double cycles,uint level=0)const
+            {
+                return interpolate(getTable(level),cycles);
+            }
+
+            /** Adds samplesCount samples of the waveform multiplied by amplitude to output, starting at phase
+            *   (in cycles, positive) with a constant phase increment. Returns the phase for the next sample,
+            *   reduced to [0;1[.
+            */
+            double render(double* output,uint samplesCount,double phase,double increment,double amplitude)const
+            {
+                const double* table=getTable(getLevel(increment));
+                // groups of 8 samples (independent from each other: computed in parallel in vector registers)
+                uint i=0;
+                for(;i+8<=samplesCount;i+=8)
+                {
+                    double y[8];
+                    for(int l=0;l<8;l++)
+                        y[l]=interpolate(table,phase+double(i+l)*increment);
+                    for(int l=0;l<8;l++)
+                        output[i+l]+=amplitude*y[l];
+                }
+                for(;i<samplesCount;i++)
+                    output[i]+=amplitude*interpolate(table,phase+double(i)*increment);
+                phase+=double(samplesCount)*increment;
+                return phase-floor(phase);
+            }
+
+            // private data
+        private:
+            array<double>   tables; ///< all levels, one after the other
+
+            double* getWritableTable(uint level)
+            {
+                return tables.ptr+level*(kTableSize+1);
+            }
+        };
+
+        /** Returns the bank of a standard waveform, shared by all the voices and instances of the script.
+        *   The tables are built on first call (a few milliseconds): call it from initialize(), not from the audio thread.
+        */
+        inline const WavetableBank& getSharedBank(Waveform waveform)
+        {
+            switch(waveform)
+            {
+            case kTriangle:
+                {
+                    static const WavetableBank bank(kTriangle);
+                    return bank;
+                }
+            case kSaw:
+                {
+                    static const WavetableBank bank(kSaw);
+                    return bank;
+                }
+            case kSquare:
+                {
+                    static const WavetableBank bank(kSquare);
+                    return bank;
+                }
+            default:
+                {
+                    static const WavetableBank bank(kSine);
+                    return bank;
+                }
+            }
+        }
+    }
+}
+#endif
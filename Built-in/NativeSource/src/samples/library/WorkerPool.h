@@ -0,0 +1,329 @@
+#ifndef _WorkerPool_h_
+#define _WorkerPool_h_
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/** \file WorkerPool.h
+*   Pool of worker threads running the tasks of the audio thread in parallel (c++ scripting).
+*
+*   The audio thread splits its work into independent tasks and calls run(): the tasks are shared
+*   between the workers and the audio thread itself, which also runs tasks and then waits for the
+*   tasks started by the workers only. Tasks are split into one range per thread; a thread that has
+*   finished its range steals the remaining tasks of the other ranges.
+*
+*   Threads are started once (start() from initialize()), and the audio thread chooses how many of
+*   them take part in the next dispatches with setActiveWorkersCount(), which is real-time safe.
+*
+*   Dispatching never allocates memory: tasks are claimed with atomic operations, and waiting is
+*   bounded (spin, then yield). Idle workers spin and yield for a while after each dispatch, then
+*   wait on a condition variable until the next one: a parked worker does not delay the audio
+*   thread, which runs the tasks that have not been claimed. Inactive workers stay parked.
+*
+*   Workers use the default scheduling of the system, unless start() is asked for a real-time
+*   priority or to pin each worker to a core (ignored if the system does not allow it).
+*
+*   Created by Blue Cat Audio <services@bluecataudio.com>
+*   \copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Threads
+    {
+        struct WorkerPool
+        {
+            static const uint kMaxWorkers=15; ///< worker threads (the calling thread is not counted)
+            static const uint kSpinCount=2000; ///< busy wait iterations before yielding
+            static const uint kYieldCount=200; ///< yields before parking (idle workers only)
+            static const uint kMaxTasks=0xFFFF; ///< tasks per dispatch (more tasks are run by the calling thread)
+
+            /// a task: function(context,task) is called once for each task index.
+            typedef void (*TaskFunction)(void* context,uint task);
+
+            /// scheduling options of the worker threads (see start), can be combined.
+            enum Options
+            {
+                kDefaultScheduling=0,
+                kRealTimePriority=1, ///< lowest real-time priority (SCHED_FIFO, or time critical on Windows)
+                kPinnedToCores=2 ///< one core per worker, the first one being left to the host (Linux and Windows)
+            };
+
+            WorkerPool(){}
+
+            ~WorkerPool()
+            {
+                stop();
+            }
+
+            /// number of workers to use by default: one per extra core, up to 3.
+            static uint getDefaultWorkersCount()
+            {
+                uint cores=std::thread::hardware_concurrency();
+                if(cores<=1)
+                    return 0;
+                return (cores-1<3)?cores-1:3;
+            }
+
+            /** Starts the worker threads (0 to kMaxWorkers), all active, with the given scheduling options.
+            *   Not for the audio thread: call it from initialize(), and stop() from shutdown().
+            */
+            void start(uint count,int options=kDefaultScheduling)
+            {
+                stop();
+                if(count>kMaxWorkers)
+                    count=kMaxWorkers;
+                running.store(true);
+                activeCount.store(count);
+                for(uint w=0;w<count;w++)
+                    workers[w]=std::thread(&WorkerPool::runWorker,this,w+1,options);
+                workersCount=count;
+            }
+
+            /// stops the worker threads.
+            void stop()
+            {
+                running.store(false);
+                wakeWorkers();
+                for(uint w=0;w<workersCount;w++)
+                    workers[w].join();
+                workersCount=0;
+                activeCount.store(0);
+            }
+
+            /** Sets the number of workers that take part in the next dispatches (up to the number of workers
+            *   started), for a "Threads" parameter for example. No thread is started or stopped: real-time safe,
+            *   call it from the thread that calls run(). With 0, run() uses the calling thread only.
+            */
+            void setActiveWorkersCount(uint count)
+            {
+                if(count>workersCount)
+                    count=workersCount;
+                activeCount.store(count,std::memory_order_relaxed);
+            }
+
+            /// number of worker threads started.
+            uint get_workersCount()const
+            {
+                return workersCount;
+            }
+
+            /// number of workers that take part in the dispatches (see setActiveWorkersCount).
+            uint get_activeWorkersCount()const
+            {
+                return activeCount.load(std::memory_order_relaxed);
+            }
+
+            /** Runs function(context,task) for task=0 to tasksCount-1, on the workers and the calling thread, and
+            *   returns when all the tasks are done. Tasks must be independent from each other (they may run in
+            *   any order). No memory allocation: can be called from the audio thread (parked workers are
+            *   woken up with a short lock, never held while waiting).
+            *   Without active workers, the tasks are run in order by the calling thread.
+            */
+            void run(TaskFunction function,void* context,uint tasksCount)
+            {
+                const uint active=activeCount.load(std::memory_order_relaxed);
+                if(active==0 || tasksCount<2 || tasksCount>kMaxTasks)
+                {
+                    for(uint t=0;t<tasksCount;t++)
+                        function(context,t);
+                    return;
+                }
+                // publish the tasks: each range is a single word (generation, end and next task), so that a
+                // late worker cannot claim a task of a previous dispatch, nor a task with the end of another one.
+                // No task of the previous dispatch can still be claimed (they were all done), so the function
+                // can be replaced before the ranges are.
+                const uint gen=generation.load(std::memory_order_relaxed)+1;
+                taskFunction=function;
+                taskContext=context;
+                remaining.store(tasksCount,std::memory_order_relaxed);
+                const uint rangesCount=active+1;
+                dispatchRangesCount.store(rangesCount,std::memory_order_relaxed);
+                for(uint r=0;r<rangesCount;r++)
+                    ranges[r].store(makeRange(gen,tasksCount*(r+1)/rangesCount,tasksCount*r/rangesCount),std::memory_order_release);
+                generation.store(gen,std::memory_order_seq_cst);
+                if((parkedWorkers.load(std::memory_order_seq_cst)&getWorkersMask(active))!=0)
+                    wakeWorkers();
+
+                // the calling thread uses the first range, then steals
+                runTasks(0,gen);
+
+                // wait for the tasks claimed by the workers (bounded: one task per worker at most)
+                for(uint i=0;remaining.load(std::memory_order_acquire)!=0;i++)
+                {
+                    if(i>=kSpinCount)
+                        std::this_thread::yield();
+                }
+            }
+
+            // private data
+        private:
+            /// a range of tasks: generation (high 32 bits), end (16 bits) and next task (low 16 bits).
+            /// Aligned on cache lines: written by different threads.
+            struct alignas(64) Range:std::atomic<uint64>
+            {
+                Range():std::atomic<uint64>(0){}
+            };
+
+            std::thread             workers[kMaxWorkers];
+            uint                    workersCount=0;
+            std::atomic<bool>       running{false};
+            std::atomic<uint>       generation{0};
+            std::atomic<uint>       remaining{0};
+            std::atomic<uint>       activeCount{0};
+            std::atomic<uint>       dispatchRangesCount{1}; ///< ranges of the current dispatch (active workers+1)
+            std::atomic<uint>       parkedWorkers{0}; ///< workers waiting (or about to wait) on wakeUp (bit=index)
+            std::mutex              parkingMutex;
+            std::condition_variable wakeUp;
+            TaskFunction            taskFunction=null;
+            void*                   taskContext=null;
+            Range                   ranges[kMaxWorkers+1];
+
+            static uint64 makeRange(uint gen,uint end,uint task)
+            {
+                return (uint64(gen)<<32)|(uint64(end)<<16)|uint64(task);
+            }
+
+            /// bits of the workers 1 to count (see parkedWorkers).
+            static uint getWorkersMask(uint count)
+            {
+                return (2u<<count)-2;
+            }
+
+            /// claims the next task of a range for a dispatch. Returns false if the range is empty.
+            bool claim(uint r,uint gen,uint& task)
+            {
+                Range& range=ranges[r];
+                uint64 cursor=range.load(std::memory_order_acquire);
+                for(;;)
+                {
+                    if(uint(cursor>>32)!=gen)
+                        return false;
+                    task=uint(cursor)&0xFFFF;
+                    if(task>=((uint(cursor)>>16)&0xFFFF))
+                        return false;
+                    if(range.compare_exchange_weak(cursor,cursor+1,std::memory_order_acq_rel,std::memory_order_acquire))
+                        return true;
+                }
+            }
+
+            /// wakes up the parked workers. The lock is only held by workers while they check the generation,
+            /// so that a worker cannot miss the notification between its check and its wait.
+            void wakeWorkers()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(parkingMutex);
+                }
+                wakeUp.notify_all();
+            }
+
+            /// runs the tasks of a range, then the remaining tasks of the other ranges.
+            void runTasks(uint first,uint gen)
+            {
+                const uint rangesCount=dispatchRangesCount.load(std::memory_order_relaxed);
+                for(uint i=0;i<rangesCount;i++)
+                {
+                    const uint r=(first+i)%rangesCount;
+                    uint task=0;
+                    while(claim(r,gen,task))
+                    {
+                        taskFunction(taskContext,task);
+                        remaining.fetch_sub(1,std::memory_order_release);
+                    }
+                }
+            }
+
+            void runWorker(uint index,int options)
+            {
+                if((options&kPinnedToCores)!=0)
+                    pinToCore(index);
+                if((options&kRealTimePriority)!=0)
+                    setRealTimePriority();
+                const uint bit=1u<<index;
+                uint seen=generation.load(std::memory_order_acquire);
+                uint idle=0;
+                while(running.load(std::memory_order_relaxed))
+                {
+                    const uint gen=generation.load(std::memory_order_acquire);
+                    if(gen!=seen)
+                    {
+                        // inactive workers skip the dispatch (and park soon)
+                        seen=gen;
+                        if(index<dispatchRangesCount.load(std::memory_order_relaxed))
+                        {
+                            runTasks(index,gen);
+                            idle=0;
+                        }
+                    }
+                    else if(idle<kSpinCount)
+                        idle++;
+                    else if(idle<kSpinCount+kYieldCount)
+                    {
+                        idle++;
+                        std::this_thread::yield();
+                    }
+                    else
+                    {
+                        // park until a dispatch while active (or stop)
+                        parkedWorkers.fetch_or(bit,std::memory_order_seq_cst);
+                        {
+                            std::unique_lock<std::mutex> lock(parkingMutex);
+                            while((generation.load(std::memory_order_seq_cst)==seen || index>activeCount.load(std::memory_order_relaxed))
+                                && running.load(std::memory_order_relaxed))
+                                wakeUp.wait(lock);
+                        }
+                        parkedWorkers.fetch_and(~bit,std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            /// pins the current thread to a core (the first one is left to the host).
+            static void pinToCore(uint index)
+            {
+                uint cores=std::thread::hardware_concurrency();
+                uint core=(cores>1)?(index%cores):0;
+#ifdef _WIN32
+                SetThreadAffinityMask(GetCurrentThread(),DWORD_PTR(1)<<core);
+#elif defined(__linux__)
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(core,&set);
+                pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+#else
+                (void)core; // no affinity API (macOS): left to the scheduler
+#endif
+            }
+
+            /// raises the priority of the current thread.
+            static void setRealTimePriority()
+            {
+#ifdef _WIN32
+                SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_TIME_CRITICAL);
+#else
+                sched_param param;
+                param.sched_priority=sched_get_priority_min(SCHED_FIFO);
+                pthread_setschedparam(pthread_self(),SCHED_FIFO,&param);
+#endif
+            }
+        };
+    }
+}
+#endif
@@ -4,6 +4,9 @@
 #include <string>
 #include <string.h>
 #include <stdio.h>
+#ifndef _MSC_VER
+#include <sys/types.h>
+#endif
 
 /** emulation of the angelscript file API, for compatibility with angelscript.
  *  Adapted from the angelscript file extension source code (scriptfile.cpp).
@@ -57,44 +60,44 @@ struct file
         return 0;
     }
     
-    int getSize() const
+    int64 getSize() const
     {
         if( f == 0 )
             return -1;
         
-        long pos = ftell(f);
-        fseek(f, 0, SEEK_END);
-        long size = ftell(f);
-        fseek(f, pos, SEEK_SET);
+        int64 pos = tell();
+        seek(0, SEEK_END);
+        int64 size = tell();
+        seek(pos, SEEK_SET);
         
-        return (int)size;
+        return size;
     }
     
-    int getPos() const
+    int64 getPos() const
     {
         if( f == 0 )
             return -1;
         
-        return (int)ftell(f);
+        return tell();
     }
     
-    int setPos(int pos)
+    int setPos(int64 pos)
     {
         if( f == 0 )
             return -1;
         
-        int r = fseek(f, pos, SEEK_SET);
+        int r = seek(pos, SEEK_SET);
         
         // Return -1 on error
         return r ? -1 : 0;
     }
     
-    int movePos(int delta)
+    int movePos(int64 delta)
     {
         if( f == 0 )
             return -1;
         
-        int r = fseek(f, delta, SEEK_CUR);
+        int r = seek(delta, SEEK_CUR);
         
         // Return -1 on error
         return r ? -1 : 0;
@@ -125,7 +128,7 @@ struct file
         do
         {
             // Get the current position so we can determine how many characters were read
-            int start = (int)ftell(f);
+            int64 start = tell();
             
             // Set the last byte to something different that 0, so that we can check if the buffer was filled up
             buf[255] = 1;
@@ -135,10 +138,10 @@ struct file
             if( r == 0 ) break;
             
             // Get the position after the read
-            int end = (int)ftell(f);
+            int64 end = tell();
             
             // Add the read characters to the output buffer
-            str.append(buf, end-start);
+            str.append(buf, size_t(end-start));
         }
         while( !feof(f) && buf[255] == 0 && buf[254] != '\n' );
         
@@ -370,5 +373,24 @@ struct file
         size_t r = fwrite(&buf, 8, 1, f);
         return int(r);
     }
+    
+    // 64-bit file offsets (files larger than 2 GB)
+    int64 tell() const
+    {
+#if defined(_MSC_VER)
+        return _ftelli64(f);
+#else
+        return int64(ftello(f));
+#endif
+    }
+    
+    int seek(int64 offset, int origin) const
+    {
+#if defined(_MSC_VER)
+        return _fseeki64(f, offset, origin);
+#else
+        return fseeko(f, off_t(offset), origin);
+#endif
+    }
 };
 #endif
\ No newline at end of file
@@ -124,6 +124,18 @@ DSP_EXPORT struct CStringArray outputStringsNames={_outputStringsNames,2};
 int _outputStringsMaxLengths[]={1024,1024};
 DSP_EXPORT  struct CIntArray outputStringsMaxLengths={_outputStringsMaxLengths,2};
 
+/// An array of binary buffers to be used as output for the script (see OutputBuffer).
+/// Should be preferred to strings for large amounts of data (waveforms, spectrums).
+/// The data must be allocated before initialize returns and only updated in
+/// computeOutputData (increment sequence before and after the update).
+float _outputBufferData[256];
+struct OutputBuffer _outputBuffers[]={{_outputBufferData,256,0,kOutputBufferFloat32,0}};
+DSP_EXPORT struct COutputBufferArray outputBuffers={_outputBuffers,1};
+
+/// Names to be displayed in the plug-in for the output buffers.
+const char* _outputBuffersNames[]={"B1"};
+DSP_EXPORT struct CStringArray outputBuffersNames={_outputBuffersNames,1};
+
 
 /** Initialization: called right after the script has been compiled
 *   and before any other processing occurs.
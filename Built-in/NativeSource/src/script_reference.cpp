@@ -85,6 +85,14 @@ DSP_EXPORT array<string> outputStringsNames={"S1","S2"};
 /// to avoid audio dropouts).
 DSP_EXPORT array<int> outputStringsMaxLengths={1024,1024};
 
+/// An array of binary buffers to be used as output for the script (see OutputBuffer).
+/// Should be preferred to strings for large amounts of data (waveforms, spectrums).
+/// The data must be allocated before initialize returns and only updated in
+/// computeOutputData, between calls to beginUpdate and endUpdate.
+DSP_EXPORT array<OutputBuffer> outputBuffers(1);
+/// Names to be displayed in the plug-in for the output buffers.
+DSP_EXPORT array<string> outputBuffersNames={"B1"};
+
 /** Initialization: called right after the script has been compiled
 *   and before any other processing occurs.
 *   return false if initialization fails (for example if the number of 
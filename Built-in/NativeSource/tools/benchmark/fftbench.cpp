@@ -0,0 +1,142 @@
+/** \file fftbench.cpp
+ *  Accuracy and speed of the real FFT library.
+ *
+ *  Transforms random signals with the RealFFT of each supported size and compares the spectrum with
+ *  a reference computed in long double precision (recursive radix-2 FFT): maximum error relative
+ *  to the highest bin, and time per transform. Exits with code 2 if an error exceeds the bound, so
+ *  that it can be used for regression testing.
+ *
+ *  Usage: fftbench [-t seconds]
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "dspapi.h"
+#include "cpphelpers.h"
+#include "../../src/samples/library/FFT.h"
+
+#include <chrono>
+#include <complex>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace KittyDSP::FFT;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::complex<long double> Complex;
+
+static const double kErrorBound=1e-12; ///< maximum error, relative to the highest bin
+
+/// reference complex FFT (recursive, decimation in time), in long double precision.
+static void referenceTransform(std::vector<Complex>& values)
+{
+    const size_t count=values.size();
+    if(count<2)
+        return;
+    std::vector<Complex> even(count/2),odd(count/2);
+    for(size_t i=0;i<count/2;i++)
+    {
+        even[i]=values[2*i];
+        odd[i]=values[2*i+1];
+    }
+    referenceTransform(even);
+    referenceTransform(odd);
+    const long double pi=3.141592653589793238462643383279502884L;
+    for(size_t k=0;k<count/2;k++)
+    {
+        const long double angle=-2*pi*(long double)(k)/(long double)(count);
+        const Complex t=Complex(cosl(angle),sinl(angle))*odd[k];
+        values[k]=even[k]+t;
+        values[k+count/2]=even[k]-t;
+    }
+}
+
+/// maximum error of the spectrum of input against the reference, relative to the highest bin.
+static double getMaxError(RealFFT& fft,const std::vector<double>& input,std::vector<double>& re,std::vector<double>& im)
+{
+    const uint size=fft.get_size();
+    fft.forward(&input[0],&re[0],&im[0]);
+    std::vector<Complex> reference(size);
+    for(uint i=0;i<size;i++)
+        reference[i]=Complex(input[i],0);
+    referenceTransform(reference);
+    long double highest=0;
+    long double maxError=0;
+    for(uint k=0;k<=size/2;k++)
+    {
+        const long double magnitude=std::abs(reference[k]);
+        if(magnitude>highest)
+            highest=magnitude;
+        const long double error=std::abs(Complex(re[k],im[k])-reference[k]);
+        if(!(error<=maxError)) // also catches NaN
+            maxError=error;
+    }
+    return double(maxError/highest);
+}
+
+/// time per transform (us).
+static double getTime(RealFFT& fft,const std::vector<double>& input,std::vector<double>& re,std::vector<double>& im,
+    double minTime)
+{
+    uint64 count=0;
+    double seconds=0;
+    Clock::time_point start=Clock::now();
+    while(seconds<minTime)
+    {
+        for(uint i=0;i<16;i++)
+            fft.forward(&input[0],&re[0],&im[0]);
+        count+=16;
+        seconds=std::chrono::duration<double>(Clock::now()-start).count();
+    }
+    return seconds*1e6/double(count);
+}
+
+static void printUsage()
+{
+    printf("Usage: fftbench [options]\n"
+        "  -t seconds    minimum measurement time per size (default .1)\n");
+}
+
+int main(int argc,char* argv[])
+{
+    double minTime=.1;
+    int option=0;
+    while((option=getopt(argc,argv,"t:h"))!=-1)
+    {
+        switch(option)
+        {
+        case 't':
+            minTime=atof(optarg);
+            break;
+        default:
+            printUsage();
+            return option=='h'?0:1;
+        }
+    }
+
+    printf("%-10s %14s %16s %14s %8s\n","Size","Max error","Time/transform","Time/sample","Result");
+    printf("%s\n",std::string(66,'-').c_str());
+    int failures=0;
+    srand(1);
+    for(uint size=kMinSize;size<=kMaxSize;size*=2)
+    {
+        RealFFT fft;
+        fft.setup(size);
+        std::vector<double> input(size);
+        std::vector<double> re(size/2+1);
+        std::vector<double> im(size/2+1);
+        for(uint i=0;i<size;i++)
+            input[i]=2*double(rand())/double(RAND_MAX)-1;
+        const double error=getMaxError(fft,input,re,im);
+        const double time=getTime(fft,input,re,im,minTime);
+        const bool ok=(error<=kErrorBound);
+        if(!ok)
+            failures++;
+        printf("%-10u %14.2e %13.2f us %11.2f ns %8s\n",size,error,time,time*1e3/double(size),ok?"ok":"FAILED");
+        fflush(stdout);
+    }
+    return failures!=0?2:0;
+}
@@ -0,0 +1,212 @@
+/** \file mathbench.cpp
+ *  Accuracy and speed of the FastMath approximations.
+ *
+ *  Compares each function of the FastMath library, for each accuracy level, with the standard
+ *  library: maximum error over a range of arguments, and time per value when processing blocks.
+ *  Exits with code 2 if an error exceeds the bound of its accuracy level, so that it can be
+ *  used for regression testing.
+ *
+ *  Usage: mathbench [-t seconds] [-n points]
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "dspapi.h"
+#include "cpphelpers.h"
+#include "../../src/samples/library/FastMath.h"
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace KittyDSP::FastMath;
+
+typedef std::chrono::steady_clock Clock;
+typedef double (*ScalarFunction)(double);
+typedef void (*BlockFunction)(const double*,double*,uint);
+
+static const uint kLevelsCount=3;
+static const char* kLevelNames[kLevelsCount]={"low","medium","high"};
+static const double kErrorBounds[kLevelsCount]={1e-3,1e-5,1e-7}; ///< maximum error for each accuracy level
+
+// reference functions (standard library) and approximations with a fixed second argument
+static const double kPowExponent=1.7;
+
+static double powReference(double x)
+{
+    return pow(x,kPowExponent);
+}
+
+static double dbToGainReference(double x)
+{
+    return pow(10,x/20);
+}
+
+static double gainToDbReference(double x)
+{
+    return 20*log10(x);
+}
+
+template <Accuracy accuracy>
+static double powFixed(double x)
+{
+    return powApprox<accuracy>(x,kPowExponent);
+}
+
+template <Accuracy accuracy>
+static void powBlock(const double* input,double* output,uint count)
+{
+    applyBlock<powFixed<accuracy> >(input,output,count);
+}
+
+/// A function to test: reference, approximations and range of arguments.
+struct TestedFunction
+{
+    const char*     name;
+    ScalarFunction  reference;
+    BlockFunction   approximations[kLevelsCount];
+    double          minArgument;
+    double          maxArgument;
+    bool            relativeError; ///< relative or absolute error
+};
+
+static const TestedFunction kFunctions[]=
+{
+    {"exp",exp,{expBlock<kLowAccuracy>,expBlock<kMediumAccuracy>,expBlock<kHighAccuracy>},-700,700,true},
+    {"expm1",expm1,{expm1Block<kLowAccuracy>,expm1Block<kMediumAccuracy>,expm1Block<kHighAccuracy>},-50,50,true},
+    {"log",log,{logBlock<kLowAccuracy>,logBlock<kMediumAccuracy>,logBlock<kHighAccuracy>},1e-300,1e300,false},
+    {"pow(x,1.7)",powReference,{powBlock<kLowAccuracy>,powBlock<kMediumAccuracy>,powBlock<kHighAccuracy>},1e-6,1e6,true},
+    {"sin",sin,{sinBlock<kLowAccuracy>,sinBlock<kMediumAccuracy>,sinBlock<kHighAccuracy>},-1000,1000,false},
+    {"cos",cos,{cosBlock<kLowAccuracy>,cosBlock<kMediumAccuracy>,cosBlock<kHighAccuracy>},-1000,1000,false},
+    {"tanh",tanh,{tanhBlock<kLowAccuracy>,tanhBlock<kMediumAccuracy>,tanhBlock<kHighAccuracy>},-20,20,true},
+    {"dB to gain",dbToGainReference,{dbToGainBlock<kLowAccuracy>,dbToGainBlock<kMediumAccuracy>,dbToGainBlock<kHighAccuracy>},-200,200,true},
+    {"gain to dB",gainToDbReference,{gainToDbBlock<kLowAccuracy>,gainToDbBlock<kMediumAccuracy>,gainToDbBlock<kHighAccuracy>},1e-10,1e10,false},
+};
+
+/** Arguments for a function: evenly spaced, or spaced geometrically for positive ranges spanning several
+*   decades, plus small arguments (where relative errors are the hardest to keep).
+*/
+static void fillArguments(const TestedFunction& f,std::vector<double>& arguments)
+{
+    const size_t count=arguments.size();
+    const bool geometric=(f.minArgument>0 && f.maxArgument/f.minArgument>1000);
+    for(size_t i=0;i<count;i++)
+    {
+        const double t=double(i)/double(count-1);
+        if(geometric)
+            arguments[i]=exp(log(f.minArgument)+(log(f.maxArgument)-log(f.minArgument))*t);
+        else
+            arguments[i]=f.minArgument+(f.maxArgument-f.minArgument)*t;
+    }
+    if(!geometric)
+    {
+        for(size_t i=0;i<count/8;i++)
+            arguments[i]=1e-6*(double(i)-double(count/16));
+    }
+}
+
+/// maximum error of values against the reference function.
+static double getMaxError(const TestedFunction& f,const std::vector<double>& arguments,const std::vector<double>& values)
+{
+    double maxError=0;
+    for(size_t i=0;i<arguments.size();i++)
+    {
+        const double reference=f.reference(arguments[i]);
+        double error=fabs(values[i]-reference);
+        if(f.relativeError && reference!=0)
+            error/=fabs(reference);
+        if(!(error<=maxError)) // also catches NaN
+            maxError=error;
+    }
+    return maxError;
+}
+
+/// time per value (ns) of the block function, or of the reference if function is null.
+static double getTime(const TestedFunction& f,BlockFunction function,const std::vector<double>& arguments,
+    std::vector<double>& values,double minTime)
+{
+    const uint blockSize=256;
+    const uint blocksCount=uint(arguments.size()/blockSize);
+    uint64 count=0;
+    double seconds=0;
+    Clock::time_point start=Clock::now();
+    while(seconds<minTime)
+    {
+        for(uint b=0;b<blocksCount;b++)
+        {
+            const double* input=&arguments[b*blockSize];
+            double* output=&values[b*blockSize];
+            if(function!=null)
+                function(input,output,blockSize);
+            else
+            {
+                for(uint i=0;i<blockSize;i++)
+                    output[i]=f.reference(input[i]);
+            }
+        }
+        count+=uint64(blocksCount)*blockSize;
+        seconds=std::chrono::duration<double>(Clock::now()-start).count();
+    }
+    return seconds*1e9/double(count);
+}
+
+static void printUsage()
+{
+    printf("Usage: mathbench [options]\n"
+        "  -t seconds    minimum measurement time per case (default .1)\n"
+        "  -n points     number of arguments tested per function (default 1048576)\n");
+}
+
+int main(int argc,char* argv[])
+{
+    double minTime=.1;
+    size_t pointsCount=1<<20;
+    int option=0;
+    while((option=getopt(argc,argv,"t:n:h"))!=-1)
+    {
+        switch(option)
+        {
+        case 't':
+            minTime=atof(optarg);
+            break;
+        case 'n':
+            pointsCount=size_t(atol(optarg));
+            break;
+        default:
+            printUsage();
+            return option=='h'?0:1;
+        }
+    }
+    if(pointsCount<1024)
+        pointsCount=1024;
+
+    printf("%-24s %14s %14s %10s %8s\n","Function","Max error","Time/value","Speed up","Result");
+    printf("%s\n",std::string(74,'-').c_str());
+    std::vector<double> arguments(pointsCount);
+    std::vector<double> values(pointsCount);
+    int failures=0;
+    for(size_t i=0;i<sizeof(kFunctions)/sizeof(kFunctions[0]);i++)
+    {
+        const TestedFunction& f=kFunctions[i];
+        fillArguments(f,arguments);
+        const double referenceTime=getTime(f,null,arguments,values,minTime);
+        printf("%-24s %14s %11.2f ns %10s %8s\n",(std::string(f.name)+" (libm)").c_str(),"-",referenceTime,"-","-");
+        for(uint level=0;level<kLevelsCount;level++)
+        {
+            f.approximations[level](&arguments[0],&values[0],uint(pointsCount));
+            const double error=getMaxError(f,arguments,values);
+            const double time=getTime(f,f.approximations[level],arguments,values,minTime);
+            const bool ok=(error<=kErrorBounds[level]);
+            if(!ok)
+                failures++;
+            std::string caseName=std::string(f.name)+" ("+kLevelNames[level]+")";
+            printf("%-24s %10.2e %s %11.2f ns %9.1fx %8s\n",caseName.c_str(),error,f.relativeError?"rel":"abs",time,
+                referenceTime/time,ok?"ok":"FAILED");
+        }
+        fflush(stdout);
+    }
+    return failures!=0?2:0;
+}
@@ -0,0 +1,357 @@
+/** \file scriptbench.cpp
+ *  Micro benchmark for native scripts.
+ *
+ *  Runs each script for several block sizes and channel counts, and reports the
+ *  processing time per sample (ns and CPU cycles) and the share of the real time
+ *  budget used by the script. Scripts exporting processSample are driven sample after
+ *  sample (like in the plug-in), and scripts exporting processBlock block after block.
+ *  Scripts exporting both are measured through each entry point, unless one is forced
+ *  with -e.
+ *
+ *  Usage: scriptbench [options] script.so [script2.so...]
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "../host/ScriptHost.h"
+#include "../../src/samples/library/Midi.h"
+#include "../../src/samples/library/Constants.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SCRIPTBENCH_HAS_CYCLES 1
+static inline uint64 readCycles()
+{
+    return __rdtsc();
+}
+#else
+#define SCRIPTBENCH_HAS_CYCLES 0
+static inline uint64 readCycles()
+{
+    return 0;
+}
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+/// Result of a single benchmark case.
+struct BenchmarkResult
+{
+    bool    ok=false;
+    const char* failure="load or initialize failed";
+    uint64  samples=0;          // number of sample frames processed
+    uint64  blocks=0;           // number of blocks processed
+    double  nsPerSample=0;      // time per sample frame
+    double  cyclesPerSample=0;  // TSC cycles per sample frame
+    double  realTimeShare=0;    // share of the real time budget (%)
+};
+
+/// Benchmark settings.
+struct BenchmarkSettings
+{
+    double              sampleRate=48000;
+    double              minTime=.1;     // minimum measurement time per case, in seconds
+    uint                notesCount=8;   // notes held while measuring (for instruments)
+    std::string         entryPoint;     // forced processing function (empty: all exported ones)
+    std::vector<uint>   blockSizes;
+    std::vector<uint>   channelCounts;
+};
+
+/** Parses a comma separated list of positive integers.
+ *
+ */
+static bool parseList(const char* arg,std::vector<uint>& values)
+{
+    values.clear();
+    char* end=null;
+    while(*arg!=0)
+    {
+        long value=strtol(arg,&end,10);
+        if(end==arg || value<=0)
+            return false;
+        values.push_back(uint(value));
+        arg=(*end==',')?end+1:end;
+    }
+    return !values.empty();
+}
+
+/** Fills the input signal: a sine wave with a different frequency on each channel,
+ *   so that dynamics processors and meters see a realistic signal.
+ */
+static void fillInput(std::vector<double>& input,uint channels,uint blockSize,double rate)
+{
+    input.resize(size_t(channels)*blockSize);
+    for(uint ch=0;ch<channels;ch++)
+    {
+        double omega=2*PI*(220.0*(ch+1))/rate;
+        for(uint i=0;i<blockSize;i++)
+            input[size_t(ch)*blockSize+i]=.5*sin(omega*i);
+    }
+}
+
+/** Copies the input signal to the host buffers (the scripts modify them in place).
+ *
+ */
+static inline void copyInput(const std::vector<double>& input,double** buffers,uint channels,uint blockSize)
+{
+    for(uint ch=0;ch<channels;ch++)
+    {
+        const double* src=&input[size_t(ch)*blockSize];
+        double* dest=buffers[ch];
+        for(uint i=0;i<blockSize;i++)
+            dest[i]=src[i];
+    }
+}
+
+/** Runs blocks for at least minTime seconds and returns the elapsed time and cycles.
+ *   If callScript is false, only the input copy is measured (calibration).
+ */
+static void runBlocks(ScriptHost& host,bool callScript,const std::vector<double>& input,uint channels,uint blockSize,
+    double minTime,uint64& blocks,double& seconds,uint64& cycles)
+{
+    double** buffers=host.get_buffers();
+    blocks=0;
+    uint64 batch=1;
+    Clock::time_point start=Clock::now();
+    uint64 startCycles=readCycles();
+    do
+    {
+        for(uint64 b=0;b<batch;b++)
+        {
+            copyInput(input,buffers,channels,blockSize);
+            if(callScript)
+                host.processBlock(blockSize);
+        }
+        blocks+=batch;
+        batch*=2;
+        seconds=std::chrono::duration<double>(Clock::now()-start).count();
+    }
+    while(seconds<minTime);
+    cycles=readCycles()-startCycles;
+}
+
+/** Lists the processing functions to measure for a script: the forced one if any, both
+ *   if the script exports processSample and processBlock, or an empty name to let the host pick.
+ */
+static std::vector<std::string> getEntryPoints(const std::string& path,const BenchmarkSettings& settings)
+{
+    std::vector<std::string> entryPoints;
+    if(!settings.entryPoint.empty())
+    {
+        entryPoints.push_back(settings.entryPoint);
+        return entryPoints;
+    }
+    ScriptHost host;
+    host.quiet=true;
+    std::string error;
+    if(host.load(path,error) && host.get_usesProcessSample() && host.get_exportsProcessBlock())
+    {
+        entryPoints.push_back("processSample");
+        entryPoints.push_back("processBlock");
+    }
+    else
+        entryPoints.push_back(std::string());
+    return entryPoints;
+}
+
+/** Benchmarks a script for one block size and channel count, through the given processing
+ *   function (or the one picked by the host if empty).
+ *   The script is reloaded for each case so that it is initialized with the right configuration.
+ */
+static BenchmarkResult runBenchmark(const std::string& path,const BenchmarkSettings& settings,uint blockSize,uint channels,
+    const std::string& function,std::string& entryPoint)
+{
+    BenchmarkResult result;
+    ScriptHost host;
+    host.quiet=true;
+    host.sampleRate=settings.sampleRate;
+    host.maxBlockSize=int(blockSize);
+    host.audioInputsCount=channels;
+    host.audioOutputsCount=channels;
+    std::string error;
+    if(!host.load(path,error))
+        return result;
+    if(!function.empty() && !host.selectProcessFunction(function))
+    {
+        entryPoint=function;
+        result.failure="entry point not exported";
+        return result;
+    }
+    if(!host.setup())
+        return result;
+    entryPoint=host.get_processFunctionName();
+
+    std::vector<double> input;
+    fillInput(input,channels,blockSize,settings.sampleRate);
+
+    // hold a chord (for instruments), then warm up
+    for(uint n=0;n<settings.notesCount;n++)
+    {
+        MidiEvent evt;
+        MidiEventUtils::setType(evt,kMidiNoteOn);
+        MidiEventUtils::setNote(evt,uint8(48+3*n));
+        MidiEventUtils::setNoteVelocity(evt,100);
+        host.inputMidiEvents.push(evt);
+    }
+    copyInput(input,host.get_buffers(),channels,blockSize);
+    host.processBlock(blockSize);
+    host.inputMidiEvents.clear();
+    uint64 blocks=0;
+    uint64 cycles=0;
+    double seconds=0;
+    runBlocks(host,true,input,channels,blockSize,settings.minTime*.2,blocks,seconds,cycles);
+
+    // measure, then remove the cost of the input copy
+    runBlocks(host,true,input,channels,blockSize,settings.minTime,blocks,seconds,cycles);
+    uint64 copyBlocks=0;
+    uint64 copyCycles=0;
+    double copySeconds=0;
+    runBlocks(host,false,input,channels,blockSize,settings.minTime*.2,copyBlocks,copySeconds,copyCycles);
+    double samples=double(blocks)*blockSize;
+    double copySamples=double(copyBlocks)*blockSize;
+    double nsPerSample=1e9*(seconds/samples-copySeconds/copySamples);
+    double cyclesPerSample=double(cycles)/samples-double(copyCycles)/copySamples;
+
+    result.ok=true;
+    result.blocks=blocks;
+    result.samples=uint64(samples);
+    result.nsPerSample=nsPerSample>0?nsPerSample:0;
+    result.cyclesPerSample=cyclesPerSample>0?cyclesPerSample:0;
+    result.realTimeShare=100*result.nsPerSample*1e-9*settings.sampleRate;
+    return result;
+}
+
+static void printUsage()
+{
+    fprintf(stderr,
+        "Usage: scriptbench [options] script.so [script2.so...]\n"
+        "  -b sizes      comma separated block sizes (default 1,32,64,256,4096)\n"
+        "  -c counts     comma separated channel counts (default 1,2,8,32)\n"
+        "  -r rate       sample rate (default 48000)\n"
+        "  -t seconds    minimum measurement time per case (default 0.1)\n"
+        "  -n notes      number of notes held for instruments (default 8)\n"
+        "  -e entry      force the processing function: sample or block (default: each one exported)\n"
+        "  -f csv        output format: table (default) or csv\n");
+}
+
+int main(int argc,char* argv[])
+{
+    BenchmarkSettings settings;
+    const char* defaultBlockSizes="1,32,64,256,4096";
+    const char* defaultChannelCounts="1,2,8,32";
+    parseList(defaultBlockSizes,settings.blockSizes);
+    parseList(defaultChannelCounts,settings.channelCounts);
+    bool csv=false;
+
+    int option=0;
+    while((option=getopt(argc,argv,"b:c:r:t:n:e:f:h"))!=-1)
+    {
+        switch(option)
+        {
+        case 'b':
+            if(!parseList(optarg,settings.blockSizes))
+            {
+                fprintf(stderr,"Invalid block sizes: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'c':
+            if(!parseList(optarg,settings.channelCounts))
+            {
+                fprintf(stderr,"Invalid channel counts: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            settings.sampleRate=atof(optarg);
+            break;
+        case 't':
+            settings.minTime=atof(optarg);
+            break;
+        case 'n':
+            settings.notesCount=uint(atoi(optarg));
+            break;
+        case 'e':
+            if(strcmp(optarg,"sample")==0)
+                settings.entryPoint="processSample";
+            else if(strcmp(optarg,"block")==0)
+                settings.entryPoint="processBlock";
+            else
+            {
+                fprintf(stderr,"Invalid entry point: %s\n",optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            csv=(strcmp(optarg,"csv")==0);
+            break;
+        default:
+            printUsage();
+            return option=='h'?0:1;
+        }
+    }
+    if(optind>=argc || settings.sampleRate<=0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    if(csv)
+        printf("script,entry point,block size,channels,ns/sample,cycles/sample,real time cpu %%,blocks\n");
+    else
+    {
+        printf("%-52s %14s %14s %12s %12s\n","Benchmark","Time/sample","Cycles/sample","RT CPU","Blocks");
+        printf("%s\n",std::string(108,'-').c_str());
+    }
+    int failures=0;
+    for(int arg=optind;arg<argc;arg++)
+    {
+        std::string path=argv[arg];
+        std::string scriptName=path.substr(path.rfind('/')+1);
+        scriptName=scriptName.substr(0,scriptName.rfind('.'));
+        std::vector<std::string> functions=getEntryPoints(path,settings);
+        for(size_t f=0;f<functions.size();f++)
+        {
+            for(size_t c=0;c<settings.channelCounts.size();c++)
+            {
+                for(size_t b=0;b<settings.blockSizes.size();b++)
+                {
+                    uint channels=settings.channelCounts[c];
+                    uint blockSize=settings.blockSizes[b];
+                    std::string entryPoint="-";
+                    BenchmarkResult result=runBenchmark(path,settings,blockSize,channels,functions[f],entryPoint);
+                    if(csv)
+                    {
+                        if(result.ok)
+                            printf("%s,%s,%u,%u,%.3f,%.2f,%.4f,%llu\n",scriptName.c_str(),entryPoint.c_str(),blockSize,channels,
+                                result.nsPerSample,SCRIPTBENCH_HAS_CYCLES?result.cyclesPerSample:-1.0,result.realTimeShare,(unsigned long long)result.blocks);
+                        else
+                            printf("%s,%s,%u,%u,,,,\n",scriptName.c_str(),entryPoint.c_str(),blockSize,channels);
+                    }
+                    else
+                    {
+                        std::string caseName=scriptName+"/"+entryPoint+"/block:"+std::to_string(blockSize)+"/ch:"+std::to_string(channels);
+                        if(result.ok)
+                        {
+                            std::string cycles=SCRIPTBENCH_HAS_CYCLES?std::to_string(int64(result.cyclesPerSample+.5)):"n/a";
+                            printf("%-52s %11.2f ns %14s %10.4f %% %12llu\n",caseName.c_str(),result.nsPerSample,cycles.c_str(),
+                                result.realTimeShare,(unsigned long long)result.blocks);
+                        }
+                        else
+                            printf("%-52s skipped (%s)\n",caseName.c_str(),result.failure);
+                    }
+                    if(!result.ok)
+                        failures++;
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    return failures!=0?1:0;
+}
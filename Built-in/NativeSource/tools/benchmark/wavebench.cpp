@@ -0,0 +1,305 @@
+/** \file wavebench.cpp
+ *  Accuracy and speed of the wave file loaders.
+ *
+ *  Writes a test file for each supported sample format (8/16/24/32-bit integer, 32/64-bit float,
+ *  and the WAVE_FORMAT_EXTENSIBLE variant of the 32-bit formats) with its own encoder, then loads it
+ *  with each loader of the library: WaveFileData (memory mapped, see MappedWaveFile), the sample per
+ *  sample WaveFileReader and the BufferedWaveFileReader streamed by a background thread. Reports the
+ *  maximum error against the encoded values and the loading time per sample. Exits with code 2 if a
+ *  loader fails or decodes a sample wrong, so that it can be used for regression testing.
+ *
+ *  Usage: wavebench [-d directory] [-l seconds]
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "dspapi.h"
+#include "cpphelpers.h"
+#include "../../src/samples/library/WaveFile.h"
+#include "../../src/samples/library/BufferedWaveFile.h"
+#include "../../src/samples/library/Constants.h"
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static const double kErrorBound=1e-12; ///< maximum error against the encoded values
+static const uint   kChannelsCount=2;
+static const uint   kSampleRate=48000;
+
+/// A test file: sample format and header variant.
+struct Fixture
+{
+    const char* name;
+    uint        bytesPerSample;
+    uint        formatTag;      // 1: integer PCM, 3: IEEE float
+    bool        extensible;     // WAVE_FORMAT_EXTENSIBLE header
+};
+
+static const Fixture kFixtures[]=
+{
+    {"int8",1,1,false},
+    {"int16",2,1,false},
+    {"int24",3,1,false},
+    {"int32",4,1,false},
+    {"int32 ext",4,1,true},
+    {"float32",4,3,false},
+    {"float32 ext",4,3,true},
+    {"float64",8,3,false}
+};
+
+/** Test signal: a sine sweep with some noise, below full scale.
+ *
+ */
+static void fillSignal(std::vector<double>& signal,uint64 framesCount)
+{
+    signal.resize(size_t(framesCount*kChannelsCount));
+    srand(1);
+    double phase=0;
+    for(uint64 i=0;i<framesCount;i++)
+    {
+        phase+=2*PI*(50.0+10000.0*double(i)/double(framesCount))/kSampleRate;
+        for(uint ch=0;ch<kChannelsCount;ch++)
+            signal[size_t(i*kChannelsCount+ch)]=.8*sin(phase*(ch+1))+.1*(2*double(rand())/double(RAND_MAX)-1);
+    }
+}
+
+static void writeUInt(std::vector<uint8>& bytes,uint64 value,uint size)
+{
+    for(uint i=0;i<size;i++)
+        bytes.push_back(uint8(value>>(8*i)));
+}
+
+/** Encodes the signal in the format of the fixture (little endian), and replaces each sample of the
+ *   signal with the value that a loader should decode from the file.
+ */
+static void encode(const Fixture& fixture,std::vector<double>& signal,std::vector<uint8>& bytes)
+{
+    for(size_t i=0;i<signal.size();i++)
+    {
+        double& value=signal[i];
+        if(fixture.formatTag==3 && fixture.bytesPerSample==4)
+        {
+            float encoded=float(value);
+            uint32_t bits=0;
+            memcpy(&bits,&encoded,4);
+            writeUInt(bytes,bits,4);
+            value=encoded;
+        }
+        else if(fixture.formatTag==3)
+        {
+            uint64 bits=0;
+            memcpy(&bits,&value,8);
+            writeUInt(bytes,bits,8);
+        }
+        else if(fixture.bytesPerSample==1)
+        {
+            int encoded=int(floor(value*128.0+128.0));
+            writeUInt(bytes,uint64(encoded),1);
+            value=(double(encoded)-128.0)/128.0;
+        }
+        else
+        {
+            const double maxValue=double((uint64(1)<<(8*fixture.bytesPerSample-1))-1);
+            int64 encoded=int64(floor(value*maxValue+.5));
+            writeUInt(bytes,uint64(encoded),fixture.bytesPerSample);
+            value=double(encoded)/maxValue;
+        }
+    }
+}
+
+/** Writes the test file of the fixture, and returns the expected (decoded) samples.
+ *
+ */
+static bool writeFixture(const Fixture& fixture,const std::string& path,uint64 framesCount,std::vector<double>& expected)
+{
+    fillSignal(expected,framesCount);
+    std::vector<uint8> data;
+    encode(fixture,expected,data);
+
+    std::vector<uint8> bytes;
+    const uint fmtSize=fixture.extensible?40:16;
+    const uint blockAlign=kChannelsCount*fixture.bytesPerSample;
+    bytes.insert(bytes.end(),{'R','I','F','F'});
+    writeUInt(bytes,4+(8+fmtSize)+(8+data.size()),4);
+    bytes.insert(bytes.end(),{'W','A','V','E','f','m','t',' '});
+    writeUInt(bytes,fmtSize,4);
+    writeUInt(bytes,fixture.extensible?0xFFFE:fixture.formatTag,2);
+    writeUInt(bytes,kChannelsCount,2);
+    writeUInt(bytes,kSampleRate,4);
+    writeUInt(bytes,uint64(kSampleRate)*blockAlign,4);
+    writeUInt(bytes,blockAlign,2);
+    writeUInt(bytes,8*fixture.bytesPerSample,2);
+    if(fixture.extensible)
+    {
+        writeUInt(bytes,22,2); // extension size
+        writeUInt(bytes,8*fixture.bytesPerSample,2); // valid bits
+        writeUInt(bytes,3,4); // channel mask (front left and right)
+        // sub format GUID: format tag, then the standard suffix
+        writeUInt(bytes,fixture.formatTag,2);
+        bytes.insert(bytes.end(),{0x00,0x00,0x00,0x00,0x10,0x00,0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71});
+    }
+    bytes.insert(bytes.end(),{'d','a','t','a'});
+    writeUInt(bytes,data.size(),4);
+    bytes.insert(bytes.end(),data.begin(),data.end());
+
+    FILE* f=fopen(path.c_str(),"wb");
+    if(f==null)
+        return false;
+    bool ok=(fwrite(&bytes[0],1,bytes.size(),f)==bytes.size());
+    return (fclose(f)==0) && ok;
+}
+
+/// maximum error of the decoded samples (interleaved) against the expected ones, or a negative value if the sizes differ.
+static double getMaxError(const std::vector<double>& decoded,const std::vector<double>& expected)
+{
+    if(decoded.size()!=expected.size())
+        return -1;
+    double maxError=0;
+    for(size_t i=0;i<decoded.size();i++)
+    {
+        const double error=fabs(decoded[i]-expected[i]);
+        if(!(error<=maxError)) // also catches NaN
+            maxError=error;
+    }
+    return maxError;
+}
+
+/// loads the file with WaveFileData (memory mapped file, decoded by blocks).
+static bool loadData(const std::string& path,std::vector<double>& decoded)
+{
+    WaveFileData data;
+    if(!data.loadFile(path.c_str()) || data.channelsCount!=kChannelsCount)
+        return false;
+    decoded.assign(data.interleavedSamples.ptr,data.interleavedSamples.ptr+data.interleavedSamples.length);
+    return true;
+}
+
+/// loads the file with WaveFileReader (sample per sample).
+static bool loadReader(const std::string& path,std::vector<double>& decoded)
+{
+    WaveFileReader reader;
+    if(!reader.openFile(path) || reader.get_channelsCount()!=int(kChannelsCount))
+        return false;
+    decoded.resize(size_t(reader.get_samplesCount()*kChannelsCount));
+    for(size_t i=0;i<decoded.size();i+=kChannelsCount)
+        reader.readSample(&decoded[i]);
+    reader.close();
+    return true;
+}
+
+/// loads the file with BufferedWaveFileReader (background thread), waiting for the data like offline rendering.
+static bool loadBuffered(const std::string& path,uint64 framesCount,std::vector<double>& decoded)
+{
+    const uint kBlockSize=512;
+    BufferedWaveFileReader reader;
+    reader.start(kChannelsCount,kSampleRate);
+    reader.openFile(path,false);
+    std::vector<double> block(kChannelsCount*kBlockSize);
+    double* samples[kChannelsCount];
+    for(uint ch=0;ch<kChannelsCount;ch++)
+        samples[ch]=&block[ch*kBlockSize];
+    decoded.clear();
+    decoded.reserve(size_t(framesCount*kChannelsCount));
+    for(;;)
+    {
+        uint count=reader.read(samples,kChannelsCount,kBlockSize,true);
+        for(uint i=0;i<count;i++)
+        {
+            for(uint ch=0;ch<kChannelsCount;ch++)
+                decoded.push_back(samples[ch][i]);
+        }
+        if(count<kBlockSize)
+            break;
+    }
+    const bool ok=(reader.get_fileChannelsCount()==kChannelsCount);
+    reader.stop();
+    return ok;
+}
+
+static void printUsage()
+{
+    printf("Usage: wavebench [options]\n"
+        "  -d directory  directory for the test files (default: current directory)\n"
+        "  -l seconds    length of the test files (default 10)\n");
+}
+
+int main(int argc,char* argv[])
+{
+    std::string directory=".";
+    double length=10;
+    int option=0;
+    while((option=getopt(argc,argv,"d:l:h"))!=-1)
+    {
+        switch(option)
+        {
+        case 'd':
+            directory=optarg;
+            break;
+        case 'l':
+            length=atof(optarg);
+            break;
+        default:
+            printUsage();
+            return option=='h'?0:1;
+        }
+    }
+    const uint64 framesCount=uint64(length*kSampleRate);
+    if(framesCount==0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    printf("%-24s %14s %14s %8s\n","Loader","Max error","Time/sample","Result");
+    printf("%s\n",std::string(63,'-').c_str());
+    int failures=0;
+    for(size_t f=0;f<sizeof(kFixtures)/sizeof(kFixtures[0]);f++)
+    {
+        const Fixture& fixture=kFixtures[f];
+        std::string path=directory+"/wavebench-"+fixture.name+".wav";
+        for(size_t c=0;c<path.size();c++)
+        {
+            if(path[c]==' ')
+                path[c]='-';
+        }
+        std::vector<double> expected;
+        if(!writeFixture(fixture,path,framesCount,expected))
+        {
+            fprintf(stderr,"Cannot write %s\n",path.c_str());
+            return 1;
+        }
+        static const char* const kLoaders[]={"data","reader","buffered"};
+        for(uint l=0;l<3;l++)
+        {
+            std::vector<double> decoded;
+            Clock::time_point start=Clock::now();
+            bool ok=false;
+            if(l==0)
+                ok=loadData(path,decoded);
+            else if(l==1)
+                ok=loadReader(path,decoded);
+            else
+                ok=loadBuffered(path,framesCount,decoded);
+            const double seconds=std::chrono::duration<double>(Clock::now()-start).count();
+            const double error=ok?getMaxError(decoded,expected):-1;
+            ok=ok && error>=0 && error<=kErrorBound;
+            if(!ok)
+                failures++;
+            std::string caseName=std::string(fixture.name)+"/"+kLoaders[l];
+            if(error>=0)
+                printf("%-24s %14.2e %11.2f ns %8s\n",caseName.c_str(),error,seconds*1e9/double(expected.size()),ok?"ok":"FAILED");
+            else
+                printf("%-24s %14s %14s %8s\n",caseName.c_str(),"-","-","FAILED");
+            fflush(stdout);
+        }
+        remove(path.c_str());
+    }
+    return failures!=0?2:0;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compares the optimization profiles built with -DNATIVE_EXTRA_PROFILES=all (see build/CMake).
+# For each script, the output of the default build is used as the reference: every profile
+# is rendered with the offline host, which reports its speed and checks that the output
+# matches the reference within the tolerance.
+#
+# Usage: compare_profiles.sh <cmake build dir> <input.wav> [tolerance] [extra offlinehost options]
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <cmake build dir> <input.wav> [tolerance] [extra offlinehost options]"
+    exit 1
+fi
+BUILD_DIR=$1
+INPUT=$2
+TOLERANCE=1e-4
+shift 2
+# the tolerance is optional: only consume the third argument if it is a number
+case "$1" in
+    [0-9]*|.[0-9]*)
+        TOLERANCE=$1
+        shift
+        ;;
+esac
+HOST="$BUILD_DIR/offlinehost"
+TEMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TEMP_DIR"' EXIT
+
+failures=0
+for script in "$BUILD_DIR"/*.so; do
+    name=$(basename "$script" .so)
+    reference="$TEMP_DIR/$name.wav"
+    echo "== $name"
+    "$HOST" -q -w 64 "$@" "$script" "$INPUT" "$reference" | sed 's/^/default:   /'
+    for profileDir in "$BUILD_DIR"/*/; do
+        profile=$(basename "$profileDir")
+        if [ -f "$profileDir/$name.so" ]; then
+            "$HOST" -q "$@" -e "$reference:$TOLERANCE" "$profileDir/$name.so" "$INPUT" > "$TEMP_DIR/report.txt"
+            [ $? -ne 0 ] && failures=$((failures+1))
+            sed "s/^/$profile: /" "$TEMP_DIR/report.txt"
+        fi
+    done
+done
+exit $failures
@@ -0,0 +1,541 @@
+#ifndef _ScriptHost_h_
+#define _ScriptHost_h_
+
+/** \file ScriptHost.h
+ *  Minimal native script host for command line tools (Linux and Mac).
+ *
+ *  Loads a compiled native script (shared library) with dlopen, fills the
+ *  host variables (sampleRate, maxBlockSize, audioInputsCount...) and calls
+ *  the script functions in the same order as the plug-in:
+ *  - initialize() then reset() once the host variables have been set.
+ *  - for each block: updateInputParametersForBlock() when parameters or tempo changed,
+ *  then either processSample() for each sample (preceded by updateInputParameters()
+ *  when parameters changed), or updateInputParameters() and processBlock() for the entire block.
+ *  Scripts that export neither function leave the audio unchanged (pass-through).
+ *  - computeOutputData() after each block.
+ *  Output buffers are read like a user interface would (copy, then check the sequence counter).
+ *  - shutdown() before the library is unloaded.
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "dspapi.h"
+#include "cpphelpers.h"
+
+#include <atomic>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/** MIDI queue owned by the host.
+ *   The MidiQueue member must remain the first one, so that the push callback
+ *   can retrieve the host queue from the script queue pointer.
+ */
+struct HostMidiQueue
+{
+    MidiQueue               queue;
+    std::vector<MidiEvent>  events;
+
+    HostMidiQueue(uint capacity=1024)
+    {
+        events.reserve(capacity);
+        queue.events=events.data();
+        queue.length=0;
+        queue.pushEvent=&HostMidiQueue::pushEvent;
+    }
+
+    void clear()
+    {
+        events.clear();
+        queue.events=events.data();
+        queue.length=0;
+    }
+
+    void push(const MidiEvent& evt)
+    {
+        events.push_back(evt);
+        queue.events=events.data();
+        queue.length=uint(events.size());
+    }
+
+    static void pushEvent(MidiQueue* iQueue,const MidiEvent* evt)
+    {
+        if(iQueue!=null && evt!=null)
+            reinterpret_cast<HostMidiQueue*>(iQueue)->push(*evt);
+    }
+};
+
+/** Native script loaded by the host.
+ *   Symbols that are not exported by the script are simply ignored,
+ *   as in the plug-in.
+ */
+struct ScriptHost
+{
+    // script function types
+    typedef bool (InitializeFunc)();
+    typedef void (VoidFunc)();
+    typedef int  (IntFunc)();
+    typedef void (ProcessSampleFunc)(double ioSample[]);
+    typedef void (ProcessBlockFunc)(BlockData& data);
+    typedef void (UpdateForBlockFunc)(const TransportInfo* info);
+
+    // host configuration (set before calling setup)
+    double      sampleRate=44100;
+    int         maxBlockSize=512;
+    uint        audioInputsCount=2;
+    uint        audioOutputsCount=2;
+    uint        auxAudioInputsCount=0;
+    uint        auxAudioOutputsCount=0;
+    std::string userDocumentsPath="./";
+    std::string scriptFilePath;
+    std::string scriptDataPath;
+    bool        quiet=false;
+
+    // transport and MIDI
+    TransportInfo   transport;
+    HostMidiQueue   inputMidiEvents;
+    HostMidiQueue   outputMidiEvents;
+
+    // script metadata
+    std::string     name;
+    std::string     description;
+
+    ScriptHost()
+    {
+        transport.bpm=120;
+        transport.timeSigTop=4;
+        transport.timeSigBottom=4;
+        transport.isPlaying=true;
+        transport.isLooping=false;
+        transport.isRecording=false;
+        transport.positionInSamples=0;
+        transport.positionInQuarterNotes=0;
+        transport.positionInSeconds=0;
+        transport.currentMeasureDownBeat=0;
+        transport.loopStart=0;
+        transport.loopEnd=0;
+    }
+
+    ~ScriptHost()
+    {
+        unload();
+    }
+
+    /** Load the shared library and resolve script symbols.
+     *   Returns false and fills error if the library cannot be loaded.
+     */
+    bool load(const std::string& path,std::string& error)
+    {
+        unload();
+        // without a '/', dlopen would search the system library paths
+        std::string libraryPath=(path.find('/')==std::string::npos)?"./"+path:path;
+        library=dlopen(libraryPath.c_str(),RTLD_NOW|RTLD_LOCAL);
+        if(library==null)
+        {
+            const char* message=dlerror();
+            error=(message!=null)?message:"cannot load library";
+            return false;
+        }
+        scriptFilePath=path;
+        if(scriptDataPath.empty())
+        {
+            size_t extensionIndex=path.rfind('.');
+            scriptDataPath=path.substr(0,extensionIndex)+"-data/";
+        }
+
+        // functions
+        initializeFunc=(InitializeFunc*)symbol("initialize");
+        resetFunc=(VoidFunc*)symbol("reset");
+        shutdownFunc=(VoidFunc*)symbol("shutdown");
+        getTailSizeFunc=(IntFunc*)symbol("getTailSize");
+        getLatencyFunc=(IntFunc*)symbol("getLatency");
+        processSampleFunc=(ProcessSampleFunc*)symbol("processSample");
+        processBlockFunc=(ProcessBlockFunc*)symbol("processBlock");
+        updateInputParametersFunc=(VoidFunc*)symbol("updateInputParameters");
+        updateInputParametersForBlockFunc=(UpdateForBlockFunc*)symbol("updateInputParametersForBlock");
+        computeOutputDataFunc=(VoidFunc*)symbol("computeOutputData");
+
+        // parameters and strings
+        inputParameters=(ArrayDescriptor<double>*)symbol("inputParameters");
+        inputParametersNames=(ArrayDescriptor<string>*)symbol("inputParametersNames");
+        inputParametersMin=(ArrayDescriptor<double>*)symbol("inputParametersMin");
+        inputParametersMax=(ArrayDescriptor<double>*)symbol("inputParametersMax");
+        inputParametersDefault=(ArrayDescriptor<double>*)symbol("inputParametersDefault");
+        inputStrings=(ArrayDescriptor<string>*)symbol("inputStrings");
+        outputParameters=(ArrayDescriptor<double>*)symbol("outputParameters");
+        outputParametersNames=(ArrayDescriptor<string>*)symbol("outputParametersNames");
+        outputStrings=(ArrayDescriptor<string>*)symbol("outputStrings");
+        outputStringsNames=(ArrayDescriptor<string>*)symbol("outputStringsNames");
+        outputBuffers=(ArrayDescriptor<OutputBuffer>*)symbol("outputBuffers");
+        outputBuffersNames=(ArrayDescriptor<string>*)symbol("outputBuffersNames");
+
+        // metadata
+        string* namePtr=(string*)symbol("name");
+        if(namePtr!=null && *namePtr!=null)
+            name=*namePtr;
+        string* descriptionPtr=(string*)symbol("description");
+        if(descriptionPtr!=null && *descriptionPtr!=null)
+            description=*descriptionPtr;
+        return true;
+    }
+
+    /** Fill host variables, set parameters to their default values and
+     *   initialize the script. Returns false if the script refused the configuration.
+     */
+    bool setup()
+    {
+        setVariable<double>("sampleRate",sampleRate);
+        setVariable<int>("maxBlockSize",maxBlockSize);
+        setVariable<uint>("audioInputsCount",audioInputsCount);
+        setVariable<uint>("audioOutputsCount",audioOutputsCount);
+        setVariable<uint>("auxAudioInputsCount",auxAudioInputsCount);
+        setVariable<uint>("auxAudioOutputsCount",auxAudioOutputsCount);
+        setVariable<string>("userDocumentsPath",userDocumentsPath.c_str());
+        setVariable<string>("scriptFilePath",scriptFilePath.c_str());
+        setVariable<string>("scriptDataPath",scriptDataPath.c_str());
+        setVariable<void*>("host",this);
+        setVariable<HostPrintFunc*>("hostPrint",&ScriptHost::hostPrint);
+
+        // audio buffers: one buffer per main and auxiliary channel
+        uint mainChannels=audioInputsCount>audioOutputsCount?audioInputsCount:audioOutputsCount;
+        uint auxChannels=auxAudioInputsCount>auxAudioOutputsCount?auxAudioInputsCount:auxAudioOutputsCount;
+        channelsCount=mainChannels+auxChannels;
+        buffers.assign(size_t(channelsCount)*maxBlockSize,0);
+        bufferPointers.resize(channelsCount);
+        for(uint ch=0;ch<channelsCount;ch++)
+            bufferPointers[ch]=&buffers[size_t(ch)*maxBlockSize];
+        frame.assign(channelsCount>0?channelsCount:1,0);
+
+        // parameters default values
+        uint paramsCount=get_inputParametersCount();
+        beginValues.assign(paramsCount,0);
+        endValues.assign(paramsCount,0);
+        for(uint i=0;i<paramsCount;i++)
+        {
+            double value=0;
+            if(inputParametersDefault!=null && i<inputParametersDefault->length)
+                value=inputParametersDefault->ptr[i];
+            beginValues[i]=endValues[i]=value;
+            inputParameters->ptr[i]=value;
+        }
+        parametersChanged=true;
+
+        // input strings must be valid C strings
+        if(inputStrings!=null)
+        {
+            inputStringsValues.resize(inputStrings->length);
+            for(uint i=0;i<inputStrings->length;i++)
+                inputStrings->ptr[i]=inputStringsValues[i].c_str();
+        }
+
+        if(initializeFunc!=null && !initializeFunc())
+            return false;
+        initialized=true;
+        if(resetFunc!=null)
+            resetFunc();
+        return true;
+    }
+
+    /** Set the value of an input parameter, clipped to its range.
+     *   If endValue differs from value, the parameter ramps linearly over the next block.
+     */
+    void setParameter(uint index,double value,double endValue)
+    {
+        if(index<beginValues.size())
+        {
+            value=clipParameter(index,value);
+            endValue=clipParameter(index,endValue);
+            if(value!=beginValues[index] || endValue!=endValues[index] || value!=endValue)
+            {
+                beginValues[index]=value;
+                endValues[index]=endValue;
+                parametersChanged=true;
+            }
+        }
+    }
+
+    /** Set the value of an input string (before calling setup or between blocks).
+     *
+     */
+    void setInputString(uint index,const std::string& value)
+    {
+        if(inputStrings!=null && index<inputStrings->length)
+        {
+            if(inputStringsValues.size()<inputStrings->length)
+                inputStringsValues.resize(inputStrings->length);
+            inputStringsValues[index]=value;
+            inputStrings->ptr[index]=inputStringsValues[index].c_str();
+            parametersChanged=true;
+        }
+    }
+
+    /** Process a block of audio stored in the host buffers (see get_buffers).
+     *   MIDI events to be sent to the script must be stored in inputMidiEvents
+     *   before calling this method.
+     */
+    void processBlock(uint samplesCount)
+    {
+        outputMidiEvents.clear();
+        if(parametersChanged)
+        {
+            for(uint i=0;i<beginValues.size();i++)
+                inputParameters->ptr[i]=endValues[i];
+            if(updateInputParametersForBlockFunc!=null)
+                updateInputParametersForBlockFunc(&transport);
+        }
+
+        if(processSampleFunc!=null)
+        {
+            bool ramping=parametersChanged && isRamping();
+            for(uint i=0;i<samplesCount;i++)
+            {
+                if(ramping)
+                {
+                    double ratio=double(i+1)/double(samplesCount);
+                    for(uint p=0;p<beginValues.size();p++)
+                        inputParameters->ptr[p]=beginValues[p]+ratio*(endValues[p]-beginValues[p]);
+                }
+                if((parametersChanged && i==0) || ramping)
+                {
+                    if(updateInputParametersFunc!=null)
+                        updateInputParametersFunc();
+                }
+                for(uint ch=0;ch<channelsCount;ch++)
+                    frame[ch]=bufferPointers[ch][i];
+                processSampleFunc(frame.data());
+                for(uint ch=0;ch<channelsCount;ch++)
+                    bufferPointers[ch][i]=frame[ch];
+            }
+        }
+        else if(processBlockFunc!=null)
+        {
+            if(parametersChanged && updateInputParametersFunc!=null)
+                updateInputParametersFunc();
+            BlockData data={bufferPointers.data(),samplesCount,inputMidiEvents.queue,outputMidiEvents.queue,
+                beginValues.data(),endValues.data(),&transport,true};
+            processBlockFunc(data);
+        }
+
+        if(computeOutputDataFunc!=null)
+            computeOutputDataFunc();
+
+        // next block starts where this one ended
+        if(parametersChanged)
+        {
+            beginValues=endValues;
+            parametersChanged=isRamping();
+        }
+        advanceTransport(samplesCount);
+    }
+
+    /** Call shutdown() if the script was initialized and unload the library.
+     *
+     */
+    void unload()
+    {
+        if(library!=null)
+        {
+            if(initialized && shutdownFunc!=null)
+                shutdownFunc();
+            initialized=false;
+            dlclose(library);
+            library=null;
+        }
+    }
+
+    /** Keep only one of the processing functions when the script exports both, so that
+     *   processBlock() calls it ("processSample" or "processBlock"). Call after load().
+     *   Returns false if the script does not export the requested function.
+     */
+    bool selectProcessFunction(const std::string& functionName)
+    {
+        if(functionName=="processSample" && processSampleFunc!=null)
+            processBlockFunc=null;
+        else if(functionName=="processBlock" && processBlockFunc!=null)
+            processSampleFunc=null;
+        else
+            return false;
+        return true;
+    }
+
+    // accessors
+    double**    get_buffers(){return bufferPointers.data();}
+    uint        get_channelsCount()const{return channelsCount;}
+    bool        get_usesProcessSample()const{return processSampleFunc!=null;}
+    bool        get_exportsProcessBlock()const{return processBlockFunc!=null;}
+    /// name of the processing function called by processBlock (for reports).
+    const char* get_processFunctionName()const
+    {
+        if(processSampleFunc!=null)
+            return "processSample";
+        return processBlockFunc!=null?"processBlock":"pass-through";
+    }
+    int         get_tailSize()const{return getTailSizeFunc!=null?getTailSizeFunc():0;}
+    int         get_latency()const{return getLatencyFunc!=null?getLatencyFunc():0;}
+    uint        get_inputParametersCount()const{return inputParameters!=null?inputParameters->length:0;}
+    uint        get_outputParametersCount()const{return outputParameters!=null?outputParameters->length:0;}
+    double      get_outputParameter(uint i)const{return outputParameters->ptr[i];}
+    uint        get_outputStringsCount()const{return outputStrings!=null?outputStrings->length:0;}
+    string      get_outputString(uint i)const{return outputStrings->ptr[i];}
+    uint        get_outputBuffersCount()const{return outputBuffers!=null?outputBuffers->length:0;}
+    uint        get_outputBufferSequence(uint i)const{return outputBuffers->ptr[i].sequence;}
+
+    /** Copies the values of output buffer i (converted to floating point), retrying while the
+     *   script is updating them. Returns false if no consistent copy could be made.
+     */
+    bool readOutputBuffer(uint i,std::vector<float>& values)const
+    {
+        const OutputBuffer& buffer=outputBuffers->ptr[i];
+        for(int attempt=0;attempt<100;attempt++)
+        {
+            const uint sequence=buffer.sequence;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if((sequence&1)!=0)
+                continue;
+            uint length=buffer.length;
+            if(length>buffer.capacity)
+                length=buffer.capacity;
+            values.resize(length);
+            if(buffer.data!=null)
+            {
+                for(uint v=0;v<length;v++)
+                {
+                    if(buffer.format==kOutputBufferInt16)
+                        values[v]=float(((const int16*)buffer.data)[v])/32767.0f;
+                    else
+                        values[v]=((const float*)buffer.data)[v];
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(buffer.sequence==sequence)
+                return true;
+        }
+        return false;
+    }
+
+    std::string get_inputParameterName(uint i)const
+    {
+        return stringAt(inputParametersNames,i,"Param "+std::to_string(i+1));
+    }
+
+    std::string get_outputParameterName(uint i)const
+    {
+        return stringAt(outputParametersNames,i,"Output "+std::to_string(i+1));
+    }
+
+    std::string get_outputStringName(uint i)const
+    {
+        return stringAt(outputStringsNames,i,"String "+std::to_string(i+1));
+    }
+
+    std::string get_outputBufferName(uint i)const
+    {
+        return stringAt(outputBuffersNames,i,"Buffer "+std::to_string(i+1));
+    }
+
+    // private data and utilities
+private:
+    void*   library=null;
+    bool    initialized=false;
+    bool    parametersChanged=true;
+    uint    channelsCount=0;
+
+    std::vector<double>     buffers;
+    std::vector<double*>    bufferPointers;
+    std::vector<double>     frame;
+    std::vector<double>     beginValues;
+    std::vector<double>     endValues;
+    std::vector<std::string> inputStringsValues;
+
+    InitializeFunc*     initializeFunc=null;
+    VoidFunc*           resetFunc=null;
+    VoidFunc*           shutdownFunc=null;
+    IntFunc*            getTailSizeFunc=null;
+    IntFunc*            getLatencyFunc=null;
+    ProcessSampleFunc*  processSampleFunc=null;
+    ProcessBlockFunc*   processBlockFunc=null;
+    VoidFunc*           updateInputParametersFunc=null;
+    UpdateForBlockFunc* updateInputParametersForBlockFunc=null;
+    VoidFunc*           computeOutputDataFunc=null;
+
+    ArrayDescriptor<double>*    inputParameters=null;
+    ArrayDescriptor<string>*    inputParametersNames=null;
+    ArrayDescriptor<double>*    inputParametersMin=null;
+    ArrayDescriptor<double>*    inputParametersMax=null;
+    ArrayDescriptor<double>*    inputParametersDefault=null;
+    ArrayDescriptor<string>*    inputStrings=null;
+    ArrayDescriptor<double>*    outputParameters=null;
+    ArrayDescriptor<string>*    outputParametersNames=null;
+    ArrayDescriptor<string>*    outputStrings=null;
+    ArrayDescriptor<string>*    outputStringsNames=null;
+    ArrayDescriptor<OutputBuffer>* outputBuffers=null;
+    ArrayDescriptor<string>*    outputBuffersNames=null;
+
+    void* symbol(const char* symbolName)const
+    {
+        return dlsym(library,symbolName);
+    }
+
+    template <typename T>
+    void setVariable(const char* variableName,const T& value)
+    {
+        T* variable=(T*)symbol(variableName);
+        if(variable!=null)
+            *variable=value;
+    }
+
+    static std::string stringAt(const ArrayDescriptor<string>* strings,uint i,const std::string& defaultValue)
+    {
+        if(strings!=null && i<strings->length && strings->ptr[i]!=null)
+            return strings->ptr[i];
+        return defaultValue;
+    }
+
+    double clipParameter(uint index,double value)const
+    {
+        // same defaults as the plug-in: [0;1] range
+        double minValue=0;
+        double maxValue=1;
+        if(inputParametersMin!=null && index<inputParametersMin->length)
+            minValue=inputParametersMin->ptr[index];
+        if(inputParametersMax!=null && index<inputParametersMax->length)
+            maxValue=inputParametersMax->ptr[index];
+        if(value<minValue)
+            value=minValue;
+        if(value>maxValue)
+            value=maxValue;
+        return value;
+    }
+
+    bool isRamping()const
+    {
+        for(size_t i=0;i<beginValues.size();i++)
+        {
+            if(beginValues[i]!=endValues[i])
+                return true;
+        }
+        return false;
+    }
+
+    void advanceTransport(uint samplesCount)
+    {
+        transport.positionInSamples+=samplesCount;
+        transport.positionInSeconds=double(transport.positionInSamples)/sampleRate;
+        transport.positionInQuarterNotes=transport.positionInSeconds*transport.bpm/60.0;
+        if(transport.timeSigTop!=0 && transport.timeSigBottom!=0)
+        {
+            double quarterNotesPerMeasure=double(transport.timeSigTop)*4.0/double(transport.timeSigBottom);
+            transport.currentMeasureDownBeat=quarterNotesPerMeasure*int(transport.positionInQuarterNotes/quarterNotesPerMeasure);
+        }
+    }
+
+    static void hostPrint(void* hostImpl,const char* message)
+    {
+        ScriptHost* scriptHost=reinterpret_cast<ScriptHost*>(hostImpl);
+        if(scriptHost!=null && !scriptHost->quiet && message!=null)
+            fprintf(stderr,"[%s] %s\n",scriptHost->name.c_str(),message);
+    }
+};
+
+#endif
@@ -0,0 +1,402 @@
+/** \file offlinehost.cpp
+ *  Command line offline host for native scripts.
+ *
+ *  Streams a wave file (or silence) through a compiled native script, followed by the
+ *  tail of the script (getTailSize, with silent input), writes the result to a wave file
+ *  and reports the rendering speed as a multiple of real time.
+ *  Can also compare the output with a reference file for regression testing.
+ *
+ *  Usage: offlinehost [options] script.so [input.wav|-] [output.wav]
+ *
+ *  Copyright (c) 2015-2017 Blue Cat Audio. All rights reserved.
+ */
+
+#include "ScriptHost.h"
+#include "../../src/samples/library/Midi.h"
+#include "../../src/samples/library/WaveFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/// A note to be sent to the script (times in seconds).
+struct TestNote
+{
+    int     note=60;
+    int     velocity=100;
+    double  start=0;
+    double  length=1;
+};
+
+/// An input parameter value or linear ramp over the entire file.
+struct ParameterValue
+{
+    uint    index=0;
+    double  startValue=0;
+    double  endValue=0;
+};
+
+/// An input string value.
+struct StringValue
+{
+    uint        index=0;
+    std::string value;
+};
+
+static void printUsage()
+{
+    fprintf(stderr,
+        "Usage: offlinehost [options] script.so [input.wav|-] [output.wav]\n"
+        "  -b size        block size (default 512)\n"
+        "  -r rate        sample rate when no input file (default 44100)\n"
+        "  -n channels    audio channels when no input file (default 2)\n"
+        "  -l seconds     length when no input file (default 10)\n"
+        "  -p i=v[:e]     set input parameter i to value v (ramp to e over the file)\n"
+        "  -s i=text      set input string i\n"
+        "  -m n:v:s:l     send note n with velocity v at s seconds for l seconds\n"
+        "  -t bpm         transport tempo (default 120)\n"
+        "  -w bits        output bit depth: 8, 16, 24, 32 or 64 (default 32)\n"
+        "  -e ref.wav[:t] compare output with reference file (max error t, default 1e-4)\n"
+        "  -o             print output parameters, strings and buffers at the end\n"
+        "  -q             quiet: do not print script messages\n");
+}
+
+static bool parseParameter(const char* arg,ParameterValue& param)
+{
+    char* end=null;
+    param.index=uint(strtoul(arg,&end,10));
+    if(end==null || *end!='=')
+        return false;
+    param.startValue=strtod(end+1,&end);
+    param.endValue=param.startValue;
+    if(*end==':')
+        param.endValue=strtod(end+1,&end);
+    return *end==0;
+}
+
+static bool parseNote(const char* arg,TestNote& testNote)
+{
+    return sscanf(arg,"%d:%d:%lf:%lf",&testNote.note,&testNote.velocity,&testNote.start,&testNote.length)==4;
+}
+
+/// position of a sample in the parameters ramps (0 at the beginning of the file, 1 at its end and in the tail).
+static double rampRatio(uint64 position,uint64 samplesCount)
+{
+    if(samplesCount==0 || position>=samplesCount)
+        return 1;
+    return double(position)/double(samplesCount);
+}
+
+/** Queue the note on and note off events that fall within [blockStart;blockStart+blockSize[,
+ *   sorted by time stamp.
+ */
+static void queueNotes(const std::vector<TestNote>& notes,int64 blockStart,uint blockSize,double rate,HostMidiQueue& queue)
+{
+    queue.clear();
+    for(size_t i=0;i<notes.size();i++)
+    {
+        const TestNote& n=notes[i];
+        int64 onSample=int64(n.start*rate);
+        int64 offSample=int64((n.start+n.length)*rate);
+        MidiEvent evt;
+        MidiEventUtils::setNote(evt,n.note);
+        MidiEventUtils::setNoteVelocity(evt,n.velocity);
+        if(onSample>=blockStart && onSample<blockStart+blockSize)
+        {
+            MidiEventUtils::setType(evt,kMidiNoteOn);
+            evt.timeStamp=double(onSample-blockStart);
+            queue.push(evt);
+        }
+        if(offSample>=blockStart && offSample<blockStart+blockSize)
+        {
+            MidiEventUtils::setType(evt,kMidiNoteOff);
+            MidiEventUtils::setNoteVelocity(evt,0);
+            evt.timeStamp=double(offSample-blockStart);
+            queue.push(evt);
+        }
+    }
+    std::stable_sort(queue.events.begin(),queue.events.end(),
+        [](const MidiEvent& a,const MidiEvent& b){return a.timeStamp<b.timeStamp;});
+}
+
+int main(int argc,char* argv[])
+{
+    uint        blockSize=512;
+    double      rate=44100;
+    uint        channels=2;
+    double      length=10;
+    double      bpm=120;
+    uint        bitDepth=32;
+    bool        printOutputs=false;
+    bool        quiet=false;
+    std::string referencePath;
+    double      tolerance=1e-4;
+    std::vector<ParameterValue> params;
+    std::vector<StringValue>    strings;
+    std::vector<TestNote>       notes;
+
+    int option=0;
+    while((option=getopt(argc,argv,"b:r:n:l:p:s:m:t:w:e:oqh"))!=-1)
+    {
+        switch(option)
+        {
+        case 'b':
+            blockSize=uint(atoi(optarg));
+            break;
+        case 'r':
+            rate=atof(optarg);
+            break;
+        case 'n':
+            channels=uint(atoi(optarg));
+            break;
+        case 'l':
+            length=atof(optarg);
+            break;
+        case 'p':
+        {
+            ParameterValue param;
+            if(!parseParameter(optarg,param))
+            {
+                fprintf(stderr,"Invalid parameter value: %s\n",optarg);
+                return 1;
+            }
+            params.push_back(param);
+            break;
+        }
+        case 's':
+        {
+            StringValue str;
+            const char* separator=strchr(optarg,'=');
+            if(separator==null)
+            {
+                fprintf(stderr,"Invalid string value: %s\n",optarg);
+                return 1;
+            }
+            str.index=uint(atoi(optarg));
+            str.value=separator+1;
+            strings.push_back(str);
+            break;
+        }
+        case 'm':
+        {
+            TestNote testNote;
+            if(!parseNote(optarg,testNote))
+            {
+                fprintf(stderr,"Invalid note: %s\n",optarg);
+                return 1;
+            }
+            notes.push_back(testNote);
+            break;
+        }
+        case 't':
+            bpm=atof(optarg);
+            break;
+        case 'w':
+            bitDepth=uint(atoi(optarg));
+            break;
+        case 'e':
+        {
+            referencePath=optarg;
+            size_t separator=referencePath.rfind(':');
+            if(separator!=std::string::npos)
+            {
+                tolerance=atof(referencePath.c_str()+separator+1);
+                referencePath.erase(separator);
+            }
+            break;
+        }
+        case 'o':
+            printOutputs=true;
+            break;
+        case 'q':
+            quiet=true;
+            break;
+        default:
+            printUsage();
+            return option=='h'?0:1;
+        }
+    }
+    if(optind>=argc || blockSize==0 || rate<=0)
+    {
+        printUsage();
+        return 1;
+    }
+    std::string scriptPath=argv[optind];
+    std::string inputPath=(optind+1<argc)?argv[optind+1]:"-";
+    std::string outputPath=(optind+2<argc)?argv[optind+2]:"";
+
+    // open input file if any
+    WaveFileReader reader;
+    bool hasInput=(inputPath!="-");
+    uint64 samplesCount=0;
+    if(hasInput)
+    {
+        if(!reader.openFile(inputPath))
+        {
+            fprintf(stderr,"Cannot open input file: %s\n",inputPath.c_str());
+            return 1;
+        }
+        channels=uint(reader.get_channelsCount());
+        rate=reader.get_sampleRate();
+        samplesCount=reader.get_samplesCount();
+    }
+    else
+        samplesCount=uint64(length*rate);
+
+    // load and initialize the script
+    ScriptHost script;
+    script.sampleRate=rate;
+    script.maxBlockSize=int(blockSize);
+    script.audioInputsCount=channels;
+    script.audioOutputsCount=channels;
+    script.transport.bpm=bpm;
+    script.quiet=quiet;
+    std::string error;
+    if(!script.load(scriptPath,error))
+    {
+        fprintf(stderr,"Cannot load script %s: %s\n",scriptPath.c_str(),error.c_str());
+        return 1;
+    }
+    for(size_t i=0;i<strings.size();i++)
+        script.setInputString(strings[i].index,strings[i].value);
+    if(!script.setup())
+    {
+        fprintf(stderr,"Script initialization failed: %s\n",scriptPath.c_str());
+        return 1;
+    }
+    if(!quiet)
+    {
+        fprintf(stderr,"Script: %s (%s)\n",script.name.c_str(),script.get_processFunctionName());
+        fprintf(stderr,"Format: %u channels, %g Hz, %u samples per block\n",channels,rate,blockSize);
+        fprintf(stderr,"Latency: %d samples, tail: %d samples\n",script.get_latency(),script.get_tailSize());
+    }
+
+    // open output and reference files
+    WaveFileWriter writer;
+    bool hasOutput=!outputPath.empty();
+    if(hasOutput)
+    {
+        writer.header.channelsCount=channels;
+        writer.header.sampleRate=uint64(rate);
+        writer.header.bytesPerSample=bitDepth/8;
+        if(!writer.openFile(outputPath))
+        {
+            fprintf(stderr,"Cannot open output file: %s\n",outputPath.c_str());
+            return 1;
+        }
+    }
+    WaveFileReader reference;
+    bool hasReference=!referencePath.empty();
+    if(hasReference && !reference.openFile(referencePath,int(channels)))
+    {
+        fprintf(stderr,"Cannot open reference file: %s\n",referencePath.c_str());
+        return 1;
+    }
+
+    // render the input, then the tail of the script (if finite) with silent input
+    const int tailSize=script.get_tailSize();
+    const uint64 renderedCount=samplesCount+uint64(tailSize>0?tailSize:0);
+    std::vector<double> frame(channels>0?channels:1,0);
+    std::vector<double> referenceFrame(frame.size(),0);
+    double** buffers=script.get_buffers();
+    double processingTime=0;
+    double maxError=0;
+    std::chrono::steady_clock::time_point renderStart=std::chrono::steady_clock::now();
+    for(uint64 position=0;position<renderedCount;position+=blockSize)
+    {
+        uint count=blockSize;
+        if(position+count>renderedCount)
+            count=uint(renderedCount-position);
+
+        // input: interleaved file data to host buffers (silence in the tail)
+        for(uint i=0;i<count;i++)
+        {
+            const bool inFile=hasInput && position+i<samplesCount;
+            if(inFile)
+                reader.readSample(frame.data());
+            for(uint ch=0;ch<channels;ch++)
+                buffers[ch][i]=inFile?frame[ch]:0;
+        }
+
+        // parameters (linear ramp over the entire file, end value in the tail) and MIDI notes
+        for(size_t p=0;p<params.size();p++)
+        {
+            const ParameterValue& param=params[p];
+            double begin=param.startValue+(param.endValue-param.startValue)*rampRatio(position,samplesCount);
+            double end=param.startValue+(param.endValue-param.startValue)*rampRatio(position+count,samplesCount);
+            script.setParameter(param.index,begin,end);
+        }
+        queueNotes(notes,int64(position),count,rate,script.inputMidiEvents);
+
+        // process: only script calls are timed
+        std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+        script.processBlock(count);
+        processingTime+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        // output
+        for(uint i=0;i<count;i++)
+        {
+            for(uint ch=0;ch<channels;ch++)
+                frame[ch]=buffers[ch][i];
+            if(hasOutput)
+                writer.writeSample(frame.data());
+            if(hasReference)
+            {
+                reference.readSample(referenceFrame.data());
+                for(uint ch=0;ch<channels;ch++)
+                {
+                    double diff=fabs(frame[ch]-referenceFrame[ch]);
+                    if(!(diff<=maxError)) // also catches NaN
+                        maxError=diff;
+                }
+            }
+        }
+    }
+    double totalTime=std::chrono::duration<double>(std::chrono::steady_clock::now()-renderStart).count();
+    if(hasOutput)
+        writer.close();
+
+    // report
+    double audioDuration=double(renderedCount)/rate;
+    printf("%s: %.3f s of audio rendered in %.3f s (script: %.3f s) => %.1fx real time\n",
+        script.name.c_str(),audioDuration,totalTime,processingTime,
+        processingTime>0?audioDuration/processingTime:0.0);
+    if(printOutputs)
+    {
+        for(uint i=0;i<script.get_outputParametersCount();i++)
+            printf("%s: %g\n",script.get_outputParameterName(i).c_str(),script.get_outputParameter(i));
+        for(uint i=0;i<script.get_outputStringsCount();i++)
+        {
+            string value=script.get_outputString(i);
+            printf("%s: %s\n",script.get_outputStringName(i).c_str(),value!=null?value:"");
+        }
+        std::vector<float> values;
+        for(uint i=0;i<script.get_outputBuffersCount();i++)
+        {
+            printf("%s: ",script.get_outputBufferName(i).c_str());
+            if(!script.readOutputBuffer(i,values))
+            {
+                printf("(being updated)\n");
+                continue;
+            }
+            printf("[%u values, update %u]",uint(values.size()),script.get_outputBufferSequence(i)/2);
+            for(size_t v=0;v<values.size();v++)
+                printf("%s%g",v==0?" ":";",values[v]);
+            printf("\n");
+        }
+    }
+    int result=0;
+    if(hasReference)
+    {
+        bool ok=(maxError<=tolerance) && (uint64(reference.get_samplesCount())>=renderedCount);
+        printf("Reference: max error %g (tolerance %g) => %s\n",maxError,tolerance,ok?"PASSED":"FAILED");
+        if(!ok)
+            result=2;
+        reference.close();
+    }
+    if(hasInput)
+        reader.close();
+    return result;
+}
@@ -0,0 +1,505 @@
+/**
+*  \file Oversampler.hxx
+*  Oversampling (2x, 4x or 8x) of nonlinear processing for angelscript.
+*
+*  Each input sample of a channel is upsampled to get_factor() samples, which the script processes
+*  in place (at sampleRate*get_factor()) before they are downsampled back to one sample. Each 2x
+*  step is a half-band lowpass filter, cascaded for higher factors (the first step, closest to the
+*  audio band, uses the longest filter). Two modes are available:
+*  - linear phase: polyphase half-band FIR filters (Kaiser windowed sinc). The latency is padded to
+*    a whole number of samples, so that the reported latency is exact.
+*  - minimum phase: polyphase IIR half-band filters (chains of first order allpass sections,
+*    elliptic response). Very short delay (a few samples) but the phase is not linear: the reported
+*    latency is the position of the peak of the impulse response.
+*
+*  Same filters as the Oversampler.h library of the native (c/c++) scripts.
+*
+*  Created by Blue Cat Audio <services@bluecataudio.com>
+*  Copyright 2011-2015 Blue Cat Audio. All rights reserved.
+*
+*/
+
+namespace KittyDSP
+{
+    namespace Oversampling
+    {
+        /** Oversampling filters mode.
+        *
+        */
+        enum Mode
+        {
+            kLinearPhase,
+            kMinimumPhase
+        };
+
+        const uint kMaxStages=3; ///< 2^kMaxStages is the highest oversampling factor
+        const uint kMaxFactor=8;
+
+        /// modified Bessel function of the first kind, order 0 (for Kaiser windows).
+        double besselI0(double x)
+        {
+            double sum=1;
+            double term=1;
+            for(uint k=1;k<64 && term>sum*1e-17;k++)
+            {
+                const double t=x/(2*k);
+                term*=t*t;
+                sum+=term;
+            }
+            return sum;
+        }
+
+        /** Memories of one 2x step for one channel.
+        *   FIR lines are stored twice (ring buffer of length, written at pos and pos+length), so that the
+        *   last length samples are always contiguous: from pos+1 (oldest) to pos+length (newest).
+        */
+        class StageMemory
+        {
+            array<double>   upLine;
+            array<double>   evenLine;
+            array<double>   oddLine;
+            uint            upPos=0;
+            uint            evenPos=0;
+            uint            oddPos=0;
+            array<double>   iirUp;
+            array<double>   iirDown;
+
+            void resize(uint firLength,uint iirLength)
+            {
+                upLine.resize(2*firLength);
+                evenLine.resize(2*firLength);
+                oddLine.resize(2*firLength);
+                iirUp.resize(iirLength);
+                iirDown.resize(iirLength);
+                clear();
+            }
+
+            void clear()
+            {
+                for(uint i=0;i<upLine.length;i++)
+                {
+                    upLine[i]=0;
+                    evenLine[i]=0;
+                    oddLine[i]=0;
+                }
+                for(uint i=0;i<iirUp.length;i++)
+                {
+                    iirUp[i]=0;
+                    iirDown[i]=0;
+                }
+                upPos=evenPos=oddPos=0;
+            }
+        };
+
+        /** Linear phase half-band FIR filter, for one 2x step (up and down).
+        *   The filter has 4*halfLength-1 taps: the center tap (.5), zeros, and 2*halfLength non zero taps,
+        *   which form the FIR branch of the polyphase filter (the other branch is a delay of halfLength
+        *   samples at the lower rate).
+        */
+        class HalfBandFir
+        {
+            array<double>   taps;
+            uint            halfLength=0;
+
+            /// designs the filter (Kaiser window): longer filters have a sharper transition.
+            void design(uint iHalfLength,double beta)
+            {
+                halfLength=iHalfLength;
+                const uint count=2*halfLength;
+                taps.resize(count);
+                const double center=double(2*halfLength-1);
+                const double i0Beta=besselI0(beta);
+                double sum=0;
+                for(uint i=0;i<count;i++)
+                {
+                    // tap i of the branch is the tap 2*i of the full filter
+                    const double n=double(2*i)-center;
+                    const double r=n/(center+1);
+                    const double window=besselI0(beta*sqrt(1-r*r))/i0Beta;
+                    taps[i]=sin(PI*n*.5)/(PI*n)*window;
+                    sum+=taps[i];
+                }
+                // normalize: unity gain at DC (the taps of the branch sum to .5)
+                for(uint i=0;i<count;i++)
+                    taps[i]*=.5/sum;
+            }
+
+            uint get_length()const
+            {
+                return taps.length;
+            }
+
+            /// delay of the up and down filters together, at the higher rate, in samples.
+            uint get_delay()const
+            {
+                return 2*(2*halfLength-1);
+            }
+
+            /// upsamples one sample (input) to two samples (even, then odd).
+            void upsample(double input,StageMemory& memory,double& even,double& odd)const
+            {
+                const uint length=taps.length;
+                memory.upPos++;
+                if(memory.upPos==length)
+                    memory.upPos=0;
+                const uint first=memory.upPos+1;
+                memory.upLine[memory.upPos]=input;
+                memory.upLine[memory.upPos+length]=input;
+                even=2*filter(memory.upLine,first);
+                odd=memory.upLine[first+halfLength];
+            }
+
+            /// downsamples two samples (even, then odd) to one sample.
+            double downsample(double even,double odd,StageMemory& memory)const
+            {
+                const uint length=taps.length;
+                memory.evenPos++;
+                if(memory.evenPos==length)
+                    memory.evenPos=0;
+                memory.evenLine[memory.evenPos]=even;
+                memory.evenLine[memory.evenPos+length]=even;
+                memory.oddPos++;
+                if(memory.oddPos==length)
+                    memory.oddPos=0;
+                memory.oddLine[memory.oddPos]=odd;
+                memory.oddLine[memory.oddPos+length]=odd;
+                // odd samples branch: delay of halfLength samples
+                return filter(memory.evenLine,memory.evenPos+1)+.5*memory.oddLine[memory.oddPos+halfLength];
+            }
+
+            /// FIR branch, for the samples of line from first to first+length-1.
+            double filter(array<double>& line,uint first)const
+            {
+                double y=0;
+                for(uint i=0;i<taps.length;i++)
+                    y+=taps[i]*line[first+i];
+                return y;
+            }
+        };
+
+        /** Minimum phase half-band IIR filter, for one 2x step (up and down): two chains of first order
+        *   allpass sections (a+z^-1)/(1+a*z^-1) at the lower rate, with alternate coefficients.
+        */
+        class HalfBandIir
+        {
+            array<double>   coefficients;
+
+            /** Designs the filter for a number of coefficients (memory: 2 values per coefficient) and a
+            *   transition bandwidth (relative to the higher sampling rate, 0 to .5).
+            */
+            void design(uint count,double transition)
+            {
+                coefficients.resize(count);
+
+                // elliptic filter parameters
+                double k=tan((1-transition*2)*PI/4);
+                k*=k;
+                const double kk=pow(1-k*k,.25);
+                const double e=.5*(1-kk)/(1+kk);
+                const double e4=e*e*e*e;
+                const double q=e*(1+e4*(2+e4*(15+150*e4)));
+                const double order=double(2*count+1);
+                for(uint c=0;c<count;c++)
+                {
+                    double num=0;
+                    double term=0;
+                    int sign=1;
+                    for(uint i=0;i==0 || abs(term)>1e-100;i++)
+                    {
+                        term=pow(q,double(i*(i+1)))*sin(double(2*i+1)*double(c+1)*PI/order)*sign;
+                        num+=term;
+                        sign=-sign;
+                    }
+                    double den=.5;
+                    sign=-1;
+                    for(uint i=1;i==1 || abs(term)>1e-100;i++)
+                    {
+                        term=pow(q,double(i*i))*cos(double(2*i)*double(c+1)*PI/order)*sign;
+                        den+=term;
+                        sign=-sign;
+                    }
+                    const double w=num*pow(q,.25)/den;
+                    const double w2=w*w;
+                    const double x=sqrt((1-w2*k)*(1-w2/k))/(1+w2);
+                    coefficients[c]=(1-x)/(1+x);
+                }
+            }
+
+            /// memory values per channel.
+            uint get_memoryLength()const
+            {
+                return 2*coefficients.length;
+            }
+
+            /// upsamples one sample (input) to two samples (even, then odd).
+            void upsample(double input,StageMemory& memory,double& even,double& odd)const
+            {
+                even=input;
+                odd=input;
+                processPair(even,odd,memory.iirUp);
+            }
+
+            /// downsamples two samples (even, then odd) to one sample.
+            double downsample(double even,double odd,StageMemory& memory)const
+            {
+                // the chains are swapped: the delay between them is compensated by ending on the odd sample
+                double first=odd;
+                double second=even;
+                processPair(first,second,memory.iirDown);
+                return .5*(first+second);
+            }
+
+            /// processes one sample of both chains (even coefficients for the first one, odd for the second one).
+            void processPair(double& even,double& odd,array<double>& memory)const
+            {
+                const uint count=coefficients.length;
+                for(uint c=0;c+1<count;c+=2)
+                {
+                    even=allpass(even,coefficients[c],memory,2*c);
+                    odd=allpass(odd,coefficients[c+1],memory,2*c+2);
+                }
+                if((count&1)!=0)
+                    even=allpass(even,coefficients[count-1],memory,2*count-2);
+            }
+
+            double allpass(double input,double a,array<double>& memory,uint index)const
+            {
+                double output=(input-memory[index+1])*a+memory[index];
+                // getting rid of denormal numbers
+                const double antiDenormal=1e-30;
+                output+=antiDenormal;
+                output-=antiDenormal;
+                memory[index]=input;
+                memory[index+1]=output;
+                return output;
+            }
+        };
+
+        /** Memories of all steps for one channel, and the delay padding of the linear phase mode.
+        *
+        */
+        class ChannelMemory
+        {
+            array<StageMemory>  stages;
+            array<double>       padLine;
+            uint                padPos=0;
+            array<double>       scratch;
+
+            void clear()
+            {
+                for(uint s=0;s<stages.length;s++)
+                    stages[s].clear();
+                for(uint i=0;i<padLine.length;i++)
+                    padLine[i]=0;
+                padPos=0;
+            }
+        };
+
+        /** Oversampler for several channels, sample per sample: call upsample() for a sample of a channel,
+        *   process the get_factor() returned samples in place, then downsample() them.
+        */
+        class Oversampler
+        {
+            Oversampler()
+            {
+                fir.resize(kMaxStages);
+                iir.resize(kMaxStages);
+                // the first step needs a sharp transition (top of the audio band), the others only need to
+                // reject the images above the audio band
+                fir[0].design(16,8);
+                iir[0].design(10,.04);
+                for(uint s=1;s<kMaxStages;s++)
+                {
+                    fir[s].design(6,8);
+                    iir[s].design(4,.15);
+                }
+                setFactor(2);
+            }
+
+            /// allocates the memories of the channels (not for the audio thread).
+            void setChannelsCount(uint count)
+            {
+                channels.resize(count);
+                for(uint ch=0;ch<count;ch++)
+                {
+                    ChannelMemory@ channel=channels[ch];
+                    channel.stages.resize(kMaxStages);
+                    for(uint s=0;s<kMaxStages;s++)
+                        channel.stages[s].resize(fir[s].get_length(),iir[s].get_memoryLength());
+                    channel.padLine.resize(kMaxFactor);
+                    channel.scratch.resize(kMaxFactor);
+                    channel.clear();
+                }
+            }
+
+            uint get_channelsCount()const
+            {
+                return channels.length;
+            }
+
+            /// sets the oversampling factor (1, 2, 4 or 8: rounded down to a power of 2). Resets the memories if changed.
+            void setFactor(uint iFactor)
+            {
+                uint count=0;
+                while(count<kMaxStages && (uint(2)<<count)<=iFactor)
+                    count++;
+                if(count!=stagesCount)
+                {
+                    stagesCount=count;
+                    updateLatency();
+                    reset();
+                }
+            }
+
+            uint get_factor()const
+            {
+                return uint(1)<<stagesCount;
+            }
+
+            /// sets the filters mode. Resets the memories if changed.
+            void setMode(Mode iMode)
+            {
+                if(iMode!=mode)
+                {
+                    mode=iMode;
+                    updateLatency();
+                    reset();
+                }
+            }
+
+            Mode get_mode()const
+            {
+                return mode;
+            }
+
+            /// latency in samples (base rate), to be reported by getLatency().
+            int get_latency()const
+            {
+                return latency;
+            }
+
+            void reset()
+            {
+                for(uint ch=0;ch<channels.length;ch++)
+                    channels[ch].clear();
+            }
+
+            /** Upsamples one sample of a channel: fills the first get_factor() values of samples (which should
+            *   hold kMaxFactor values), to be processed in place before calling downsample() for the same channel.
+            */
+            void upsample(double input,array<double>& samples,uint channel)
+            {
+                upsampleChannel(input,samples,channels[channel]);
+            }
+
+            /** Downsamples the get_factor() samples returned by upsample() (and processed) to one sample of
+            *   the channel.
+            */
+            double downsample(array<double>& samples,uint channel)
+            {
+                return downsampleChannel(samples,channels[channel]);
+            }
+
+            // private data
+            private array<HalfBandFir>    fir;
+            private array<HalfBandIir>    iir;
+            private array<ChannelMemory>  channels;
+            private uint                  stagesCount=0;
+            private Mode                  mode=kLinearPhase;
+            private uint                  padding=0; ///< delay at the highest rate, for a whole latency at the base rate
+            private int                   latency=0;
+
+            private void upsampleChannel(double input,array<double>& samples,ChannelMemory& memory)
+            {
+                samples[0]=input;
+                for(uint s=0;s<stagesCount;s++)
+                {
+                    // the samples of the step are processed in chronological order (from a copy)
+                    const uint count=uint(1)<<s;
+                    for(uint i=0;i<count;i++)
+                        memory.scratch[i]=samples[i];
+                    StageMemory@ stage=memory.stages[s];
+                    for(uint i=0;i<count;i++)
+                    {
+                        if(mode==kMinimumPhase)
+                            iir[s].upsample(memory.scratch[i],stage,samples[2*i],samples[2*i+1]);
+                        else
+                            fir[s].upsample(memory.scratch[i],stage,samples[2*i],samples[2*i+1]);
+                    }
+                }
+            }
+
+            private double downsampleChannel(array<double>& samples,ChannelMemory& memory)
+            {
+                if(padding!=0)
+                {
+                    const uint mask=kMaxFactor-1;
+                    for(uint i=0,factor=get_factor();i<factor;i++)
+                    {
+                        memory.padPos=(memory.padPos+1)&mask;
+                        memory.padLine[memory.padPos]=samples[i];
+                        samples[i]=memory.padLine[(memory.padPos-padding)&mask];
+                    }
+                }
+                for(uint s=stagesCount;s-->0;)
+                {
+                    // in place: output i is written after reading inputs 2*i and 2*i+1
+                    const uint count=uint(1)<<s;
+                    StageMemory@ stage=memory.stages[s];
+                    for(uint i=0;i<count;i++)
+                    {
+                        if(mode==kMinimumPhase)
+                            samples[i]=iir[s].downsample(samples[2*i],samples[2*i+1],stage);
+                        else
+                            samples[i]=fir[s].downsample(samples[2*i],samples[2*i+1],stage);
+                    }
+                }
+                return samples[0];
+            }
+
+            private void updateLatency()
+            {
+                padding=0;
+                if(mode==kMinimumPhase)
+                {
+                    latency=getImpulsePeak();
+                    return;
+                }
+                // delay at the highest rate: the delay of a stage pair is doubled by each following stage
+                uint delay=0;
+                for(uint s=0;s<stagesCount;s++)
+                    delay+=fir[s].get_delay()<<(stagesCount-1-s);
+                const uint factor=get_factor();
+                padding=(factor-delay%factor)%factor;
+                latency=int((delay+padding)/factor);
+            }
+
+            /// position (base rate) of the peak of the impulse response of the minimum phase filters.
+            private int getImpulsePeak()
+            {
+                const uint kLength=32; ///< base rate samples (the response peaks within a few samples)
+                ChannelMemory memory;
+                memory.stages.resize(kMaxStages);
+                for(uint s=0;s<kMaxStages;s++)
+                    memory.stages[s].resize(fir[s].get_length(),iir[s].get_memoryLength());
+                memory.padLine.resize(kMaxFactor);
+                memory.scratch.resize(kMaxFactor);
+                memory.clear();
+                array<double> samples(kMaxFactor);
+                uint peak=0;
+                double peakValue=0;
+                for(uint i=0;i<kLength;i++)
+                {
+                    upsampleChannel(i==0?1.0:0.0,samples,memory);
+                    const double value=abs(downsampleChannel(samples,memory));
+                    if(value>peakValue)
+                    {
+                        peak=i;
+                        peakValue=value;
+                    }
+                }
+                return int(peak);
+            }
+        };
+    }
+}
@@ -36,4 +36,13 @@ struct CIntArray
     uint        length;
 };
 
+/** C Array Descriptor expected by host for arrays of output buffers.
+ *  (outputBuffers)
+ */
+struct COutputBufferArray
+{
+    struct OutputBuffer*    ptr;
+    uint                    length;
+};
+
 #endif
@@ -19,7 +19,7 @@
 #if __has_feature(cxx_generalized_initializers)
 #define CPP11_INITIALIZERS
 #endif
-#elif defined(__GNUG__) &&  (__GNUC__ >= 4) && (__GNUC_MINOR__ >=4) // supported starting with GCC 4.4
+#elif defined(__GNUG__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >=4))) // supported starting with GCC 4.4
 #define CPP11_INITIALIZERS
 #endif
 
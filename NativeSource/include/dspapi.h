@@ -29,6 +29,8 @@ typedef char const*     string;
 typedef unsigned int    uint;
 typedef signed char     int8;
 typedef unsigned char   uint8;
+typedef signed short    int16;
+typedef unsigned short  uint16;
 #ifdef _MSC_VER // Visual Studio
 typedef _int64          int64;
 typedef unsigned _int64 uint64;
@@ -40,6 +42,12 @@ typedef uint64_t        uint64;
 
 #define null 0
 
+// memory fences for output buffers updates (C++11 only: the header remains valid for C and C++03)
+#if defined(__cplusplus) && (__cplusplus>=201103L || (defined(_MSC_VER) && _MSC_VER>=1900))
+#define DSPAPI_HAS_ATOMIC
+#include <atomic>
+#endif
+
 /** MIDI Event (packet) abstraction.
  *	Contains 4 bytes of data and a timestamp.
  */
@@ -177,6 +185,61 @@ struct BlockData
     /// Transport information - may be null if not supported or not provided
     /// by the host application.
     const struct TransportInfo* transport;
+    /// True when the host is rendering offline (faster or slower than real time).
+    bool                        offlineRenderingMode;
+};
+
+/** Formats of the values stored in output buffers.
+ *
+ */
+enum OutputBufferFormat
+{
+    /// 32-bit floating point values.
+    kOutputBufferFloat32=0,
+    /// 16-bit signed integers (32767 for 1.0).
+    kOutputBufferInt16=1
+};
+
+/** Fixed-size binary buffer used as output for the script (waveforms, spectrums...).
+ *  Large amounts of data can be sent to the user interface without being formatted
+ *  as strings. The data is allocated by the script and updated in computeOutputData.
+ *  The sequence counter is incremented before and after each update (it is odd while
+ *  the data is being written), so that a reader can detect incomplete copies and retry
+ *  (the beginUpdate and endUpdate helpers require C++11).
+ */
+struct OutputBuffer
+{
+    /// The values (capacity values in the given format), allocated by the script.
+    void*           data;
+    /// The maximum number of values in data.
+    uint            capacity;
+    /// The number of valid values in data.
+    uint            length;
+    /// The format of the values (see OutputBufferFormat).
+    int             format;
+    /// Update counter: odd while the script is writing the data, even otherwise.
+    volatile uint   sequence;
+
+    // extra C++ inline methods
+#ifdef __cplusplus
+    OutputBuffer():data(null),capacity(0),length(0),format(kOutputBufferFloat32),sequence(0){}
+
+#ifdef DSPAPI_HAS_ATOMIC
+    /// call before writing the data (sequence becomes odd).
+    inline void beginUpdate()
+    {
+        sequence=sequence+1;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /// call after writing the data (sequence becomes even).
+    inline void endUpdate()
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        sequence=sequence+1;
+    }
+#endif
+#endif
 };
 
 // C API definition
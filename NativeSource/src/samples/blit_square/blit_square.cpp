@@ -6,8 +6,11 @@
  */
 
 #include"dspapi.h"
+#include"cpphelpers.h"
 #include"../library/Midi.h"
 #include"../library/Constants.h"
+#include"../library/MidiBlockSplitter.h"
+#include"../library/Wavetable.h"
 #include<cmath>
 #include<array>
 #include<algorithm>
@@ -18,76 +21,120 @@ DSP_EXPORT double sampleRate = 0;
 DSP_EXPORT string name = "blit square";
 DSP_EXPORT string description = "BLIT-Based square wave synthesis";
 
-// note
-class blit_square_oscillator_note
+DSP_EXPORT array<string> inputParametersNames = { "Polyphony" };
+DSP_EXPORT array<double> inputParameters(inputParametersNames.length);
+DSP_EXPORT array<double> inputParametersMin = { 1 };
+DSP_EXPORT array<double> inputParametersMax = { 64 };
+DSP_EXPORT array<double> inputParametersDefault = { 64 };
+DSP_EXPORT array<int> inputParametersSteps = { 64 };
+
+// oscillator
+// The state of the notes is stored as a structure of arrays, active notes first: notes are
+// processed by groups of "lanes" notes, with independent computations that the compiler can
+// vectorize (the band-limited impulse of all the notes of a group is computed in parallel).
+class blit_square_oscillator
 {
 public:
+	static const uint max_notes = 64;
+	static const uint lanes = 8;
+
+private:
 	// current time
-	double t;
+	std::array<double, max_notes> t;
 
 	// current value
-	double value;
+	std::array<double, max_notes> value;
 
 	// nyquist limit
-	int n;
+	std::array<int, max_notes> n;
 
 	// delta t
-	double dt;
+	std::array<double, max_notes> dt;
 
 	// note number [0,127]
-	int note_no;
+	std::array<int, max_notes> note_no;
 
 	// velocity [0,1]
-	double velocity;
+	std::array<double, max_notes> velocity;
+
+	// number of notes playing (first notes of the arrays)
+	uint active_count;
+
+	// maximum number of notes playing
+	uint polyphony;
+
+	// sine wave table (one period, shared with the wavetables library)
+	const double* sin_table;
 
-	blit_square_oscillator_note()
+	double pitchbend;
+
+	void reset_note(uint i)
 	{
-		t = 0.0;
-		value = 0.0;
-		n = 0;
-		dt = 0.0;
-		note_no = -1;
-		velocity = 0.0;
+		// silent note (with finite values when processed in a group of lanes)
+		t[i] = 0.25;
+		value[i] = 0.0;
+		n[i] = 0;
+		dt[i] = 0.0;
+		note_no[i] = -1;
+		velocity[i] = 0.0;
 	}
-};
 
-// oscillator
-class blit_square_oscillator
-{
-	std::array<blit_square_oscillator_note, 8> notes;
+	void update_pitch(uint i)
+	{
+		double freq = 440.0*(std::pow(2.0, (note_no[i] + pitchbend - 69.0) / 12.0));
+		n[i] = static_cast<int>(sampleRate / 4.0 / freq) * 2;
+		dt[i] = freq / sampleRate;
+	}
 
-	std::array<double, (1 << 10) + 1> sin_table;
+	void remove_note(uint i)
+	{
+		// the last active note takes its place
+		active_count--;
+		if (i != active_count)
+		{
+			t[i] = t[active_count];
+			value[i] = value[active_count];
+			n[i] = n[active_count];
+			dt[i] = dt[active_count];
+			note_no[i] = note_no[active_count];
+			velocity[i] = velocity[active_count];
+		}
+		reset_note(active_count);
+	}
 
-	double pitchbend;
 public:
 	blit_square_oscillator()
-		:pitchbend(0.0)
+		:active_count(0), polyphony(max_notes), pitchbend(0.0)
 	{
-		// sine wave table
-		for (size_t ii = 0; ii < sin_table.size(); ii++)
+		sin_table = KittyDSP::Wavetables::getSineTable();
+		for (uint i = 0; i < max_notes; i++)
 		{
-			sin_table[ii] = std::sin(2.0*PI * ii / (sin_table.size() - 1));
+			reset_note(i);
 		}
 	}
 
-	void trigger(const MidiEvent& evt)
+	void set_polyphony(uint count)
 	{
-		auto note = std::find_if(
-			notes.begin(),
-			notes.end(),
-			[](blit_square_oscillator_note& n) { return n.note_no < 0; });
+		polyphony = std::min(std::max(count, 1u), max_notes);
+		while (active_count > polyphony)
+		{
+			// too many notes: release the last ones
+			remove_note(active_count - 1);
+		}
+	}
 
-		if (note != notes.end())
+	void trigger(const MidiEvent& evt)
+	{
+		if (active_count < polyphony)
 		{
-			note->note_no = MidiEventUtils::getNote(evt);
-			note->velocity = MidiEventUtils::getNoteVelocity(evt) / 127.0;
-			note->value = 1.0;
-			note->t = 0.25;
+			uint i = active_count++;
+			note_no[i] = MidiEventUtils::getNote(evt);
+			velocity[i] = MidiEventUtils::getNoteVelocity(evt) / 127.0;
+			value[i] = 1.0;
+			t[i] = 0.25;
 
 			//
-			double freq = 440.0*(std::pow(2.0, (note->note_no + pitchbend - 69.0) / 12.0));
-			note->n = static_cast<int>(sampleRate / 4.0 / freq) * 2;
-			note->dt = freq / sampleRate;
+			update_pitch(i);
 		}
 	}
 
@@ -95,100 +142,110 @@ public:
 	{
 		pitchbend = MidiEventUtils::getPitchWheelValue(evt) / 4096.0;
 
-		for (blit_square_oscillator_note& note : notes)
+		for (uint i = 0; i < active_count; i++)
 		{
-			if (note.note_no >= 0)
-			{
-				double freq = 440.0*(std::pow(2.0, (note.note_no + pitchbend - 69.0) / 12.0));
-				note.n = static_cast<int>(sampleRate / 4.0 / freq) * 2;
-				note.dt = freq / sampleRate;
-			}
+			update_pitch(i);
 		}
 	}
 
 	void release(const MidiEvent& evt)
 	{
-		int note_no = MidiEventUtils::getNote(evt);
+		int note = MidiEventUtils::getNote(evt);
 
-		auto note = std::find_if(
-			notes.begin(),
-			notes.end(),
-			[note_no](blit_square_oscillator_note& n) { return n.note_no == note_no; });
+		auto found = std::find(note_no.begin(), note_no.begin() + active_count, note);
 
-		if (note != notes.end())
+		if (found != note_no.begin() + active_count)
 		{
 			// note off
-			note->note_no = -1;
+			remove_note(static_cast<uint>(found - note_no.begin()));
 		}
 	}
 
-	double linear_interpolated_sin(double x)
+	// render count samples (all notes) to output
+	void process_block(double* output, uint count)
 	{
-		//
-		double pos = (sin_table.size() - 1) * x;
-
-		//
-		int idx_A = static_cast<int>(pos);
-
-		//
-		double s = pos - idx_A;
-
-		//
-		return (1.0 - s) * sin_table[idx_A] + s*sin_table[idx_A + 1];
+		std::fill(output, output + count, 0.0);
+		for (uint first = 0; first < active_count; first += lanes)
+		{
+			process_lanes(first, output, count);
+		}
 	}
 
-	//
-	double bandlimited_bipolar_impulse(double t, int n)
+private:
+	// adds count samples of notes [first, first+lanes[ to output
+	void process_lanes(uint first, double* output, uint count)
 	{
-		if (t < 1.0e-8 || 1.0 - 1.0e-8 < t)
-		{
-			return 4.0*n;
-		}
-		else if (0.5 - 1.0e-8 < t && t < 0.5 + 1.0e-8)
+		// local copy of the state of the notes (kept in registers)
+		double t_[lanes], value_[lanes], n_[lanes], peak_[lanes], dt_[lanes], velocity_[lanes];
+		for (uint l = 0; l < lanes; l++)
 		{
-			return -4.0*n;
+			t_[l] = t[first + l];
+			value_[l] = value[first + l];
+			n_[l] = n[first + l];
+			peak_[l] = 4.0*n[first + l];
+			dt_[l] = dt[first + l];
+			velocity_[l] = velocity[first + l];
 		}
-		else
-		{
-			double den = linear_interpolated_sin(t);
-			double num = linear_interpolated_sin(std::fmod(n*t, 1.0));
-			return 4.0*num / den;
-		}
-	}
 
-	//
-	double process_sample()
-	{
-		double value = 0.0;
-		for (blit_square_oscillator_note& note : notes)
+		for (uint i = 0; i < count; ++i)
 		{
-			if (note.note_no >= 0)
+			// render
+			double sum = 0.0;
+			for (uint l = 0; l < lanes; l++)
 			{
-				// render
-				value += note.value * note.velocity;
+				sum += value_[l] * velocity_[l];
+			}
+			output[i] += sum;
 
-				// update
-				note.t += note.dt;
-				if (1.0 <= note.t)note.t -= 1.0;
-				note.value = note.value*0.999 + bandlimited_bipolar_impulse(note.t, note.n)*note.dt;
+			// update
+			for (uint l = 0; l < lanes; l++)
+			{
+				double tl = t_[l] + dt_[l];
+				tl -= double(int(tl)); // [0,2[ to [0,1[
+				t_[l] = tl;
+
+				// bandlimited bipolar impulse (periods of the table are wrapped: no fmod)
+				// without branches, so that the lanes can be computed in parallel
+				double den = KittyDSP::Wavetables::interpolate(sin_table, tl);
+				double num = KittyDSP::Wavetables::interpolate(sin_table, n_[l] * tl);
+				double edge = ((tl < 1.0e-8) | (1.0 - 1.0e-8 < tl)) ? 1.0 : 0.0;
+				double middle = ((0.5 - 1.0e-8 < tl) & (tl < 0.5 + 1.0e-8)) ? 1.0 : 0.0;
+				double ratio = 4.0*num / (den + edge + middle); // not used at the edges and middle
+				double impulse = ratio + edge*(peak_[l] - ratio) + middle*(-peak_[l] - ratio);
+
+				value_[l] = value_[l] * 0.999 + impulse*dt_[l];
 			}
 		}
-		return value;
+
+		for (uint l = 0; l < lanes; l++)
+		{
+			t[first + l] = t_[l];
+			value[first + l] = value_[l];
+		}
 	}
 };
 
+// definitions of the static constants (ODR-used by std::min/std::max)
+const uint blit_square_oscillator::max_notes;
+const uint blit_square_oscillator::lanes;
+
 blit_square_oscillator blit_square;
 
 DSP_EXPORT void processBlock(BlockData& data)
 {
-	uint event_idx = 0;
-	const MidiQueue& inputMidiEvents = data.inputMidiEvents;
-	for (uint i = 0; i < data.samplesToProcess; ++i)
+	if (audioOutputsCount == 0)
 	{
-		while (event_idx < inputMidiEvents.length
-			&& inputMidiEvents[event_idx].timeStamp <= static_cast<double>(i))
+		return;
+	}
+
+	// render to the first channel, between MIDI events
+	double* output = data.samples[0];
+	KittyDSP::Midi::BlockSplitter span(data.inputMidiEvents, data.samplesToProcess);
+	while (span.next())
+	{
+		for (uint e = 0; e < span.get_eventsCount(); ++e)
 		{
-			const MidiEvent& event = inputMidiEvents[event_idx];
+			const MidiEvent& event = span.getEvent(e);
 			MidiEventType evt_type = MidiEventUtils::getType(event);
 			if (evt_type == kMidiNoteOn)
 			{
@@ -202,17 +259,22 @@ DSP_EXPORT void processBlock(BlockData& data)
 			{
 				blit_square.update_pitchbend(event);
 			}
-			++event_idx;
 		}
+		blit_square.process_block(output + span.get_start(), span.get_length());
+	}
 
-		double value = blit_square.process_sample();
-		for (uint ch = 0; ch < audioOutputsCount; ++ch)
-		{
-			data.samples[ch][i] = value;
-		}
+	// copy to the other channels
+	for (uint ch = 1; ch < audioOutputsCount; ++ch)
+	{
+		std::copy(output, output + data.samplesToProcess, data.samples[ch]);
 	}
 }
 
+DSP_EXPORT void updateInputParameters()
+{
+	blit_square.set_polyphony(static_cast<uint>(inputParameters[0] + 0.5));
+}
+
 DSP_EXPORT int getTailSize()
 {
 	return -1;
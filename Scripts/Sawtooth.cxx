@@ -21,11 +21,25 @@ void processSample(array<double>& ioSample)
     sampleValue += freqNormalized;
     if (sampleValue >= .5) // Threshold 0.5 -> No DC, or 1.0 -> DC
         sampleValue -= 1.;
+
+    // PolyBLEP: smooth the step on the samples just before and after it (much less aliasing)
+    double outputValue = sampleValue;
+    double phase = sampleValue + .5;
+    if (phase < freqNormalized)
+    {
+        double x = 1. - phase / freqNormalized;
+        outputValue += .5 * x * x;
+    }
+    else if (phase > 1. - freqNormalized)
+    {
+        double x = 1. + (phase - 1.) / freqNormalized;
+        outputValue -= .5 * x * x;
+    }
     
     // copy to all audio outputs
     for(uint channel=0;channel<audioOutputsCount;channel++)
     {
-        ioSample[channel]=sampleValue*amplitude;
+        ioSample[channel]=outputValue*amplitude;
     }
 }
 
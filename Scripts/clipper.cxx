@@ -3,6 +3,9 @@
 *   (https://github.com/michaeldonovan)
 */
 
+#include "library/Constants.hxx"
+#include "library/Oversampler.hxx"
+
 /** Script metadata.
 */
 string name="Clipper";
@@ -10,12 +13,14 @@ string description="A very simple hard clipper";
 
 /** Define our parameters.
 */
-array<string> inputParametersNames={"Input", "Clip Level", "Output"};
-array<string> inputParametersUnits={"dB", "", "dB"};
+array<string> inputParametersNames={"Input", "Clip Level", "Output", "Oversampling", "Filters"};
+array<string> inputParametersUnits={"dB", "", "dB", "", ""};
 array<double> inputParameters(inputParametersNames.length);
-array<double> inputParametersMin={-20, 0, -20};
-array<double> inputParametersMax={20, 10, 20};
-array<double> inputParametersDefault={0, 0 , 0};
+array<double> inputParametersMin={-20, 0, -20, 0, 0};
+array<double> inputParametersMax={20, 10, 20, 3, 1};
+array<double> inputParametersDefault={0, 0 , 0, 1, 1};
+array<int>    inputParametersSteps={-1, -1, -1, 4, 2};
+array<string> inputParametersEnums={"", "", "", "1x;2x;4x;8x", "Linear Phase;Minimum Phase"};
 
 /** Define our internal variables.
 *
@@ -24,6 +29,31 @@ double preGain=0;
 double cliplevel=1;
 double postGain=0;
 
+/** Oversampling of the nonlinear stage (the gains are applied at the base rate).
+*
+*/
+KittyDSP::Oversampling::Oversampler oversampler;
+array<double> oversampled(KittyDSP::Oversampling::kMaxFactor);
+
+bool initialize()
+{
+    oversampler.setChannelsCount(audioInputsCount);
+    return true;
+}
+
+void reset()
+{
+    oversampler.reset();
+}
+
+/** latency of the oversampling filters.
+*
+*/
+int getLatency()
+{
+    return oversampler.get_latency();
+}
+
 /** per-sample processing function: called for every sample with updated parameters values.
 *
 */
@@ -35,10 +65,16 @@ void processSample(array<double>& ioSample)
 
         sample*=preGain;
 
-        if(sample>cliplevel)
-            sample=cliplevel;
-        else if(sample<-1*cliplevel)
-            sample=-1*cliplevel;
+        // clipping (oversampled)
+        oversampler.upsample(sample,oversampled,channel);
+        for(uint i=0,factor=oversampler.get_factor();i<factor;i++)
+        {
+            if(oversampled[i]>cliplevel)
+                oversampled[i]=cliplevel;
+            else if(oversampled[i]<-1*cliplevel)
+                oversampled[i]=-1*cliplevel;
+        }
+        sample=oversampler.downsample(oversampled,channel);
 
         sample*=postGain;
 
@@ -54,4 +90,9 @@ void updateInputParameters()
     preGain=pow(10, inputParameters[0]/20);
     cliplevel=pow(10, -2*inputParameters[1]/20);
     postGain=pow(10,inputParameters[2]/20);
+    oversampler.setFactor(uint(1)<<uint(inputParameters[3]+.5));
+    if(inputParameters[4]>.5)
+        oversampler.setMode(KittyDSP::Oversampling::kMinimumPhase);
+    else
+        oversampler.setMode(KittyDSP::Oversampling::kLinearPhase);
 }
@@ -11,15 +11,18 @@
 *
 */
 #include "./library/Constants.hxx"
+#include "./library/Oversampler.hxx"
 
 /** Define our parameters.
 */
-array <string> inputParametersNames={"Frequency","Resonance","Volume"};
-array <string> inputParametersUnits={"%","%","dB"};
+array <string> inputParametersNames={"Frequency","Resonance","Volume","Oversampling","Filters"};
+array <string> inputParametersUnits={"%","%","dB","",""};
 array <double> inputParameters(inputParametersNames.length);
-array <double> inputParametersDefault={100, 50, 0};
-array <double> inputParametersMin={0, 0, -40};
-array <double> inputParametersMax={100, 100, 40};
+array <double> inputParametersDefault={100, 50, 0, 1, 1};
+array <double> inputParametersMin={0, 0, -40, 0, 0};
+array <double> inputParametersMax={100, 100, 40, 3, 1};
+array <int>    inputParametersSteps={-1, -1, -1, 4, 2};
+array <string> inputParametersEnums={"","","","1x;2x;4x;8x","Linear Phase;Minimum Phase"};
 
 string name = "Moog Ladder filter";
 string author = "Ivan COHEN";
@@ -29,6 +32,10 @@ string description = "Moog transistor ladder filter modeling";
 double f, r;
 double volume;
 
+// Oversampling (the whole filter runs at the higher rate)
+KittyDSP::Oversampling::Oversampler oversampler;
+array<double> oversampled(KittyDSP::Oversampling::kMaxFactor);
+
 
 // Classes definition
 class sampleProcessor
@@ -102,6 +109,12 @@ class sampleProcessor
 array<sampleProcessor> processors(audioOutputsCount);
 
 
+bool initialize()
+{
+    oversampler.setChannelsCount(audioOutputsCount);
+    return true;
+}
+
 // Reset function
 void reset()
 {
@@ -109,6 +122,13 @@ void reset()
     {
         processors[i].reset();
     }
+    oversampler.reset();
+}
+
+// Latency of the oversampling filters
+int getLatency()
+{
+    return oversampler.get_latency();
 }
 
 /** update internal parameters from inputParameters array.
@@ -116,8 +136,14 @@ void reset()
 */
 void updateInputParameters()
 {
+    oversampler.setFactor(uint(1)<<uint(inputParameters[3]+.5));
+    if(inputParameters[4]>.5)
+        oversampler.setMode(KittyDSP::Oversampling::kMinimumPhase);
+    else
+        oversampler.setMode(KittyDSP::Oversampling::kLinearPhase);
+
     double cutoff = pow(10, inputParameters[0]/100*(log10(20000)-log10(40))+log10(40));
-	f = tan(PI * cutoff/sampleRate);
+	f = tan(PI * cutoff/(sampleRate*oversampler.get_factor()));
 	r = (40/9) * inputParameters[1]/100;
 	volume = pow(10, (inputParameters[2])/20);
 }
@@ -129,7 +155,10 @@ void processSample(array<double>& ioSample)
 {		
 	for(uint i=0;i<audioOutputsCount;i++)
 	{
-        processors[i].processSample(ioSample[i]);
+        oversampler.upsample(ioSample[i],oversampled,i);
+        for(uint j=0,factor=oversampler.get_factor();j<factor;j++)
+            processors[i].processSample(oversampled[j]);
+        ioSample[i]=oversampler.downsample(oversampled,i);
     }
 }
 
@@ -10,15 +10,18 @@
 *
 */
 #include "./library/Constants.hxx"
+#include "./library/Oversampler.hxx"
 
 /** Define our parameters.
 */
-array <string> inputParametersNames={"Pre-HP","Post-LP","Drive","Output","Dry/Wet"};
-array <string> inputParametersUnits={"%","%","dB","dB","%","%"};
+array <string> inputParametersNames={"Pre-HP","Post-LP","Drive","Output","Dry/Wet","Oversampling","Filters","Tanh"};
+array <string> inputParametersUnits={"%","%","dB","dB","%","","",""};
 array <double> inputParameters(inputParametersNames.length);
-array <double> inputParametersDefault = {0,   100,   0,   0, 100};
-array <double> inputParametersMin     = {0,     0,   0, -40,   0};
-array <double> inputParametersMax     = {100, 100,  40,  40, 100};
+array <double> inputParametersDefault = {0,   100,   0,   0, 100, 1, 1, 0};
+array <double> inputParametersMin     = {0,     0,   0, -40,   0, 0, 0, 0};
+array <double> inputParametersMax     = {100, 100,  40,  40, 100, 3, 1, 1};
+array <int>    inputParametersSteps   = {-1,   -1,  -1,  -1,  -1, 4, 2, 2};
+array <string> inputParametersEnums   = {"","","","","","1x;2x;4x;8x","Linear Phase;Minimum Phase","Exact;Fast"};
 
 string name = "Waveshaper";
 string author = "Ivan COHEN";
@@ -29,27 +32,64 @@ double a1L, b0L, b1L;
 double a1H, b0H, b1H;
 double gain, volume;
 double dry, wet;
+uint dryDelay;
+bool fastTanh;
 
+// Oversampling of the waveshaping function (the filters run at the base rate)
+KittyDSP::Oversampling::Oversampler oversampler;
+array<double> oversampled(KittyDSP::Oversampling::kMaxFactor);
+const uint kDryDelayMask=63; // dry signal delay line (latency of the oversampling filters)
+
+// Fast tanh: [7/6] Pade approximant, clipped to +/-1 where it reaches 1 (absolute error below 1e-4)
+double tanhApprox(double x)
+{
+    if (x > 4.971786858527683)
+        return 1;
+    if (x < -4.971786858527683)
+        return -1;
+    const double x2 = x*x;
+    return x * (((x2 + 378)*x2 + 17325)*x2 + 135135) / (((28*x2 + 3150)*x2 + 62370)*x2 + 135135);
+}
 
 // Classes definition
 class sampleProcessor
 {
     double v1L, v1H;
+    array<double> dryLine(kDryDelayMask+1);
+    uint dryPos;
 
     void reset()
     {  	v1L = v1H = 0;
+        for(uint i=0;i<dryLine.length;i++)
+            dryLine[i]=0;
+        dryPos=0;
     }
 
-    void processSample(double& sample)
+    void processSample(double& sample, uint channel)
     {
-        const double input=sample;
+        // dry signal, aligned with the wet signal
+        dryPos=(dryPos+1)&kDryDelayMask;
+        dryLine[dryPos]=sample;
+        const double input=dryLine[(dryPos-dryDelay)&kDryDelayMask];
 
         // Pre High-Pass filter
-        const double yH = b0H * input + v1H;
-        v1H = b1H * input - a1H * yH;
-
-        // Waveshaping function
-        const double yNL = tanh(gain*(yH))*0.9;
+        const double yH = b0H * sample + v1H;
+        v1H = b1H * sample - a1H * yH;
+
+        // Waveshaping function (oversampled)
+        oversampler.upsample(yH,oversampled,channel);
+        const uint factor=oversampler.get_factor();
+        if(fastTanh)
+        {
+            for(uint i=0;i<factor;i++)
+                oversampled[i] = tanhApprox(gain*(oversampled[i]))*0.9;
+        }
+        else
+        {
+            for(uint i=0;i<factor;i++)
+                oversampled[i] = tanh(gain*(oversampled[i]))*0.9;
+        }
+        const double yNL = oversampler.downsample(oversampled,channel);
 
         // Post Low-Pass filter
         const double yL = b0L * yNL + v1L;
@@ -69,6 +109,12 @@ class sampleProcessor
 array<sampleProcessor> processors(audioOutputsCount);
 
 
+bool initialize()
+{
+    oversampler.setChannelsCount(audioOutputsCount);
+    return true;
+}
+
 // Reset function
 void reset()
 {
@@ -76,6 +122,13 @@ void reset()
     {
         processors[i].reset();
     }
+    oversampler.reset();
+}
+
+// Latency of the oversampling filters
+int getLatency()
+{
+    return oversampler.get_latency();
 }
 
 /** update internal parameters from inputParameters array.
@@ -106,6 +159,16 @@ void updateInputParameters()
     volume = pow(10, (inputParameters[3])/20);
     dry = 1 - (inputParameters[4]/100);
     wet = (inputParameters[4]/100);
+
+    // Oversampling
+    oversampler.setFactor(uint(1)<<uint(inputParameters[5]+.5));
+    if(inputParameters[6]>.5)
+        oversampler.setMode(KittyDSP::Oversampling::kMinimumPhase);
+    else
+        oversampler.setMode(KittyDSP::Oversampling::kLinearPhase);
+    dryDelay = uint(oversampler.get_latency());
+
+    fastTanh = (inputParameters[7]>.5);
 }
 
 /** per-sample processing function: called for every sample with updated parameters values.
@@ -115,7 +178,7 @@ void processSample(array<double>& ioSample)
 {		
 	for(uint i=0;i<audioOutputsCount;i++)
 	{
-        processors[i].processSample(ioSample[i]);
+        processors[i].processSample(ioSample[i],i);
     }
 }
 
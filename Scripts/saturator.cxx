@@ -3,18 +3,23 @@
 *   (https://github.com/michaeldonovan)
 */
 
+#include "library/Constants.hxx"
+#include "library/Oversampler.hxx"
+
 /** Script metadata.
 */
 string name="Saturator";
 
 /** Define our parameters.
 */
-array<string> inputParametersNames={"Drive", "Shape", "Output"};
-array<string> inputParametersUnits={"dB", "", "dB"};
+array<string> inputParametersNames={"Drive", "Shape", "Output", "Oversampling", "Filters"};
+array<string> inputParametersUnits={"dB", "", "dB", "", ""};
 array<double> inputParameters(inputParametersNames.length);
-array<double> inputParametersMin={-20, 1, -20};
-array<double> inputParametersMax={20, 10, 20};
-array<double> inputParametersDefault={0, 5, 0};
+array<double> inputParametersMin={-20, 1, -20, 0, 0};
+array<double> inputParametersMax={20, 10, 20, 3, 1};
+array<double> inputParametersDefault={0, 5, 0, 1, 1};
+array<int>    inputParametersSteps={-1, -1, -1, 4, 2};
+array<string> inputParametersEnums={"", "", "", "1x;2x;4x;8x", "Linear Phase;Minimum Phase"};
 
 /** Define our internal variables.
 *
@@ -24,6 +29,31 @@ double cliplevel=1;
 double postGain=0;
 double c=1;
 
+/** Oversampling of the nonlinear stage (the gains are applied at the base rate).
+*
+*/
+KittyDSP::Oversampling::Oversampler oversampler;
+array<double> oversampled(KittyDSP::Oversampling::kMaxFactor);
+
+bool initialize()
+{
+    oversampler.setChannelsCount(audioInputsCount);
+    return true;
+}
+
+void reset()
+{
+    oversampler.reset();
+}
+
+/** latency of the oversampling filters.
+*
+*/
+int getLatency()
+{
+    return oversampler.get_latency();
+}
+
 /** per-sample processing function: called for every sample with updated parameters values.
 *
 */
@@ -34,11 +64,11 @@ void processSample(array<double>& ioSample)
         double sample=ioSample[channel];
         sample*=preGain;
 
-        int sign = 1;
-        if(sample<0)
-            sign=-1;
-
-        sample = (1/ c) * fastAtan(sample *  c);
+        // saturation (oversampled)
+        oversampler.upsample(sample,oversampled,channel);
+        for(uint i=0,factor=oversampler.get_factor();i<factor;i++)
+            oversampled[i] = (1/ c) * fastAtan(oversampled[i] *  c);
+        sample=oversampler.downsample(oversampled,channel);
 
         sample*=postGain;
 
@@ -59,4 +89,9 @@ void updateInputParameters()
     preGain=pow(10, inputParameters[0]/20);
     c=inputParameters[1];
     postGain=pow(10,inputParameters[2]/20);
+    oversampler.setFactor(uint(1)<<uint(inputParameters[3]+.5));
+    if(inputParameters[4]>.5)
+        oversampler.setMode(KittyDSP::Oversampling::kMinimumPhase);
+    else
+        oversampler.setMode(KittyDSP::Oversampling::kLinearPhase);
 }